@@ -0,0 +1,250 @@
+#include <algorithm>
+#include "BinaryIndex.h"
+
+const int BinaryIndex::SUBSTRING_BITS	= 16;
+const int BinaryIndex::PROBE_RADIUS		= 1;
+
+
+/**
+ * Answers the queries of a range. Every indexed descriptor is compared at
+ * most once per query, which the stamps (the index of the last query that
+ * compared it) ensure.
+ */
+class BinaryIndex::Searcher : public ParallelLoopBody
+{
+	const BinaryIndex& index;
+	const Mat& queries;
+	vector<vector<DMatch>>& matches;
+	const int k;
+
+	// inserts a candidate into the list of the k nearest ones, sorted by
+	// distance
+	void insert(vector<DMatch>& nearest, const DMatch& candidate) const
+	{
+		if (nearest.size() == k && candidate.distance >= nearest.back().distance)
+			return;
+
+		vector<DMatch>::iterator position = nearest.begin();
+		while (position != nearest.end() &&
+			position->distance <= candidate.distance)
+			position++;
+		nearest.insert(position, candidate);
+		if (nearest.size() > k)
+			nearest.pop_back();
+	}
+
+public:
+	Searcher(const BinaryIndex& index, const Mat& queries,
+		vector<vector<DMatch>>& matches, int k) :
+		index(index), queries(queries), matches(matches), k(k)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const int count		= index.descriptors.rows;
+		const int length	= index.descriptors.cols;
+		const int probes	= 1 + PROBE_RADIUS * SUBSTRING_BITS;
+		vector<int> stamps	= vector<int>(count, -1);
+
+		for (int q = range.start; q < range.end; q++)
+		{
+			const uchar* query = queries.ptr<uchar>(q);
+			vector<DMatch>& nearest = matches.at(q);
+			nearest.clear();
+
+			// 1) compare the descriptors in the probed buckets
+			for (int s = 0; s < index.substringCount; s++)
+			{
+				const int key = query[2 * s] | (query[2 * s + 1] << 8);
+				const int* indices = index.indices.data() + s * count;
+
+				// the bucket of the key and those of all keys 1 bit away
+				for (int p = 0; p < probes; p++)
+				{
+					const Bucket* bucket = index.findBucket(s,
+						(p == 0) ? key : key ^ (1 << (p - 1)));
+					if (bucket == NULL)
+						continue;
+
+					for (int j = bucket->begin; j < bucket->end; j++)
+					{
+						const int i = indices[j];
+						if (stamps[i] == q)
+							continue;
+						stamps[i] = q;
+
+						insert(nearest, DMatch(q, i, (float) hammingDistance(
+							query, index.descriptors.ptr<uchar>(i), length)));
+					}
+				}
+			}
+
+			// 2) fall back to brute force if too few were found
+			if (nearest.size() < k && nearest.size() < count)
+			{
+				nearest.clear();
+				for (int i = 0; i < count; i++)
+					insert(nearest, DMatch(q, i, (float) hammingDistance(
+						query, index.descriptors.ptr<uchar>(i), length)));
+			}
+		}
+	}
+};
+
+
+BinaryIndex::BinaryIndex(void)
+{
+	this->substringCount = 0;
+	this->tableSize = 0;
+}
+
+
+BinaryIndex::~BinaryIndex(void)
+{
+}
+
+
+void BinaryIndex::build(const Mat& descriptors)
+{
+	CV_Assert(descriptors.empty() ||
+		(descriptors.type() == CV_8UC1 && descriptors.cols % 2 == 0));
+
+	const int count = descriptors.rows;
+	this->descriptors = descriptors;
+	this->substringCount = descriptors.cols / 2;
+
+	// at most half of the slots are used
+	this->tableSize = 1;
+	while (this->tableSize < 2 * count)
+		this->tableSize *= 2;
+
+	Bucket empty;
+	empty.key	= -1;
+	empty.begin	= 0;
+	empty.end	= 0;
+	this->tables.assign(this->substringCount * this->tableSize, empty);
+	this->indices.resize(this->substringCount * count);
+
+	vector<pair<int, int>> keys = vector<pair<int, int>>(count);
+	for (int s = 0; s < this->substringCount; s++)
+	{
+		// 1) sort the descriptors by their substring
+		for (int i = 0; i < count; i++)
+		{
+			const uchar* descriptor = descriptors.ptr<uchar>(i);
+			keys[i] = make_pair(descriptor[2 * s] | (descriptor[2 * s + 1] << 8), i);
+		}
+		sort(keys.begin(), keys.end());
+
+		// 2) add a bucket for every run of equal substrings
+		Bucket* table = &this->tables.at(s * this->tableSize);
+		int* list = this->indices.data() + s * count;
+		for (int begin = 0, end; begin < count; begin = end)
+		{
+			for (end = begin; end < count && keys[end].first == keys[begin].first;
+				end++)
+				list[end] = keys[end].second;
+
+			unsigned int slot = keys[begin].first * 2654435761u;
+			slot = (slot ^ (slot >> 16)) & (this->tableSize - 1);
+			while (table[slot].key >= 0)
+				slot = (slot + 1) & (this->tableSize - 1);
+
+			table[slot].key		= keys[begin].first;
+			table[slot].begin	= begin;
+			table[slot].end		= end;
+		}
+	}
+}
+
+
+const BinaryIndex::Bucket* BinaryIndex::findBucket(int substring, int key)
+	const
+{
+	const Bucket* table = &this->tables[substring * this->tableSize];
+
+	unsigned int slot = key * 2654435761u;
+	slot = (slot ^ (slot >> 16)) & (this->tableSize - 1);
+	while (table[slot].key != key)
+	{
+		if (table[slot].key < 0)
+			return NULL;
+		slot = (slot + 1) & (this->tableSize - 1);
+	}
+
+	return &table[slot];
+}
+
+
+void BinaryIndex::knnMatch(const Mat& queries, vector<vector<DMatch>>& matches,
+	int k) const
+{
+	CV_Assert(queries.empty() || this->descriptors.empty() ||
+		(queries.type() == CV_8UC1 && queries.cols == this->descriptors.cols));
+
+	matches.clear();
+	matches.resize(queries.rows);
+	if (this->descriptors.empty())
+		return;
+
+	parallel_for_(Range(0, queries.rows), Searcher(*this, queries, matches, k));
+}
+
+
+void BinaryIndex::swap(BinaryIndex& other)
+{
+	std::swap(this->descriptors, other.descriptors);
+	std::swap(this->substringCount, other.substringCount);
+	std::swap(this->tableSize, other.tableSize);
+	this->tables.swap(other.tables);
+	this->indices.swap(other.indices);
+}
+
+
+int BinaryIndex::getDescriptorCount() const
+{
+	return this->descriptors.rows;
+}
+
+
+/**
+ * Counts the bits of the exclusive or of the descriptors, 16 bytes at a time
+ * with SSE2: the bits are summed within each byte by shifts and masks, the
+ * bytes by _mm_sad_epu8.
+ */
+int BinaryIndex::hammingDistance(const uchar* a, const uchar* b, int length)
+{
+	int distance = 0;
+	int i = 0;
+
+#if CV_SSE2
+	const __m128i m1	= _mm_set1_epi8(0x55);
+	const __m128i m2	= _mm_set1_epi8(0x33);
+	const __m128i m4	= _mm_set1_epi8(0x0f);
+	const __m128i zero	= _mm_setzero_si128();
+	__m128i sum = zero;
+
+	for (; i <= length - 16; i += 16)
+	{
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (a + i)),
+			_mm_loadu_si128((const __m128i*) (b + i)));
+		v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+		v = _mm_add_epi8(_mm_and_si128(v, m2),
+			_mm_and_si128(_mm_srli_epi64(v, 2), m2));
+		v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+	}
+	distance = _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+#endif
+
+	for (; i < length; i++)
+	{
+		uchar v = a[i] ^ b[i];
+		v = v - ((v >> 1) & 0x55);
+		v = (v & 0x33) + ((v >> 2) & 0x33);
+		distance += (v + (v >> 4)) & 0x0f;
+	}
+
+	return distance;
+}
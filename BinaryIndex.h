@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * An index for approximate nearest-neighbour search of binary descriptors
+ * (like ORB's) by Hamming distance, using multi-index hashing:
+ *
+ *     Fast Search in Hamming Space with Multi-Index Hashing.
+ *     Mohammad Norouzi, Ali Punjani and David J. Fleet.
+ *     In IEEE Conference on Computer Vision and Pattern Recognition (CVPR),
+ *     2012
+ *
+ * The descriptors are split into 16 bit substrings, each of which is hashed
+ * into its own table. A query probes the buckets of its substrings and all
+ * buckets within PROBE_RADIUS bits of them; only the descriptors found there
+ * are compared in full. By the pigeonhole principle, this finds every
+ * descriptor closer than (PROBE_RADIUS + 1) times the number of substrings,
+ * i.e. 32 bits for 256 bit ORB descriptors. Queries with fewer than k
+ * candidates are answered by brute force, so knnMatch() always returns k
+ * matches if there are k descriptors.
+ *
+ * An index is built once per set of descriptors (an image) and queried many
+ * times, queries are processed in parallel.
+ */
+class BinaryIndex
+{
+	static const int SUBSTRING_BITS;
+	static const int PROBE_RADIUS;
+
+	// hash table of the descriptors with the same substring, which are
+	// contiguous in the substring's list of descriptor indices
+	struct Bucket
+	{
+		int key;		// the substring, -1 for empty slots
+		int begin;		// range in the list of descriptor indices
+		int end;
+	};
+
+	class Searcher;
+
+	Mat descriptors;
+	int substringCount;
+	int tableSize;				// slots per table, a power of 2
+	vector<Bucket> tables;		// substringCount tables of tableSize slots
+	vector<int> indices;		// substringCount lists of all descriptors
+
+	const Bucket* findBucket(int substring, int key) const;
+
+public:
+	BinaryIndex(void);
+	~BinaryIndex(void);
+
+	// indexes the rows of descriptors (CV_8UC1, an even number of bytes
+	// each), which are referenced, not copied
+	void build(const Mat& descriptors);
+
+	// finds the (approximately) k nearest indexed descriptors of every row of
+	// queries, ordered by distance, as DescriptorMatcher::knnMatch() does
+	void knnMatch(const Mat& queries, vector<vector<DMatch>>& matches,
+		int k) const;
+
+	// exchanges the contents of the indices without copying them
+	void swap(BinaryIndex& other);
+
+	int getDescriptorCount() const;
+
+	// number of differing bits of two descriptors of length bytes
+	static int hammingDistance(const uchar* a, const uchar* b, int length);
+};
@@ -0,0 +1,515 @@
+#include <opencv2/calib3d/calib3d.hpp>
+#include "BundleAdjuster.h"
+
+const int BundleAdjuster::MAX_SOLVER_ITERATIONS	= 200;
+const double BundleAdjuster::SOLVER_TOLERANCE	= 1e-6;
+const double BundleAdjuster::COST_TOLERANCE		= 1e-6;
+const double BundleAdjuster::INITIAL_DAMPING	= 1e-3;
+
+
+static double dot(const vector<Vec6d>& a, const vector<Vec6d>& b)
+{
+	double sum = 0;
+	for (int i = 0; i < a.size(); i++)
+		sum += a[i].dot(b[i]);
+
+	return sum;
+}
+
+
+/**
+ * Computes the robust cost, weight, residual and (optionally) Jacobians of a
+ * range of observations.
+ */
+class BundleAdjuster::Evaluator : public ParallelLoopBody
+{
+	const BundleAdjuster& adjuster;
+	const vector<Camera>& cameras;
+	const vector<Observation>& observations;
+	const vector<Vec3d>& points;
+	vector<Linearization>& linearizations;
+	const bool withJacobians;
+
+public:
+	Evaluator(const BundleAdjuster& adjuster, const vector<Camera>& cameras,
+		const vector<Observation>& observations, const vector<Vec3d>& points,
+		vector<Linearization>& linearizations, bool withJacobians) :
+		adjuster(adjuster), cameras(cameras), observations(observations),
+		points(points), linearizations(linearizations),
+		withJacobians(withJacobians)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const Matx33d& K = adjuster.calibrationMatrix;
+		const double scale = adjuster.lossScale;
+
+		for (int i = range.start; i < range.end; i++)
+		{
+			const Observation& observation = observations[i];
+			const Camera& camera = cameras[observation.camera];
+			Linearization& linearization = linearizations[i];
+
+			// 1) project the point
+			const Vec3d rotated = camera.rotation * points[observation.point];
+			const Vec3d y = rotated + camera.translation;
+			if (y[2] <= 0)
+			{
+				// points behind the camera count as gross outliers
+				linearization.residual = Vec2d(0, 0);
+				linearization.weight = 0;
+				linearization.cost = 2 * scale * 1000 - scale * scale;
+				linearization.cameraJacobian = Matx26d::zeros();
+				linearization.pointJacobian = Matx23d::zeros();
+				continue;
+			}
+
+			const double z = 1. / y[2];
+			const double u = (K(0, 0) * y[0] + K(0, 1) * y[1]) * z + K(0, 2);
+			const double v = K(1, 1) * y[1] * z + K(1, 2);
+
+			// 2) Huber loss, applied as weight of the squared residual
+			const Vec2d residual = Vec2d(observation.pixel.x - u,
+				observation.pixel.y - v);
+			const double error = norm(residual);
+			linearization.residual = residual;
+			if (error <= scale)
+			{
+				linearization.weight = 1;
+				linearization.cost = error * error;
+			}
+			else
+			{
+				linearization.weight = scale / error;
+				linearization.cost = 2 * scale * error - scale * scale;
+			}
+
+			if (!withJacobians)
+				continue;
+
+			// 3) derivatives of the projection by y, by the rotation (applied
+			// as exp([w]x) * R), the translation and the point
+			const Matx23d projection = Matx23d(
+				K(0, 0) * z,	K(0, 1) * z,	(K(0, 2) - u) * z,
+				0,				K(1, 1) * z,	(K(1, 2) - v) * z);
+			const Matx33d rotation = Matx33d(
+				0,				rotated[2],		-rotated[1],
+				-rotated[2],	0,				rotated[0],
+				rotated[1],		-rotated[0],	0);
+
+			const Matx23d byRotation = projection * rotation;
+			for (int r = 0; r < 2; r++)
+				for (int c = 0; c < 3; c++)
+				{
+					linearization.cameraJacobian(r, c) = byRotation(r, c);
+					linearization.cameraJacobian(r, 3 + c) = projection(r, c);
+				}
+			linearization.pointJacobian = projection * camera.rotation;
+		}
+	}
+};
+
+
+BundleAdjuster::BundleAdjuster(void)
+{
+	this->calibrationMatrix = Matx33d::eye();
+	this->lossScale = 2.0;
+	this->maxIterations = 20;
+}
+
+
+BundleAdjuster::~BundleAdjuster(void)
+{
+}
+
+
+void BundleAdjuster::clear()
+{
+	this->cameras.clear();
+	this->points.clear();
+	this->observations.clear();
+	this->pointObservations.clear();
+	this->cameraObservations.clear();
+	this->activePointIndices.clear();
+}
+
+
+void BundleAdjuster::setCalibrationMatrix(const Matx33d& calibrationMatrix)
+{
+	this->calibrationMatrix = calibrationMatrix;
+}
+
+
+int BundleAdjuster::addCamera(const Matx33d& rotation, const Vec3d& translation,
+	bool fixed)
+{
+	Camera camera;
+	camera.rotation = rotation;
+	camera.translation = translation;
+	camera.fixed = fixed;
+	camera.parameterIndex = -1;
+	this->cameras.push_back(camera);
+	this->cameraObservations.push_back(vector<int>());
+
+	return this->cameras.size() - 1;
+}
+
+
+int BundleAdjuster::addPoint(const Vec3d& point)
+{
+	this->points.push_back(point);
+	this->pointObservations.push_back(vector<int>());
+	this->activePointIndices.push_back(-1);
+
+	return this->points.size() - 1;
+}
+
+
+void BundleAdjuster::addObservation(int camera, int point, const Point2f& pixel)
+{
+	CV_Assert(camera >= 0 && camera < this->cameras.size());
+	CV_Assert(point >= 0 && point < this->points.size());
+
+	Observation observation;
+	observation.camera = camera;
+	observation.point = point;
+	observation.pixel = pixel;
+	this->pointObservations.at(point).push_back(this->observations.size());
+	this->cameraObservations.at(camera).push_back(this->observations.size());
+	this->observations.push_back(observation);
+}
+
+
+double BundleAdjuster::evaluate(const vector<Camera>& cameras,
+	const vector<Observation>& observations, const vector<Vec3d>& points,
+	vector<Linearization>& linearizations, bool withJacobians) const
+{
+	linearizations.resize(observations.size());
+	parallel_for_(Range(0, observations.size()), Evaluator(*this, cameras,
+		observations, points, linearizations, withJacobians));
+
+	double cost = 0;
+	for (int i = 0; i < linearizations.size(); i++)
+		cost += linearizations[i].cost;
+
+	return cost;
+}
+
+
+/**
+ * Preconditioned conjugate gradients on the reduced camera system, which is
+ * given by its blocks on and above the diagonal.
+ */
+void BundleAdjuster::solveReducedSystem(const map<int64, Matx66d>& blocks,
+	const vector<Vec6d>& rhs, vector<Vec6d>& solution) const
+{
+	const int n = rhs.size();
+	solution.assign(n, Vec6d::all(0));
+
+	const double rhsNorm = sqrt(dot(rhs, rhs));
+	if (rhsNorm == 0)
+		return;
+
+	// block Jacobi preconditioner
+	vector<Matx66d> preconditioner = vector<Matx66d>(n);
+	for (int i = 0; i < n; i++)
+		preconditioner[i] = blocks.find((int64) i * n + i)->second.inv(
+			DECOMP_CHOLESKY);
+
+	vector<Vec6d> residual = rhs;
+	vector<Vec6d> direction = vector<Vec6d>(n);
+	vector<Vec6d> product = vector<Vec6d>(n);
+	vector<Vec6d> preconditioned = vector<Vec6d>(n);
+	for (int i = 0; i < n; i++)
+		preconditioned[i] = preconditioner[i] * residual[i];
+	direction = preconditioned;
+	double rz = dot(residual, preconditioned);
+
+	for (int iteration = 0; iteration < MAX_SOLVER_ITERATIONS; iteration++)
+	{
+		// product = S * direction
+		product.assign(n, Vec6d::all(0));
+		for (map<int64, Matx66d>::const_iterator block = blocks.begin();
+			block != blocks.end(); block++)
+		{
+			const int i = block->first / n;
+			const int j = block->first % n;
+			product[i] += block->second * direction[j];
+			if (i != j)
+				product[j] += block->second.t() * direction[i];
+		}
+
+		const double alpha = rz / dot(direction, product);
+		for (int i = 0; i < n; i++)
+		{
+			solution[i] += direction[i] * alpha;
+			residual[i] -= product[i] * alpha;
+		}
+		if (sqrt(dot(residual, residual)) < SOLVER_TOLERANCE * rhsNorm)
+			break;
+
+		for (int i = 0; i < n; i++)
+			preconditioned[i] = preconditioner[i] * residual[i];
+		const double nextRz = dot(residual, preconditioned);
+		const double beta = nextRz / rz;
+		for (int i = 0; i < n; i++)
+			direction[i] = preconditioned[i] + direction[i] * beta;
+		rz = nextRz;
+	}
+}
+
+
+/**
+ * Levenberg-Marquardt with the damping applied to the diagonals of the
+ * camera and point blocks. Each step solves
+ *
+ *     [ U  W ] [dc]   [gc]
+ *     [ W' V ] [dp] = [gp]
+ *
+ * by eliminating the points: (U - W * V^-1 * W') * dc = gc - W * V^-1 * gp,
+ * then dp = V^-1 * (gp - W' * dc).
+ *
+ * Only the points observed by the cameras from firstCamera on take part, with
+ * all of their observations; observations by earlier cameras constrain them
+ * like those by fixed cameras.
+ */
+double BundleAdjuster::optimize(int firstCamera)
+{
+	// 1) collect the active points and their observations, renumbered
+	vector<int> activePoints;
+	for (int i = max(firstCamera, 0); i < this->cameras.size(); i++)
+		for (int j = 0; j < this->cameraObservations[i].size(); j++)
+		{
+			const int p = this->observations[this->cameraObservations[i][j]].point;
+			if (this->activePointIndices[p] >= 0)
+				continue;
+
+			this->activePointIndices[p] = activePoints.size();
+			activePoints.push_back(p);
+		}
+
+	const int pointCount = activePoints.size();
+	vector<Vec3d> points = vector<Vec3d>(pointCount);
+	vector<Observation> observations;
+	vector<vector<int>> pointObservations = vector<vector<int>>(pointCount);
+	for (int p = 0; p < pointCount; p++)
+	{
+		points[p] = this->points[activePoints[p]];
+		this->activePointIndices[activePoints[p]] = -1;
+
+		const vector<int>& indices = this->pointObservations[activePoints[p]];
+		for (int a = 0; a < indices.size(); a++)
+		{
+			Observation observation = this->observations[indices[a]];
+			observation.point = p;
+			pointObservations[p].push_back(observations.size());
+			observations.push_back(observation);
+		}
+	}
+
+	const int observationCount = observations.size();
+	if (observationCount == 0)
+		return 0;
+
+	// 2) number the free cameras
+	int freeCount = 0;
+	for (int i = 0; i < this->cameras.size(); i++)
+		this->cameras[i].parameterIndex = (this->cameras[i].fixed ||
+			i < firstCamera) ? -1 : freeCount++;
+
+	vector<Linearization> linearizations, nextLinearizations;
+	double cost = evaluate(this->cameras, observations, points, linearizations,
+		true);
+	double damping = INITIAL_DAMPING;
+
+	vector<Matx66d> U;
+	vector<Vec6d> gc, dc;
+	vector<Matx33d> V, inverseV;
+	vector<Vec3d> gp;
+	vector<Matx63d> W = vector<Matx63d>(observationCount);
+	map<int64, Matx66d> blocks;
+
+	for (int iteration = 0; iteration < this->maxIterations; iteration++)
+	{
+		// 3) normal equations
+		U.assign(freeCount, Matx66d::zeros());
+		gc.assign(freeCount, Vec6d::all(0));
+		V.assign(pointCount, Matx33d::zeros());
+		gp.assign(pointCount, Vec3d::all(0));
+
+		for (int i = 0; i < observationCount; i++)
+		{
+			const Observation& observation = observations[i];
+			const Linearization& l = linearizations[i];
+			const int c = this->cameras[observation.camera].parameterIndex;
+			const int p = observation.point;
+
+			const Matx32d JpT = l.pointJacobian.t() * l.weight;
+			V[p] += JpT * l.pointJacobian;
+			gp[p] += JpT * l.residual;
+			if (c >= 0)
+			{
+				const Matx<double, 6, 2> JcT = l.cameraJacobian.t() * l.weight;
+				U[c] += JcT * l.cameraJacobian;
+				gc[c] += JcT * l.residual;
+				W[i] = JcT * l.pointJacobian;
+			}
+		}
+
+		// 4) damp and eliminate the points
+		blocks.clear();
+		for (int c = 0; c < freeCount; c++)
+		{
+			Matx66d block = U[c];
+			for (int k = 0; k < 6; k++)
+				block(k, k) += damping * block(k, k) + 1e-12;
+			blocks[(int64) c * freeCount + c] = block;
+		}
+
+		vector<Vec6d> rhs = gc;
+		inverseV.assign(pointCount, Matx33d::zeros());
+		for (int p = 0; p < pointCount; p++)
+		{
+			Matx33d block = V[p];
+			for (int k = 0; k < 3; k++)
+				block(k, k) += damping * block(k, k) + 1e-12;
+			inverseV[p] = block.inv(DECOMP_CHOLESKY);
+
+			const vector<int>& indices = pointObservations[p];
+			for (int a = 0; a < indices.size(); a++)
+			{
+				const int ca = this->cameras[observations[indices[a]].camera]
+					.parameterIndex;
+				if (ca < 0)
+					continue;
+
+				const Matx63d WV = W[indices[a]] * inverseV[p];
+				rhs[ca] -= WV * gp[p];
+				for (int b = 0; b < indices.size(); b++)
+				{
+					const int cb = this->cameras[observations[indices[b]]
+						.camera].parameterIndex;
+					if (cb >= ca)
+						blocks[(int64) ca * freeCount + cb] -=
+							WV * W[indices[b]].t();
+				}
+			}
+		}
+
+		// 5) solve for the cameras, back-substitute the points
+		solveReducedSystem(blocks, rhs, dc);
+
+		vector<Camera> nextCameras = this->cameras;
+		for (int i = 0; i < nextCameras.size(); i++)
+		{
+			const int c = nextCameras[i].parameterIndex;
+			if (c < 0)
+				continue;
+
+			Mat rotation;
+			Rodrigues(Mat(Vec3d(dc[c][0], dc[c][1], dc[c][2])), rotation);
+			nextCameras[i].rotation = Matx33d(rotation) * nextCameras[i].rotation;
+			nextCameras[i].translation += Vec3d(dc[c][3], dc[c][4], dc[c][5]);
+		}
+
+		vector<Vec3d> nextPoints = points;
+		for (int p = 0; p < pointCount; p++)
+		{
+			Vec3d g = gp[p];
+			const vector<int>& indices = pointObservations[p];
+			for (int a = 0; a < indices.size(); a++)
+			{
+				const int c = this->cameras[observations[indices[a]].camera]
+					.parameterIndex;
+				if (c >= 0)
+					g -= W[indices[a]].t() * dc[c];
+			}
+			nextPoints[p] += inverseV[p] * g;
+		}
+
+		// 6) keep the step if it reduces the cost
+		const double nextCost = evaluate(nextCameras, observations,
+			nextPoints, nextLinearizations, true);
+		if (nextCost < cost)
+		{
+			const double decrease = (cost - nextCost) / cost;
+			this->cameras.swap(nextCameras);
+			points.swap(nextPoints);
+			linearizations.swap(nextLinearizations);
+			cost = nextCost;
+			damping = max(damping / 3, 1e-9);
+			if (decrease < COST_TOLERANCE)
+				break;
+		}
+		else
+		{
+			damping *= 4;
+			if (damping > 1e8)
+				break;
+		}
+	}
+
+	for (int p = 0; p < pointCount; p++)
+		this->points[activePoints[p]] = points[p];
+
+	double squaredError = 0;
+	for (int i = 0; i < observationCount; i++)
+		squaredError += linearizations[i].residual.dot(linearizations[i].residual);
+
+	return sqrt(squaredError / observationCount);
+}
+
+
+int BundleAdjuster::getCameraCount() const
+{
+	return this->cameras.size();
+}
+
+
+int BundleAdjuster::getPointCount() const
+{
+	return this->points.size();
+}
+
+
+Matx33d BundleAdjuster::getRotation(int camera) const
+{
+	return this->cameras.at(camera).rotation;
+}
+
+
+Vec3d BundleAdjuster::getTranslation(int camera) const
+{
+	return this->cameras.at(camera).translation;
+}
+
+
+Vec3d BundleAdjuster::getPoint(int point) const
+{
+	return this->points.at(point);
+}
+
+
+double BundleAdjuster::getLossScale() const
+{
+	return this->lossScale;
+}
+
+
+void BundleAdjuster::setLossScale(double scale)
+{
+	this->lossScale = scale;
+}
+
+
+int BundleAdjuster::getMaxIterations() const
+{
+	return this->maxIterations;
+}
+
+
+void BundleAdjuster::setMaxIterations(int maxIterations)
+{
+	this->maxIterations = maxIterations;
+}
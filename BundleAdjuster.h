@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Sparse bundle adjustment: refines camera poses and 3D points jointly by
+ * minimizing the reprojection errors of all observations with the
+ * Levenberg-Marquardt algorithm.
+ *
+ * The points are eliminated from the normal equations with the Schur
+ * complement, which leaves a reduced camera system of 6x6 blocks, one for
+ * every pair of cameras sharing a point. It is solved by conjugate gradients
+ * with a block Jacobi preconditioner, so neither time nor memory grow with
+ * the square of the number of cameras for sequences where only nearby images
+ * overlap. Residuals and Jacobians are evaluated in parallel, and a Huber
+ * loss limits the influence of wrong matches.
+ *
+ * Poses map world to camera coordinates (x = R * X + t). Fixed cameras keep
+ * their poses; at least one camera should be fixed to define the coordinate
+ * system. For incremental reconstruction, the optimization can be limited to
+ * a window of the most recently added cameras and the points they observe,
+ * which takes time independent of the number of earlier cameras.
+ */
+class BundleAdjuster
+{
+	static const int MAX_SOLVER_ITERATIONS;
+	static const double SOLVER_TOLERANCE;
+	static const double COST_TOLERANCE;
+	static const double INITIAL_DAMPING;
+
+	typedef Matx<double, 6, 6> Matx66d;
+	typedef Matx<double, 6, 3> Matx63d;
+	typedef Matx<double, 2, 6> Matx26d;
+
+	struct Camera
+	{
+		Matx33d rotation;
+		Vec3d translation;
+		bool fixed;
+		int parameterIndex;		// among the free cameras, -1 if fixed
+	};
+
+	struct Observation
+	{
+		int camera;
+		int point;
+		Point2f pixel;
+	};
+
+	// weighted residual and Jacobians of an observation
+	struct Linearization
+	{
+		Vec2d residual;
+		double weight;
+		double cost;
+		Matx26d cameraJacobian;
+		Matx23d pointJacobian;
+	};
+
+	class Evaluator;
+
+	Matx33d calibrationMatrix;
+	vector<Camera> cameras;
+	vector<Vec3d> points;
+	vector<Observation> observations;
+	vector<vector<int>> pointObservations;	// observation indices by point
+	vector<vector<int>> cameraObservations;	// observation indices by camera
+	vector<int> activePointIndices;	// during optimize(), -1 for other points
+
+	double lossScale;
+	int maxIterations;
+
+	double evaluate(const vector<Camera>& cameras,
+		const vector<Observation>& observations, const vector<Vec3d>& points,
+		vector<Linearization>& linearizations, bool withJacobians) const;
+	void solveReducedSystem(const map<int64, Matx66d>& blocks,
+		const vector<Vec6d>& rhs, vector<Vec6d>& solution) const;
+
+public:
+	BundleAdjuster(void);
+	~BundleAdjuster(void);
+
+	void clear();
+
+	// the cameras share this calibration matrix (in pixels)
+	void setCalibrationMatrix(const Matx33d& calibrationMatrix);
+
+	// add unknowns and observations and return their indices
+	int addCamera(const Matx33d& rotation, const Vec3d& translation,
+		bool fixed = false);
+	int addPoint(const Vec3d& point);
+	void addObservation(int camera, int point, const Point2f& pixel);
+
+	// runs Levenberg-Marquardt on the cameras from firstCamera on and the
+	// points they observe, with all other cameras held fixed, and returns the
+	// final RMS reprojection error of those points in pixels
+	double optimize(int firstCamera = 0);
+
+	int getCameraCount() const;
+	int getPointCount() const;
+	Matx33d getRotation(int camera) const;
+	Vec3d getTranslation(int camera) const;
+	Vec3d getPoint(int point) const;
+
+	// reprojection error in pixels above which the loss grows linearly
+	double getLossScale() const;
+	void setLossScale(double scale);
+	int getMaxIterations() const;
+	void setMaxIterations(int maxIterations);
+};
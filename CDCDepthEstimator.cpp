@@ -1,10 +1,15 @@
 #include <iostream>	// debugging
 #include <cfloat>	// debugging
+#include <cmath>
 #include <vector>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>	// debugging
 #include "mrf.h"
 #include "MaxProdBP.h"
+#include "TRW-S.h"
+#include "BP-S.h"
+#include "HBP.h"
+#include "MRFDriver.h"
 #include "ImageRenderer4.h"
 #include "CDCDepthEstimator.h"
 #include "Util.h"
@@ -18,6 +23,7 @@ const float CDCDepthEstimator::LAMBDA_SOURCE[]				= { 1, 1 };
 const float CDCDepthEstimator::LAMBDA_FLAT					= 2;
 const float CDCDepthEstimator::LAMBDA_SMOOTH				= 2;
 const double CDCDepthEstimator::CONVERGENCE_FRACTION		= 1;
+const int CDCDepthEstimator::MAX_ITERATIONS				= 100;
 
 const int CDCDepthEstimator::DDEPTH					= -1;
 const Point CDCDepthEstimator::WINDOW_CENTER		= Point (-1, -1);
@@ -46,22 +52,509 @@ const Mat CDCDepthEstimator::LoG = (
 
 const int CDCDepthEstimator::MAT_TYPE = CV_32FC1;
 
+const int CDCDepthEstimator::REDUCTION_TILE_HEIGHT = 16;
+
+// used for tiled evaluation of the alpha sweep
+const int CDCDepthEstimator::MIN_TILE_SIZE				= 32;
+const int CDCDepthEstimator::INTERPOLATION_MARGIN		= 2;	// bicubic
+// refocused image and both responses of a slice on the host
+const size_t CDCDepthEstimator::SLICE_BYTES_PER_PIXEL	= 5 * sizeof(float);
+// rough upper bound for the device temporaries of a single workspace
+const size_t CDCDepthEstimator::WORKER_BYTES_PER_PIXEL	= 40 * sizeof(float);
+// extrema, alpha maps and both EDOF images
+const size_t CDCDepthEstimator::STATE_BYTES_PER_PIXEL	= 12 * sizeof(float);
+
+// scratch device buffers of a slice workspace's response arena
+enum
+{
+	REFOCUSED_IMAGE_SLOT,
+	DEFOCUS_RESPONSE_SLOT,
+	CORRESPONDENCE_RESPONSE_SLOT,
+	SECOND_DERIVATIVE_X_SLOT,
+	SECOND_DERIVATIVE_Y_SLOT,
+	CHANNEL_RESPONSE_SLOT,
+	FILTERED_RESPONSE_SLOT,
+	SHIFTED_IMAGE_SLOT,
+	DIFFERENCE_IMAGE_SLOT,
+	SQUARED_DIFFERENCE_SLOT,
+	VARIANCE_SLOT,
+	CONFIDENCE_SLOT,
+	TARGET_IMAGE_SLOT,
+	REDUCTION_SLOT
+};
+
+// scratch host buffers of a slice workspace's response arena
+enum
+{
+	REFOCUSED_IMAGE_HOST_SLOT,
+	DEFOCUS_RESPONSE_HOST_SLOT,
+	CORRESPONDENCE_RESPONSE_HOST_SLOT,
+	TRANSFORMATION_SLOT
+};
+
 // used for MRF belief propagation
-vector<MRF::CostVal> CDCDepthEstimator::dataCost1;
-vector<MRF::CostVal> CDCDepthEstimator::dataCost2;
-vector<MRF::CostVal> CDCDepthEstimator::fsCost1;
-vector<MRF::CostVal> CDCDepthEstimator::fsCost2;
+const int CDCDepthEstimator::LABEL_COUNT = 2;
+
+// costs of both MRFs are passed in units of 1 / MRF_COST_SCALE, so that they
+// keep their precision when MRF2.2 is built with 16-bit integer costs
+#ifdef MRF_COMPACT_TYPES
+const float CDCDepthEstimator::MRF_COST_SCALE = 1000;
+#else
+const float CDCDepthEstimator::MRF_COST_SCALE = 1;
+#endif
+
+// used for the depth labeling MRF, a truncated linear smoothness term in
+// units of alpha steps; the iterations stop at a relative energy decrease
+// below LABELING_CONVERGENCE or, for sequential TRW-S, once the energy is
+// within LABELING_MAX_GAP of its lower bound (relative to the energy)
+const float CDCDepthEstimator::LABELING_SMOOTHNESS		= 0.05;
+const float CDCDepthEstimator::LABELING_TRUNCATION		= 4;
+const int CDCDepthEstimator::LABELING_MAX_ITERATIONS	= 20;
+const double CDCDepthEstimator::LABELING_CONVERGENCE	= 0.001;
+const double CDCDepthEstimator::LABELING_MAX_GAP		= 0.01;
+
+// TRW-S processes horizontal bands of at least this many rows in parallel
+const int CDCDepthEstimator::LABELING_MIN_BAND_HEIGHT	= 32;
 
 
 CDCDepthEstimator::CDCDepthEstimator(void)
 {
-	this->renderer = new ImageRenderer4();
+	this->cueCombination	= CUE_SELECTION;
+	this->memoryBudget		= 0;
 }
 
 
 CDCDepthEstimator::~CDCDepthEstimator(void)
 {
-	delete this->renderer;
+}
+
+
+/**
+ * Renders the refocused images of a batch of alpha values and computes both
+ * responses for them. The i-th slice of a batch is evaluated with the i-th
+ * workspace, whose host buffers it keeps until the batch has been reduced.
+ *
+ * All slices are evaluated on the calling thread: the OpenCL module of
+ * OpenCV 2.4 has a single global context and command queue, which must not
+ * be used from several threads at once. The device runs the kernels of one
+ * queue in order anyway, only the reduction on the host is parallelized.
+ */
+class CDCDepthEstimator::SliceEvaluator
+{
+	const CDCDepthEstimator& estimator;
+	const LightFieldPicture& lightfield;
+	vector<SliceWorkspace>& workspaces;
+	vector<DepthSlice>& slices;
+
+public:
+	SliceEvaluator(const CDCDepthEstimator& estimator,
+		const LightFieldPicture& lightfield, vector<SliceWorkspace>& workspaces,
+		vector<DepthSlice>& slices) :
+		estimator(estimator), lightfield(lightfield), workspaces(workspaces),
+		slices(slices)
+	{
+	}
+
+	void operator()() const
+	{
+		const Size imageSize = lightfield.SPARTIAL_RESOLUTION;
+
+		for (size_t i = 0; i < slices.size(); i++)
+		{
+			DepthSlice& slice			= slices.at(i);
+			SliceWorkspace& workspace	= workspaces.at(i);
+			ScratchArena& arena			= workspace.responseArena;
+
+			oclMat& refocusedImage = arena.getDeviceBuffer(REFOCUSED_IMAGE_SLOT,
+				imageSize, LightFieldPicture::IMAGE_TYPE);
+			oclMat& defocusResponse = arena.getDeviceBuffer(
+				DEFOCUS_RESPONSE_SLOT, imageSize, MAT_TYPE);
+			oclMat& correspondenceResponse = arena.getDeviceBuffer(
+				CORRESPONDENCE_RESPONSE_SLOT, imageSize, MAT_TYPE);
+
+			workspace.renderer.setMaximumNormalization(true,
+				slice.imageMaximum);
+			workspace.renderer.setAlpha(slice.alpha);
+			workspace.renderer.renderImage(refocusedImage,
+				workspace.renderArena);
+
+			estimator.calculateDefocusResponse(lightfield, refocusedImage,
+				slice.alpha, workspace, defocusResponse);
+			estimator.calculateCorrespondenceResponse(lightfield,
+				refocusedImage, slice.alpha, workspace, correspondenceResponse);
+
+			// the slice's host buffers are owned by the workspace as well
+			slice.refocusedImage = arena.getHostBuffer(
+				REFOCUSED_IMAGE_HOST_SLOT, imageSize,
+				LightFieldPicture::IMAGE_TYPE);
+			slice.defocusResponse = arena.getHostBuffer(
+				DEFOCUS_RESPONSE_HOST_SLOT, imageSize, MAT_TYPE);
+			slice.correspondenceResponse = arena.getHostBuffer(
+				CORRESPONDENCE_RESPONSE_HOST_SLOT, imageSize, MAT_TYPE);
+
+			refocusedImage.download(slice.refocusedImage);
+			defocusResponse.download(slice.defocusResponse);
+			correspondenceResponse.download(slice.correspondenceResponse);
+		}
+	}
+};
+
+
+/**
+ * Merges a batch of slices into the running top-2 extrema. The image is split
+ * into horizontal tiles and every tile is owned by exactly one worker, so the
+ * reduction needs no locking. Slices are merged in ascending alpha order,
+ * which keeps the result independent of the number of workers.
+ *
+ * Slices may cover a larger region than the target rectangle of the state
+ * (e.g. a tile and its halo), regionOrigin is the slices' position in the
+ * state.
+ */
+class CDCDepthEstimator::SliceReducer : public ParallelLoopBody
+{
+	const vector<DepthSlice>& slices;
+	const Point regionOrigin;
+	const Rect target;
+	SweepState& state;
+
+public:
+	SliceReducer(const vector<DepthSlice>& slices, const Point& regionOrigin,
+		const Rect& target, SweepState& state) :
+		slices(slices), regionOrigin(regionOrigin), target(target), state(state)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const int width		= target.width;
+		const int offsetX	= target.x - regionOrigin.x;
+
+		for (int y = range.start; y < range.end; y++)
+		{
+			float* max1 = state.maxDefocusResponse.ptr<float>(y) + target.x;
+			float* max2 = state.max2.ptr<float>(y) + target.x;
+			float* min1 =
+				state.minCorrespondenceResponse.ptr<float>(y) + target.x;
+			float* min2 = state.min2.ptr<float>(y) + target.x;
+			float* dAlpha = state.defocusAlpha.ptr<float>(y) + target.x;
+			float* cAlpha = state.correspondenceAlpha.ptr<float>(y) + target.x;
+			Vec3f* dEDOF = state.dEDOF.ptr<Vec3f>(y) + target.x;
+			Vec3f* cEDOF = state.cEDOF.ptr<Vec3f>(y) + target.x;
+
+			// responses of all slices, if collected
+			const int sliceCount = state.defocusVolume.channels();
+			float* dVolume = state.defocusVolume.empty() ? NULL :
+				state.defocusVolume.ptr<float>(y) + target.x * sliceCount;
+			float* cVolume = state.correspondenceVolume.empty() ? NULL :
+				state.correspondenceVolume.ptr<float>(y) +
+				target.x * sliceCount;
+
+			const int sliceY = y - regionOrigin.y;
+			for (size_t i = 0; i < slices.size(); i++)
+			{
+				const DepthSlice& slice = slices[i];
+				const float* defocus =
+					slice.defocusResponse.ptr<float>(sliceY) + offsetX;
+				const float* correspondence =
+					slice.correspondenceResponse.ptr<float>(sliceY) + offsetX;
+				const Vec3f* image =
+					slice.refocusedImage.ptr<Vec3f>(sliceY) + offsetX;
+
+				for (int x = 0; x < width; x++)
+				{
+					// handle defocus-based algorithm
+					if (defocus[x] > max1[x])
+					{
+						max2[x]		= max1[x];
+						max1[x]		= defocus[x];
+						dAlpha[x]	= slice.alpha;
+						dEDOF[x]	= image[x];
+					}
+					else if (defocus[x] > max2[x])
+						max2[x] = defocus[x];
+
+					// handle correspondence-based algorithm
+					if (correspondence[x] < min1[x])
+					{
+						min2[x]		= min1[x];
+						min1[x]		= correspondence[x];
+						cAlpha[x]	= slice.alpha;
+						cEDOF[x]	= image[x];
+					}
+					else if (correspondence[x] < min2[x])
+						min2[x] = correspondence[x];
+
+					if (dVolume != NULL)
+					{
+						dVolume[x * sliceCount + slice.index] = defocus[x];
+						cVolume[x * sliceCount + slice.index] =
+							correspondence[x];
+					}
+				}
+			}
+		}
+	}
+};
+
+
+/**
+ * Renders the refocused images of a batch of alpha values without normalizing
+ * them and finds their maxima within the target rectangle (in coordinates of
+ * the rendered region). Workspaces are assigned and all slices are evaluated
+ * on the calling thread as in SliceEvaluator.
+ */
+class CDCDepthEstimator::MaximumEvaluator
+{
+	const LightFieldPicture& lightfield;
+	vector<SliceWorkspace>& workspaces;
+	vector<DepthSlice>& slices;
+	const Rect target;
+
+public:
+	MaximumEvaluator(const LightFieldPicture& lightfield,
+		vector<SliceWorkspace>& workspaces, vector<DepthSlice>& slices,
+		const Rect& target) :
+		lightfield(lightfield), workspaces(workspaces), slices(slices),
+		target(target)
+	{
+	}
+
+	void operator()() const
+	{
+		const Size imageSize = lightfield.SPARTIAL_RESOLUTION;
+
+		for (size_t i = 0; i < slices.size(); i++)
+		{
+			DepthSlice& slice			= slices.at(i);
+			SliceWorkspace& workspace	= workspaces.at(i);
+			ScratchArena& arena			= workspace.responseArena;
+
+			oclMat& refocusedImage = arena.getDeviceBuffer(REFOCUSED_IMAGE_SLOT,
+				imageSize, LightFieldPicture::IMAGE_TYPE);
+			oclMat& targetImage = arena.getDeviceBuffer(TARGET_IMAGE_SLOT,
+				target.size(), LightFieldPicture::IMAGE_TYPE);
+
+			workspace.renderer.setMaximumNormalization(false);
+			workspace.renderer.setAlpha(slice.alpha);
+			workspace.renderer.renderImage(refocusedImage,
+				workspace.renderArena);
+
+			// the reduction needs a continuous single channel matrix
+			oclMat(refocusedImage, target).copyTo(targetImage);
+			double minVal;
+			ocl::minMax_buf(targetImage.reshape(1), &minVal,
+				&slice.imageMaximum, oclMat(),
+				arena.getDeviceBuffer(REDUCTION_SLOT));
+		}
+	}
+};
+
+
+void CDCDepthEstimator::initializeSweepState(SweepState& state,
+	const int sliceCount) const
+{
+	state.maxDefocusResponse		= Mat(imageSize, MAT_TYPE, Scalar(-FLT_MAX));
+	state.max2						= Mat(imageSize, MAT_TYPE, Scalar(-FLT_MAX));
+	state.minCorrespondenceResponse	= Mat(imageSize, MAT_TYPE, Scalar(FLT_MAX));
+	state.min2						= Mat(imageSize, MAT_TYPE, Scalar(FLT_MAX));
+	state.defocusAlpha				= Mat(imageSize, MAT_TYPE, Scalar(ALPHA_MIN));
+	state.correspondenceAlpha		= Mat(imageSize, MAT_TYPE, Scalar(ALPHA_MIN));
+	state.dEDOF	= Mat(imageSize, LightFieldPicture::IMAGE_TYPE, Scalar::all(0));
+	state.cEDOF	= Mat(imageSize, LightFieldPicture::IMAGE_TYPE, Scalar::all(0));
+
+	if (this->cueCombination != CUE_SELECTION)
+	{
+		state.defocusVolume			= Mat(imageSize, CV_32FC(sliceCount));
+		state.correspondenceVolume	= Mat(imageSize, CV_32FC(sliceCount));
+	}
+}
+
+
+int CDCDepthEstimator::calculateHalo(const LightFieldPicture& lightfield,
+	const vector<float>& alphas) const
+{
+	// the shift weight 1 - 1/alpha is monotonic, so the widest shift is found at
+	// one of the ends of the sweep
+	const double maxWeight = std::max(fabs(1. - 1. / alphas.front()),
+		fabs(1. - 1. / alphas.back()));
+
+	// sub-aperture images are shifted by ((u, v) - center) * weight
+	const Point center		= lightfield.getAngularCenter();
+	const Size resolution	= lightfield.ANGULAR_RESOLUTION;
+	const int maxOffset		= std::max(
+		std::max(center.x, resolution.width - 1 - center.x),
+		std::max(center.y, resolution.height - 1 - center.y));
+
+	// the windows are applied after shifting
+	const int defocusRadius = LAPLACIAN_KERNEL_SIZE / 2 + std::max(
+		DEFOCUS_WINDOW_SIZE.width, DEFOCUS_WINDOW_SIZE.height) / 2;
+	const int correspondenceRadius = std::max(
+		CORRESPONDENCE_WINDOW_SIZE.width, CORRESPONDENCE_WINDOW_SIZE.height) / 2;
+
+	return (int) ceil(maxWeight * maxOffset) + INTERPOLATION_MARGIN +
+		std::max(defocusRadius, correspondenceRadius);
+}
+
+
+int CDCDepthEstimator::calculateTileSize(const LightFieldPicture& lightfield,
+	const int sliceCount, const int halo) const
+{
+	if (this->memoryBudget == 0)
+		return 0;
+
+	// the sweep state always covers the whole image, for depth labeling it
+	// holds both responses of every slice
+	size_t stateBytesPerPixel = STATE_BYTES_PER_PIXEL;
+	if (this->cueCombination != CUE_SELECTION)
+		stateBytesPerPixel += 2 * sliceCount * sizeof(float);
+	const size_t stateBytes = imageSize.area() * stateBytesPerPixel;
+
+	// the light field stays resident as well: its raw image and, if it has
+	// been extracted, the sub-aperture image atlas
+	const Mat rawImage		= lightfield.getRawImage();
+	const oclMat atlas		= lightfield.getSubapertureImageAtlas();
+	const size_t lightfieldBytes	= rawImage.total() * rawImage.elemSize() +
+		atlas.rows * atlas.cols * atlas.elemSize();
+
+	const size_t residentBytes	= stateBytes + lightfieldBytes;
+	const size_t tileBytes		= (this->memoryBudget > residentBytes) ?
+		this->memoryBudget - residentBytes : 0;
+
+	// every pixel of a tile (including its halo) is needed once per slice of
+	// a batch and once per workspace, and once per sub-aperture image unless
+	// the tiles are views of the resident atlas
+	const size_t batchSize		= std::max(1, getNumThreads());
+	size_t tileBytesPerPixel	=
+		batchSize * (SLICE_BYTES_PER_PIXEL + WORKER_BYTES_PER_PIXEL);
+	if (atlas.empty())
+		tileBytesPerPixel += lightfield.ANGULAR_RESOLUTION.area() *
+			CV_ELEM_SIZE(LightFieldPicture::IMAGE_TYPE);
+
+	int tileSize = (int) std::sqrt(tileBytes / (double) tileBytesPerPixel) -
+		2 * halo;
+	if (tileSize < MIN_TILE_SIZE)
+	{
+		cout << "The memory budget of " << this->memoryBudget << " bytes is "
+			"too small, using tiles of " << MIN_TILE_SIZE << " pixels." << endl;
+		tileSize = MIN_TILE_SIZE;
+	}
+
+	// a single tile would cover the whole image
+	if (tileSize >= std::max(imageSize.width, imageSize.height))
+		return 0;
+
+	return tileSize;
+}
+
+
+/**
+ * Finds the maximum of every slice's refocused image over all tiles, so that
+ * tiles can be normalized exactly like the whole image. Only the refocused
+ * images are rendered, which is cheap compared to the responses.
+ */
+void CDCDepthEstimator::measureImageMaxima(const LightFieldPicture& lightfield,
+	const vector<float>& alphas, const vector<Rect>& regions,
+	const vector<Rect>& tiles, vector<double>& imageMaxima)
+{
+	const int sliceCount = alphas.size();
+	imageMaxima.assign(sliceCount, 0);
+
+	vector<DepthSlice> batch;
+	for (size_t t = 0; t < tiles.size(); t++)
+	{
+		const LightFieldPicture region	= lightfield.getRegion(regions[t]);
+		const Rect target	= tiles[t] - regions[t].tl();
+		const int batchSize	= prepareWorkspaces(region, sliceCount);
+
+		for (int first = 0; first < sliceCount; first += batchSize)
+		{
+			batch.resize(std::min(batchSize, sliceCount - first));
+			for (int i = 0; i < (int) batch.size(); i++)
+			{
+				batch[i].index = first + i;
+				batch[i].alpha = alphas[first + i];
+			}
+
+			MaximumEvaluator(region, this->workspaces, batch, target)();
+
+			for (size_t i = 0; i < batch.size(); i++)
+				imageMaxima[batch[i].index] = std::max(
+					imageMaxima[batch[i].index], batch[i].imageMaximum);
+		}
+	}
+}
+
+
+/**
+ * Evaluates all slices for the target rectangle of the sweep state. The
+ * refocused images are normalized by the given maxima of the whole images, or
+ * by their own maxima if none are given.
+ */
+void CDCDepthEstimator::sweep(const LightFieldPicture& region,
+	const vector<float>& alphas, const Point& regionOrigin, const Rect& target,
+	const vector<double>& imageMaxima, SweepState& state)
+{
+	// evaluate the slices in batches of one slice per worker, merging each
+	// batch before the next one is rendered to bound the memory footprint;
+	// the device work runs on this thread, the merge in parallel
+	const int sliceCount	= alphas.size();
+	const int batchSize		= prepareWorkspaces(region, sliceCount);
+	const double tileCount	= std::max(1, target.height / REDUCTION_TILE_HEIGHT);
+
+	vector<DepthSlice> batch;
+	batch.reserve(batchSize);
+	for (int first = 0; first < sliceCount; first += batchSize)
+	{
+		batch.resize(std::min(batchSize, sliceCount - first));
+		for (int i = 0; i < (int) batch.size(); i++)
+		{
+			batch[i].index = first + i;
+			batch[i].alpha = alphas[first + i];
+			batch[i].imageMaximum = imageMaxima.empty() ? 0 :
+				imageMaxima[first + i];
+		}
+
+		SliceEvaluator(*this, region, this->workspaces, batch)();
+		parallel_for_(Range(target.y, target.y + target.height),
+			SliceReducer(batch, regionOrigin, target, state), tileCount);
+	}
+}
+
+
+/**
+ * Provides a workspace for every slice of a batch, all rendering the given
+ * region, and returns the batch size.
+ */
+int CDCDepthEstimator::prepareWorkspaces(const LightFieldPicture& region,
+	const int sliceCount)
+{
+	const int batchSize = std::min(sliceCount, std::max(1, getNumThreads()));
+
+	if ((int) this->workspaces.size() < batchSize)
+		this->workspaces.resize(batchSize);
+	for (int i = 0; i < batchSize; i++)
+	{
+		initializeWorkspace(this->workspaces[i]);
+		this->workspaces[i].renderer.setLightfield(region);
+	}
+
+	return batchSize;
+}
+
+
+void CDCDepthEstimator::initializeWorkspace(SliceWorkspace& workspace) const
+{
+	if (!workspace.secondDerivativeX.empty())
+		return;
+
+	workspace.secondDerivativeX = ocl::createDerivFilter_GPU(MAT_TYPE, MAT_TYPE,
+		2, 0, LAPLACIAN_KERNEL_SIZE);
+	workspace.secondDerivativeY = ocl::createDerivFilter_GPU(MAT_TYPE, MAT_TYPE,
+		0, 2, LAPLACIAN_KERNEL_SIZE);
+	workspace.defocusWindow = ocl::createLinearFilter_GPU(MAT_TYPE, MAT_TYPE,
+		DEFOCUS_WINDOW, WINDOW_CENTER, BORDER_TYPE);
+	workspace.correspondenceWindow = ocl::createLinearFilter_GPU(CV_32FC3,
+		CV_32FC3, CORRESPONDENCE_WINDOW, WINDOW_CENTER, BORDER_TYPE);
 }
 
 
@@ -72,7 +565,6 @@ oclMat CDCDepthEstimator::estimateDepth(const LightFieldPicture& lightfield)
 	// 1) for each shear, compute depth response
 	// also compute "running" response extrema, depth map and extended depth of
 	// field image
-	this->renderer->setLightfield(lightfield);
 	this->imageSize	= lightfield.SPARTIAL_RESOLUTION;
 	this->angularCorrection = Vec2f(lightfield.ANGULAR_RESOLUTION.width, 
 		lightfield.ANGULAR_RESOLUTION.height) * 0.5;
@@ -86,76 +578,66 @@ oclMat CDCDepthEstimator::estimateDepth(const LightFieldPicture& lightfield)
 	this->fromCornerToCenter	= Vec2f(left, top);
 
 	const float alphaStep = (alphaMax - ALPHA_MIN) / (float) DEPTH_RESOLUTION;
-	oclMat refocusedImage, response, maxDefocusResponse, max2,
-		minCorrespondenceResponse, min2, dEDOF, cEDOF, defocusAlpha,
-		correspondenceAlpha, mask1, mask2;	// TODO use fewer Mats
-
-	float alpha = ALPHA_MIN;
-	Scalar scalarAlpha = Scalar(alpha);
-	defocusAlpha = oclMat(imageSize, MAT_TYPE);
-	defocusAlpha.setTo(scalarAlpha);
-	correspondenceAlpha = oclMat(imageSize, MAT_TYPE);
-	correspondenceAlpha.setTo(scalarAlpha);
-
-	this->renderer->setAlpha(alpha);
-	refocusedImage = this->renderer->renderImage();
-	refocusedImage.copyTo(dEDOF);
-	refocusedImage.copyTo(cEDOF);
-
-	response = calculateDefocusResponse(lightfield, refocusedImage, alpha);
-	response.copyTo(maxDefocusResponse);
-	response.copyTo(max2);
-
-	response = calculateCorrespondenceResponse(lightfield, refocusedImage, alpha);
-	response.copyTo(minCorrespondenceResponse);
-	response.copyTo(min2);
-	
-	for (alpha = ALPHA_MIN + alphaStep; alpha <= alphaMax; alpha += alphaStep)
+	vector<float> alphas;
+	alphas.push_back(ALPHA_MIN);
+	for (float alpha = ALPHA_MIN + alphaStep; alpha <= alphaMax;
+		alpha += alphaStep)
+		alphas.push_back(alpha);
+
+	SweepState state;
+	initializeSweepState(state, alphas.size());
+
+	const Rect imageRect	= Rect(Point(0, 0), imageSize);
+	const int halo			= calculateHalo(lightfield, alphas);
+	const int tileSize		= calculateTileSize(lightfield, alphas.size(),
+		halo);
+	if (tileSize == 0)
 	{
-		scalarAlpha = Scalar(alpha);
-		this->renderer->setAlpha(alpha);
-		refocusedImage = this->renderer->renderImage();
-
-
-		// handle defocus-based algorithm
-		response = calculateDefocusResponse(lightfield, refocusedImage, alpha);
-
-		// find first maximum
-		mask1 = (response > maxDefocusResponse);
-
-		// find second maximum
-		mask2 = (response < maxDefocusResponse) & (response > max2);
-
-		// update maxima
-		response.copyTo(maxDefocusResponse, mask1);
-		response.copyTo(max2, mask2);
-
-		// update depth estimation
-		defocusAlpha.setTo(scalarAlpha, mask1);
-
-		// update extended depth of field image
-		refocusedImage.copyTo(dEDOF, mask1);
-
-
-		// handle correspondence-based algorithm
-		response = calculateCorrespondenceResponse(lightfield, refocusedImage, alpha);
-
-		// find first minimum
-		mask1 = (response < minCorrespondenceResponse);
+		// without an atlas, the sub-aperture images are extracted once here
+		// instead of once per slice
+		const vector<double> ownMaxima;
+		if (lightfield.getSubapertureImageAtlas().empty())
+			sweep(lightfield.getRegion(imageRect), alphas, imageRect.tl(),
+				imageRect, ownMaxima, state);
+		else
+			sweep(lightfield, alphas, imageRect.tl(), imageRect, ownMaxima,
+				state);
+	}
+	else
+	{
+		vector<Rect> tiles, regions;
+		for (int y = 0; y < imageSize.height; y += tileSize)
+		{
+			for (int x = 0; x < imageSize.width; x += tileSize)
+			{
+				const Rect tile = Rect(x, y, min(tileSize, imageSize.width - x),
+					min(tileSize, imageSize.height - y));
+				tiles.push_back(tile);
+				regions.push_back(Rect(tile.x - halo, tile.y - halo,
+					tile.width + 2 * halo, tile.height + 2 * halo) & imageRect);
+			}
+		}
 
-		// find second minimum
-		mask2 = (response > minCorrespondenceResponse) & (response < min2);
+		// the maximum of a refocused image, by which it is normalized, is
+		// unknown until all of its tiles have been rendered
+		vector<double> imageMaxima;
+		measureImageMaxima(lightfield, alphas, regions, tiles, imageMaxima);
 
-		// update minima
-		response.copyTo(minCorrespondenceResponse, mask1);
-		response.copyTo(min2, mask2);
+		for (size_t t = 0; t < tiles.size(); t++)
+			sweep(lightfield.getRegion(regions[t]), alphas, regions[t].tl(),
+				tiles[t], imageMaxima, state);
+	}
 
-		// update depth estimation
-		correspondenceAlpha.setTo(scalarAlpha, mask1);
+	oclMat maxDefocusResponse(state.maxDefocusResponse);
+	oclMat max2(state.max2);
+	oclMat minCorrespondenceResponse(state.minCorrespondenceResponse);
+	oclMat min2(state.min2);
+	oclMat defocusAlpha(state.defocusAlpha);
+	oclMat correspondenceAlpha(state.correspondenceAlpha);
+	oclMat dEDOF(state.dEDOF);
+	oclMat cEDOF(state.cEDOF);
+	oclMat mask1;
 
-		// update extended depth of field image
-		refocusedImage.copyTo(cEDOF, mask1);
-	}
 	oclMat defocusConfidence, correspondenceConfidence;
 	ocl::divide(maxDefocusResponse, max2, defocusConfidence);
 	ocl::divide(min2, minCorrespondenceResponse, correspondenceConfidence);
@@ -164,26 +646,42 @@ oclMat CDCDepthEstimator::estimateDepth(const LightFieldPicture& lightfield)
 	normalizeConfidence(defocusConfidence, correspondenceConfidence);
 
 	// 3) global operation to combine cues
-	oclMat labels = mrf(defocusAlpha, correspondenceAlpha,
-		defocusConfidence, correspondenceConfidence);
-	
-	/*
-	oclMat labels = pickLabelWithMaxConfidence(defocusConfidence,
-		correspondenceConfidence);
-	*/
-
-	// translate label map into depth map
 	oclMat alphaMap, confidenceMap, extendedDepthOfFieldImage;
+	if (this->cueCombination == CUE_SELECTION)
+	{
+		oclMat labels = mrf(defocusAlpha, correspondenceAlpha,
+			defocusConfidence, correspondenceConfidence);
+	
+		/*
+		oclMat labels = pickLabelWithMaxConfidence(defocusConfidence,
+			correspondenceConfidence);
+		*/
+
+		// translate label map into depth map
+		mask1 = (labels == 0);
+		defocusAlpha.copyTo(alphaMap, mask1);
+		defocusConfidence.copyTo(confidenceMap, mask1);
+		dEDOF.copyTo(extendedDepthOfFieldImage, mask1);
+
+		mask1 = (labels == 1);
+		correspondenceAlpha.copyTo(alphaMap, mask1);
+		correspondenceConfidence.copyTo(confidenceMap, mask1);
+		cEDOF.copyTo(extendedDepthOfFieldImage, mask1);
+	}
+	else
+	{
+		Mat dConfidence, cConfidence, hostAlphaMap, hostConfidenceMap,
+			hostImage;
+		defocusConfidence.download(dConfidence);
+		correspondenceConfidence.download(cConfidence);
 
-	mask1 = (labels == 0);
-	defocusAlpha.copyTo(alphaMap, mask1);
-	defocusConfidence.copyTo(confidenceMap, mask1);
-	dEDOF.copyTo(extendedDepthOfFieldImage, mask1);
+		labelDepth(alphas, dConfidence, cConfidence, state, hostAlphaMap,
+			hostConfidenceMap, hostImage);
 
-	mask1 = (labels == 1);
-	correspondenceAlpha.copyTo(alphaMap, mask1);
-	correspondenceConfidence.copyTo(confidenceMap, mask1);
-	cEDOF.copyTo(extendedDepthOfFieldImage, mask1);
+		alphaMap.upload(hostAlphaMap);
+		confidenceMap.upload(hostConfidenceMap);
+		extendedDepthOfFieldImage.upload(hostImage);
+	}
 
 	// 4) compute actual depth from alpha values
 	oclMat focalLengthMap, depthMap, tmp1, tmp2;
@@ -290,55 +788,75 @@ oclMat CDCDepthEstimator::estimateDepth(const LightFieldPicture& lightfield)
 }
 
 
-oclMat CDCDepthEstimator::calculateDefocusResponse(
+void CDCDepthEstimator::calculateDefocusResponse(
 	const LightFieldPicture& lightfield, const oclMat& refocusedImage,
-	const float alpha)
+	const float alpha, SliceWorkspace& workspace, oclMat& response) const
 {
-	vector<oclMat> channels;
+	const Size imageSize	= refocusedImage.size();
+	ScratchArena& arena		= workspace.responseArena;
+
+	vector<oclMat>& channels = workspace.channels;
 	ocl::split(refocusedImage, channels);
 
-	oclMat d2x, d2y, channelResponse;
-	oclMat totalResponse = oclMat(refocusedImage.size(), CV_32FC1, Scalar::all(0));
+	oclMat& d2x = arena.getDeviceBuffer(SECOND_DERIVATIVE_X_SLOT, imageSize,
+		MAT_TYPE);
+	oclMat& d2y = arena.getDeviceBuffer(SECOND_DERIVATIVE_Y_SLOT, imageSize,
+		MAT_TYPE);
+	oclMat& channelResponse = arena.getDeviceBuffer(CHANNEL_RESPONSE_SLOT,
+		imageSize, MAT_TYPE);
+	oclMat& filteredResponse = arena.getDeviceBuffer(FILTERED_RESPONSE_SLOT,
+		imageSize, MAT_TYPE);
+
+	response.setTo(Scalar::all(0));
 	for (int i = 0; i < 3; i++)
 	{
-		ocl::Sobel(refocusedImage, d2x, CV_32FC1, 2, 0, LAPLACIAN_KERNEL_SIZE);
-		ocl::Sobel(refocusedImage, d2y, CV_32FC1, 0, 2, LAPLACIAN_KERNEL_SIZE);
+		workspace.secondDerivativeX->apply(channels.at(i), d2x);
+		workspace.secondDerivativeY->apply(channels.at(i), d2y);
 		ocl::add(d2x, d2y, channelResponse);
 
 		ocl::abs(channelResponse, channelResponse);
 
-		ocl::filter2D(channelResponse, channelResponse, DDEPTH, DEFOCUS_WINDOW,
-			WINDOW_CENTER, 0, BORDER_TYPE);
+		workspace.defocusWindow->apply(channelResponse, filteredResponse);
 
 		// merge color channels
-		ocl::multiply(channelResponse, channelResponse, channelResponse);
-		ocl::add(channelResponse, totalResponse, totalResponse);
+		ocl::multiply(filteredResponse, filteredResponse, filteredResponse);
+		ocl::add(filteredResponse, response, response);
 	}
-	ocl::multiply(1. / 3., totalResponse, totalResponse);
-	ocl::pow(totalResponse, 0.5, totalResponse);
-
-	return totalResponse;
+	ocl::multiply(1. / 3., response, response);
+	ocl::pow(response, 0.5, response);
 }
 
 
-oclMat CDCDepthEstimator::calculateCorrespondenceResponse(
+void CDCDepthEstimator::calculateCorrespondenceResponse(
 	const LightFieldPicture& lightfield, const oclMat& refocusedImage,
-	const float alpha)
+	const float alpha, SliceWorkspace& workspace, oclMat& response) const
 {
-	const float weight = 1. - 1. / alpha;
-
-	oclMat subapertureImage, modifiedSubapertureImage, differenceImage,
-		squaredDifference;
-	oclMat variance = oclMat(imageSize, CV_32FC3, Scalar::all(0));
-	Mat transformation = Mat::eye(2, 3, CV_32FC1);
+	const float weight		= 1. - 1. / alpha;
+	const Size imageSize	= refocusedImage.size();
+	ScratchArena& arena		= workspace.responseArena;
+
+	oclMat subapertureImage;
+	oclMat& modifiedSubapertureImage = arena.getDeviceBuffer(SHIFTED_IMAGE_SLOT,
+		imageSize, CV_32FC3);
+	oclMat& differenceImage = arena.getDeviceBuffer(DIFFERENCE_IMAGE_SLOT,
+		imageSize, CV_32FC3);
+	oclMat& squaredDifference = arena.getDeviceBuffer(SQUARED_DIFFERENCE_SLOT,
+		imageSize, CV_32FC3);
+	oclMat& variance = arena.getDeviceBuffer(VARIANCE_SLOT, imageSize,
+		CV_32FC3);
+	variance.setTo(Scalar::all(0));
+	Mat& transformation = arena.getHostBuffer(TRANSFORMATION_SLOT, Size(3, 2),
+		CV_32FC1);
+	setIdentity(transformation);
+	const Point center = lightfield.getAngularCenter();
 
 	int u, v;
 	for (v = 0; v < lightfield.ANGULAR_RESOLUTION.height; v++)
 	{
-		transformation.at<float>(1, 2) = -(v - 5) * weight;
+		transformation.at<float>(1, 2) = -(v - center.y) * weight;
 		for (u = 0; u < lightfield.ANGULAR_RESOLUTION.width; u++)
 		{
-			transformation.at<float>(0, 2) = -(u - 5) * weight;
+			transformation.at<float>(0, 2) = -(u - center.x) * weight;
 
 			// get subaperture image
 			subapertureImage = lightfield.getSubapertureImageI(u, v);
@@ -348,7 +866,8 @@ oclMat CDCDepthEstimator::calculateCorrespondenceResponse(
 				transformation, imageSize, INTER_LINEAR);
 
 			// compute response
-			differenceImage = modifiedSubapertureImage - refocusedImage;
+			ocl::subtract(modifiedSubapertureImage, refocusedImage,
+				differenceImage);
 			ocl::multiply(differenceImage, differenceImage, squaredDifference);
 			ocl::add(squaredDifference, variance, variance);
 		}
@@ -356,25 +875,23 @@ oclMat CDCDepthEstimator::calculateCorrespondenceResponse(
 
 	ocl::multiply(NuvMultiplier, variance, variance);
 
-	oclMat standardDeviation, confidence;
-	ocl::pow(variance, 0.5, standardDeviation);	// there is no ocl::sqrt()
-	ocl::filter2D(standardDeviation, confidence, DDEPTH, CORRESPONDENCE_WINDOW,
-		WINDOW_CENTER, 0, BORDER_TYPE);
+	// the variance is turned into the standard deviation in place
+	oclMat& confidence = arena.getDeviceBuffer(CONFIDENCE_SLOT, imageSize,
+		CV_32FC3);
+	ocl::pow(variance, 0.5, variance);	// there is no ocl::sqrt()
+	workspace.correspondenceWindow->apply(variance, confidence);
 
 	// merge color channels
-	vector<oclMat> channels;
+	vector<oclMat>& channels = workspace.channels;
 	ocl::split(confidence, channels);
-	oclMat totalConfidence = oclMat(refocusedImage.size(), CV_32FC1,
-		Scalar::all(0));
+	response.setTo(Scalar::all(0));
 	for (int i = 0; i < 3; i++)
 	{
 		ocl::multiply(channels.at(i), channels.at(i), channels.at(i));
-		ocl::add(channels.at(i), totalConfidence, totalConfidence);
+		ocl::add(channels.at(i), response, response);
 	}
-	ocl::multiply(1. / 3., totalConfidence, totalConfidence);
-	ocl::pow(totalConfidence, 0.5, totalConfidence);
-
-	return totalConfidence;
+	ocl::multiply(1. / 3., response, response);
+	ocl::pow(response, 0.5, response);
 }
 
 
@@ -407,66 +924,131 @@ oclMat CDCDepthEstimator::pickLabelWithMaxConfidence(const oclMat& confidence1,
 }
 
 
-MRF::CostVal CDCDepthEstimator::dataCost(int pix, MRF::Label i)
+/**
+ * Labels every pixel with one of the alpha values of the sweep. The data term
+ * of a label combines the normalized responses of both cues at its alpha
+ * value, each weighted by the cue's confidence, and is computed in place of
+ * the state's defocus volume. The smoothness term is truncated linear in the
+ * label difference, so TRW-S and BP-S use their fast L1 message updates.
+ *
+ * The EDOF image and confidence of a pixel are taken from the cue whose alpha
+ * value is closest to the chosen one.
+ */
+void CDCDepthEstimator::labelDepth(const vector<float>& alphas,
+	const Mat& defocusConfidence, const Mat& correspondenceConfidence,
+	SweepState& state, Mat& alphaMap, Mat& confidenceMap,
+	Mat& extendedDepthOfFieldImage) const
 {
-	switch (i)
+	const int labelCount	= alphas.size();
+	const int width			= imageSize.width;
+	const int height		= imageSize.height;
+	Mat& costVolume			= state.defocusVolume;
+
+	// 1 - D / Dmax is 0 at the sharpest slice, 1 - Cmin / C at the one with the
+	// least variance
+	int x, y, l;
+	for (y = 0; y < height; y++)
 	{
-	case 0:
-		return CDCDepthEstimator::dataCost1[pix];
-	case 1:
-		return CDCDepthEstimator::dataCost2[pix];
-	default:
-		return 0;
+		const float* maxDefocus = state.maxDefocusResponse.ptr<float>(y);
+		const float* minCorrespondence =
+			state.minCorrespondenceResponse.ptr<float>(y);
+		const float* dConfidence = defocusConfidence.ptr<float>(y);
+		const float* cConfidence = correspondenceConfidence.ptr<float>(y);
+		const float* correspondence = state.correspondenceVolume.ptr<float>(y);
+		float* cost = costVolume.ptr<float>(y);
+
+		for (x = 0; x < width; x++)
+		{
+			const float dWeight = LAMBDA_SOURCE[0] * dConfidence[x];
+			const float cWeight = LAMBDA_SOURCE[1] * cConfidence[x];
+			const float dNormalization =
+				(maxDefocus[x] > 0) ? 1. / maxDefocus[x] : 0;
+
+			for (l = 0; l < labelCount; l++, cost++, correspondence++)
+			{
+				const float dCost = 1 - *cost * dNormalization;
+				const float cCost = (*correspondence > 0) ?
+					1 - minCorrespondence[x] / *correspondence : 0;
+				*cost = dWeight * dCost + cWeight * cCost;
+			}
+		}
 	}
-}
-
-
-MRF::CostVal CDCDepthEstimator::fnCost(int pix1, int pix2,
-	MRF::Label i, MRF::Label j)
-{
-	return 0;
+	state.correspondenceVolume.release();
+#ifdef MRF_COMPACT_TYPES
+	costVolume.convertTo(costVolume, DataType<MRF::CostVal>::depth,
+		MRF_COST_SCALE);
+#endif
 
+	// define/generate complete cost function
+	DataCost data = DataCost(costVolume.ptr<MRF::CostVal>());
+	SmoothnessCost smooth = SmoothnessCost(1,
+		MRF::toCostVal(LABELING_TRUNCATION),
+		MRF::toCostVal(LABELING_SMOOTHNESS * MRF_COST_SCALE));
+	EnergyFunction energy = EnergyFunction(&data, &smooth);
 
-	if (pix1 > pix2)	// swap
+	MRF* mrf;
+	if (this->cueCombination == DEPTH_LABELING_BPS)
+		mrf = new BPS(width, height, labelCount, &energy);
+	else if (this->cueCombination == DEPTH_LABELING_HBP)
+		mrf = new HBP(width, height, labelCount, &energy);
+	else
 	{
-		int tmp = pix1; pix1 = pix2; pix2 = tmp;
-		tmp = i; i = j; j = tmp;
+		TRWS* trws = new TRWS(width, height, labelCount, &energy);
+		trws->setBandCount(std::max(1, std::min(getNumThreads(),
+			height / LABELING_MIN_BAND_HEIGHT)));
+		mrf = trws;
 	}
+	mrf->initialize();
+	mrf->clearAnswer();
 
-	/*
-	switch (j)
+	// perform optimization, a bounded number of iterations, until the energy
+	// converges or comes close to the lower bound, if the solver has one (not
+	// banded TRW-S); the driver leaves the labeling with the lowest energy in
+	// the MRF
+	MRFDriver::Criteria criteria;
+	criteria.maxIterations		= LABELING_MAX_ITERATIONS;
+	criteria.minRelativeDecrease	= LABELING_CONVERGENCE;
+	if (mrf->hasLowerBound())
+		criteria.maxRelativeGap	= LABELING_MAX_GAP;
+	MRFDriver driver = MRFDriver(mrf, criteria);
+	driver.run();
+	printf("Depth labeling took %.3f secs\n", driver.getStatistics().time);
+
+	// translate labels into alpha values
+	alphaMap			= Mat(imageSize, MAT_TYPE);
+	confidenceMap		= Mat(imageSize, MAT_TYPE);
+	extendedDepthOfFieldImage = Mat(imageSize, LightFieldPicture::IMAGE_TYPE);
+
+	const MRF::Label* labels = mrf->getAnswerPtr();
+	for (y = 0; y < height; y++)
 	{
-	case 0:
-		return CDCDepthEstimator::fsCost1[pix2];
-	case 1:
-		return CDCDepthEstimator::fsCost2[pix2];
-	default:
-		return 0;
+		const float* dAlpha	= state.defocusAlpha.ptr<float>(y);
+		const float* cAlpha	= state.correspondenceAlpha.ptr<float>(y);
+		const float* dConfidence = defocusConfidence.ptr<float>(y);
+		const float* cConfidence = correspondenceConfidence.ptr<float>(y);
+		const Vec3f* dEDOF = state.dEDOF.ptr<Vec3f>(y);
+		const Vec3f* cEDOF = state.cEDOF.ptr<Vec3f>(y);
+		float* alpha		= alphaMap.ptr<float>(y);
+		float* confidence	= confidenceMap.ptr<float>(y);
+		Vec3f* image		= extendedDepthOfFieldImage.ptr<Vec3f>(y);
+
+		for (x = 0; x < width; x++, labels++)
+		{
+			alpha[x] = alphas[*labels];
+			if (fabs(alpha[x] - dAlpha[x]) <= fabs(alpha[x] - cAlpha[x]))
+			{
+				confidence[x]	= dConfidence[x];
+				image[x]		= dEDOF[x];
+			}
+			else
+			{
+				confidence[x]	= cConfidence[x];
+				image[x]		= cEDOF[x];
+			}
+		}
 	}
-	*/
-	/*
-	const int width = -1;
-	float *depthMap1, *depthMap2, *drvt1, *drvt2;
-
-	const int x1 = pix1 / width;	const int y1 = pix1 % width;
-	const int x2 = pix2 / width;	const int y2 = pix2 % width;
-	const float diffX = x1 - (float) x2;
-	const float diffY = y1 - (float) y2;
-	const bool xIsEqual = (x1 == x2);
-	const bool yIsEqual = (y1 == y2);
-
-	const float d1depth = depthMap1[pix1] - depthMap2[pix2];
-	const float d1x = xIsEqual ? 0 : abs(d1depth / diffX);
-	const float d1y = yIsEqual ? 0 : abs(d1depth / diffY);
-	const float flatnessCost = LAMBDA_FLAT * (d1x + d1y);
-
-	const float d2depth = drvt1[pix1] - drvt2[pix2];
-	const float d2x = xIsEqual ? 0 : abs(d2depth / diffX);
-	const float d2y = yIsEqual ? 0 : abs(d2depth / diffY);
-	const float smoothnessCost = LAMBDA_SMOOTH * (d2x + d2y);
-
-	return flatnessCost + smoothnessCost;
-	*/
+
+	delete mrf;
 }
 
 
@@ -474,13 +1056,12 @@ oclMat CDCDepthEstimator::mrf(const oclMat& depth1, const oclMat& depth2,
 	const oclMat& confidence1, const oclMat& confidence2)
 {
 	MRF* mrf;
-	EnergyFunction *energy;
-	float time;
 
 	const int ENERGY_KERNEL_SIZE = 3;
 
 	// pre-calculate cost
-	Mat tmpMat;
+	const int costType = CV_MAKETYPE(DataType<MRF::CostVal>::depth, 1);
+	Mat tmpMat, defocusCost, correspondenceCost;
 	oclMat aDiffs, gradientX, gradientY, laplacian, dataCost, flatnessCost,
 		smoothnessCost, totalCost;
 	ocl::absdiff(depth1, depth2, aDiffs);
@@ -515,10 +1096,7 @@ oclMat CDCDepthEstimator::mrf(const oclMat& depth1, const oclMat& depth2,
 	tmpMat.reshape(1, 1).copyTo(CDCDepthEstimator::dataCost1);
 	*/
 	totalCost.download(tmpMat);
-	tmpMat.reshape(1, 1).copyTo(CDCDepthEstimator::dataCost1);
-	ocl::add(flatnessCost, smoothnessCost, totalCost);
-	totalCost.download(tmpMat);
-	tmpMat.reshape(1, 1).copyTo(CDCDepthEstimator::fsCost1);
+	tmpMat.convertTo(defocusCost, costType, MRF_COST_SCALE);
 
 	// debugging
 	//double maxVal, minVal;
@@ -561,10 +1139,7 @@ oclMat CDCDepthEstimator::mrf(const oclMat& depth1, const oclMat& depth2,
 	*/
 
 	totalCost.download(tmpMat);
-	tmpMat.reshape(1, 1).copyTo(CDCDepthEstimator::dataCost2);
-	ocl::add(flatnessCost, smoothnessCost, totalCost);
-	totalCost.download(tmpMat);
-	tmpMat.reshape(1, 1).copyTo(CDCDepthEstimator::fsCost2);
+	tmpMat.convertTo(correspondenceCost, costType, MRF_COST_SCALE);
 
 	// debugging
 	/*
@@ -647,47 +1222,44 @@ oclMat CDCDepthEstimator::mrf(const oclMat& depth1, const oclMat& depth2,
 	//waitKey(0);
 	*/
 
-	// define/generate complete cost function
-	DataCost *data         = new DataCost(&CDCDepthEstimator::dataCost);
-	SmoothnessCost *smooth = new SmoothnessCost(&CDCDepthEstimator::fnCost);
-	energy = new EnergyFunction(data, smooth);
+	// interleave both costs into the array layout expected by DataCost,
+	// cost[p * LABEL_COUNT + l], writing directly into the instance's buffer
+	this->dataCostVolume.resize(depth1.size().area() * LABEL_COUNT);
+	Mat costVolume = Mat(depth1.size(), CV_MAKETYPE(costType, LABEL_COUNT),
+		&this->dataCostVolume[0]);
+	Mat costPlanes[] = { defocusCost, correspondenceCost };
+	cv::merge(costPlanes, LABEL_COUNT, costVolume);
+
+	// neighbouring labels are not penalized, the smoothness of both solutions
+	// is already part of the data cost
+	this->smoothnessCostTable.assign(LABEL_COUNT * LABEL_COUNT, 0);
+
+	// define/generate complete cost function; the MRF keeps pointers to both
+	// arrays, which therefore have to outlive it
+	DataCost data = DataCost(&this->dataCostVolume[0]);
+	SmoothnessCost smooth = SmoothnessCost(&this->smoothnessCostTable[0]);
+	EnergyFunction energy = EnergyFunction(&data, &smooth);
 
 	// compute optimized depth map (labeling)
-	mrf = new MaxProdBP(depth1.size().width, depth1.size().height, 2, energy);
-	//mrf = new BPS(depth1.size().width, depth1.size().height, 2, energy);
+	mrf = new MaxProdBP(depth1.size().width, depth1.size().height,
+		LABEL_COUNT, &energy);
+	//mrf = new BPS(depth1.size().width, depth1.size().height, LABEL_COUNT,
+	//	&energy);
 	mrf->initialize();
 	mrf->clearAnswer();
-	
-	// debugging
-	printf("Energy at the Start = %g (Es %g + Ed %g)\n", (float)mrf->totalEnergy(),
-	   (float)mrf->smoothnessEnergy(), (float)mrf->dataEnergy());
-	
-	// perform optimization
-	const int labelMatType = CV_32SC1;
-	MRF::Label* labelsArray = mrf->getAnswerPtr();
-	oclMat newLabels, tmpOclMat;
-	oclMat oldLabels = oclMat(depth1.size(), labelMatType, Scalar(2));
-
-	double rootMeanSquareDeviation;
-	int pixelCount = depth1.size().area();
-	do {
-		// perform more optimization
-		mrf->optimize(1, time);	// TODO use constant
-
-		// calculate root-mean-square deviation
-		newLabels = oclMat(depth1.size(), labelMatType, labelsArray);
-		tmpOclMat = newLabels - oldLabels;
-		ocl::multiply(tmpOclMat, tmpOclMat, tmpOclMat);
-		rootMeanSquareDeviation = std::sqrt(ocl::sum(tmpOclMat)[0] /
-			(double) pixelCount);
-		
-		newLabels.copyTo(oldLabels);
-				
-		// debugging
-		printf("Current energy = %g (Es %g + Ed %g)\n", (float)mrf->totalEnergy(),
-			(float)mrf->smoothnessEnergy(), (float)mrf->dataEnergy());
-		
-	} while (rootMeanSquareDeviation > CONVERGENCE_FRACTION);
+
+	// perform optimization until the root-mean-square deviation of the binary
+	// labels between two iterations drops to CONVERGENCE_FRACTION, i.e. the
+	// fraction of changed labels to its square; the solver counts the changes
+	// while writing the labeling, so the labels are uploaded only once
+	MRFDriver::Criteria criteria;
+	criteria.maxIterations		= MAX_ITERATIONS;
+	criteria.maxChangedFraction	= CONVERGENCE_FRACTION * CONVERGENCE_FRACTION;
+	MRFDriver driver = MRFDriver(mrf, criteria);
+	driver.run();
+
+	oclMat newLabels = oclMat(depth1.size(), DataType<MRF::Label>::type,
+		mrf->getAnswerPtr());
 
 	delete mrf;
 
@@ -695,6 +1267,53 @@ oclMat CDCDepthEstimator::mrf(const oclMat& depth1, const oclMat& depth2,
 }
 
 
+CDCDepthEstimator::CueCombination CDCDepthEstimator::getCueCombination() const
+{
+	return this->cueCombination;
+}
+
+
+void CDCDepthEstimator::setCueCombination(CueCombination combination)
+{
+	this->cueCombination = combination;
+}
+
+
+size_t CDCDepthEstimator::getMemoryBudget() const
+{
+	return this->memoryBudget;
+}
+
+
+void CDCDepthEstimator::setMemoryBudget(size_t bytes)
+{
+	this->memoryBudget = bytes;
+}
+
+
+size_t CDCDepthEstimator::getScratchAllocationCount() const
+{
+	size_t count = 0;
+	for (size_t i = 0; i < this->workspaces.size(); i++)
+	{
+		count += this->workspaces[i].renderArena.getAllocationCount();
+		count += this->workspaces[i].responseArena.getAllocationCount();
+	}
+
+	return count;
+}
+
+
+void CDCDepthEstimator::resetScratchAllocationCount()
+{
+	for (size_t i = 0; i < this->workspaces.size(); i++)
+	{
+		this->workspaces[i].renderArena.resetAllocationCount();
+		this->workspaces[i].responseArena.resetAllocationCount();
+	}
+}
+
+
 oclMat CDCDepthEstimator::getDepthMap() const
 {
 	return this->depthMap;
@@ -1,8 +1,9 @@
 #pragma once
 
 #include "mrf.h"
-#include "ImageRenderer.h"
+#include "ImageRenderer4.h"
 #include "DepthEstimator.h"
+#include "ScratchArena.h"
 
 /**
  * Implementation of the depth estimation algorithm described by Tao, Hadap,
@@ -23,6 +24,7 @@ class CDCDepthEstimator :
 	static const float LAMBDA_FLAT;
 	static const float LAMBDA_SMOOTH;
 	static const double CONVERGENCE_FRACTION;
+	static const int MAX_ITERATIONS;
 
 	// required for OpenCV's filter2D(), used for averaging over a window
 	static const int DDEPTH;
@@ -37,12 +39,92 @@ class CDCDepthEstimator :
 
 	static const int MAT_TYPE;
 
+	// used for parallel evaluation of the alpha sweep
+	static const int REDUCTION_TILE_HEIGHT;
+
+	// used for tiled evaluation of the alpha sweep
+	static const int MIN_TILE_SIZE;
+	static const int INTERPOLATION_MARGIN;
+	static const size_t SLICE_BYTES_PER_PIXEL;
+	static const size_t WORKER_BYTES_PER_PIXEL;
+	static const size_t STATE_BYTES_PER_PIXEL;
+
 	// used for MRF propagation
-	static vector<MRF::CostVal> dataCost1, dataCost2, fsCost1, fsCost2;
+	static const int LABEL_COUNT;
+	static const float MRF_COST_SCALE;
+
+	// used for the depth labeling MRF
+	static const float LABELING_SMOOTHNESS;
+	static const float LABELING_TRUNCATION;
+	static const int LABELING_MAX_ITERATIONS;
+	static const double LABELING_CONVERGENCE;
+	static const double LABELING_MAX_GAP;
+	static const int LABELING_MIN_BAND_HEIGHT;
 
 	typedef Vec2f fPair;
-	
-	ImageRenderer* renderer;
+
+	// the refocused image and both responses for a single alpha value
+	struct DepthSlice
+	{
+		int index;
+		float alpha;
+		double imageMaximum;	// of the whole refocused image, 0 if unknown
+		Mat refocusedImage;
+		Mat defocusResponse;
+		Mat correspondenceResponse;
+	};
+
+	// per-pixel top-2 extrema of both responses, collected over all slices
+	struct SweepState
+	{
+		Mat maxDefocusResponse, max2;
+		Mat minCorrespondenceResponse, min2;
+		Mat defocusAlpha, correspondenceAlpha;
+		Mat dEDOF, cEDOF;
+
+		// responses of all slices, only collected for depth labeling;
+		// slice l of pixel p is stored at [p * sliceCount + l]
+		Mat defocusVolume, correspondenceVolume;
+	};
+
+	// renderer, filters and buffers of one slice of a batch, reused for the
+	// slices at the same position of all batches
+	struct SliceWorkspace
+	{
+		ImageRenderer4 renderer;
+		ScratchArena renderArena;
+		ScratchArena responseArena;
+		vector<oclMat> channels;
+		Ptr<FilterEngine_GPU> secondDerivativeX, secondDerivativeY;
+		Ptr<FilterEngine_GPU> defocusWindow, correspondenceWindow;
+	};
+
+	// batch evaluators and the parallel loop body of the reduction, defined
+	// in CDCDepthEstimator.cpp
+	class SliceEvaluator;
+	class SliceReducer;
+	class MaximumEvaluator;
+
+public:
+	// ways of combining both cues in the global optimization stage
+	enum CueCombination
+	{
+		CUE_SELECTION,			// pick the defocus or correspondence cue per pixel
+		DEPTH_LABELING_TRWS,	// label each pixel with an alpha value, TRW-S
+		DEPTH_LABELING_BPS,		// label each pixel with an alpha value, BP-S
+		DEPTH_LABELING_HBP		// label each pixel with an alpha value, hierarchical BP (slower than BP-S on one core)
+	};
+
+private:
+	CueCombination cueCombination;
+	size_t memoryBudget;
+	vector<SliceWorkspace> workspaces;
+
+	// cost arrays referenced by the MRF, cost[p * LABEL_COUNT + l] and
+	// V[l1 * LABEL_COUNT + l2]; owned per instance, so that several
+	// estimators can run concurrently
+	vector<MRF::CostVal> dataCostVolume;
+	vector<MRF::CostVal> smoothnessCostTable;
 
 	Size imageSize;
 	Vec2f angularCorrection;
@@ -53,18 +135,34 @@ class CDCDepthEstimator :
 	oclMat confidenceMap;
 	oclMat extendedDepthOfFieldImage;
 
-	oclMat calculateDefocusResponse(const LightFieldPicture& lightfield,
-		const oclMat& refocusedImage, const float alpha);
-	oclMat calculateCorrespondenceResponse(const LightFieldPicture& lightfield,
-		const oclMat& refocusedImage, const float alpha);
+	void initializeSweepState(SweepState& state, const int sliceCount) const;
+	int calculateHalo(const LightFieldPicture& lightfield,
+		const vector<float>& alphas) const;
+	int calculateTileSize(const LightFieldPicture& lightfield,
+		const int sliceCount, const int halo) const;
+	void measureImageMaxima(const LightFieldPicture& lightfield,
+		const vector<float>& alphas, const vector<Rect>& regions,
+		const vector<Rect>& tiles, vector<double>& imageMaxima);
+	void sweep(const LightFieldPicture& region, const vector<float>& alphas,
+		const Point& regionOrigin, const Rect& target,
+		const vector<double>& imageMaxima, SweepState& state);
+	int prepareWorkspaces(const LightFieldPicture& region,
+		const int sliceCount);
+	void initializeWorkspace(SliceWorkspace& workspace) const;
+	void calculateDefocusResponse(const LightFieldPicture& lightfield,
+		const oclMat& refocusedImage, const float alpha,
+		SliceWorkspace& workspace, oclMat& response) const;
+	void calculateCorrespondenceResponse(const LightFieldPicture& lightfield,
+		const oclMat& refocusedImage, const float alpha,
+		SliceWorkspace& workspace, oclMat& response) const;
 	void normalizeConfidence(oclMat& confidence1, oclMat& confidence2);
 	oclMat mrf(const oclMat& depth1, const oclMat& depth2,
 		const oclMat& confidence1, const oclMat& confidence2);
 	oclMat pickLabelWithMaxConfidence(const oclMat& confidence1,
 		const oclMat& confidence2) const;
-
-	static MRF::CostVal dataCost(int pix, MRF::Label i);
-	static MRF::CostVal fnCost(int pix1, int pix2, MRF::Label i, MRF::Label j);
+	void labelDepth(const vector<float>& alphas, const Mat& defocusConfidence,
+		const Mat& correspondenceConfidence, SweepState& state, Mat& alphaMap,
+		Mat& confidenceMap, Mat& extendedDepthOfFieldImage) const;
 
 public:
 	static const int DEPTH_RESOLUTION;
@@ -75,6 +173,24 @@ public:
 
 	oclMat estimateDepth(const LightFieldPicture& lightfield);
 
+	CueCombination getCueCombination() const;
+	void setCueCombination(CueCombination combination);
+
+	// the alpha sweep renders and evaluates tiles of the image (plus a halo)
+	// small enough for the budget; a budget of 0 bytes disables the tiles.
+	// Tiling does not come for free: a refocused image is normalized by its
+	// maximum over all tiles, so every tile is rendered twice (once to find
+	// the maxima, once for the responses). Only the sweep's temporaries are
+	// bounded, its result and, for depth labeling, both response volumes of
+	// width x height x slices floats always cover the whole image.
+	size_t getMemoryBudget() const;
+	void setMemoryBudget(size_t bytes);
+
+	// number of buffer (re)allocations of the alpha sweep's workspaces, which
+	// stops growing once all workspaces have evaluated their first slice
+	size_t getScratchAllocationCount() const;
+	void resetScratchAllocationCount();
+
 	// accessors for results
 	oclMat getDepthMap() const;
 	oclMat getConfidenceMap() const;
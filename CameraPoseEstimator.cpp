@@ -9,3 +9,15 @@ CameraPoseEstimator::CameraPoseEstimator(void)
 CameraPoseEstimator::~CameraPoseEstimator(void)
 {
 }
+
+
+void CameraPoseEstimator::estimateCameraPoses(const vector<Mat>& images,
+	const Mat& calibrationMatrix)
+{
+	beginSequence(calibrationMatrix);
+	for (int i = 0; i < images.size(); i++)
+		addImage(images.at(i));
+
+	assert (rotations.size() == images.size());
+	assert (translations.size() == images.size());
+}
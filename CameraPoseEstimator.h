@@ -28,7 +28,14 @@ public:
 	CameraPoseEstimator(void);
 	~CameraPoseEstimator(void);
 
+	// estimates the poses of all images at once, using the incremental
+	// interface by default
 	virtual void estimateCameraPoses(const vector<Mat>& images,
-		const Mat& calibrationMatrix) =0;
+		const Mat& calibrationMatrix);
+
+	// incremental interface: clears the poses, then each added image appends
+	// its pose to rotations and translations
+	virtual void beginSequence(const Mat& calibrationMatrix) =0;
+	virtual void addImage(const Mat& image) =0;
 };
 
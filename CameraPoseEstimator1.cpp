@@ -8,102 +8,186 @@
 
 using namespace ocl;
 
-const double CameraPoseEstimator1::ZERO_THRESHOLD = 0.01;
-const Mat CameraPoseEstimator1::TEST_POINTS = (Mat_<double>(4, 13) <<
-	0,	0,	0,	0,	0,	0,	0,	0,		0,		0,		0,		0,		0,
-	0,	0,	0,	0,	0,	0,	0,	0,		0,		0,		0,		0,		0,
-	1,	2,	4,	8,	16,	32,	64,	128,	256,	512,	1024,-	2048,	4096,
-	1,	1,	1,	1,	1,	1,	1,	1,		1,		1,		1,		1,		1);
+/**
+ * Estimates the relative poses of consecutive images, one pair per iteration.
+ */
+class CameraPoseEstimator1::PairEstimator : public ParallelLoopBody
+{
+	const CameraPoseEstimator1& estimator;
+	const vector<const FeatureCache::Features*>& features;
+	const vector<BinaryIndex>& indices;
+	vector<Mat>& rotations;
+	vector<Mat>& translations;
+
+public:
+	PairEstimator(const CameraPoseEstimator1& estimator,
+		const vector<const FeatureCache::Features*>& features,
+		const vector<BinaryIndex>& indices, vector<Mat>& rotations,
+		vector<Mat>& translations) :
+		estimator(estimator), features(features), indices(indices),
+		rotations(rotations), translations(translations)
+	{
+	}
 
-const Mat CameraPoseEstimator1::R90 = (Mat_<double>(3, 3) <<
-	0,	-1,	0,
-	1,	0,	0,
-	0,	0,	1);
+	void operator()(const Range& range) const
+	{
+		for (int i = range.start; i < range.end; i++)
+			estimator.estimateRelativePose(*features.at(i), indices.at(i),
+				*features.at(i + 1), indices.at(i + 1), rotations.at(i),
+				translations.at(i));
+	}
+};
 
 
 CameraPoseEstimator1::CameraPoseEstimator1(void)
 {
-	const bool doCrossCheck = false;
-	
-	Feature2D* detectorAndExtractor = new ORB();
-	this->detector = detectorAndExtractor;
-	this->extractor = detectorAndExtractor;
-	this->matcher = new BFMatcher(NORM_HAMMING, doCrossCheck);
-	//this->matcher = new ocl::BruteForceMatcher_OCL_base(
-	//	ocl::BruteForceMatcher_OCL_base::HammingDist);	// no cross-checking
+	this->featureCache = new FeatureCache();
+	this->ownsFeatureCache = true;
 }
 
 
 CameraPoseEstimator1::~CameraPoseEstimator1(void)
 {
-	delete this->detector;
-	delete this->extractor;
-	delete this->matcher;
+	if (this->ownsFeatureCache)
+		delete this->featureCache;
 }
 
 
+/**
+ * Extracts the features of all images and estimates the poses of all pairs of
+ * consecutive images in parallel before combining them.
+ */
 void CameraPoseEstimator1::estimateCameraPoses(const vector<Mat>& images,
 	const Mat& calibrationMatrix)
 {
-	//cout << "CameraPoseEstimator1::estimateCameraPoses(): start" << endl;
+	const int imageCount = images.size();
+	beginSequence(calibrationMatrix);
+	if (imageCount == 0)
+		return;
+
+	// 1) detect features and index their descriptors
+	this->featureCache->extractFeatures(images);
+	vector<const FeatureCache::Features*> features =
+		vector<const FeatureCache::Features*>(imageCount);
+	vector<BinaryIndex> indices = vector<BinaryIndex>(imageCount);
+	for (int i = 0; i < imageCount; i++)
+	{
+		features.at(i) = &this->featureCache->getFeatures(images.at(i));
+		indices.at(i).build(features.at(i)->descriptors);
+	}
 
+	// 2) estimate the relative poses
+	vector<Mat> relativeRotations = vector<Mat>(imageCount - 1);
+	vector<Mat> relativeTranslations = vector<Mat>(imageCount - 1);
+	parallel_for_(Range(0, imageCount - 1), PairEstimator(*this, features,
+		indices, relativeRotations, relativeTranslations));
+
+	// 3) combine them, the first image defines the coordinate system
+	rotations.push_back(totalRotation.clone());
+	translations.push_back(totalTranslation.clone());
+	for (int i = 0; i < imageCount - 1; i++)
+		appendPose(relativeRotations.at(i), relativeTranslations.at(i));
+
+	// continue the sequence from the last image
+	this->previousFeatures = *features.back();
+	this->previousIndex.swap(indices.back());
+}
+
+
+void CameraPoseEstimator1::beginSequence(const Mat& calibrationMatrix)
+{
 	// initialize result vectors
 	this->rotations		= vector<rotationType>();
 	this->translations	= vector<translationType>();
 
-	const int imageCount = images.size();
-	vector<vector<KeyPoint>> keyPoints;//	= vector<vector<KeyPoint>>(imageCount);
-	vector<Mat> descriptors				= vector<Mat>(imageCount);
+	this->calibrationMatrix = Matx33d(calibrationMatrix);
+	this->previousFeatures = FeatureCache::Features();
+	this->previousIndex.build(Mat());
+	this->totalRotation = Mat::eye(3, 3, CV_64FC1);
+	this->totalTranslation = Mat(3, 1, CV_64FC1, Scalar(0));
+}
+
+
+/**
+ * Appends the pose of the image, which is relative to the previous one and
+ * combined with its pose. Only the features of the previous image are kept.
+ */
+void CameraPoseEstimator1::addImage(const Mat& image)
+{
+	// detect features and extract descriptors (or take them from the cache)
+	const FeatureCache::Features& features =
+		this->featureCache->getFeatures(image);
+	this->currentIndex.build(features.descriptors);
 
-	// 1) detect features and extract descriptors
-	// ORB-specific image conversion
-	vector<Mat> bwImages = vector<Mat>(images.size());
-	for (int i = 0; i < images.size(); i++)
+	// the first image defines the coordinate system
+	if (rotations.empty())
 	{
-		cvtColor(images.at(i), bwImages.at(i), CV_RGB2GRAY);
-		bwImages.at(i).convertTo(bwImages.at(i), CV_8UC1, 255);
+		rotations.push_back(totalRotation.clone());
+		translations.push_back(totalTranslation.clone());
+	}
+	else
+	{
+		Mat rotation, translation;
+		estimateRelativePose(this->previousFeatures, this->previousIndex,
+			features, this->currentIndex, rotation, translation);
+		appendPose(rotation, translation);
 	}
-	this->detector->detect(bwImages, keyPoints);
-	this->extractor->compute(bwImages, keyPoints, descriptors);
-	
-	/*
-	vector<oclMat> oclDescriptors = vector<oclMat>(descriptors.size());
-	for (int i = 0; i < descriptors.size(); i++)
-		oclDescriptors.at(i) = oclMat(descriptors.at(i));
-	*/
 
-	// 2) match features
-	vector<DMatch> matches = vector<DMatch>();
+	this->previousFeatures = features;
+	this->previousIndex.swap(this->currentIndex);
+}
+
+
+void CameraPoseEstimator1::appendPose(const Mat& rotation,
+	const Mat& translation)
+{
+	// combine rotations and translations to form R and t to the first camera
+	totalTranslation += totalRotation * translation;
+	totalRotation *= rotation;	// the order is important
+
+	rotations.push_back(totalRotation.clone());
+	translations.push_back(totalTranslation.clone());
+}
+
+
+/**
+ * Matches the features of the images, cross-checked and ratio-tested, and
+ * relaxes the tests if fewer than 8 matches remain. Each index is queried
+ * with the other image's descriptors.
+ */
+void CameraPoseEstimator1::matchFeatures(const Mat& descriptors1,
+	const BinaryIndex& index1, const Mat& descriptors2,
+	const BinaryIndex& index2, vector<DMatch>& matches) const
+{
 	vector<vector<DMatch>> matches12, matches21;
 	vector<DMatch> knn1, knn2;
 	DMatch match12, match21;
-	vector<Point2f> points1, points2;
-	int pointCount, queryIndex, trainIndex, validPointCount, bestPointCount;
-	Mat F, w, u, vt, t1, t2, currentR, currentT, bestR, bestT, Rt,
-		resultPoints;
-	vector<Mat> R12 = vector<Mat>();
-	vector<Mat> t12 = vector<Mat>();
-	rotationType totalRotation = Mat::eye(3, 3, CV_64FC1);
-	translationType totalTranslation = Mat(3, 1, CV_64FC1, Scalar(0));
-	rotations.push_back(totalRotation.clone());
-	translations.push_back(totalTranslation.clone());
-	int imgIdx1, imgIdx2, matchIndex;
+	int matchIndex;
 	const float distanceThreshold = 0.75;			//TODO constant
-	for (imgIdx1 = 0, imgIdx2 = 1; imgIdx1 < images.size() - 1;
-		imgIdx1++, imgIdx2++)
+
+	// match
+	index2.knnMatch(descriptors1, matches12, 2);
+	index1.knnMatch(descriptors2, matches21, 2);
+
+	// cross-check and symmetric ratio test
+	matches.clear();
+	for (matchIndex = 0; matchIndex < matches12.size(); matchIndex++)
+	{
+		knn1 = matches12.at(matchIndex);
+		match12 = knn1.at(0);
+		knn2 = matches21.at(match12.trainIdx);
+		match21 = knn2.at(0);
+		
+		if (match21.trainIdx == match12.queryIdx
+			&& knn1.at(0).distance / knn1.at(1).distance < distanceThreshold
+			&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
+		)
+
+		matches.push_back(match12);
+	}
+
+	if (matches.size() < 8)
 	{
-		// match
-		matcher->knnMatch(descriptors.at(imgIdx1), descriptors.at(imgIdx2),
-			matches12, 2);
-		matcher->knnMatch(descriptors.at(imgIdx2), descriptors.at(imgIdx1),
-			matches21, 2);
-		/*
-		matcher->knnMatch(oclDescriptors.at(imgIdx1), oclDescriptors.at(imgIdx2),
-			matches12, 2);
-		matcher->knnMatch(oclDescriptors.at(imgIdx2), oclDescriptors.at(imgIdx1),
-			matches21, 2);
-		*/
-		// cross-check and symmetric ratio test
 		matches.clear();
 		for (matchIndex = 0; matchIndex < matches12.size(); matchIndex++)
 		{
@@ -111,139 +195,95 @@ void CameraPoseEstimator1::estimateCameraPoses(const vector<Mat>& images,
 			match12 = knn1.at(0);
 			knn2 = matches21.at(match12.trainIdx);
 			match21 = knn2.at(0);
-			
+		
 			if (match21.trainIdx == match12.queryIdx
 				&& knn1.at(0).distance / knn1.at(1).distance < distanceThreshold
-				&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
+				//&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
 			)
 
-			matches.push_back(match12);
+				matches.push_back(match12);
 		}
-
-		if (matches.size() < 8)
+	}
+	
+	if (matches.size() < 8)
+	{
+		matches.clear();
+		for (matchIndex = 0; matchIndex < matches12.size(); matchIndex++)
 		{
-			matches.clear();
-			for (matchIndex = 0; matchIndex < matches12.size(); matchIndex++)
-			{
-				knn1 = matches12.at(matchIndex);
-				match12 = knn1.at(0);
-				knn2 = matches21.at(match12.trainIdx);
-				match21 = knn2.at(0);
-			
-				if (match21.trainIdx == match12.queryIdx
-					&& knn1.at(0).distance / knn1.at(1).distance < distanceThreshold
-					//&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
-				)
-
-					matches.push_back(match12);
-			}
-		}
+			knn1 = matches12.at(matchIndex);
+			match12 = knn1.at(0);
+			knn2 = matches21.at(match12.trainIdx);
+			match21 = knn2.at(0);
 		
-		if (matches.size() < 8)
-		{
-			matches.clear();
-			for (matchIndex = 0; matchIndex < matches12.size(); matchIndex++)
-			{
-				knn1 = matches12.at(matchIndex);
-				match12 = knn1.at(0);
-				knn2 = matches21.at(match12.trainIdx);
-				match21 = knn2.at(0);
-			
-				if (match21.trainIdx == match12.queryIdx
-					//&& knn1.at(0).distance / knn1.at(1).distance < distanceThreshold
-					//&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
-				)
-
-					matches.push_back(match12);
-			}
-		}
+			if (match21.trainIdx == match12.queryIdx
+				//&& knn1.at(0).distance / knn1.at(1).distance < distanceThreshold
+				//&& knn2.at(0).distance / knn2.at(1).distance < distanceThreshold
+			)
 
-		/*
-		// debugging - render matches
-		Mat matchImg;
-		drawMatches(images.at(imgIdx1), keyPoints.at(imgIdx1),
-			images.at(imgIdx2), keyPoints.at(imgIdx2), matches, matchImg);
-		string window0 = "matches " + to_string((long double) imgIdx1);
-		namedWindow(window0, WINDOW_AUTOSIZE);// Create a window for display. (scale down size)
-		imshow(window0, matchImg);
+				matches.push_back(match12);
+		}
+	}
 
-		waitKey(0);
-		*/
+	/*
+	// debugging - render matches
+	Mat matchImg;
+	drawMatches(images.at(imgIdx1), keyPoints.at(imgIdx1),
+		images.at(imgIdx2), keyPoints.at(imgIdx2), matches, matchImg);
+	string window0 = "matches " + to_string((long double) imgIdx1);
+	namedWindow(window0, WINDOW_AUTOSIZE);// Create a window for display. (scale down size)
+	imshow(window0, matchImg);
+
+	waitKey(0);
+	*/
+}
 
-		assert (matches.size() >= 8);
 
-		// compute fundamental matrix
-		const int FUNDAMENTAL_MATRIX_METHOD = CV_FM_RANSAC;
+/**
+ * Estimates rotation and translation of the second image relative to the
+ * first one from their matched features.
+ */
+void CameraPoseEstimator1::estimateRelativePose(
+	const FeatureCache::Features& features1, const BinaryIndex& index1,
+	const FeatureCache::Features& features2, const BinaryIndex& index2,
+	Mat& rotation, Mat& translation) const
+{
+	// 1) match features
+	vector<DMatch> matches = vector<DMatch>();
+	matchFeatures(features1.descriptors, index1, features2.descriptors, index2,
+		matches);
+	assert (matches.size() >= 8);
+
+	// 2) estimate the pose, PROSAC tries the closest matches first
+	sort(matches.begin(), matches.end());
+	const int pointCount = matches.size();
+	vector<Point2f> points1 = vector<Point2f>(pointCount);
+	vector<Point2f> points2 = vector<Point2f>(pointCount);
+	for (int j = 0; j < pointCount; j++)
+	{
+		points1[j] = features1.keyPoints.at(matches.at(j).queryIdx).pt;
+		points2[j] = features2.keyPoints.at(matches.at(j).trainIdx).pt;
+	}
 
-		// initialize the points here ...
-		pointCount = matches.size();
-		points1 = vector<Point2f>(pointCount);
-		points2 = vector<Point2f>(pointCount);
-		for( int j = 0; j < pointCount; j++ )
-		{
-			queryIndex = matches.at(j).queryIdx;
-			trainIndex = matches.at(j).trainIdx;
-			points1[j] = keyPoints.at(imgIdx1).at(queryIndex).pt;
-			points2[j] = keyPoints.at(imgIdx2).at(trainIndex).pt;
-		}
-		F = findFundamentalMat(points1, points2, FUNDAMENTAL_MATRIX_METHOD);
-
-		// decompose fundamental matrix into rotation and translation
-		SVD::compute(F, w, u, vt);
-
-		t12.clear(); t12.push_back(u.col(2)); t12.push_back(-u.col(2));
-
-		R12.clear();
-		Mat RCandidate = u * R90.t() * vt;
-		if (abs(determinant(RCandidate) - 1.) < ZERO_THRESHOLD)
-			R12.push_back(RCandidate);
-		RCandidate = u * R90 * vt;
-		if (abs(determinant(RCandidate) - 1.) < ZERO_THRESHOLD)
-			R12.push_back(RCandidate);
-		RCandidate = -u * R90.t() * vt;
-		if (abs(determinant(RCandidate) - 1.) < ZERO_THRESHOLD)
-			R12.push_back(RCandidate);
-		RCandidate = -u * R90 * vt;
-		if (abs(determinant(RCandidate) - 1.) < ZERO_THRESHOLD)
-			R12.push_back(RCandidate);
-
-		assert (R12.size() == 2);
-
-		// pick the one valid combination of R and t
-		bestPointCount = -1;
-		for (int rI = 0; rI < 2; rI++)
-		for (int tI = 0; tI < 2; tI++)
-		{
-			currentR = R12.at(rI);	currentT = t12.at(tI);
-			hconcat(currentR, currentT, Rt);
-			resultPoints = Rt * TEST_POINTS;
-
-			resultPoints.convertTo(resultPoints, CV_32FC1);
-			threshold(resultPoints.row(2), resultPoints, ZERO_THRESHOLD, 1.0,
-				THRESH_BINARY);
-			validPointCount = countNonZero(resultPoints);
-			if (validPointCount > bestPointCount)
-			{
-				bestPointCount = validPointCount;
-				bestR = currentR;
-				bestT = currentT;
-			}
-		}
-		assert (bestPointCount > 0);
+	Matx33d R;
+	Vec3d t;
+	vector<uchar> inlierMask;
+	const int inlierCount = poseSolver.solvePose(points1, points2,
+		calibrationMatrix, R, t, inlierMask);
+	assert (inlierCount > 0);
 
-		printf("CameraPoseEstimator1: %i points in view for pose %i\n",
-			validPointCount, imgIdx1);
+	printf("CameraPoseEstimator1: %i inliers of %i matches\n", inlierCount,
+		pointCount);
 
-		// combine rotations and translations to form R and t to the first camera
-		totalTranslation += totalRotation * bestT;
-		totalRotation *= bestR;	// the order is important
+	rotation = Mat(R);
+	translation = Mat(t);
+}
 
-		rotations.push_back(totalRotation.clone());
-		translations.push_back(totalTranslation.clone());
-	}
 
-	assert (rotations.size() == images.size());
-	assert (translations.size() == images.size());
+void CameraPoseEstimator1::setFeatureCache(FeatureCache* cache)
+{
+	if (this->ownsFeatureCache)
+		delete this->featureCache;
 
-	//cout << "CameraPoseEstimator1::estimateCameraPoses(): end" << endl;
+	this->featureCache = cache;
+	this->ownsFeatureCache = false;
 }
@@ -2,6 +2,9 @@
 
 #include <opencv2\ocl\ocl.hpp>
 #include "CameraPoseEstimator.h"
+#include "FeatureCache.h"
+#include "BinaryIndex.h"
+#include "PoseSolver.h"
 
 /**
  * An implementation of camera pose estimation.
@@ -13,14 +16,29 @@
 class CameraPoseEstimator1 :
 	public CameraPoseEstimator
 {
-	static const double ZERO_THRESHOLD;
-	static const Mat TEST_POINTS;
-	static const Mat R90;
+	class PairEstimator;
 
-	FeatureDetector* detector;
-	DescriptorExtractor* extractor;
-	DescriptorMatcher* matcher;
-	//ocl::BruteForceMatcher_OCL_base* matcher;
+	Matx33d calibrationMatrix;
+	PoseSolver poseSolver;
+
+	FeatureCache* featureCache;
+	bool ownsFeatureCache;
+	// descriptor indices of the previous and the current image, each built once
+	BinaryIndex previousIndex;
+	BinaryIndex currentIndex;
+
+	// features of the last added image and pose relative to the first one
+	FeatureCache::Features previousFeatures;
+	rotationType totalRotation;
+	translationType totalTranslation;
+
+	void matchFeatures(const Mat& descriptors1, const BinaryIndex& index1,
+		const Mat& descriptors2, const BinaryIndex& index2,
+		vector<DMatch>& matches) const;
+	void estimateRelativePose(const FeatureCache::Features& features1,
+		const BinaryIndex& index1, const FeatureCache::Features& features2,
+		const BinaryIndex& index2, Mat& rotation, Mat& translation) const;
+	void appendPose(const Mat& rotation, const Mat& translation);
 
 public:
 	CameraPoseEstimator1(void);
@@ -28,5 +46,11 @@ public:
 
 	void estimateCameraPoses(const vector<Mat>& images,
 		const Mat& calibrationMatrix);
+	void beginSequence(const Mat& calibrationMatrix);
+	void addImage(const Mat& image);
+
+	// features are taken from this cache, which may be shared with other
+	// stages and is not deleted by the estimator (by default, it has its own)
+	void setFeatureCache(FeatureCache* cache);
 };
 
@@ -0,0 +1,382 @@
+#include <iostream>
+#include <opencv2/calib3d/calib3d.hpp>
+#include "CameraPoseEstimator2.h"
+
+const int CameraPoseEstimator2::RETRIEVAL_COUNT			= 3;
+const int CameraPoseEstimator2::TRAINING_IMAGE_COUNT		= 10;
+const int CameraPoseEstimator2::MIN_MATCH_COUNT				= 8;
+const float CameraPoseEstimator2::MAX_DISTANCE_RATIO		= 0.75f;
+const double CameraPoseEstimator2::MIN_TRIANGULATION_ANGLE	= 1.0;	// degrees
+const int CameraPoseEstimator2::LOCAL_ADJUSTMENT_WINDOW		= 5;
+const int CameraPoseEstimator2::GLOBAL_ADJUSTMENT_INTERVAL	= 10;
+
+
+CameraPoseEstimator2::CameraPoseEstimator2(void)
+{
+	this->featureCache = new FeatureCache();
+	this->ownsFeatureCache = true;
+	this->vocabularyImageCount = 0;
+}
+
+
+CameraPoseEstimator2::~CameraPoseEstimator2(void)
+{
+	if (this->ownsFeatureCache)
+		delete this->featureCache;
+}
+
+
+/**
+ * Extracts the features of all images in parallel and trains the vocabulary
+ * with all of them before adding the images one after another. Finally, all
+ * poses and points are refined together.
+ */
+void CameraPoseEstimator2::estimateCameraPoses(const vector<Mat>& images,
+	const Mat& calibrationMatrix)
+{
+	this->featureCache->extractFeatures(images);
+	beginSequence(calibrationMatrix);
+
+	vector<Mat> descriptors = vector<Mat>(images.size());
+	for (int i = 0; i < images.size(); i++)
+		descriptors[i] = this->featureCache->getFeatures(images[i]).descriptors;
+	if (!images.empty())
+		trainVocabulary(descriptors);
+
+	for (int i = 0; i < images.size(); i++)
+		addImage(images[i]);
+
+	// unless the last image triggered it anyway
+	if (images.size() > 1 && (images.size() - 1) % GLOBAL_ADJUSTMENT_INTERVAL)
+		refinePoses(true);
+}
+
+
+void CameraPoseEstimator2::beginSequence(const Mat& calibrationMatrix)
+{
+	// initialize result vectors
+	this->rotations		= vector<rotationType>();
+	this->translations	= vector<translationType>();
+
+	this->calibrationMatrix = Matx33d(calibrationMatrix);
+	this->adjuster.clear();
+	this->adjuster.setCalibrationMatrix(this->calibrationMatrix);
+	this->features.clear();
+	this->indices.clear();
+	this->tracks.clear();
+	this->vocabularyImageCount = 0;
+}
+
+
+/**
+ * Adds the image to the bundle adjustment problem and refines the poses of
+ * the most recent images, or periodically of all images.
+ */
+void CameraPoseEstimator2::addImage(const Mat& image)
+{
+	const int current = this->features.size();
+	this->features.push_back(this->featureCache->getFeatures(image));
+	this->indices.push_back(BinaryIndex());
+	this->indices.back().build(this->features.back().descriptors);
+	this->tracks.push_back(vector<int>(this->features.back().keyPoints.size(), -1));
+	const vector<KeyPoint>& keyPoints = this->features.back().keyPoints;
+
+	// 1) choose the images to match with: the predecessor and the previous
+	// images most similar to this one. Unless estimateCameraPoses() trained
+	// the vocabulary with the whole sequence, it is retrained with the images
+	// so far until there are TRAINING_IMAGE_COUNT of them.
+	if (this->vocabularyImageCount < min(current + 1, TRAINING_IMAGE_COUNT)
+		&& !this->features.back().descriptors.empty())
+	{
+		vector<Mat> descriptors = vector<Mat>(current + 1);
+		for (int i = 0; i <= current; i++)
+			descriptors[i] = this->features[i].descriptors;
+		trainVocabulary(descriptors);
+	}
+
+	vector<VocabularyTree::Result> similarImages;
+	if (this->vocabulary.isTrained())
+	{
+		for (int i = this->vocabulary.getImageCount(); i < current; i++)
+			this->vocabulary.addImage(this->features[i].descriptors);
+		this->vocabulary.query(this->features.back().descriptors,
+			RETRIEVAL_COUNT, similarImages);
+		this->vocabulary.addImage(this->features.back().descriptors);
+	}
+
+	// the first image defines the coordinate system
+	if (current == 0)
+	{
+		this->adjuster.addCamera(Matx33d::eye(), Vec3d(0, 0, 0), true);
+		updatePoses();
+		return;
+	}
+
+	vector<int> candidates = vector<int>(1, current - 1);
+	for (int i = 0; i < similarImages.size(); i++)
+		if (similarImages[i].image != current - 1)
+			candidates.push_back(similarImages[i].image);
+
+	// 2) match with the candidates, keeping the matches which agree with the
+	// epipolar geometry of the pair
+	vector<vector<DMatch>> inlierMatches = vector<vector<DMatch>>(current);
+	int reference = -1;
+	Matx33d relativeRotation = Matx33d::eye();
+	Vec3d relativeTranslation = Vec3d(0, 0, 0);
+	for (int c = 0; c < candidates.size(); c++)
+	{
+		const int previous = candidates[c];
+		vector<DMatch> matches;
+		matchFeatures(previous, current, matches);
+		if (matches.size() < MIN_MATCH_COUNT)
+			continue;
+
+		// PROSAC tries the closest matches first
+		sort(matches.begin(), matches.end());
+		const vector<KeyPoint>& previousKeyPoints =
+			this->features.at(previous).keyPoints;
+		vector<Point2f> points1 = vector<Point2f>(matches.size());
+		vector<Point2f> points2 = vector<Point2f>(matches.size());
+		for (int i = 0; i < matches.size(); i++)
+		{
+			points1[i] = previousKeyPoints.at(matches[i].queryIdx).pt;
+			points2[i] = keyPoints.at(matches[i].trainIdx).pt;
+		}
+
+		Matx33d R;
+		Vec3d t;
+		vector<uchar> inlierMask;
+		if (this->poseSolver.solvePose(points1, points2, this->calibrationMatrix,
+			R, t, inlierMask) == 0)
+			continue;
+
+		for (int i = 0; i < matches.size(); i++)
+			if (inlierMask[i])
+				inlierMatches[previous].push_back(matches[i]);
+		if (reference < 0 || inlierMatches[previous].size()
+			> inlierMatches[reference].size())
+		{
+			reference = previous;
+			relativeRotation = R;
+			relativeTranslation = t;
+		}
+	}
+
+	// 3) locate the image by the triangulated points it sees, or by its pose
+	// relative to the candidate with most inliers
+	vector<Point3f> objectPoints;
+	vector<Point2f> imagePoints;
+	vector<bool> used = vector<bool>(keyPoints.size(), false);
+	for (int previous = 0; previous < current; previous++)
+		for (int i = 0; i < inlierMatches[previous].size(); i++)
+		{
+			const DMatch& match = inlierMatches[previous][i];
+			const int point = this->tracks[previous][match.queryIdx];
+			if (point < 0 || used[match.trainIdx])
+				continue;
+
+			const Vec3d X = this->adjuster.getPoint(point);
+			objectPoints.push_back(Point3f((float) X[0], (float) X[1], (float) X[2]));
+			imagePoints.push_back(keyPoints[match.trainIdx].pt);
+			used[match.trainIdx] = true;
+		}
+
+	Matx33d rotation;
+	Vec3d translation;
+	bool located = false;
+	if (objectPoints.size() >= MIN_MATCH_COUNT)
+	{
+		Mat rvec, tvec, R;
+		vector<int> inliers;
+		solvePnPRansac(objectPoints, imagePoints, Mat(this->calibrationMatrix),
+			Mat(), rvec, tvec, false, 100, 8.0, 100, inliers);
+		if (inliers.size() >= MIN_MATCH_COUNT)
+		{
+			Rodrigues(rvec, R);
+			rotation = Matx33d(R);
+			translation = Vec3d(tvec.at<double>(0), tvec.at<double>(1),
+				tvec.at<double>(2));
+			located = true;
+		}
+	}
+
+	if (!located)
+	{
+		// the relative translation has unit length, scale it like the distance
+		// of the reference image to the one added before or after it
+		if (reference < 0)
+			reference = current - 1;
+		const Matx33d referenceRotation = this->adjuster.getRotation(reference);
+		const Vec3d referenceTranslation = this->adjuster.getTranslation(reference);
+		double scale = 1;
+		if (current > 1)
+		{
+			const int neighbour = (reference > 0) ? reference - 1 : 1;
+			scale = norm(referenceRotation.t() * referenceTranslation
+				- this->adjuster.getRotation(neighbour).t()
+				* this->adjuster.getTranslation(neighbour));
+		}
+
+		rotation = relativeRotation * referenceRotation;
+		translation = relativeRotation * referenceTranslation
+			+ relativeTranslation * scale;
+	}
+	this->adjuster.addCamera(rotation, translation);
+
+	// 4) extend the tracks by the matches, triangulating new ones
+	for (int previous = 0; previous < current; previous++)
+	{
+		const vector<KeyPoint>& previousKeyPoints =
+			this->features.at(previous).keyPoints;
+		for (int i = 0; i < inlierMatches[previous].size(); i++)
+		{
+			const DMatch& match = inlierMatches[previous][i];
+			int point = this->tracks[previous][match.queryIdx];
+			if (point < 0)
+			{
+				Vec3d X;
+				if (this->tracks[current][match.trainIdx] >= 0
+					|| !triangulate(previous, previousKeyPoints[match.queryIdx].pt,
+						current, keyPoints[match.trainIdx].pt, X))
+					continue;
+
+				point = this->adjuster.addPoint(X);
+				this->tracks[previous][match.queryIdx] = point;
+				this->adjuster.addObservation(previous, point,
+					previousKeyPoints[match.queryIdx].pt);
+			}
+
+			if (this->tracks[current][match.trainIdx] < 0)
+			{
+				this->tracks[current][match.trainIdx] = point;
+				this->adjuster.addObservation(current, point,
+					keyPoints[match.trainIdx].pt);
+			}
+		}
+	}
+
+	// 5) refine the poses
+	refinePoses(current % GLOBAL_ADJUSTMENT_INTERVAL == 0);
+}
+
+
+/**
+ * Cross-checked matches of the features of the images which pass the ratio
+ * test in both directions.
+ */
+void CameraPoseEstimator2::matchFeatures(int image1, int image2,
+	vector<DMatch>& matches) const
+{
+	vector<vector<DMatch>> matches12, matches21;
+	this->indices.at(image2).knnMatch(this->features.at(image1).descriptors,
+		matches12, 2);
+	this->indices.at(image1).knnMatch(this->features.at(image2).descriptors,
+		matches21, 2);
+
+	matches.clear();
+	for (int i = 0; i < matches12.size(); i++)
+	{
+		const vector<DMatch>& knn1 = matches12[i];
+		if (knn1.size() < 2)
+			continue;
+		const vector<DMatch>& knn2 = matches21.at(knn1[0].trainIdx);
+		if (knn2.size() < 2)
+			continue;
+
+		if (knn2[0].trainIdx == knn1[0].queryIdx
+			&& knn1[0].distance < MAX_DISTANCE_RATIO * knn1[1].distance
+			&& knn2[0].distance < MAX_DISTANCE_RATIO * knn2[1].distance)
+			matches.push_back(knn1[0]);
+	}
+}
+
+
+/**
+ * Midpoint of the closest points of the viewing rays, if they meet in front
+ * of both cameras at a sufficient angle.
+ */
+bool CameraPoseEstimator2::triangulate(int camera1, const Point2f& pixel1,
+	int camera2, const Point2f& pixel2, Vec3d& point) const
+{
+	const Matx33d inverseK = this->calibrationMatrix.inv();
+	const Matx33d R1 = this->adjuster.getRotation(camera1).t();
+	const Matx33d R2 = this->adjuster.getRotation(camera2).t();
+	const Vec3d center1 = -(R1 * this->adjuster.getTranslation(camera1));
+	const Vec3d center2 = -(R2 * this->adjuster.getTranslation(camera2));
+
+	Vec3d direction1 = R1 * (inverseK * Vec3d(pixel1.x, pixel1.y, 1));
+	Vec3d direction2 = R2 * (inverseK * Vec3d(pixel2.x, pixel2.y, 1));
+	direction1 *= 1. / norm(direction1);
+	direction2 *= 1. / norm(direction2);
+
+	// minimize |center1 + s1 * direction1 - center2 - s2 * direction2|
+	const Vec3d w = center1 - center2;
+	const double b = direction1.dot(direction2);
+	const double d = direction1.dot(w);
+	const double e = direction2.dot(w);
+	const double sine = sin(MIN_TRIANGULATION_ANGLE * CV_PI / 180);
+	const double denominator = 1 - b * b;
+	if (denominator < sine * sine)
+		return false;
+
+	const double s1 = (b * e - d) / denominator;
+	const double s2 = (e - b * d) / denominator;
+	if (s1 <= 0 || s2 <= 0)
+		return false;
+
+	point = (center1 + direction1 * s1 + center2 + direction2 * s2) * 0.5;
+	return true;
+}
+
+
+/**
+ * Trains the vocabulary with the descriptors of a set of images, which
+ * empties its database; addImage() adds the images again.
+ */
+void CameraPoseEstimator2::trainVocabulary(const vector<Mat>& descriptors)
+{
+	this->vocabulary.train(descriptors);
+	this->vocabularyImageCount = descriptors.size();
+}
+
+
+/**
+ * Refines all poses and points, or those of the last LOCAL_ADJUSTMENT_WINDOW
+ * images and the points they see.
+ */
+void CameraPoseEstimator2::refinePoses(bool global)
+{
+	const int cameraCount = this->adjuster.getCameraCount();
+	const int firstCamera = global ? 0 :
+		max(0, cameraCount - LOCAL_ADJUSTMENT_WINDOW);
+
+	const double error = this->adjuster.optimize(firstCamera);
+	cout << "CameraPoseEstimator2::refinePoses(): images " << firstCamera
+		<< " to " << cameraCount - 1 << ", " << this->adjuster.getPointCount()
+		<< " points, reprojection error " << error << " px" << endl;
+
+	updatePoses();
+}
+
+
+void CameraPoseEstimator2::updatePoses()
+{
+	const int cameraCount = this->adjuster.getCameraCount();
+	this->rotations.resize(cameraCount);
+	this->translations.resize(cameraCount);
+	for (int i = 0; i < cameraCount; i++)
+	{
+		this->rotations[i] = Mat(this->adjuster.getRotation(i));
+		this->translations[i] = Mat(this->adjuster.getTranslation(i));
+	}
+}
+
+
+void CameraPoseEstimator2::setFeatureCache(FeatureCache* cache)
+{
+	if (this->ownsFeatureCache)
+		delete this->featureCache;
+
+	this->featureCache = cache;
+	this->ownsFeatureCache = false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <deque>
+#include "CameraPoseEstimator.h"
+#include "FeatureCache.h"
+#include "BinaryIndex.h"
+#include "VocabularyTree.h"
+#include "PoseSolver.h"
+#include "BundleAdjuster.h"
+
+/**
+ * An implementation of camera pose estimation which refines all poses
+ * globally instead of chaining relative ones.
+ *
+ * Every new image is matched with its predecessor and with the
+ * RETRIEVAL_COUNT previous images which a vocabulary tree finds most similar
+ * to it, so that O(N * RETRIEVAL_COUNT) pairs are matched even for unordered
+ * images. The matches which agree with the epipolar geometry of the pair
+ * extend tracks of features across images. The image is located by
+ * resection from the already triangulated tracks it sees (falling back to
+ * its pose relative to the image it shares most matches with), new tracks
+ * are triangulated, and the poses of the last LOCAL_ADJUSTMENT_WINDOW images
+ * and the points they see are refined by bundle adjustment. Every
+ * GLOBAL_ADJUSTMENT_INTERVAL images (and after estimateCameraPoses()), all
+ * poses and points are refined. Errors therefore do not accumulate from pair
+ * to pair, overlaps of non-adjacent images constrain the poses, and adding an
+ * image does not take time growing with the length of the sequence, apart
+ * from the periodic global refinement.
+ *
+ * The poses map world coordinates (those of the first camera) to camera
+ * coordinates, x = R * X + t.
+ */
+class CameraPoseEstimator2 :
+	public CameraPoseEstimator
+{
+	static const int RETRIEVAL_COUNT;
+	static const int TRAINING_IMAGE_COUNT;
+	static const int MIN_MATCH_COUNT;
+	static const float MAX_DISTANCE_RATIO;
+	static const double MIN_TRIANGULATION_ANGLE;
+	static const int LOCAL_ADJUSTMENT_WINDOW;
+	static const int GLOBAL_ADJUSTMENT_INTERVAL;
+
+	Matx33d calibrationMatrix;
+	PoseSolver poseSolver;
+	BundleAdjuster adjuster;
+	VocabularyTree vocabulary;
+	int vocabularyImageCount;	// number of images it was trained with
+
+	FeatureCache* featureCache;
+	bool ownsFeatureCache;
+
+	// features and descriptor index of every image, and the point (in the
+	// bundle adjuster) each feature belongs to, -1 for none
+	vector<FeatureCache::Features> features;
+	deque<BinaryIndex> indices;
+	vector<vector<int>> tracks;
+
+	void trainVocabulary(const vector<Mat>& descriptors);
+	void matchFeatures(int image1, int image2, vector<DMatch>& matches) const;
+	bool triangulate(int camera1, const Point2f& pixel1, int camera2,
+		const Point2f& pixel2, Vec3d& point) const;
+	void refinePoses(bool global);
+	void updatePoses();
+
+public:
+	CameraPoseEstimator2(void);
+	~CameraPoseEstimator2(void);
+
+	void estimateCameraPoses(const vector<Mat>& images,
+		const Mat& calibrationMatrix);
+	void beginSequence(const Mat& calibrationMatrix);
+	void addImage(const Mat& image);
+
+	// features are taken from this cache, which may be shared with other
+	// stages and is not deleted by the estimator (by default, it has its own)
+	void setFeatureCache(FeatureCache* cache);
+};
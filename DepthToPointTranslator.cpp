@@ -9,3 +9,14 @@ DepthToPointTranslator::DepthToPointTranslator(void)
 DepthToPointTranslator::~DepthToPointTranslator(void)
 {
 }
+
+
+Mat DepthToPointTranslator::translateDepthToPoints(const Mat& depth,
+	const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation)
+	const
+{
+	Mat points;
+	translateDepthToPoints(depth, calibrationMatrix, rotation, translation,
+		points);
+	return points;
+}
@@ -17,8 +17,27 @@ public:
 	DepthToPointTranslator(void);
 	~DepthToPointTranslator(void);
 
-	virtual Mat translateDepthToPoints(const Mat& depth,
-		const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation)
-		const =0;
+	Mat translateDepthToPoints(const Mat& depth, const Mat& calibrationMatrix,
+		const Mat& rotation, const Mat& translation) const;
+
+	// translates every pixel into points, an image-shaped CV_32FC3 Mat which
+	// is only reallocated if its size or type differ
+	virtual void translateDepthToPoints(const Mat& depth,
+		const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation,
+		Mat& points) const =0;
+
+	// translates only the pixels with a finite, positive depth and a
+	// confidence of at least minConfidence into a list of points (Nx1,
+	// CV_32FC3), pixels receives the index y * width + x of the pixel of each
+	// point if not NULL
+	virtual void translateDepthToPointList(const Mat& depth,
+		const Mat& confidence, float minConfidence, const Mat& calibrationMatrix,
+		const Mat& rotation, const Mat& translation, Mat& points,
+		vector<int>* pixels = NULL) const =0;
+
+	// the inverse of translateDepthToPoints(): maps homogeneous 3D points to
+	// homogeneous image coordinates (x, y) and depth
+	virtual Matx44d getProjectionMatrix(const Mat& calibrationMatrix,
+		const Mat& rotation, const Mat& translation) const =0;
 };
 
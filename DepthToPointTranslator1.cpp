@@ -3,6 +3,8 @@
 #include "CDCDepthEstimator.h"
 #include "DepthToPointTranslator1.h"
 
+const float DepthToPointTranslator1::LENS_PITCH	= 1.389859962463379e-005;	// TODO get from LightFieldPicture
+
 
 DepthToPointTranslator1::DepthToPointTranslator1(void)
 {
@@ -14,16 +16,14 @@ DepthToPointTranslator1::~DepthToPointTranslator1(void)
 }
 
 
-Mat DepthToPointTranslator1::translateDepthToPoints(const Mat& depthMap,
-	const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation)
-	const
+Mat DepthToPointTranslator1::getCameraMatrix(const Mat& calibrationMatrix,
+	const Mat& rotation, const Mat& translation) const
 {
-	Mat K44, Rt44, cameraMatrix, roi, points;
+	Mat K44, Rt44;
 	const Mat identityMatrix = Mat::eye(4, 4, CV_64FC1);
 	const Mat zeroRow = identityMatrix.row(3);		// TODO constants
 	const Mat zeroColumn = Mat::zeros(3, 1, CV_64FC1);
 
-	// 1) generate 4x4 camera matrix
 	// combine rotation and translation into a single 4x4 matrix
 	hconcat(rotation, translation, Rt44);
 	vconcat(Rt44, zeroRow, Rt44);
@@ -33,26 +33,205 @@ Mat DepthToPointTranslator1::translateDepthToPoints(const Mat& depthMap,
 	vconcat(K44, zeroRow, K44);
 
 	// P = K[R|t]
-	cameraMatrix = K44 * Rt44;	
+	return K44 * Rt44;
+}
+
+
+/**
+ * Back-projects the rows of a depth map in parallel, either into an image-
+ * shaped point Mat or, given the offsets of the rows in it, into a list of the
+ * points of valid pixels.
+ */
+class DepthToPointTranslator1::BackProjector : public ParallelLoopBody
+{
+	const Mat& depthMap;
+	const Mat& confidenceMap;
+	const float minConfidence;
+	const Matx44f pointMatrix;
+	Mat& points;
+	const vector<int>* rowOffsets;
+	vector<int>* pixels;
+
+public:
+	BackProjector(const Mat& depthMap, const Mat& confidenceMap,
+		float minConfidence, const Matx44f& pointMatrix, Mat& points,
+		const vector<int>* rowOffsets, vector<int>* pixels) :
+		depthMap(depthMap), confidenceMap(confidenceMap),
+		minConfidence(minConfidence), pointMatrix(pointMatrix), points(points),
+		rowOffsets(rowOffsets), pixels(pixels)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const int width = depthMap.cols;
+
+		if (rowOffsets == NULL)
+		{
+			for (int y = range.start; y < range.end; y++)
+				backProjectRow(depthMap.ptr<float>(y), y, width,
+					pointMatrix.val, points.ptr<float>(y));
+			return;
+		}
+
+		// back-project whole rows, then keep the valid pixels
+		vector<Vec3f> row = vector<Vec3f>(width);
+		for (int y = range.start; y < range.end; y++)
+		{
+			const float* depth		= depthMap.ptr<float>(y);
+			const float* confidence	= confidenceMap.ptr<float>(y);
+			backProjectRow(depth, y, width, pointMatrix.val, row[0].val);
+
+			int i = rowOffsets->at(y);
+			for (int x = 0; x < width; x++)
+				if (depth[x] > 0 && !cvIsInf(depth[x]) &&
+					confidence[x] >= minConfidence)
+				{
+					points.at<Vec3f>(i) = row[x];
+					if (pixels != NULL)
+						pixels->at(i) = y * width + x;
+					i++;
+				}
+		}
+	}
+};
+
+
+/**
+ * Computes the points of a row of pixels as pointMatrix * (x, y, depth, 1),
+ * divided by its last component (0 if that is 0). This combines the
+ * inverse pixel pitch, the inverse camera matrix and the flip around the x
+ * axis. Processes four pixels at a time with SSE2.
+ */
+void DepthToPointTranslator1::backProjectRow(const float* depth, int y,
+	int width, const float* m, float* points)
+{
+	// the y terms are the same for the whole row
+	const float bx = m[1] * y + m[3];
+	const float by = m[5] * y + m[7];
+	const float bz = m[9] * y + m[11];
+	const float bw = m[13] * y + m[15];
+
+	int x = 0;
+#if CV_SSE2
+	const __m128 zero	= _mm_setzero_ps();
+	const __m128 one	= _mm_set1_ps(1.f);
+	const __m128 four	= _mm_set1_ps(4.f);
+	__m128 vx = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+
+	for (; x <= width - 4; x += 4, vx = _mm_add_ps(vx, four))
+	{
+		const __m128 d = _mm_loadu_ps(depth + x);
+
+		__m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), vx),
+			_mm_mul_ps(_mm_set1_ps(m[2]), d)), _mm_set1_ps(bx));
+		__m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[4]), vx),
+			_mm_mul_ps(_mm_set1_ps(m[6]), d)), _mm_set1_ps(by));
+		__m128 pz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8]), vx),
+			_mm_mul_ps(_mm_set1_ps(m[10]), d)), _mm_set1_ps(bz));
+		const __m128 pw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[12]), vx),
+			_mm_mul_ps(_mm_set1_ps(m[14]), d)), _mm_set1_ps(bw));
+
+		const __m128 scale = _mm_and_ps(_mm_cmpneq_ps(pw, zero),
+			_mm_div_ps(one, pw));
+		px = _mm_mul_ps(px, scale);
+		py = _mm_mul_ps(py, scale);
+		pz = _mm_mul_ps(pz, scale);
 
-	// 2) reproject image points with depth to 3D space
-	//reprojectImageTo3D(depthMap, points, cameraMatrix.inv());
+		// interleave to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+		const __m128 xy01	= _mm_unpacklo_ps(px, py);
+		const __m128 xy23	= _mm_unpackhi_ps(px, py);
+		const __m128 z0x1	= _mm_shuffle_ps(pz, xy01, _MM_SHUFFLE(2, 2, 0, 0));
+		const __m128 y1z1	= _mm_shuffle_ps(xy01, pz, _MM_SHUFFLE(1, 1, 3, 3));
+		const __m128 z23xy3	= _mm_shuffle_ps(pz, xy23, _MM_SHUFFLE(3, 2, 3, 2));
 
-	const float lensPitch			= 1.389859962463379e-005;	// TODO get from LightFieldPicture
-	const float horizontalDistance	= lensPitch;
-	const float verticalDistance	= lensPitch * cos(M_PI / 6.);
+		float* out = points + 3 * x;
+		_mm_storeu_ps(out, _mm_shuffle_ps(xy01, z0x1, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + 4, _mm_shuffle_ps(y1z1, xy23,
+			_MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(out + 8, _mm_shuffle_ps(z23xy3, z23xy3,
+			_MM_SHUFFLE(1, 3, 2, 0)));
+	}
+#endif
 
-	points = Mat(depthMap.size(), CV_32FC3);
+	for (; x < width; x++)
+	{
+		const float d = depth[x];
+		const float w = m[12] * x + m[14] * d + bw;
+		const float scale = (w != 0) ? 1.f / w : 0.f;
+		points[3 * x]		= (m[0] * x + m[2] * d + bx) * scale;
+		points[3 * x + 1]	= (m[4] * x + m[6] * d + by) * scale;
+		points[3 * x + 2]	= (m[8] * x + m[10] * d + bz) * scale;
+	}
+}
+
+
+void DepthToPointTranslator1::translateDepthToPoints(const Mat& depthMap,
+	const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation,
+	Mat& points) const
+{
+	CV_Assert(depthMap.type() == CV_32FC1);
+
+	// a single pass applies the inverse of the projection, see
+	// getProjectionMatrix()
+	const Matx44f pointMatrix = getProjectionMatrix(calibrationMatrix,
+		rotation, translation).inv();
+
+	points.create(depthMap.size(), CV_32FC3);
+	parallel_for_(Range(0, depthMap.rows), BackProjector(depthMap, Mat(), 0,
+		pointMatrix, points, NULL, NULL));
+}
+
+
+void DepthToPointTranslator1::translateDepthToPointList(const Mat& depthMap,
+	const Mat& confidenceMap, float minConfidence,
+	const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation,
+	Mat& points, vector<int>* pixels) const
+{
+	CV_Assert(depthMap.type() == CV_32FC1 &&
+		confidenceMap.type() == CV_32FC1 &&
+		confidenceMap.size() == depthMap.size());
+
+	const Matx44f pointMatrix = getProjectionMatrix(calibrationMatrix,
+		rotation, translation).inv();
+
+	// 1) count the valid pixels of the rows
+	vector<int> rowOffsets = vector<int>(depthMap.rows);
+	int count = 0;
 	for (int y = 0; y < depthMap.rows; y++)
-	for (int x = 0; x < depthMap.cols; x++)
-		points.at<Vec3f>(y, x) = Vec3f(
-		x * horizontalDistance, y * verticalDistance, depthMap.at<float>(y, x));
+	{
+		const float* depth		= depthMap.ptr<float>(y);
+		const float* confidence	= confidenceMap.ptr<float>(y);
 
-	perspectiveTransform(points, points, cameraMatrix.inv());
+		rowOffsets.at(y) = count;
+		for (int x = 0; x < depthMap.cols; x++)
+			if (depth[x] > 0 && !cvIsInf(depth[x]) &&
+				confidence[x] >= minConfidence)
+				count++;
+	}
+
+	// 2) back-project them
+	points.create(count, 1, CV_32FC3);
+	if (pixels != NULL)
+		pixels->resize(count);
+	parallel_for_(Range(0, depthMap.rows), BackProjector(depthMap,
+		confidenceMap, minConfidence, pointMatrix, points, &rowOffsets,
+		pixels));
+}
 
-	// 3) flip around x axis
-	const Scalar scale = Scalar(1, -1, 1);
-	points = points.mul(scale);
 
-	return points;
+Matx44d DepthToPointTranslator1::getProjectionMatrix(
+	const Mat& calibrationMatrix, const Mat& rotation, const Mat& translation)
+	const
+{
+	// undo the steps of translateDepthToPoints() in reverse order: flip
+	// around the x axis, apply the camera matrix and scale to pixels
+	const Matx44d flip = Matx44d::diag(Matx41d(1, -1, 1, 1));
+	const Matx44d toPixels = Matx44d::diag(Matx41d(
+		1. / (float) LENS_PITCH, 1. / (float) (LENS_PITCH * cos(M_PI / 6.)),
+		1, 1));
+	const Matx44d cameraMatrix = Matx44d(
+		getCameraMatrix(calibrationMatrix, rotation, translation));
+
+	return toPixels * cameraMatrix * flip;
 }
\ No newline at end of file
@@ -13,11 +13,26 @@
 class DepthToPointTranslator1 :
 	public DepthToPointTranslator
 {
+	static const float LENS_PITCH;
+
+	class BackProjector;
+
+	Mat getCameraMatrix(const Mat& calibrationMatrix, const Mat& rotation,
+		const Mat& translation) const;
+	static void backProjectRow(const float* depth, int y, int width,
+		const float* pointMatrix, float* points);
+
 public:
 	DepthToPointTranslator1(void);
 	~DepthToPointTranslator1(void);
 
-	Mat translateDepthToPoints(const Mat& depth, const Mat& calibrationMatrix,
+	using DepthToPointTranslator::translateDepthToPoints;
+	void translateDepthToPoints(const Mat& depth, const Mat& calibrationMatrix,
+		const Mat& rotation, const Mat& translation, Mat& points) const;
+	void translateDepthToPointList(const Mat& depth, const Mat& confidence,
+		float minConfidence, const Mat& calibrationMatrix, const Mat& rotation,
+		const Mat& translation, Mat& points, vector<int>* pixels = NULL) const;
+	Matx44d getProjectionMatrix(const Mat& calibrationMatrix,
 		const Mat& rotation, const Mat& translation) const;
 };
 
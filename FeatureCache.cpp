@@ -0,0 +1,157 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include "FeatureCache.h"
+
+
+/**
+ * Extracts the features of a list of images in parallel, each into its own
+ * entry of the result list.
+ */
+class FeatureCache::Extractor : public ParallelLoopBody
+{
+	const vector<const Mat*>& images;
+	const Settings& settings;
+	vector<Features>& features;
+
+public:
+	Extractor(const vector<const Mat*>& images, const Settings& settings,
+		vector<Features>& features) :
+		images(images), settings(settings), features(features)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		for (int i = range.start; i < range.end; i++)
+			FeatureCache::extractFeatures(*images.at(i), settings,
+				features.at(i));
+	}
+};
+
+
+FeatureCache::FeatureCache(void)
+{
+	// the defaults of ORB
+	this->settings.featureCount		= 500;
+	this->settings.scaleFactor		= 1.2f;
+	this->settings.levelCount		= 8;
+	this->settings.edgeThreshold	= 31;
+	this->settings.patchSize		= 31;
+
+	this->extractionCount = 0;
+}
+
+
+FeatureCache::~FeatureCache(void)
+{
+}
+
+
+/**
+ * FNV-1a hash of the size, type and pixels of the image and of the settings.
+ */
+uint64 FeatureCache::getKey(const Mat& image) const
+{
+	const uint64 prime = 1099511628211ULL;
+	uint64 hash = 14695981039346656037ULL;
+
+	const int header[8] = { image.rows, image.cols, image.type(),
+		settings.featureCount, settings.levelCount, settings.edgeThreshold,
+		settings.patchSize, cvRound(settings.scaleFactor * 1000) };
+	const uchar* bytes = (const uchar*) header;
+	for (int i = 0; i < sizeof(header); i++)
+		hash = (hash ^ bytes[i]) * prime;
+
+	const size_t rowLength = image.cols * image.elemSize();
+	for (int y = 0; y < image.rows; y++)
+	{
+		bytes = image.ptr<uchar>(y);
+		for (size_t i = 0; i < rowLength; i++)
+			hash = (hash ^ bytes[i]) * prime;
+	}
+
+	return hash;
+}
+
+
+void FeatureCache::extractFeatures(const Mat& image, const Settings& settings,
+	Features& features)
+{
+	// ORB-specific image conversion
+	Mat bwImage;
+	cvtColor(image, bwImage, CV_RGB2GRAY);
+	bwImage.convertTo(bwImage, CV_8UC1, 255);
+
+	// an ORB per call, as the threads must not share one
+	ORB orb = ORB(settings.featureCount, settings.scaleFactor,
+		settings.levelCount, settings.edgeThreshold, 0, 2, ORB::HARRIS_SCORE,
+		settings.patchSize);
+	orb.detect(bwImage, features.keyPoints);
+	orb.compute(bwImage, features.keyPoints, features.descriptors);
+}
+
+
+const FeatureCache::Features& FeatureCache::getFeatures(const Mat& image)
+{
+	const uint64 key = getKey(image);
+
+	unordered_map<uint64, Features>::iterator entry = this->entries.find(key);
+	if (entry == this->entries.end())
+	{
+		entry = this->entries.insert(make_pair(key, Features())).first;
+		extractFeatures(image, this->settings, entry->second);
+		this->extractionCount++;
+	}
+
+	return entry->second;
+}
+
+
+void FeatureCache::extractFeatures(const vector<Mat>& images)
+{
+	// 1) find the images which are not cached, each once
+	vector<const Mat*> missingImages;
+	vector<uint64> missingKeys;
+	for (int i = 0; i < images.size(); i++)
+	{
+		const uint64 key = getKey(images.at(i));
+		if (this->entries.count(key) == 0 &&
+			find(missingKeys.begin(), missingKeys.end(), key) == missingKeys.end())
+		{
+			missingImages.push_back(&images.at(i));
+			missingKeys.push_back(key);
+		}
+	}
+
+	// 2) extract their features in parallel
+	vector<Features> features = vector<Features>(missingImages.size());
+	parallel_for_(Range(0, missingImages.size()),
+		Extractor(missingImages, this->settings, features));
+
+	for (int i = 0; i < missingKeys.size(); i++)
+		this->entries[missingKeys.at(i)] = features.at(i);
+	this->extractionCount += missingKeys.size();
+}
+
+
+void FeatureCache::clear()
+{
+	this->entries.clear();
+}
+
+
+size_t FeatureCache::getExtractionCount() const
+{
+	return this->extractionCount;
+}
+
+
+FeatureCache::Settings FeatureCache::getSettings() const
+{
+	return this->settings;
+}
+
+
+void FeatureCache::setSettings(const Settings& settings)
+{
+	this->settings = settings;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Extracts ORB key points and descriptors of images and caches them, so that
+ * every image is converted and analysed only once no matter how many stages
+ * need its features.
+ *
+ * Entries are keyed by a hash of the image content and of the detector
+ * settings, so changing the settings never returns stale features. Several
+ * images are processed in parallel, one per thread.
+ */
+class FeatureCache
+{
+public:
+	// parameters of the ORB detector and extractor
+	struct Settings
+	{
+		int featureCount;
+		float scaleFactor;
+		int levelCount;
+		int edgeThreshold;
+		int patchSize;
+	};
+
+	struct Features
+	{
+		vector<KeyPoint> keyPoints;
+		Mat descriptors;
+	};
+
+private:
+	class Extractor;
+
+	Settings settings;
+	unordered_map<uint64, Features> entries;
+	size_t extractionCount;
+
+	uint64 getKey(const Mat& image) const;
+	static void extractFeatures(const Mat& image, const Settings& settings,
+		Features& features);
+
+public:
+	FeatureCache(void);
+	~FeatureCache(void);
+
+	// returns the features of the image, extracting them if necessary
+	const Features& getFeatures(const Mat& image);
+
+	// extracts the features of all images which are not cached yet in
+	// parallel
+	void extractFeatures(const vector<Mat>& images);
+
+	void clear();
+
+	// number of images analysed since construction
+	size_t getExtractionCount() const;
+
+	Settings getSettings() const;
+	void setSettings(const Settings& settings);
+};
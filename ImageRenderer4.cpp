@@ -4,8 +4,28 @@
 #include "ImageRenderer4.h"
 
 
+// scratch device buffers used by renderImage()
+enum
+{
+	ACCUMULATOR_SLOT,
+	SHIFTED_IMAGE_SLOT,
+	GRAY_IMAGE_SLOT,
+	RAY_COUNT_SLOT,
+	MULTI_CHANNEL_RAY_COUNT_SLOT,
+	REDUCTION_SLOT
+};
+
+// scratch host buffers used by renderImage()
+enum
+{
+	TRANSFORMATION_SLOT
+};
+
+
 ImageRenderer4::ImageRenderer4(void)
 {
+	this->normalizeByMaximum = true;
+	this->maximum = 0;
 }
 
 
@@ -29,14 +49,36 @@ void ImageRenderer4::setAlpha(float alpha)
 }
 
 
+void ImageRenderer4::setMaximumNormalization(bool enabled, double maximum)
+{
+	this->normalizeByMaximum	= enabled;
+	this->maximum				= maximum;
+}
+
+
 oclMat ImageRenderer4::renderImage() const
 {
-	oclMat image = oclMat(lightfield.SPARTIAL_RESOLUTION, lightfield.IMAGE_TYPE,
-		Scalar::all(0));
-	oclMat rayCountAccumulator = oclMat(lightfield.SPARTIAL_RESOLUTION, CV_32FC1,
-		Scalar::all(0));
-	oclMat subapertureImage, modifiedSubapertureImage, rayCountMat;
-	Mat transformation = Mat::eye(2, 3, CV_32FC1);
+	ScratchArena arena;
+	oclMat image;
+	renderImage(image, arena);
+
+	return image;
+}
+
+
+void ImageRenderer4::renderImage(oclMat& image, ScratchArena& arena) const
+{
+	const Size imageSize = lightfield.SPARTIAL_RESOLUTION;
+	image.create(imageSize, lightfield.IMAGE_TYPE);
+	image.setTo(Scalar::all(0));
+	oclMat& rayCountAccumulator = arena.getDeviceBuffer(ACCUMULATOR_SLOT,
+		imageSize, CV_32FC1);
+	rayCountAccumulator.setTo(Scalar::all(0));
+	oclMat subapertureImage;
+	Mat& transformation = arena.getHostBuffer(TRANSFORMATION_SLOT, Size(3, 2),
+		CV_32FC1);
+	setIdentity(transformation);
+	const Point center = this->lightfield.getAngularCenter();
 
 	if (abs(weight) >= 1)
 	{
@@ -45,7 +87,7 @@ oclMat ImageRenderer4::renderImage() const
 		for(u = 0; u <= this->lightfield.ANGULAR_RESOLUTION.width - 1;
 			u += stepSize)
 		{
-			transformation.at<float>(0, 2) = -(u - 5) * weight;
+			transformation.at<float>(0, 2) = -(u - center.x) * weight;
 	
 			for(v = 0; v <= this->lightfield.ANGULAR_RESOLUTION.height - 1;
 				v += stepSize)
@@ -55,16 +97,10 @@ oclMat ImageRenderer4::renderImage() const
 					round(v));
 				//normalize(subapertureImage);
 	
-				transformation.at<float>(1, 2) = -(v - 5) * weight;
+				transformation.at<float>(1, 2) = -(v - center.y) * weight;
 
-				// shift sub-aperture image by (u, v) * (1 - 1 / alpha)	
-				ocl::warpAffine(subapertureImage, modifiedSubapertureImage,
-					transformation, lightfield.SPARTIAL_RESOLUTION, INTER_CUBIC);
-
-				rayCountMat = extractRayCountMat(modifiedSubapertureImage);
-			
-				ocl::add(modifiedSubapertureImage, image, image);
-				ocl::add(rayCountMat, rayCountAccumulator, rayCountAccumulator);
+				addShiftedImage(subapertureImage, transformation, image,
+					rayCountAccumulator, arena);
 			}
 		}
 	}
@@ -73,30 +109,51 @@ oclMat ImageRenderer4::renderImage() const
 		int u, v;
 		for(u = 0; u < this->lightfield.ANGULAR_RESOLUTION.width; u++)
 		{
-			transformation.at<float>(0, 2) = -(u - 5) * weight;
+			transformation.at<float>(0, 2) = -(u - center.x) * weight;
 	
 			for(v = 0; v < this->lightfield.ANGULAR_RESOLUTION.height; v++)
 			{
 				subapertureImage = lightfield.getSubapertureImageI(u, v);
 				//normalize(subapertureImage);
 	
-				// shift sub-aperture image by (u, v) * (1 - 1 / alpha)
-				transformation.at<float>(1, 2) = -(v - 5) * weight;
-	
-				ocl::warpAffine(subapertureImage, modifiedSubapertureImage,
-					transformation, lightfield.SPARTIAL_RESOLUTION, INTER_CUBIC);
+				transformation.at<float>(1, 2) = -(v - center.y) * weight;
 
-				rayCountMat = extractRayCountMat(modifiedSubapertureImage);
-			
-				ocl::add(modifiedSubapertureImage, image, image);
-				ocl::add(rayCountMat, rayCountAccumulator, rayCountAccumulator);
+				addShiftedImage(subapertureImage, transformation, image,
+					rayCountAccumulator, arena);
 			}
 		}
 	}
 
-	// normalization
-	normalizeByRayCount(image, rayCountAccumulator);
-	normalize(image);
+	normalizeByRayCount(image, rayCountAccumulator, arena.getDeviceBuffer(
+		MULTI_CHANNEL_RAY_COUNT_SLOT, imageSize, lightfield.IMAGE_TYPE));
 
-	return image;
-}
\ No newline at end of file
+	if (this->normalizeByMaximum && this->maximum > 0)
+		ocl::multiply(1. / this->maximum, image, image);
+	else if (this->normalizeByMaximum)
+		normalize(image, arena.getDeviceBuffer(REDUCTION_SLOT));
+}
+
+
+void ImageRenderer4::addShiftedImage(const oclMat& subapertureImage,
+	const Mat& transformation, oclMat& image, oclMat& rayCountAccumulator,
+	ScratchArena& arena) const
+{
+	const Size imageSize = lightfield.SPARTIAL_RESOLUTION;
+	oclMat& modifiedSubapertureImage = arena.getDeviceBuffer(SHIFTED_IMAGE_SLOT,
+		imageSize, lightfield.IMAGE_TYPE);
+	oclMat& grayImage = arena.getDeviceBuffer(GRAY_IMAGE_SLOT, imageSize,
+		CV_32FC1);
+	oclMat& rayCountMat = arena.getDeviceBuffer(RAY_COUNT_SLOT, imageSize,
+		CV_32FC1);
+
+	// shift sub-aperture image by (u, v) * (1 - 1 / alpha)
+	ocl::warpAffine(subapertureImage, modifiedSubapertureImage,
+		transformation, imageSize, INTER_CUBIC);
+
+	// see extractRayCountMat()
+	ocl::cvtColor(modifiedSubapertureImage, grayImage, CV_RGB2GRAY);
+	ocl::threshold(grayImage, rayCountMat, 0, 1, THRESH_BINARY);
+
+	ocl::add(modifiedSubapertureImage, image, image);
+	ocl::add(rayCountMat, rayCountAccumulator, rayCountAccumulator);
+}
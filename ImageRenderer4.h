@@ -2,6 +2,7 @@
 
 #include <opencv2/ocl/ocl.hpp>
 #include "ImageRenderer.h"
+#include "ScratchArena.h"
 
 /**
  * A refocus algorithm for rendering images from light fields. It is based on
@@ -19,6 +20,12 @@ class ImageRenderer4 :
 	public ImageRenderer
 {
 	double weight;
+	bool normalizeByMaximum;
+	double maximum;
+
+	void addShiftedImage(const oclMat& subapertureImage,
+		const Mat& transformation, oclMat& image, oclMat& rayCountAccumulator,
+		ScratchArena& arena) const;
 
 public:
 	ImageRenderer4(void);
@@ -27,5 +34,12 @@ public:
 	void setLightfield(const LightFieldPicture& lightfield);
 	void setAlpha(float alpha);
 
+	// the final normalization by the image's maximum has to be disabled if an
+	// image is rendered in several tiles, or be given the maximum of the whole
+	// image (a maximum of 0 selects the maximum of the rendered image)
+	void setMaximumNormalization(bool enabled, double maximum = 0);
+
 	oclMat renderImage() const;
+	// renders into the given image, drawing all temporaries from the arena
+	void renderImage(oclMat& image, ScratchArena& arena) const;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #define _USE_MATH_DEFINES	// for math constants in C++
 #include <string>
 #include <cmath>
+#include <climits>
 #include <iostream>	// debug
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -16,33 +17,43 @@ const Point LightFieldPicture::IMAGE_ORIGIN = Point(0, 0);
 
 void LightFieldPicture::extractSubapertureImageAtlas()
 {
-	const double pixelPitch		= loader.pixelPitch;
-	const double scaleFactorX	= loader.scaleFactor[0];
-	const double scaleFactorY	= loader.scaleFactor[1];
+	const int atlasWidth	= ANGULAR_RESOLUTION.width * SPARTIAL_RESOLUTION.width;
+	const int atlasHeight	= ANGULAR_RESOLUTION.height * SPARTIAL_RESOLUTION.height;
+
+	this->subapertureImageAtlas = extractSubapertureImageAtlasRegion(
+		Rect(0, 0, atlasWidth, atlasHeight));
+}
 
-	const int dstWidth	= ANGULAR_RESOLUTION.width * SPARTIAL_RESOLUTION.width;
-	const int dstHeight	= ANGULAR_RESOLUTION.height * SPARTIAL_RESOLUTION.height;
+
+oclMat LightFieldPicture::extractSubapertureImageAtlasRegion(
+	const Rect& region) const
+{
+	const int atlasWidth = ANGULAR_RESOLUTION.width * SPARTIAL_RESOLUTION.width;
 
 	const int u0 = ANGULAR_RESOLUTION.width / 2;
 	const int v0 = ANGULAR_RESOLUTION.height / 2;
 	const int s0 = SPARTIAL_RESOLUTION.width / 2;
 	const int t0 = SPARTIAL_RESOLUTION.height / 2 - 1;
 
+	// the line shift correction interpolates with the right neighbour, so one
+	// more column is extracted if the atlas has one
+	const int extendedWidth = min(region.width + 1, atlasWidth - region.x);
+
 	typedef Vec2f coord;
-	Mat_<coord> map = Mat(dstHeight, dstWidth, CV_32FC2);
+	Mat_<coord> map = Mat(region.height, extendedWidth, CV_32FC2);
 	int x, y, s, t, u, v;
 	coord tmp;
-	for (y = 0; y < dstHeight; y++)
+	for (y = 0; y < region.height; y++)
 	{
-		v = y / SPARTIAL_RESOLUTION.height - v0;
-		t = y % SPARTIAL_RESOLUTION.height - t0;
+		v = (region.y + y) / SPARTIAL_RESOLUTION.height - v0;
+		t = (region.y + y) % SPARTIAL_RESOLUTION.height - t0;
 
 		tmp = mlaCenter + t * nextRow;
 
-		for (x = 0; x < dstWidth; x++)
+		for (x = 0; x < extendedWidth; x++)
 		{
-			u = x / SPARTIAL_RESOLUTION.width - u0;
-			s = x % SPARTIAL_RESOLUTION.width - s0;
+			u = (region.x + x) / SPARTIAL_RESOLUTION.width - u0;
+			s = (region.x + x) % SPARTIAL_RESOLUTION.width - s0;
 
 			map.at<coord>(y, x) = tmp + floor(s - t / 2.) * nextLens + Vec2f(u, v);
 		}
@@ -50,16 +61,41 @@ void LightFieldPicture::extractSubapertureImageAtlas()
 	Mat integralMap;
 	convertMaps(map, noArray(), integralMap, noArray(), CV_16SC2, true);
 
-	ocl::remap(oclMat(this->rawImage), this->subapertureImageAtlas,
-		oclMat(integralMap), oclMat(), INTER_NEAREST, BORDER_CONSTANT,
-		Scalar::all(0));
+	// only upload the part of the raw image which the region is sampled from
+	Point minCorner = Point(INT_MAX, INT_MAX);
+	Point maxCorner = Point(INT_MIN, INT_MIN);
+	for (y = 0; y < integralMap.rows; y++)
+	{
+		const Vec2s* row = integralMap.ptr<Vec2s>(y);
+		for (x = 0; x < integralMap.cols; x++)
+		{
+			minCorner.x = min(minCorner.x, (int) row[x][0]);
+			minCorner.y = min(minCorner.y, (int) row[x][1]);
+			maxCorner.x = max(maxCorner.x, (int) row[x][0]);
+			maxCorner.y = max(maxCorner.y, (int) row[x][1]);
+		}
+	}
+	const Rect rawRect = Rect(IMAGE_ORIGIN, this->rawImage.size()) &
+		Rect(minCorner, maxCorner + Point(1, 1));
+
+	oclMat regionImage;
+	if (rawRect.area() == 0)
+		regionImage = oclMat(integralMap.size(), IMAGE_TYPE, Scalar::all(0));
+	else
+	{
+		integralMap -= Scalar(rawRect.x, rawRect.y);
+		ocl::remap(oclMat(this->rawImage(rawRect)), regionImage,
+			oclMat(integralMap), oclMat(), INTER_NEAREST, BORDER_CONSTANT,
+			Scalar::all(0));
+	}
 
 	// correct line shift due to hexagonal microlens array structure
-	for (y = 0; y < dstHeight; y++)
+	map = Mat(region.height, region.width, CV_32FC2);
+	for (y = 0; y < region.height; y++)
 	{
-		for (x = 0; x < dstWidth; x++)
+		for (x = 0; x < region.width; x++)
 		{
-			t = y % SPARTIAL_RESOLUTION.height - t0;
+			t = (region.y + y) % SPARTIAL_RESOLUTION.height - t0;
 
 			if (t % 2 == 0)
 				map.at<coord>(y, x) = Vec2f(x, y);
@@ -67,8 +103,11 @@ void LightFieldPicture::extractSubapertureImageAtlas()
 				map.at<coord>(y, x) = Vec2f(x + 0.5, y);
 		}
 	}
-	ocl::remap(this->subapertureImageAtlas, this->subapertureImageAtlas,
-		oclMat(map), oclMat(), INTER_LINEAR, BORDER_REPLICATE);
+	oclMat correctedImage;
+	ocl::remap(regionImage, correctedImage, oclMat(map), oclMat(),
+		INTER_LINEAR, BORDER_REPLICATE);
+
+	return correctedImage;
 }
 
 
@@ -77,7 +116,8 @@ LightFieldPicture::LightFieldPicture(void)
 }
 
 
-LightFieldPicture::LightFieldPicture(const std::string& pathToFile)
+LightFieldPicture::LightFieldPicture(const std::string& pathToFile,
+	bool extractAtlas)
 {
 	// load raw data
 	this->loader	= LfpLoader(pathToFile);
@@ -144,6 +184,10 @@ LightFieldPicture::LightFieldPicture(const std::string& pathToFile)
 	demosaicedImage.copyTo(this->rawImage);
 
 	// get subaperture images
+	// without the atlas, sub-aperture images are extracted on demand
+	if (!extractAtlas)
+		return;
+
 	extractSubapertureImageAtlas();
 
 	size_t saImageCount = ANGULAR_RESOLUTION.area();
@@ -244,10 +288,49 @@ LightFieldPicture::luminanceType LightFieldPicture::getLuminanceF(
 oclMat LightFieldPicture::getSubapertureImageI(const unsigned short u,
 	const unsigned short v) const
 {
+	if (this->subapertureImages.empty())
+		return extractSubapertureImageAtlasRegion(Rect(
+			u * this->SPARTIAL_RESOLUTION.width,
+			v * this->SPARTIAL_RESOLUTION.height,
+			this->SPARTIAL_RESOLUTION.width,
+			this->SPARTIAL_RESOLUTION.height));
+
 	return this->subapertureImages[v * this->ANGULAR_RESOLUTION.width + u];
 }
 
 
+LightFieldPicture LightFieldPicture::getRegion(const Rect& region) const
+{
+	LightFieldPicture picture = *this;
+	picture.SPARTIAL_RESOLUTION			= region.size();
+	picture.validSpartialCoordinates	= Rect(IMAGE_ORIGIN, region.size());
+	picture.subapertureImageAtlas		= oclMat();
+	picture.subapertureImages			= vector<oclMat>(
+		ANGULAR_RESOLUTION.area());
+
+	int u, v, index = 0;
+	for (v = 0; v < ANGULAR_RESOLUTION.height; v++)
+	{
+		for (u = 0; u < ANGULAR_RESOLUTION.width; u++)
+		{
+			if (this->subapertureImages.empty())
+				picture.subapertureImages[index] =
+					extractSubapertureImageAtlasRegion(Rect(
+					u * SPARTIAL_RESOLUTION.width + region.x,
+					v * SPARTIAL_RESOLUTION.height + region.y,
+					region.width, region.height));
+			else
+				picture.subapertureImages[index] =
+					oclMat(this->subapertureImages[index], region);
+
+			index++;
+		}
+	}
+
+	return picture;
+}
+
+
 oclMat LightFieldPicture::getSubapertureImageF(const double u, const double v)
 	const
 {
@@ -259,14 +342,10 @@ oclMat LightFieldPicture::getSubapertureImageF(const double u, const double v)
 	int fv = min(maxAngle, max(minAngle, (int) floor(v)));
 	int cv = min(maxAngle, max(minAngle, (int) ceil(v)));
 
-	oclMat upperLeftImage	= this->subapertureImages[
-		fv * this->ANGULAR_RESOLUTION.width + fu];
-	oclMat lowerLeftImage	= this->subapertureImages[
-		cv * this->ANGULAR_RESOLUTION.width + fu];
-	oclMat upperRightImage	= this->subapertureImages[
-		fv * this->ANGULAR_RESOLUTION.width + cu];
-	oclMat lowerRightImage	= this->subapertureImages[
-		cv * this->ANGULAR_RESOLUTION.width + cu];
+	oclMat upperLeftImage	= getSubapertureImageI(fu, fv);
+	oclMat lowerLeftImage	= getSubapertureImageI(fu, cv);
+	oclMat upperRightImage	= getSubapertureImageI(cu, fv);
+	oclMat lowerRightImage	= getSubapertureImageI(cu, cv);
 
 	float lowerWeight	= v - floor(v);
 	float upperWeight	= 1.0 - lowerWeight;
@@ -307,6 +386,12 @@ double LightFieldPicture::getRawFocalLength() const
 }
 
 
+Point LightFieldPicture::getAngularCenter() const
+{
+	return Point(ANGULAR_RESOLUTION.width / 2, ANGULAR_RESOLUTION.height / 2);
+}
+
+
 void LightFieldPicture::generateCalibrationMatrix()
 {
 	// generate calibration matrix
@@ -27,6 +27,7 @@ class LightFieldPicture /*:
 	oclMat subapertureImageAtlas;
 
 	void extractSubapertureImageAtlas();
+	oclMat extractSubapertureImageAtlasRegion(const Rect& region) const;
 
 	Vec2f mlaCenter, nextLens, nextRow;
 	Rect validSpartialCoordinates;
@@ -50,7 +51,9 @@ public:
 	LfpLoader loader;	// TODO should be private
 
 	LightFieldPicture(void);
-	LightFieldPicture(const string& pathToFile);
+	// without the atlas, sub-aperture images are extracted from the raw image
+	// whenever they are requested
+	LightFieldPicture(const string& pathToFile, bool extractAtlas = true);
 	~LightFieldPicture(void);
 
 	luminanceType getLuminanceI(const int x, const int y,
@@ -65,11 +68,19 @@ public:
 	// interpolate an sub-aperture image
 	oclMat getSubapertureImageF(const double u, const double v) const;
 
+	// crop all sub-aperture images to a spartial region, the result is a light
+	// field of the region's size (luminance accessors are not supported)
+	LightFieldPicture getRegion(const Rect& region) const;
+
 	Mat getRawImage() const;
 	oclMat getSubapertureImageAtlas() const;
 
 	double getRawFocalLength() const;
 
+	// the sub-aperture image refocused images are aligned to, (u, v) is
+	// shifted by (u, v) - getAngularCenter() times the shift weight
+	Point getAngularCenter() const;
+
 	Mat getCalibrationMatrix() const;
 	double getDistanceFromImageToLens() const;
 	double getLambdaInfinity() const;
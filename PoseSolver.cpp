@@ -0,0 +1,708 @@
+#include <algorithm>
+#include "PoseSolver.h"
+
+const int PoseSolver::SAMPLE_SIZE			= 5;
+const int PoseSolver::BATCH_SIZE			= 32;
+const double PoseSolver::MODEL_COST			= 2000;	// in point verifications
+const double PoseSolver::MODELS_PER_SAMPLE	= 4;
+const double PoseSolver::INITIAL_EPSILON	= 0.1;
+const double PoseSolver::INITIAL_DELTA		= 0.01;
+const Matx33d PoseSolver::R90 = Matx33d(
+	0,	-1,	0,
+	1,	0,	0,
+	0,	0,	1);
+
+// number of set bits of 4 bit masks
+static const int BIT_COUNTS[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+// exponents of x, y and z of the monomials of the five-point constraints, in
+// the order of Nister's paper
+static const int MONOMIALS[20][3] = {
+	{ 3, 0, 0 }, { 0, 3, 0 }, { 2, 1, 0 }, { 1, 2, 0 }, { 2, 0, 1 },
+	{ 2, 0, 0 }, { 0, 2, 1 }, { 0, 2, 0 }, { 1, 1, 1 }, { 1, 1, 0 },
+	{ 1, 0, 2 }, { 1, 0, 1 }, { 1, 0, 0 }, { 0, 1, 2 }, { 0, 1, 1 },
+	{ 0, 1, 0 }, { 0, 0, 3 }, { 0, 0, 2 }, { 0, 0, 1 }, { 0, 0, 0 } };
+
+// polynomial in x, y and z of degree 3 or less, indexed by the exponents
+struct Polynomial
+{
+	double c[4][4][4];
+};
+
+// adds factor * a * b to result, dropping terms of degree 4 and more
+static void multiplyAdd(const Polynomial& a, const Polynomial& b,
+	double factor, Polynomial& result)
+{
+	for (int ax = 0; ax <= 3; ax++)
+	for (int ay = 0; ay <= 3 - ax; ay++)
+	for (int az = 0; az <= 3 - ax - ay; az++)
+	{
+		const double coefficient = factor * a.c[ax][ay][az];
+		if (coefficient == 0)
+			continue;
+
+		for (int bx = 0; bx <= 3 - ax - ay - az; bx++)
+		for (int by = 0; by <= 3 - ax - ay - az - bx; by++)
+		for (int bz = 0; bz <= 3 - ax - ay - az - bx - by; bz++)
+			result.c[ax + bx][ay + by][az + bz] += coefficient * b.c[bx][by][bz];
+	}
+}
+
+// adds a * b to result, where a and b are polynomials in z of na and nb
+// coefficients in ascending order
+static void multiplyAdd(const double* a, int na, const double* b, int nb,
+	double factor, double* result)
+{
+	for (int i = 0; i < na; i++)
+		for (int j = 0; j < nb; j++)
+			result[i + j] += factor * a[i] * b[j];
+}
+
+static double evaluate(const double* polynomial, int n, double z)
+{
+	double value = 0;
+	for (int i = n - 1; i >= 0; i--)
+		value = value * z + polynomial[i];
+
+	return value;
+}
+
+
+/**
+ * Draws samples from the best correspondences first: the n-th sample comes
+ * from a subset of the best correspondences, which grows at the rate given in
+ * the PROSAC paper until it contains all of them and sampling is uniform.
+ */
+class PoseSolver::ProsacSampler
+{
+	const int count;
+	int subsetSize;			// n
+	double subsetSamples;	// T_n, expected samples from the subset in RANSAC
+	int growthIteration;	// T'_n, the iteration in which the subset grows
+	int iteration;			// t
+	RNG rng;
+
+public:
+	ProsacSampler(int count, int maxIterations) : count(count)
+	{
+		this->subsetSize = SAMPLE_SIZE;
+		this->subsetSamples = maxIterations;
+		for (int i = 0; i < SAMPLE_SIZE; i++)
+			this->subsetSamples *= (double) (SAMPLE_SIZE - i) / (count - i);
+		this->growthIteration = 1;
+		this->iteration = 0;
+	}
+
+	void drawSample(int* sample)
+	{
+		this->iteration++;
+		if (this->iteration > this->growthIteration && this->subsetSize < count)
+		{
+			const double nextSamples = this->subsetSamples *
+				(this->subsetSize + 1) / (this->subsetSize + 1 - SAMPLE_SIZE);
+			this->growthIteration += (int) ceil(nextSamples - this->subsetSamples);
+			this->subsetSamples = nextSamples;
+			this->subsetSize++;
+		}
+
+		// the last correspondence of the subset and others from the subset,
+		// or (once the subset has stopped growing) any from the subset
+		int size = 0;
+		int range = this->subsetSize;
+		if (this->growthIteration >= this->iteration)
+		{
+			sample[size++] = this->subsetSize - 1;
+			range--;
+		}
+		while (size < SAMPLE_SIZE)
+		{
+			const int index = this->rng.uniform(0, range);
+			if (find(sample, sample + size, index) == sample + size)
+				sample[size++] = index;
+		}
+	}
+};
+
+
+/**
+ * Computes the essential matrices of a batch of samples and verifies them,
+ * one sample per iteration.
+ */
+class PoseSolver::Verifier : public ParallelLoopBody
+{
+	const Correspondences& correspondences;
+	const vector<Vec3d>& q1;
+	const vector<Vec3d>& q2;
+	const vector<int>& samples;
+	const float threshold;
+	const Sprt& sprt;
+	vector<Hypothesis>& hypotheses;
+
+public:
+	Verifier(const Correspondences& correspondences, const vector<Vec3d>& q1,
+		const vector<Vec3d>& q2, const vector<int>& samples, float threshold,
+		const Sprt& sprt, vector<Hypothesis>& hypotheses) :
+		correspondences(correspondences), q1(q1), q2(q2), samples(samples),
+		threshold(threshold), sprt(sprt), hypotheses(hypotheses)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		Vec3d sample1[5], sample2[5];
+		vector<Matx33d> essentials;
+		int testedCount, inlierCount;
+
+		for (int i = range.start; i < range.end; i++)
+		{
+			Hypothesis& hypothesis = hypotheses.at(i);
+			hypothesis.inlierCount		= -1;
+			hypothesis.rejectedCount	= 0;
+			hypothesis.rejectedTested	= 0;
+			hypothesis.rejectedInliers	= 0;
+
+			for (int j = 0; j < SAMPLE_SIZE; j++)
+			{
+				sample1[j] = q1.at(samples.at(i * SAMPLE_SIZE + j));
+				sample2[j] = q2.at(samples.at(i * SAMPLE_SIZE + j));
+			}
+			PoseSolver::solveFivePoint(sample1, sample2, essentials);
+
+			for (int j = 0; j < essentials.size(); j++)
+			{
+				inlierCount = PoseSolver::verifyHypothesis(correspondences,
+					essentials.at(j), threshold, sprt, testedCount);
+				if (testedCount < correspondences.count)
+				{
+					hypothesis.rejectedCount++;
+					hypothesis.rejectedTested += testedCount;
+					hypothesis.rejectedInliers += inlierCount;
+				}
+				else if (inlierCount > hypothesis.inlierCount)
+				{
+					hypothesis.essential = essentials.at(j);
+					hypothesis.inlierCount = inlierCount;
+				}
+			}
+		}
+	}
+};
+
+
+PoseSolver::PoseSolver(void)
+{
+	this->threshold = 1.0;
+	this->confidence = 0.999;
+	this->maxIterations = 1000;
+}
+
+
+PoseSolver::~PoseSolver(void)
+{
+}
+
+
+/**
+ * Computes the decision threshold A from the estimated probabilities epsilon
+ * and delta, as in Matas and Chum (section 2.1).
+ */
+void PoseSolver::setSprtThreshold(Sprt& sprt)
+{
+	const double epsilon	= sprt.epsilon;
+	const double delta		= sprt.delta;
+
+	const double C = (1 - delta) * log((1 - delta) / (1 - epsilon))
+		+ delta * log(delta / epsilon);
+	const double K = MODEL_COST * C / MODELS_PER_SAMPLE + 1;
+
+	double A = K;
+	for (int i = 0; i < 10; i++)
+		A = K + log(A);
+	sprt.threshold = A;
+
+	for (int n = 0; n <= 4; n++)
+		sprt.factors[n] = pow(delta / epsilon, n)
+			* pow((1 - delta) / (1 - epsilon), 4 - n);
+}
+
+
+/**
+ * Tests the correspondences index to index + 3 for a Sampson error below the
+ * (squared) threshold and returns the result as 4 bit mask.
+ */
+int PoseSolver::getInlierMask(const Correspondences& correspondences,
+	int index, const float* e, float threshold)
+{
+	const float* x1 = &correspondences.x1[index];
+	const float* y1 = &correspondences.y1[index];
+	const float* x2 = &correspondences.x2[index];
+	const float* y2 = &correspondences.y2[index];
+
+#if CV_SSE2
+	const __m128 u1 = _mm_loadu_ps(x1);
+	const __m128 v1 = _mm_loadu_ps(y1);
+	const __m128 u2 = _mm_loadu_ps(x2);
+	const __m128 v2 = _mm_loadu_ps(y2);
+
+	// E * x1 and E^T * x2
+	const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[0]), u1),
+		_mm_mul_ps(_mm_set1_ps(e[1]), v1)), _mm_set1_ps(e[2]));
+	const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[3]), u1),
+		_mm_mul_ps(_mm_set1_ps(e[4]), v1)), _mm_set1_ps(e[5]));
+	const __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[6]), u1),
+		_mm_mul_ps(_mm_set1_ps(e[7]), v1)), _mm_set1_ps(e[8]));
+	const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[0]), u2),
+		_mm_mul_ps(_mm_set1_ps(e[3]), v2)), _mm_set1_ps(e[6]));
+	const __m128 f = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[1]), u2),
+		_mm_mul_ps(_mm_set1_ps(e[4]), v2)), _mm_set1_ps(e[7]));
+
+	// x2^T * E * x1 and the squared norm of the gradient
+	const __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u2, a),
+		_mm_mul_ps(v2, b)), c);
+	const __m128 gradient = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)),
+		_mm_add_ps(_mm_mul_ps(d, d), _mm_mul_ps(f, f)));
+
+	return _mm_movemask_ps(_mm_cmplt_ps(_mm_mul_ps(s, s),
+		_mm_mul_ps(_mm_set1_ps(threshold), gradient)));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		const float a = e[0] * x1[i] + e[1] * y1[i] + e[2];
+		const float b = e[3] * x1[i] + e[4] * y1[i] + e[5];
+		const float c = e[6] * x1[i] + e[7] * y1[i] + e[8];
+		const float d = e[0] * x2[i] + e[3] * y2[i] + e[6];
+		const float f = e[1] * x2[i] + e[4] * y2[i] + e[7];
+		const float s = x2[i] * a + y2[i] * b + c;
+
+		if (s * s < threshold * (a * a + b * b + d * d + f * f))
+			mask |= 1 << i;
+	}
+
+	return mask;
+#endif
+}
+
+
+/**
+ * Counts the correspondences agreeing with the essential matrix, 4 at a time,
+ * and stops as soon as the likelihood ratio exceeds the SPRT threshold. The
+ * hypothesis was rejected if testedCount is less than the number of
+ * correspondences.
+ */
+int PoseSolver::verifyHypothesis(const Correspondences& correspondences,
+	const Matx33d& essential, float threshold, const Sprt& sprt,
+	int& testedCount)
+{
+	const int count = correspondences.count;
+	const double scale = 1. / norm(essential);
+	float e[9];
+	for (int i = 0; i < 9; i++)
+		e[i] = (float) (essential.val[i] * scale);
+
+	double ratio = 1;
+	int inlierCount = 0;
+	int i;
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		const int n = BIT_COUNTS[getInlierMask(correspondences, i, e, threshold)];
+		inlierCount += n;
+		ratio *= sprt.factors[n];
+		if (ratio > sprt.threshold)
+		{
+			testedCount = i + 4;
+			return inlierCount;
+		}
+	}
+	if (i < count)
+		inlierCount += BIT_COUNTS[getInlierMask(correspondences, i, e, threshold)
+			& ((1 << (count - i)) - 1)];
+
+	testedCount = count;
+	return inlierCount;
+}
+
+
+int PoseSolver::solvePose(const vector<Point2f>& points1,
+	const vector<Point2f>& points2, const Matx33d& calibrationMatrix,
+	Matx33d& rotation, Vec3d& translation, vector<uchar>& inlierMask) const
+{
+	Matx33d essential;
+	const int inlierCount = estimateEssentialMatrix(points1, points2,
+		calibrationMatrix, essential, inlierMask);
+	if (inlierCount < SAMPLE_SIZE)
+		return 0;
+
+	if (recoverPose(essential, points1, points2, calibrationMatrix, inlierMask,
+		rotation, translation) == 0)
+		return 0;
+
+	return inlierCount;
+}
+
+
+int PoseSolver::estimateEssentialMatrix(const vector<Point2f>& points1,
+	const vector<Point2f>& points2, const Matx33d& calibrationMatrix,
+	Matx33d& essential, vector<uchar>& inlierMask) const
+{
+	CV_Assert(points1.size() == points2.size());
+
+	const int count = points1.size();
+	inlierMask.assign(count, 0);
+	if (count < SAMPLE_SIZE)
+		return 0;
+
+	// 1) normalize the image coordinates, and the threshold accordingly
+	const Matx33d inverseK = calibrationMatrix.inv();
+	const double focalLength = (calibrationMatrix(0, 0) + calibrationMatrix(1, 1)) / 2;
+	const float threshold = (float) (this->threshold * this->threshold
+		/ (focalLength * focalLength));
+
+	vector<Vec3d> q1 = vector<Vec3d>(count);
+	vector<Vec3d> q2 = vector<Vec3d>(count);
+	Correspondences correspondences;
+	correspondences.count = count;
+	const int paddedCount = (count + 3) / 4 * 4;
+	correspondences.x1.assign(paddedCount, 0);
+	correspondences.y1.assign(paddedCount, 0);
+	correspondences.x2.assign(paddedCount, 0);
+	correspondences.y2.assign(paddedCount, 0);
+	for (int i = 0; i < count; i++)
+	{
+		q1[i] = inverseK * Vec3d(points1[i].x, points1[i].y, 1);
+		q2[i] = inverseK * Vec3d(points2[i].x, points2[i].y, 1);
+		correspondences.x1[i] = (float) q1[i][0];
+		correspondences.y1[i] = (float) q1[i][1];
+		correspondences.x2[i] = (float) q2[i][0];
+		correspondences.y2[i] = (float) q2[i][1];
+	}
+
+	// 2) verify batches of hypotheses until an all-inlier sample has been
+	// drawn with the requested confidence
+	Sprt sprt;
+	sprt.epsilon = INITIAL_EPSILON;
+	sprt.delta = INITIAL_DELTA;
+	setSprtThreshold(sprt);
+
+	ProsacSampler sampler = ProsacSampler(count, this->maxIterations);
+	vector<int> samples = vector<int>(BATCH_SIZE * SAMPLE_SIZE);
+	vector<Hypothesis> hypotheses = vector<Hypothesis>(BATCH_SIZE);
+	int bestInlierCount = 0;
+	int iterationCount = 0;
+	int requiredIterations = this->maxIterations;
+	int64 rejectedTested = 0, rejectedInliers = 0;
+
+	while (iterationCount < requiredIterations)
+	{
+		const int batchSize = min(BATCH_SIZE, requiredIterations - iterationCount);
+		for (int i = 0; i < batchSize; i++)
+			sampler.drawSample(&samples[i * SAMPLE_SIZE]);
+
+		parallel_for_(Range(0, batchSize), Verifier(correspondences, q1, q2,
+			samples, threshold, sprt, hypotheses));
+		iterationCount += batchSize;
+
+		for (int i = 0; i < batchSize; i++)
+		{
+			const Hypothesis& hypothesis = hypotheses.at(i);
+			rejectedTested += hypothesis.rejectedTested;
+			rejectedInliers += hypothesis.rejectedInliers;
+			if (hypothesis.inlierCount > bestInlierCount)
+			{
+				essential = hypothesis.essential;
+				bestInlierCount = hypothesis.inlierCount;
+			}
+		}
+
+		// 3) adapt the test and the number of iterations to the results
+		const double inlierRatio = (double) bestInlierCount / count;
+		sprt.epsilon = max(inlierRatio, INITIAL_EPSILON);
+		if (rejectedTested > 0)
+			sprt.delta = (double) rejectedInliers / rejectedTested;
+		sprt.delta = min(max(sprt.delta, 0.001), sprt.epsilon / 2);
+		setSprtThreshold(sprt);
+
+		const double allInlierProbability = pow(inlierRatio, SAMPLE_SIZE);
+		if (allInlierProbability >= 1)
+			requiredIterations = iterationCount;
+		else if (allInlierProbability > 0)
+			requiredIterations = (int) min((double) this->maxIterations,
+				ceil(log(1 - this->confidence) / log(1 - allInlierProbability)));
+	}
+
+	if (bestInlierCount == 0)
+		return 0;
+
+	// 4) mark the inliers of the best essential matrix
+	const double scale = 1. / norm(essential);
+	float e[9];
+	for (int i = 0; i < 9; i++)
+		e[i] = (float) (essential.val[i] * scale);
+
+	int inlierCount = 0;
+	for (int i = 0; i < count; i += 4)
+	{
+		const int mask = getInlierMask(correspondences, i, e, threshold);
+		for (int j = 0; j < 4 && i + j < count; j++)
+			if (mask & (1 << j))
+			{
+				inlierMask[i + j] = 1;
+				inlierCount++;
+			}
+	}
+
+	return inlierCount;
+}
+
+
+/**
+ * Tests the four decompositions of the essential matrix (Hartley and
+ * Zisserman, section 9.6.2) by triangulating the inliers.
+ */
+int PoseSolver::recoverPose(const Matx33d& essential,
+	const vector<Point2f>& points1, const vector<Point2f>& points2,
+	const Matx33d& calibrationMatrix, const vector<uchar>& inlierMask,
+	Matx33d& rotation, Vec3d& translation)
+{
+	const SVD svd = SVD(Mat(essential));
+	Matx33d U = Matx33d(svd.u.ptr<double>());
+	Matx33d Vt = Matx33d(svd.vt.ptr<double>());
+	if (determinant(U) < 0)
+		U = -U;
+	if (determinant(Vt) < 0)
+		Vt = -Vt;
+
+	const Matx33d rotations[2] = { U * R90 * Vt, U * R90.t() * Vt };
+	const Vec3d t = Vec3d(U(0, 2), U(1, 2), U(2, 2));
+	const Matx33d inverseK = calibrationMatrix.inv();
+
+	int bestCount = 0;
+	for (int r = 0; r < 2; r++)
+	for (int sign = -1; sign <= 1; sign += 2)
+	{
+		const Vec3d currentT = t * (double) sign;
+		int count = 0;
+
+		for (int i = 0; i < points1.size(); i++)
+		{
+			if (!inlierMask.at(i))
+				continue;
+
+			// depths z1 and z2 with z1 * R * q1 + t = z2 * q2, least squares
+			const Vec3d a = rotations[r] *
+				(inverseK * Vec3d(points1[i].x, points1[i].y, 1));
+			const Vec3d b = inverseK * Vec3d(points2[i].x, points2[i].y, 1);
+			const double aa = a.dot(a), ab = a.dot(b), bb = b.dot(b);
+			const double at = a.dot(currentT), bt = b.dot(currentT);
+			const double det = aa * bb - ab * ab;
+			if (det <= 1e-12 * aa * bb)
+				continue;
+
+			const double z1 = (ab * bt - at * bb) / det;
+			const double z2 = (aa * bt - ab * at) / det;
+			if (z1 > 0 && z2 > 0)
+				count++;
+		}
+
+		if (count > bestCount)
+		{
+			bestCount = count;
+			rotation = rotations[r];
+			translation = currentT;
+		}
+	}
+
+	return bestCount;
+}
+
+
+/**
+ * Nister's algorithm: E is a linear combination of the 4 dimensional null
+ * space of the epipolar constraints, E = x * X + y * Y + z * Z + W. The cubic
+ * constraints det(E) = 0 and 2 * E * E^T * E - trace(E * E^T) * E = 0 are
+ * reduced by Gauss-Jordan elimination and z is a root of a polynomial of
+ * degree 10.
+ */
+void PoseSolver::solveFivePoint(const Vec3d* q1, const Vec3d* q2,
+	vector<Matx33d>& essentials)
+{
+	essentials.clear();
+
+	// 1) null space of q2^T * E * q1 = 0
+	Mat Q = Mat(5, 9, CV_64FC1);
+	for (int i = 0; i < 5; i++)
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				Q.at<double>(i, 3 * r + c) = q2[i][r] * q1[i][c];
+
+	Mat w, u, vt;
+	SVD::compute(Q, w, u, vt, SVD::FULL_UV);
+	Matx33d basis[4];
+	for (int i = 0; i < 4; i++)
+		basis[i] = Matx33d(vt.ptr<double>(5 + i));
+
+	// 2) the entries of E as polynomials in x, y and z
+	Polynomial E[3][3];
+	memset(E, 0, sizeof(E));
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+		{
+			E[r][c].c[1][0][0] = basis[0](r, c);
+			E[r][c].c[0][1][0] = basis[1](r, c);
+			E[r][c].c[0][0][1] = basis[2](r, c);
+			E[r][c].c[0][0][0] = basis[3](r, c);
+		}
+
+	// 3) the 10 cubic constraints
+	Polynomial constraints[10], EEt[3][3], minors[3], trace;
+	memset(constraints, 0, sizeof(constraints));
+	memset(EEt, 0, sizeof(EEt));
+	memset(minors, 0, sizeof(minors));
+	memset(&trace, 0, sizeof(trace));
+
+	for (int c = 0; c < 3; c++)
+	{
+		const int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+		multiplyAdd(E[1][c1], E[2][c2], 1, minors[c]);
+		multiplyAdd(E[1][c2], E[2][c1], -1, minors[c]);
+		multiplyAdd(E[0][c], minors[c], 1, constraints[0]);
+	}
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			for (int k = 0; k < 3; k++)
+				multiplyAdd(E[r][k], E[c][k], 1, EEt[r][c]);
+
+	Polynomial one;
+	memset(&one, 0, sizeof(one));
+	one.c[0][0][0] = 1;
+	for (int r = 0; r < 3; r++)
+		multiplyAdd(EEt[r][r], one, 1, trace);
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+		{
+			Polynomial& constraint = constraints[1 + 3 * r + c];
+			for (int k = 0; k < 3; k++)
+				multiplyAdd(EEt[r][k], E[k][c], 2, constraint);
+			multiplyAdd(trace, E[r][c], -1, constraint);
+		}
+
+	// 4) Gauss-Jordan elimination of the first 10 monomials
+	Mat A = Mat(10, 20, CV_64FC1);
+	for (int i = 0; i < 10; i++)
+		for (int j = 0; j < 20; j++)
+			A.at<double>(i, j) = constraints[i].c[MONOMIALS[j][0]]
+				[MONOMIALS[j][1]][MONOMIALS[j][2]];
+
+	Mat B;
+	if (!solve(A.colRange(0, 10), A.colRange(10, 20), B, DECOMP_LU))
+		return;
+
+	// 5) B(z) * (x, y, 1)^T = 0 from the rows <e> - z * <f>, <g> - z * <h>
+	// and <i> - z * <j>, with polynomials in z of degree 3, 3 and 4
+	double b[3][3][5];
+	memset(b, 0, sizeof(b));
+	for (int r = 0; r < 3; r++)
+	{
+		const double* e = B.ptr<double>(4 + 2 * r);
+		const double* f = B.ptr<double>(5 + 2 * r);
+
+		for (int v = 0; v < 2; v++)
+		{
+			const int j = 3 * v;
+			b[r][v][0] = e[j + 2];
+			b[r][v][1] = e[j + 1] - f[j + 2];
+			b[r][v][2] = e[j] - f[j + 1];
+			b[r][v][3] = -f[j];
+		}
+		b[r][2][0] = e[9];
+		b[r][2][1] = e[8] - f[9];
+		b[r][2][2] = e[7] - f[8];
+		b[r][2][3] = e[6] - f[7];
+		b[r][2][4] = -f[6];
+	}
+
+	// 6) det(B(z)) = 0
+	double minor[8], polynomial[11];
+	memset(polynomial, 0, sizeof(polynomial));
+	const int sizes[3] = { 4, 4, 5 };
+	for (int c = 0; c < 3; c++)
+	{
+		const int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+		memset(minor, 0, sizeof(minor));
+		multiplyAdd(b[1][c1], sizes[c1], b[2][c2], sizes[c2], 1, minor);
+		multiplyAdd(b[1][c2], sizes[c2], b[2][c1], sizes[c1], -1, minor);
+		multiplyAdd(b[0][c], sizes[c], minor, sizes[c1] + sizes[c2] - 1, 1,
+			polynomial);
+	}
+
+	Mat roots;
+	solvePoly(Mat(1, 11, CV_64FC1, polynomial), roots);
+
+	// 7) x and y from the null space of B(z) for every real root
+	for (int i = 0; i < roots.total(); i++)
+	{
+		const Vec2d root = roots.at<Vec2d>(i);
+		if (abs(root[1]) > 1e-6 * (1 + abs(root[0])))
+			continue;
+
+		const double z = root[0];
+		Vec3d rows[3];
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				rows[r][c] = evaluate(b[r][c], sizes[c], z);
+
+		Vec3d xy1 = rows[0].cross(rows[1]);
+		const Vec3d xy2 = rows[0].cross(rows[2]);
+		const Vec3d xy3 = rows[1].cross(rows[2]);
+		if (norm(xy2) > norm(xy1))
+			xy1 = xy2;
+		if (norm(xy3) > norm(xy1))
+			xy1 = xy3;
+		if (abs(xy1[2]) < 1e-12)
+			continue;
+
+		const double x = xy1[0] / xy1[2];
+		const double y = xy1[1] / xy1[2];
+		essentials.push_back(basis[0] * x + basis[1] * y + basis[2] * z
+			+ basis[3]);
+	}
+}
+
+
+double PoseSolver::getThreshold() const
+{
+	return this->threshold;
+}
+
+
+void PoseSolver::setThreshold(double threshold)
+{
+	this->threshold = threshold;
+}
+
+
+double PoseSolver::getConfidence() const
+{
+	return this->confidence;
+}
+
+
+void PoseSolver::setConfidence(double confidence)
+{
+	this->confidence = confidence;
+}
+
+
+int PoseSolver::getMaxIterations() const
+{
+	return this->maxIterations;
+}
+
+
+void PoseSolver::setMaxIterations(int maxIterations)
+{
+	this->maxIterations = maxIterations;
+}
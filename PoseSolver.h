@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Estimates the relative pose of two calibrated cameras from point
+ * correspondences. Essential matrices are computed from minimal samples of 5
+ * correspondences with the five-point algorithm:
+ *
+ *     An Efficient Solution to the Five-Point Relative Pose Problem.
+ *     David Nister.
+ *     IEEE Transactions on Pattern Analysis and Machine Intelligence, 2004
+ *
+ * The samples are drawn by PROSAC (Chum and Matas, CVPR 2005), which expects
+ * the correspondences ordered by decreasing quality and tries the best ones
+ * first. Each hypothesis is verified by Wald's sequential probability ratio
+ * test (Matas and Chum, "Randomized RANSAC with Sequential Probability Ratio
+ * Test", ICCV 2005), which stops scoring a hypothesis as soon as it is likely
+ * to be bad. The Sampson errors are computed for 4 correspondences at once
+ * with SSE2, and batches of hypotheses are generated and verified in
+ * parallel.
+ *
+ * The solver has no state besides its settings, so several pairs of images
+ * may be solved at the same time.
+ */
+class PoseSolver
+{
+	static const int SAMPLE_SIZE;
+	static const int BATCH_SIZE;
+	static const double MODEL_COST;
+	static const double MODELS_PER_SAMPLE;
+	static const double INITIAL_EPSILON;
+	static const double INITIAL_DELTA;
+	static const Matx33d R90;
+
+	// normalized image coordinates of the correspondences as structure of
+	// arrays, padded to a multiple of 4
+	struct Correspondences
+	{
+		int count;
+		vector<float> x1, y1, x2, y2;
+	};
+
+	// parameters of the sequential probability ratio test
+	struct Sprt
+	{
+		double epsilon;			// probability of a point agreeing with a good model
+		double delta;			// probability of a point agreeing with a bad model
+		double threshold;		// the hypothesis is rejected above this ratio
+		double factors[5];		// ratio change by a chunk of 4 points, by inliers
+	};
+
+	// outcome of the verification of a sample's hypotheses
+	struct Hypothesis
+	{
+		Matx33d essential;
+		int inlierCount;		// of the best accepted hypothesis, -1 if none
+		int rejectedCount;
+		int rejectedTested;		// points tested and
+		int rejectedInliers;	// agreeing ones of the rejected hypotheses
+	};
+
+	class ProsacSampler;
+	class Verifier;
+
+	double threshold;
+	double confidence;
+	int maxIterations;
+
+	static void setSprtThreshold(Sprt& sprt);
+	static int getInlierMask(const Correspondences& correspondences, int index,
+		const float* essential, float threshold);
+	static int verifyHypothesis(const Correspondences& correspondences,
+		const Matx33d& essential, float threshold, const Sprt& sprt,
+		int& testedCount);
+
+public:
+	PoseSolver(void);
+	~PoseSolver(void);
+
+	// estimates the rotation and (unit) translation from the first camera to
+	// the second one (x2 = R * x1 + t) and returns the number of inliers,
+	// which are marked in inlierMask, or 0 if there is no solution
+	int solvePose(const vector<Point2f>& points1, const vector<Point2f>& points2,
+		const Matx33d& calibrationMatrix, Matx33d& rotation, Vec3d& translation,
+		vector<uchar>& inlierMask) const;
+
+	// robustly estimates the essential matrix (x2^T * E * x1 = 0) and returns
+	// the number of inliers
+	int estimateEssentialMatrix(const vector<Point2f>& points1,
+		const vector<Point2f>& points2, const Matx33d& calibrationMatrix,
+		Matx33d& essential, vector<uchar>& inlierMask) const;
+
+	// decomposes the essential matrix into the rotation and translation which
+	// puts most inliers in front of both cameras and returns their number
+	static int recoverPose(const Matx33d& essential,
+		const vector<Point2f>& points1, const vector<Point2f>& points2,
+		const Matx33d& calibrationMatrix, const vector<uchar>& inlierMask,
+		Matx33d& rotation, Vec3d& translation);
+
+	// computes the up to 10 essential matrices of 5 correspondences in
+	// normalized image coordinates
+	static void solveFivePoint(const Vec3d* q1, const Vec3d* q2,
+		vector<Matx33d>& essentials);
+
+	// maximum Sampson error of inliers in pixels
+	double getThreshold() const;
+	void setThreshold(double threshold);
+	// probability of having drawn an all-inlier sample when stopping
+	double getConfidence() const;
+	void setConfidence(double confidence);
+	int getMaxIterations() const;
+	void setMaxIterations(int maxIterations);
+};
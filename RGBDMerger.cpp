@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "RGBDMerger.h"
 
 
@@ -9,3 +10,36 @@ RGBDMerger::RGBDMerger(void)
 RGBDMerger::~RGBDMerger(void)
 {
 }
+
+
+Mat RGBDMerger::merge(const vector<Mat>& images, const vector<Mat>& depthMaps,
+	const vector<Mat>& confidenceMaps, const Mat& calibrationMatrix)
+{
+	beginScene(calibrationMatrix);
+	for (int i = 0; i < images.size(); i++)
+		addView(images.at(i), depthMaps.at(i), confidenceMaps.at(i));
+
+	return finalize();
+}
+
+
+float RGBDMerger::estimatePointSpacing(const Mat& points, int sampleStep)
+{
+	vector<float> distances;
+	for (int y = 0; y < points.rows; y += sampleStep)
+	{
+		const Vec3f* point = points.ptr<Vec3f>(y);
+		for (int x = 0; x + 1 < points.cols; x += sampleStep)
+		{
+			const float distance = (float) norm(point[x + 1] - point[x]);
+			if (distance > 0 && cvIsInf(distance) == 0 && cvIsNaN(distance) == 0)
+				distances.push_back(distance);
+		}
+	}
+	if (distances.empty())
+		return 0;
+
+	nth_element(distances.begin(), distances.begin() + distances.size() / 2,
+		distances.end());
+	return distances.at(distances.size() / 2);
+}
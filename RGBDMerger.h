@@ -16,14 +16,36 @@ using namespace cv;
  */
 class RGBDMerger
 {
+protected:
+	// median distance between horizontally neighbouring points of an
+	// image-shaped point cloud, measured on every sampleStep-th row and column,
+	// or 0 if no neighbouring points are valid
+	static float estimatePointSpacing(const Mat& points, int sampleStep);
+
 public:
 	Mat pointCloud;
 	Mat pointColors;
+	// unit normals of the points, shaped like pointCloud, empty if the merger
+	// does not estimate them
+	Mat pointNormals;
+	// for mergers whose points stem from the pixels of the views: the index of
+	// the point of each pixel in pointCloud, -1 for pixels without one (views
+	// stacked vertically, CV_32SC1), empty otherwise
+	Mat pixelIndices;
 
 	RGBDMerger(void);
 	~RGBDMerger(void);
 
+	// merges all views at once, using the incremental interface
 	virtual Mat merge(const vector<Mat>& images, const vector<Mat>& depthMaps,
-		const vector<Mat>& confidenceMaps, const Mat& calibrationMatrix) =0;
+		const vector<Mat>& confidenceMaps, const Mat& calibrationMatrix);
+
+	// incremental interface: every view is fused as soon as it is added and
+	// not referenced afterwards, so only the fused model stays in memory
+	virtual void beginScene(const Mat& calibrationMatrix) =0;
+	virtual void addView(const Mat& image, const Mat& depthMap,
+		const Mat& confidenceMap) =0;
+	// completes pointCloud and pointColors and returns the former
+	virtual Mat finalize() =0;
 };
 
@@ -1,21 +1,28 @@
 #include <iostream>		// for console output
-#include <opencv2\features2d\features2d.hpp>
+#include <unordered_map>
 #include "CameraPoseEstimator.h"
-#include "CameraPoseEstimator1.h"
+#include "CameraPoseEstimator2.h"
 #include "DepthToPointTranslator.h"
 #include "DepthToPointTranslator1.h"
 #include "RGBDMerger1.h"
 
+// the automatic voxel size is this multiple of the median distance between
+// horizontally neighbouring points, measured on every VOXEL_SIZE_SAMPLE_STEP-th
+// row and column
+const float RGBDMerger1::VOXEL_SIZE_FACTOR		= 1;
+const int RGBDMerger1::VOXEL_SIZE_SAMPLE_STEP	= 4;
+
 
 RGBDMerger1::RGBDMerger1(void)
 {
-	this->poseEstimator = new CameraPoseEstimator1();
+	this->poseEstimator = new CameraPoseEstimator2();
 	this->d2pTranslator = new DepthToPointTranslator1();
-	this->detector = new DenseFeatureDetector(1.f, 1, 0.1f, 1);
-	this->extractor = new ORB();
-	//this->matcher = new BFMatcher(NORM_HAMMING, true);
-	this->matcher = new ocl::BruteForceMatcher_OCL_base(
-		ocl::BruteForceMatcher_OCL_base::HammingDist);	// no cross-checking
+	this->voxelSize = 0;
+	this->redundancyHandling = KEEP_MOST_CONFIDENT;
+	this->minConfidence = 0;
+	this->compactOutput = true;
+	this->sceneVoxelSize = 0;
+	this->viewCount = 0;
 }
 
 
@@ -23,136 +30,340 @@ RGBDMerger1::~RGBDMerger1(void)
 {
 	delete this->poseEstimator;
 	delete this->d2pTranslator;
-	delete this->detector;
-	delete this->extractor;
-	delete this->matcher;
 }
 
 
-Mat RGBDMerger1::merge(const vector<Mat>& images, const vector<Mat>& depthMaps,
-	const vector<Mat>& confidenceMaps, const Mat& calibrationMatrix)
+void RGBDMerger1::beginScene(const Mat& calibrationMatrix)
+{
+	this->calibrationMatrix = calibrationMatrix.clone();
+	this->sceneVoxelSize = 0;
+	this->viewSize = Size();
+	this->viewCount = 0;
+	this->voxelIndices.clear();
+	this->voxels.clear();
+	this->pointCloud = Mat();
+	this->pointColors = Mat();
+	this->pointNormals = Mat();
+	this->pixelIndices = Mat();
+
+	poseEstimator->beginSequence(calibrationMatrix);
+}
+
+
+void RGBDMerger1::addView(const Mat& image, const Mat& depthMap,
+	const Mat& confidenceMap)
 {
-	assert(images.size() > 1);
+	cout << "RGBDMerger::addView(): view " << poseEstimator->rotations.size()
+		<< endl;
 
-	cout << "RGBDMerger::merge(): 1) estimate camera poses" << endl;
-	// 1) estimate camera poses
-	poseEstimator->estimateCameraPoses(images, calibrationMatrix);
+	// 1) estimate camera pose
+	poseEstimator->addImage(image);
+
+	// 2) triangulate points and estimate their normals, which face the
+	// camera, i.e. decreasing depth
+	const Mat& rotation		= poseEstimator->rotations.back();
+	const Mat& translation	= poseEstimator->translations.back();
+	d2pTranslator->translateDepthToPoints(depthMap, this->calibrationMatrix,
+		rotation, translation, this->partialReconstruction);
+
+	const Matx44d pointMatrix = d2pTranslator->getProjectionMatrix(
+		this->calibrationMatrix, rotation, translation).inv();
+	estimateNormals(this->partialReconstruction, Vec3f(-pointMatrix(0, 2),
+		-pointMatrix(1, 2), -pointMatrix(2, 2)), this->partialNormals);
+
+	if (this->sceneVoxelSize == 0)
+		this->sceneVoxelSize = (this->voxelSize > 0) ? this->voxelSize :
+			estimateVoxelSize(this->partialReconstruction);
+
+	// 3) keep the most confident sample of every voxel; until a view yields a
+	// voxel size, the points cannot be binned and are dropped
+	if (this->viewCount == 0)
+		this->viewSize = depthMap.size();
+	CV_Assert(depthMap.size() == this->viewSize);
+
+	if (this->sceneVoxelSize > 0)
+		removeRedundancies(image, confidenceMap);
+	this->viewCount++;
+}
 
-	cout << "RGBDMerger::merge(): 2) triangulate points" << endl;
-	// 2) triangulate points
-	vector<Mat> partialReconstructions = vector<Mat>(depthMaps.size());
-	for (int i = 0; i < depthMaps.size(); i++)
+
+Mat RGBDMerger1::finalize()
+{
+	if (this->redundancyHandling == AVERAGE_BY_CONFIDENCE)
+		for (int i = 0; i < this->voxels.size(); i++)
+		{
+			Voxel& voxel = this->voxels.at(i);
+			if (voxel.weight <= 0)
+				continue;
+
+			voxel.point = voxel.pointSum * (1.f / voxel.weight);
+			voxel.color = voxel.colorSum * (1.f / voxel.weight);
+		}
+
+	cout << "RGBDMerger::finalize(): keeping " << this->voxels.size() << " of "
+		<< this->viewCount * this->viewSize.area() << " points (voxel size " <<
+		this->sceneVoxelSize << ")" << endl;
+
+	if (this->compactOutput)
+		compactPoints();
+	else
 	{
-		partialReconstructions.at(i) = d2pTranslator->translateDepthToPoints(
-			depthMaps.at(i), calibrationMatrix, poseEstimator->rotations.at(i),
-			poseEstimator->translations.at(i));
+		expandPoints();
+		this->pixelIndices = Mat();
 	}
 
-	cout << "RGBDMerger::merge(): 3) find redundancies" << endl;
-	// 3) find redundancies
-	vector<vector<KeyPoint>> keyPoints;
-	vector<Mat> descriptors;
-	vector<DMatch> matches;
-	vector<vector<DMatch>> matches12, matches21;
-
-	Mat mask = Mat(images.at(0).size(), CV_8SC1, Scalar::all(0));
-	rectangle(mask, Point(32, 32), Point(images.at(0).size().width - 31,
-		images.at(0).size().height - 31), Scalar::all(255), CV_FILLED);
-	vector<Mat> masks = vector<Mat>(images.size());
-	for (int i = 0; i < masks.size(); i++)
-		mask.copyTo(masks[i]);
-
-	// prepare images for feature detection and descriptor extraction
-	vector<Mat> bwImages = vector<Mat>(images.size());
-	for (int i = 0; i < images.size(); i++)
+	this->voxelIndices.clear();
+	this->voxels.clear();
+
+	return this->pointCloud;
+}
+
+
+float RGBDMerger1::estimateVoxelSize(const Mat& points) const
+{
+	return VOXEL_SIZE_FACTOR *
+		estimatePointSpacing(points, VOXEL_SIZE_SAMPLE_STEP);
+}
+
+
+/**
+ * Estimates the normal of every point of an image-shaped point cloud as the
+ * cross product of the differences of its horizontal and vertical neighbours
+ * (one-sided at the borders), turned towards the camera.
+ */
+void RGBDMerger1::estimateNormals(const Mat& points, const Vec3f& towardsCamera,
+	Mat& normals) const
+{
+	normals.create(points.size(), CV_32FC3);
+
+	for (int y = 0; y < points.rows; y++)
 	{
-		cvtColor(images.at(i), bwImages.at(i), CV_RGB2GRAY);
-		bwImages.at(i).convertTo(bwImages.at(i), CV_8UC1, 255);
+		const Vec3f* above	= points.ptr<Vec3f>(std::max(y - 1, 0));
+		const Vec3f* row	= points.ptr<Vec3f>(y);
+		const Vec3f* below	= points.ptr<Vec3f>(std::min(y + 1, points.rows - 1));
+		Vec3f* normal		= normals.ptr<Vec3f>(y);
+
+		for (int x = 0; x < points.cols; x++)
+		{
+			const Vec3f dx = row[std::min(x + 1, points.cols - 1)] -
+				row[std::max(x - 1, 0)];
+			const Vec3f dy = below[x] - above[x];
+			Vec3f n = dx.cross(dy);
+
+			const float length = (float) norm(n);
+			if (length > 0)
+				n *= ((n.dot(towardsCamera) < 0) ? -1.f : 1.f) / length;
+			normal[x] = n;
+		}
 	}
+}
 
-	detector->detect(bwImages, keyPoints);
-	extractor->compute(bwImages, keyPoints, descriptors);
-	
-	// upload descriptors to GPU
-	vector<oclMat> oclDescriptors = vector<oclMat>(descriptors.size());
-	for (int i = 0; i < descriptors.size(); i++)
-		oclDescriptors.at(i) = oclMat(descriptors.at(i));
-	oclMat queryDescriptors;
-	
-	//Mat queryDescriptors;
-	int matchIndex, imgIdx1, imgIdx2;
-	DMatch match, match12, match21;
-	Point2f pt1, pt2;
-	float confidence1, confidence2;
-	for (imgIdx1 = images.size() - 1; imgIdx1 >= 0 ; imgIdx1--)
-	for (imgIdx2 = 0; imgIdx2 < imgIdx1; imgIdx2++)
-	{
-		//queryDescriptors = oclDescriptors.at(imgIdx1);
-		//oclDescriptors.pop_back();
-		//queryDescriptors = descriptors.at(i);
-		//descriptors.pop_back();
 
-		//matcher->clear();
-		//matcher->add(oclDescriptors);
-		//matcher->add(descriptors);
+/**
+ * Inserts the points of the current partial reconstruction into a hash grid
+ * of voxels of the scene's voxel size and keeps a single sample per voxel: the
+ * one with the highest confidence. Its point, color and normal are copied into
+ * the voxel, so the memory grows with the number of voxels only. Samples below
+ * the minimum confidence are dropped.
+ * With AVERAGE_BY_CONFIDENCE, the confidence-weighted sums of all samples of
+ * a voxel are accumulated as well and finalize() replaces the point and color
+ * of the kept sample by their means.
+ * Takes time linear in the number of points of the view.
+ */
+void RGBDMerger1::removeRedundancies(const Mat& image,
+	const Mat& confidenceMap)
+{
+	const int width			= this->viewSize.width;
+	const int height		= this->viewSize.height;
+	const float inverseSize	= 1.f / this->sceneVoxelSize;
+	const bool averaging	= this->redundancyHandling == AVERAGE_BY_CONFIDENCE;
 
-		//matcher->match(queryDescriptors, matches);
+	CV_Assert(this->partialReconstruction.type() == CV_32FC3 &&
+		image.type() == CV_32FC3 && image.size() == this->viewSize &&
+		confidenceMap.type() == CV_32FC1 &&
+		confidenceMap.size() == this->viewSize);
 
-		matcher->match(oclDescriptors.at(imgIdx1), oclDescriptors.at(imgIdx2),
-			matches);
+	// voxels are addressed by their integer coordinates, 21 bits each (far
+	// away voxels may share an entry)
+	const int64 keyMask = (1 << 21) - 1;
 
-		/*
-		matcher->knnMatch(oclDescriptors.at(imgIdx1), oclDescriptors.at(imgIdx2),
-			matches12, 2);
-		matcher->knnMatch(oclDescriptors.at(imgIdx2), oclDescriptors.at(imgIdx1),
-			matches21, 2);
-		const float distanceThreshold = 0.75;			// TODO constant
-		*/
+	for (int y = 0; y < height; y++)
+	{
+		const Vec3f* point = this->partialReconstruction.ptr<Vec3f>(y);
+		const Vec3f* normal = this->partialNormals.ptr<Vec3f>(y);
+		const Vec3f* color = image.ptr<Vec3f>(y);
+		const float* confidence = confidenceMap.ptr<float>(y);
+		int sample = (this->viewCount * height + y) * width;
 
-		for (matchIndex = 0; matchIndex < matches.size(); matchIndex++)
+		for (int x = 0; x < width; x++, sample++)
 		{
-			match12 = matches.at(matchIndex);
-			//match12 = matches12.at(matchIndex).at(0);
-			//match21 = matches21.at(match12.trainIdx).at(0);
-
-			/*
-			// cross-check and symmetric ratio test
-			if (!(match21.trainIdx == match12.queryIdx &&
-				matches12.at(matchIndex).at(0).distance / matches12.at(matchIndex).at(1).distance < distanceThreshold &&
-				matches21.at(matchIndex).at(0).distance / matches21.at(matchIndex).at(1).distance < distanceThreshold))
+			if (confidence[x] < this->minConfidence)
+				continue;
 
+			const Vec3f p = point[x];
+			if (cvIsNaN(p[0]) || cvIsNaN(p[1]) || cvIsNaN(p[2]) ||
+				cvIsInf(p[0]) || cvIsInf(p[1]) || cvIsInf(p[2]))
 				continue;
-			*/
 
-			pt1 = keyPoints.at(imgIdx1).at(match12.queryIdx).pt;
-			pt2 = keyPoints.at(imgIdx2).at(match12.trainIdx).pt;
+			const int64 key = (cvFloor(p[0] * inverseSize) & keyMask) |
+				((cvFloor(p[1] * inverseSize) & keyMask) << 21) |
+				((cvFloor(p[2] * inverseSize) & keyMask) << 42);
+			pair<unordered_map<int64, int>::iterator, bool> entry =
+				this->voxelIndices.insert(make_pair(key,
+				(int) this->voxels.size()));
+
+			if (entry.second)
+			{
+				Voxel voxel;
+				voxel.sample		= sample;
+				voxel.confidence	= confidence[x];
+				voxel.point			= p;
+				voxel.color			= color[x];
+				voxel.normal		= normal[x];
+				voxel.weight		= 0;
+				voxel.pointSum		= Vec3f();
+				voxel.colorSum		= Vec3f();
+				this->voxels.push_back(voxel);
+			}
 
-			confidence1 = confidenceMaps.at(imgIdx1).at<float>(pt1);
-			confidence2 = confidenceMaps.at(imgIdx2).at<float>(pt2);
+			// keep the more confident of the kept and the new sample
+			Voxel& voxel = this->voxels.at(entry.first->second);
+			if (confidence[x] > voxel.confidence)
+			{
+				voxel.sample		= sample;
+				voxel.confidence	= confidence[x];
+				voxel.point			= p;
+				voxel.color			= color[x];
+				voxel.normal		= normal[x];
+			}
 
-			if (confidence1 < confidence2)
-				masks.at(imgIdx1).at<uchar>(pt1) = 0;
-			else
-				masks.at(imgIdx2).at<uchar>(pt2) = 0;
+			if (averaging)
+			{
+				voxel.weight		+= confidence[x];
+				voxel.pointSum		+= confidence[x] * p;
+				voxel.colorSum		+= confidence[x] * color[x];
+			}
 		}
 	}
+}
+
 
-	cout << "RGBDMerger::merge(): 4) merge partial reconstructions" << endl;
-	// 4) merge partial reconstructions
-	Mat completeReconstruction = Mat();//partialReconstructions.at(0).clone();
-	Mat luminanceMap = Mat();//images.at(0).clone();
-	for (int i = 0; i < partialReconstructions.size(); i++)
+/**
+ * Packs the kept samples (one per voxel) into pointCloud, pointColors and
+ * pointNormals in the order of the pixels and records the index of the point
+ * of each pixel in pixelIndices.
+ */
+void RGBDMerger1::compactPoints()
+{
+	const int width = this->viewSize.width;
+
+	// pixels first refer to the voxel of their sample
+	this->pixelIndices = Mat(this->viewCount * this->viewSize.height, width,
+		CV_32SC1, Scalar(-1));
+	for (int i = 0; i < this->voxels.size(); i++)
 	{
-		// handle redundant points
-		partialReconstructions.at(i).setTo(Scalar::all(0), masks.at(i) - 255);	// flip binary mask
+		const int sample = this->voxels.at(i).sample;
+		this->pixelIndices.at<int>(sample / width, sample % width) = i;
+	}
 
-		// join partial models
-		completeReconstruction.push_back(partialReconstructions.at(i));
-		luminanceMap.push_back(images.at(i));
+	Mat points	= Mat(this->voxels.size(), 1, CV_32FC3);
+	Mat colors	= Mat(this->voxels.size(), 1, CV_32FC3);
+	Mat normals	= Mat(this->voxels.size(), 1, CV_32FC3);
+	Vec3f* point	= points.ptr<Vec3f>();
+	Vec3f* color	= colors.ptr<Vec3f>();
+	Vec3f* normal	= normals.ptr<Vec3f>();
+
+	int index = 0;
+	for (int y = 0; y < this->pixelIndices.rows; y++)
+	{
+		int* pixelIndex = this->pixelIndices.ptr<int>(y);
+		for (int x = 0; x < width; x++)
+		{
+			if (pixelIndex[x] < 0)
+				continue;
+
+			const Voxel& voxel = this->voxels.at(pixelIndex[x]);
+			pixelIndex[x]	= index;
+			point[index]	= voxel.point;
+			color[index]	= voxel.color;
+			normal[index]	= voxel.normal;
+			index++;
+		}
 	}
 
-	this->pointCloud = completeReconstruction;
-	this->pointColors = luminanceMap;
+	this->pointCloud	= points;
+	this->pointColors	= colors;
+	this->pointNormals	= normals;
+}
+
+
+/**
+ * Writes the kept samples into image-shaped pointCloud, pointColors and
+ * pointNormals (views stacked vertically), which are 0 at all other pixels.
+ */
+void RGBDMerger1::expandPoints()
+{
+	const Size size = Size(this->viewSize.width,
+		this->viewCount * this->viewSize.height);
+	this->pointCloud	= Mat(size, CV_32FC3, Scalar::all(0));
+	this->pointColors	= Mat(size, CV_32FC3, Scalar::all(0));
+	this->pointNormals	= Mat(size, CV_32FC3, Scalar::all(0));
+
+	for (int i = 0; i < this->voxels.size(); i++)
+	{
+		const Voxel& voxel	= this->voxels.at(i);
+		const int y			= voxel.sample / size.width;
+		const int x			= voxel.sample % size.width;
+		this->pointCloud.at<Vec3f>(y, x)	= voxel.point;
+		this->pointColors.at<Vec3f>(y, x)	= voxel.color;
+		this->pointNormals.at<Vec3f>(y, x)	= voxel.normal;
+	}
+}
+
+
+float RGBDMerger1::getVoxelSize() const
+{
+	return this->voxelSize;
+}
+
+
+void RGBDMerger1::setVoxelSize(float size)
+{
+	this->voxelSize = size;
+}
+
 
-	return completeReconstruction;
-}
\ No newline at end of file
+RGBDMerger1::RedundancyHandling RGBDMerger1::getRedundancyHandling() const
+{
+	return this->redundancyHandling;
+}
+
+
+void RGBDMerger1::setRedundancyHandling(RedundancyHandling handling)
+{
+	this->redundancyHandling = handling;
+}
+
+
+float RGBDMerger1::getMinConfidence() const
+{
+	return this->minConfidence;
+}
+
+
+void RGBDMerger1::setMinConfidence(float confidence)
+{
+	this->minConfidence = confidence;
+}
+
+
+bool RGBDMerger1::getCompaction() const
+{
+	return this->compactOutput;
+}
+
+
+void RGBDMerger1::setCompaction(bool enabled)
+{
+	this->compactOutput = enabled;
+}
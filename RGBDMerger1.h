@@ -1,7 +1,7 @@
 #pragma once
 
+#include <unordered_map>
 #include <opencv2\ocl\ocl.hpp>
-#include <opencv2\features2d\features2d.hpp>
 #include "RGBDMerger.h"
 #include "CameraPoseEstimator.h"
 #include "DepthToPointTranslator.h"
@@ -9,18 +9,86 @@
 class RGBDMerger1 :
 	public RGBDMerger
 {
+public:
+	// ways of merging the samples (points of all partial reconstructions)
+	// that fall into the same voxel
+	enum RedundancyHandling
+	{
+		KEEP_MOST_CONFIDENT,	// keep the sample with the highest confidence
+		AVERAGE_BY_CONFIDENCE	// replace it by the confidence-weighted mean
+	};
+
+private:
+	// used for the automatic voxel size
+	static const float VOXEL_SIZE_FACTOR;
+	static const int VOXEL_SIZE_SAMPLE_STEP;
+
+	// a voxel of the hash grid, which keeps its most confident sample and
+	// accumulates all of its samples
+	struct Voxel
+	{
+		int sample;			// pixel of the kept sample, counted over all views
+		float confidence;	// of the kept sample
+		Vec3f point;		// of the kept sample
+		Vec3f color;
+		Vec3f normal;
+		float weight;		// sum of the confidences of all samples
+		Vec3f pointSum;		// confidence-weighted sums of all samples
+		Vec3f colorSum;
+	};
+
 	CameraPoseEstimator* poseEstimator;
 	DepthToPointTranslator* d2pTranslator;
-	FeatureDetector* detector;
-	DescriptorExtractor* extractor;
-	//BFMatcher* matcher;
-	ocl::BruteForceMatcher_OCL_base* matcher;
+
+	float voxelSize;
+	RedundancyHandling redundancyHandling;
+	float minConfidence;
+	bool compactOutput;
+
+	// state of the current scene
+	Mat calibrationMatrix;
+	float sceneVoxelSize;
+	Size viewSize;
+	int viewCount;
+	unordered_map<int64, int> voxelIndices;
+	vector<Voxel> voxels;
+	Mat partialReconstruction;	// reused for the points of every view
+	Mat partialNormals;			// and their normals
+
+	float estimateVoxelSize(const Mat& points) const;
+	void estimateNormals(const Mat& points, const Vec3f& towardsCamera,
+		Mat& normals) const;
+	void removeRedundancies(const Mat& image, const Mat& confidenceMap);
+	void compactPoints();
+	void expandPoints();
 
 public:
 	RGBDMerger1(void);
 	~RGBDMerger1(void);
 
-	Mat merge(const vector<Mat>& images, const vector<Mat>& depthMaps,
-		const vector<Mat>& confidenceMaps, const Mat& calibrationMatrix);
+	void beginScene(const Mat& calibrationMatrix);
+	void addView(const Mat& image, const Mat& depthMap,
+		const Mat& confidenceMap);
+	Mat finalize();
+
+	// edge length of the voxels in which only one sample is kept, 0 (the
+	// default) chooses VOXEL_SIZE_FACTOR times the median distance of
+	// neighbouring points of the first partial reconstruction which has any
+	float getVoxelSize() const;
+	void setVoxelSize(float size);
+
+	RedundancyHandling getRedundancyHandling() const;
+	void setRedundancyHandling(RedundancyHandling handling);
+
+	// samples with a lower confidence are dropped, 0 (the default) keeps all
+	float getMinConfidence() const;
+	void setMinConfidence(float confidence);
+
+	// with compaction (the default), finalize() packs the kept points, colors
+	// and normals and sets pixelIndices, otherwise the points of all pixels
+	// are returned with dropped ones set to 0; either way, only the kept
+	// samples are stored until finalize()
+	bool getCompaction() const;
+	void setCompaction(bool enabled);
 };
 
@@ -0,0 +1,528 @@
+#include <iostream>		// for console output
+#include <algorithm>
+#include "CameraPoseEstimator2.h"
+#include "DepthToPointTranslator1.h"
+#include "RGBDMerger2.h"
+
+const int RGBDMerger2::BLOCK_SIZE				= 8;
+const int RGBDMerger2::BLOCK_VOXELS				= 8 * 8 * 8;
+const float RGBDMerger2::TRUNCATION_FACTOR		= 4;
+const float RGBDMerger2::MAX_WEIGHT				= 100;
+const int RGBDMerger2::VOXEL_SIZE_SAMPLE_STEP	= 4;
+
+const int RGBDMerger2::EDGE_CORNERS[12][2] = {
+	{0, 1}, {2, 3}, {4, 5}, {6, 7},		// along x
+	{0, 2}, {1, 3}, {4, 6}, {5, 7},		// along y
+	{0, 4}, {1, 5}, {2, 6}, {3, 7}		// along z
+};
+const vector<vector<int> > RGBDMerger2::TRIANGLE_TABLE =
+	RGBDMerger2::buildTriangleTable();
+
+
+/**
+ * Integrates a depth map into the voxels of a list of blocks. Every voxel is
+ * projected into the depth map, its signed distance to the observed surface
+ * along the viewing ray is truncated and averaged with its previous value,
+ * weighted by the confidence of the observation. Voxels more than the
+ * truncation distance behind the surface are occluded and left untouched.
+ * Blocks are processed in parallel, each by one thread.
+ */
+class RGBDMerger2::Integrator : public ParallelLoopBody
+{
+	RGBDMerger2& merger;
+	const Mat& image;
+	const Mat& depthMap;
+	const Mat& confidenceMap;
+	const Matx44d projection;
+	const float voxelSize;
+	const float depthScale;
+	const float truncation;
+	const vector<int>& touched;
+
+public:
+	Integrator(RGBDMerger2& merger, const Mat& image, const Mat& depthMap,
+		const Mat& confidenceMap, const Matx44d& projection, float voxelSize,
+		float depthScale, float truncation, const vector<int>& touched) :
+		merger(merger), image(image), depthMap(depthMap),
+		confidenceMap(confidenceMap), projection(projection),
+		voxelSize(voxelSize), depthScale(depthScale), truncation(truncation),
+		touched(touched)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const float inverseTruncation = 1.f / truncation;
+
+		// homogeneous image coordinates of a voxel are those of the block
+		// origin plus multiples of the projected voxel steps
+		const Vec4d stepX = Vec4d(projection(0, 0), projection(1, 0),
+			projection(2, 0), projection(3, 0)) * voxelSize;
+		const Vec4d stepY = Vec4d(projection(0, 1), projection(1, 1),
+			projection(2, 1), projection(3, 1)) * voxelSize;
+		const Vec4d stepZ = Vec4d(projection(0, 2), projection(1, 2),
+			projection(2, 2), projection(3, 2)) * voxelSize;
+
+		for (int i = range.start; i < range.end; i++)
+		{
+			const int blockIndex	= touched.at(i);
+			const Vec3i origin		= merger.blocks.at(blockIndex) * BLOCK_SIZE;
+			Voxel* voxel			= &merger.voxels.at(blockIndex * BLOCK_VOXELS);
+
+			const Vec4d originPoint = projection * Vec4d(origin[0] * voxelSize,
+				origin[1] * voxelSize, origin[2] * voxelSize, 1);
+
+			for (int z = 0; z < BLOCK_SIZE; z++)
+			for (int y = 0; y < BLOCK_SIZE; y++)
+			{
+				Vec4d point = originPoint + stepZ * z + stepY * y;
+				for (int x = 0; x < BLOCK_SIZE; x++, voxel++, point += stepX)
+				{
+					if (point[3] <= 0)
+						continue;
+
+					const double w	= 1. / point[3];
+					const int px	= cvRound(point[0] * w);
+					const int py	= cvRound(point[1] * w);
+					if (px < 0 || py < 0 || px >= depthMap.cols ||
+						py >= depthMap.rows)
+						continue;
+
+					const float depth		= depthMap.at<float>(py, px);
+					const float confidence	= confidenceMap.at<float>(py, px);
+					if (!(depth > 0) || cvIsInf(depth) || !(confidence > 0))
+						continue;
+
+					const float distance =
+						(depth - (float) (point[2] * w)) * depthScale;
+					if (distance < -truncation)
+						continue;
+
+					const float value = std::min(1.f, distance * inverseTruncation);
+					const float weight = voxel->weight + confidence;
+					voxel->distance	= (voxel->distance * voxel->weight +
+						value * confidence) / weight;
+					voxel->color	= (voxel->color * voxel->weight +
+						image.at<Vec3f>(py, px) * confidence) * (1.f / weight);
+					voxel->weight	= std::min(weight, MAX_WEIGHT);
+				}
+			}
+		}
+	}
+};
+
+
+RGBDMerger2::RGBDMerger2(void)
+{
+	this->poseEstimator = new CameraPoseEstimator2();
+	this->d2pTranslator = new DepthToPointTranslator1();
+	this->voxelSize = 0;
+	this->sceneVoxelSize = 0;
+}
+
+
+RGBDMerger2::~RGBDMerger2(void)
+{
+	delete this->poseEstimator;
+	delete this->d2pTranslator;
+}
+
+
+void RGBDMerger2::beginScene(const Mat& calibrationMatrix)
+{
+	this->calibrationMatrix = calibrationMatrix.clone();
+	this->sceneVoxelSize = 0;
+	this->blocks.clear();
+	this->voxels.clear();
+	this->blockIndices.clear();
+
+	poseEstimator->beginSequence(calibrationMatrix);
+}
+
+
+void RGBDMerger2::addView(const Mat& image, const Mat& depthMap,
+	const Mat& confidenceMap)
+{
+	CV_Assert(image.type() == CV_32FC3 && depthMap.type() == CV_32FC1 &&
+		confidenceMap.type() == CV_32FC1);
+
+	const int view = poseEstimator->rotations.size();
+
+	// 1) estimate camera pose
+	poseEstimator->addImage(image);
+	const Mat& rotation		= poseEstimator->rotations.back();
+	const Mat& translation	= poseEstimator->translations.back();
+
+	if (this->sceneVoxelSize == 0)
+		this->sceneVoxelSize = (this->voxelSize > 0) ? this->voxelSize :
+			estimatePointSpacing(d2pTranslator->translateDepthToPoints(
+			depthMap, this->calibrationMatrix, rotation, translation),
+			VOXEL_SIZE_SAMPLE_STEP);
+	const float size		= this->sceneVoxelSize;
+	const float truncation	= TRUNCATION_FACTOR * size;
+	if (size == 0)
+	{
+		cout << "RGBDMerger::addView(): view " << view << " has no valid "
+			"neighbouring depths to choose the voxel size, skipping it" << endl;
+		return;
+	}
+
+	// 2) integrate depth map
+	const Matx44d projection = d2pTranslator->getProjectionMatrix(
+		this->calibrationMatrix, rotation, translation);
+	const Matx44d pointMatrix = projection.inv();
+
+	// the camera model of DepthToPointTranslator1 is affine, so a unit of
+	// depth is the same distance everywhere
+	const float depthScale = (float) norm(Vec3d(pointMatrix(0, 2),
+		pointMatrix(1, 2), pointMatrix(2, 2)));
+
+	vector<int> touched;
+	allocateBlocks(depthMap, confidenceMap, pointMatrix, size,
+		truncation / depthScale, touched);
+	parallel_for_(Range(0, touched.size()), Integrator(*this, image,
+		depthMap, confidenceMap, projection, size, depthScale, truncation,
+		touched));
+
+	cout << "RGBDMerger::addView(): view " << view << " touched " <<
+		touched.size() << " of " << blocks.size() << " blocks (voxel size " <<
+		size << ")" << endl;
+}
+
+
+Mat RGBDMerger2::finalize()
+{
+	// 3) extract surface
+	extractSurface(this->sceneVoxelSize);
+
+	cout << "RGBDMerger::finalize(): " << pointCloud.rows << " vertices, " <<
+		triangles.rows << " triangles" << endl;
+
+	return this->pointCloud;
+}
+
+
+/**
+ * Generates the marching cubes configurations from the faces of the cube
+ * instead of tabulating them by hand. The surface crosses every edge whose
+ * corners lie on different sides. On each face it separates the outside
+ * corners from the inside ones by segments, which are chained into closed
+ * loops around the cube and triangulated as fans. Faces with two inside
+ * corners on a diagonal always connect them; as this depends on the face
+ * alone, neighbouring cubes agree and the surface is closed. Inside corners
+ * are those with a negative distance.
+ */
+vector<vector<int> > RGBDMerger2::buildTriangleTable()
+{
+	// faces as cycles of corners, counter-clockwise seen from outside
+	int faces[6][4];
+	for (int axis = 0; axis < 3; axis++)
+	for (int side = 0; side < 2; side++)
+	{
+		const int u		= 1 << ((axis + 1) % 3);
+		const int v		= 1 << ((axis + 2) % 3);
+		const int base	= side << axis;
+		const int cycle[4] = { base, base | u, base | u | v, base | v };
+		for (int k = 0; k < 4; k++)
+			faces[axis * 2 + side][k] = cycle[(side == 1) ? k : 3 - k];
+	}
+
+	int edges[8][8];
+	for (int e = 0; e < 12; e++)
+	{
+		edges[EDGE_CORNERS[e][0]][EDGE_CORNERS[e][1]] = e;
+		edges[EDGE_CORNERS[e][1]][EDGE_CORNERS[e][0]] = e;
+	}
+
+	vector<vector<int> > table = vector<vector<int> >(256);
+	for (int configuration = 0; configuration < 256; configuration++)
+	{
+		// 1) on every face, connect each edge on which the cycle leaves the
+		// inside to the next one on which it enters it again
+		int next[12];
+		fill(next, next + 12, -1);
+		for (int f = 0; f < 6; f++)
+		{
+			int crossing[4];	// 1 leaving, -1 entering, 0 none
+			for (int k = 0; k < 4; k++)
+			{
+				const bool inside0 = (configuration >> faces[f][k]) & 1;
+				const bool inside1 = (configuration >> faces[f][(k + 1) % 4]) & 1;
+				crossing[k] = (inside0 == inside1) ? 0 : (inside0 ? 1 : -1);
+			}
+
+			for (int k = 0; k < 4; k++)
+			{
+				if (crossing[k] != 1)
+					continue;
+				int j = (k + 1) % 4;
+				while (crossing[j] != -1)
+					j = (j + 1) % 4;
+				next[edges[faces[f][k]][faces[f][(k + 1) % 4]]] =
+					edges[faces[f][j]][faces[f][(j + 1) % 4]];
+			}
+		}
+
+		// 2) follow the segments around the loops and triangulate them
+		bool visited[12] = { false };
+		for (int e = 0; e < 12; e++)
+		{
+			if (next[e] < 0 || visited[e])
+				continue;
+
+			vector<int> loop;
+			for (int i = e; !visited[i]; i = next[i])
+			{
+				visited[i] = true;
+				loop.push_back(i);
+			}
+
+			// fan from a vertex whose diagonals do not run along a face, as
+			// the ones of the neighbouring cube might run there as well
+			const int n = loop.size();
+			int first = 0, minCount = n;
+			for (int s = 0; s < n; s++)
+			{
+				int count = 0;
+				for (int i = 2; i + 1 < n; i++)
+				{
+					const int* a = EDGE_CORNERS[loop.at(s)];
+					const int* b = EDGE_CORNERS[loop.at((s + i) % n)];
+					const int common = ~(a[0] ^ a[1]) & ~(a[0] ^ b[0]) &
+						~(b[0] ^ b[1]) & 7;
+					if (common != 0)
+						count++;
+				}
+				if (count < minCount)
+				{
+					minCount = count;
+					first = s;
+				}
+			}
+
+			// the loops run clockwise seen from outside
+			for (int i = 1; i + 1 < n; i++)
+			{
+				table.at(configuration).push_back(loop.at(first));
+				table.at(configuration).push_back(loop.at((first + i + 1) % n));
+				table.at(configuration).push_back(loop.at((first + i) % n));
+			}
+		}
+	}
+
+	return table;
+}
+
+
+int64 RGBDMerger2::getBlockKey(int x, int y, int z)
+{
+	// 21 bits per coordinate (far away blocks may share an entry)
+	const int64 keyMask = (1 << 21) - 1;
+	return (x & keyMask) | ((y & keyMask) << 21) | ((z & keyMask) << 42);
+}
+
+
+int RGBDMerger2::allocateBlock(int x, int y, int z)
+{
+	pair<unordered_map<int64, int>::iterator, bool> entry =
+		this->blockIndices.insert(make_pair(getBlockKey(x, y, z),
+		(int) this->blocks.size()));
+
+	if (entry.second)
+	{
+		Voxel empty;
+		empty.distance	= 0;
+		empty.weight	= 0;
+		empty.color		= Vec3f();
+		this->blocks.push_back(Vec3i(x, y, z));
+		this->voxels.resize(this->voxels.size() + BLOCK_VOXELS, empty);
+	}
+
+	return entry.first->second;
+}
+
+
+const RGBDMerger2::Voxel* RGBDMerger2::findVoxel(int x, int y, int z) const
+{
+	const int bx = cvFloor((float) x / BLOCK_SIZE);
+	const int by = cvFloor((float) y / BLOCK_SIZE);
+	const int bz = cvFloor((float) z / BLOCK_SIZE);
+
+	unordered_map<int64, int>::const_iterator entry =
+		this->blockIndices.find(getBlockKey(bx, by, bz));
+	if (entry == this->blockIndices.end())
+		return NULL;
+
+	return &this->voxels.at(entry->second * BLOCK_VOXELS +
+		(x - bx * BLOCK_SIZE) + BLOCK_SIZE * ((y - by * BLOCK_SIZE) +
+		BLOCK_SIZE * (z - bz * BLOCK_SIZE)));
+}
+
+
+/**
+ * Allocates the blocks within the truncation distance (given in units of
+ * depth) in front of and behind the observed surface and returns the indices
+ * of all of them in touched. The band is sampled at half the block size.
+ */
+void RGBDMerger2::allocateBlocks(const Mat& depthMap, const Mat& confidenceMap,
+	const Matx44d& pointMatrix, float voxelSize, float depthTruncation,
+	vector<int>& touched)
+{
+	const float blockLength	= BLOCK_SIZE * voxelSize;
+	const float inverseLength = 1.f / blockLength;
+	const int steps = max(1, (int) ceil(2 * TRUNCATION_FACTOR / (BLOCK_SIZE / 2)));
+
+	touched.clear();
+	for (int y = 0; y < depthMap.rows; y++)
+	{
+		const float* depth		= depthMap.ptr<float>(y);
+		const float* confidence	= confidenceMap.ptr<float>(y);
+
+		for (int x = 0; x < depthMap.cols; x++)
+		{
+			if (!(depth[x] > 0) || cvIsInf(depth[x]) || !(confidence[x] > 0))
+				continue;
+
+			for (int k = 0; k <= steps; k++)
+			{
+				const double d = depth[x] +
+					depthTruncation * (2. * k / steps - 1);
+				const Vec4d point = pointMatrix * Vec4d(x, y, d, 1);
+				const double w = inverseLength / point[3];
+				touched.push_back(allocateBlock(cvFloor(point[0] * w),
+					cvFloor(point[1] * w), cvFloor(point[2] * w)));
+			}
+		}
+	}
+
+	sort(touched.begin(), touched.end());
+	touched.erase(unique(touched.begin(), touched.end()), touched.end());
+}
+
+
+/**
+ * Extracts the zero crossing of the TSDF by marching cubes. Every cube
+ * between 8 observed voxels belongs to the block of its lowest corner.
+ * Vertices are shared by the cubes around their edge, their colors are
+ * interpolated like their positions and their normals point outwards.
+ */
+void RGBDMerger2::extractSurface(float voxelSize)
+{
+	const int64 keyMask = (1 << 20) - 1;
+	unordered_map<int64, int> vertexIndices;
+	vector<Vec3f> vertices, colors;
+	vector<Vec3i> faces;
+
+	const Voxel* corners[8];
+	int cornerCoordinates[8][3];
+	for (int b = 0; b < this->blocks.size(); b++)
+	{
+		const Vec3i origin	= this->blocks.at(b) * BLOCK_SIZE;
+		const Voxel* block	= &this->voxels.at(b * BLOCK_VOXELS);
+
+		for (int z = 0; z < BLOCK_SIZE; z++)
+		for (int y = 0; y < BLOCK_SIZE; y++)
+		for (int x = 0; x < BLOCK_SIZE; x++)
+		{
+			int configuration = 0;
+			bool observed = true;
+			for (int c = 0; c < 8 && observed; c++)
+			{
+				const int cx = x + (c & 1);
+				const int cy = y + (c >> 1 & 1);
+				const int cz = z + (c >> 2 & 1);
+				cornerCoordinates[c][0] = origin[0] + cx;
+				cornerCoordinates[c][1] = origin[1] + cy;
+				cornerCoordinates[c][2] = origin[2] + cz;
+
+				if (cx < BLOCK_SIZE && cy < BLOCK_SIZE && cz < BLOCK_SIZE)
+					corners[c] = block + cx + BLOCK_SIZE * (cy + BLOCK_SIZE * cz);
+				else
+					corners[c] = findVoxel(cornerCoordinates[c][0],
+						cornerCoordinates[c][1], cornerCoordinates[c][2]);
+
+				observed = corners[c] != NULL && corners[c]->weight > 0;
+				if (observed && corners[c]->distance < 0)
+					configuration |= 1 << c;
+			}
+
+			if (!observed || configuration == 0 || configuration == 255)
+				continue;
+
+			const vector<int>& cubeTriangles = TRIANGLE_TABLE.at(configuration);
+			int face[3];
+			for (int i = 0; i < cubeTriangles.size(); i++)
+			{
+				const int edge	= cubeTriangles.at(i);
+				const int axis	= edge / 4;
+				const int c0	= EDGE_CORNERS[edge][0];
+				const int c1	= EDGE_CORNERS[edge][1];
+				const int* p	= cornerCoordinates[c0];
+
+				const int64 key = (p[0] & keyMask) | ((p[1] & keyMask) << 20) |
+					((p[2] & keyMask) << 40) | ((int64) axis << 60);
+				pair<unordered_map<int64, int>::iterator, bool> entry =
+					vertexIndices.insert(make_pair(key, (int) vertices.size()));
+
+				if (entry.second)
+				{
+					const Voxel& v0 = *corners[c0];
+					const Voxel& v1 = *corners[c1];
+					const float t = v0.distance / (v0.distance - v1.distance);
+
+					Vec3f position = Vec3f(p[0], p[1], p[2]);
+					position[axis] += t;
+					vertices.push_back(position * voxelSize);
+					colors.push_back(v0.color + (v1.color - v0.color) * t);
+				}
+
+				face[i % 3] = entry.first->second;
+				if (i % 3 == 2)
+					faces.push_back(Vec3i(face[0], face[1], face[2]));
+			}
+		}
+	}
+
+	// vertex normals are the sums of the normals of their triangles, weighted
+	// by area
+	vector<Vec3f> normals = vector<Vec3f>(vertices.size(), Vec3f());
+	for (int i = 0; i < faces.size(); i++)
+	{
+		const Vec3i& f = faces.at(i);
+		const Vec3f n = (vertices.at(f[1]) - vertices.at(f[0])).cross(
+			vertices.at(f[2]) - vertices.at(f[0]));
+		normals.at(f[0]) += n;
+		normals.at(f[1]) += n;
+		normals.at(f[2]) += n;
+	}
+	for (int i = 0; i < normals.size(); i++)
+	{
+		const float length = (float) norm(normals.at(i));
+		if (length > 0)
+			normals.at(i) *= 1.f / length;
+	}
+
+	this->pointCloud	= Mat(vertices, true);
+	this->pointColors	= Mat(colors, true);
+	this->pointNormals	= Mat(normals, true);
+	this->pixelIndices	= Mat();
+	this->triangles		= Mat(faces, true);
+}
+
+
+float RGBDMerger2::getVoxelSize() const
+{
+	return this->voxelSize;
+}
+
+
+void RGBDMerger2::setVoxelSize(float size)
+{
+	this->voxelSize = size;
+}
+
+
+int RGBDMerger2::getBlockCount() const
+{
+	return this->blocks.size();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <unordered_map>
+#include "RGBDMerger.h"
+#include "CameraPoseEstimator.h"
+#include "DepthToPointTranslator.h"
+
+/**
+ * Merges RGB+D maps by volumetric fusion: every depth map is integrated into a
+ * truncated signed distance function (TSDF), weighted by its confidence map,
+ * and the surface is extracted by marching cubes. Only blocks of voxels near
+ * the observed surfaces are stored (voxel block hashing), so memory scales
+ * with the surface area instead of the number of shots.
+ *
+ * After finalize(), pointCloud, pointColors and pointNormals hold the vertices
+ * of the surface (Nx1, CV_32FC3) and triangles their indices (Mx1, CV_32SC3). Triangles are
+ * oriented counter-clockwise seen from outside, i.e. from the cameras.
+ */
+class RGBDMerger2 :
+	public RGBDMerger
+{
+	// voxel blocks have BLOCK_SIZE^3 voxels
+	static const int BLOCK_SIZE;
+	static const int BLOCK_VOXELS;
+	// the truncation distance is this multiple of the voxel size
+	static const float TRUNCATION_FACTOR;
+	// weights of voxels do not grow beyond it, so they keep adapting
+	static const float MAX_WEIGHT;
+	// the automatic voxel size is measured on every VOXEL_SIZE_SAMPLE_STEP-th
+	// row and column
+	static const int VOXEL_SIZE_SAMPLE_STEP;
+	// the two corners of the 12 edges of a cube, corner c is offset by
+	// (c & 1, c >> 1 & 1, c >> 2 & 1), edge e is parallel to axis e / 4
+	static const int EDGE_CORNERS[12][2];
+	// the edges of a cube which the triangles of its 256 configurations
+	// connect, three per triangle
+	static const vector<vector<int> > TRIANGLE_TABLE;
+
+	// a voxel of the TSDF
+	struct Voxel
+	{
+		float distance;		// truncated signed distance divided by truncation
+		float weight;		// sum of the confidences of its observations
+		Vec3f color;		// weighted mean of the colors of its observations
+	};
+
+	class Integrator;
+
+	CameraPoseEstimator* poseEstimator;
+	DepthToPointTranslator* d2pTranslator;
+
+	float voxelSize;
+
+	// state of the current scene
+	Mat calibrationMatrix;
+	float sceneVoxelSize;
+
+	// block coordinates, voxels of all blocks (BLOCK_VOXELS each) and their
+	// index by block key
+	vector<Vec3i> blocks;
+	vector<Voxel> voxels;
+	unordered_map<int64, int> blockIndices;
+
+	static vector<vector<int> > buildTriangleTable();
+	static int64 getBlockKey(int x, int y, int z);
+
+	int allocateBlock(int x, int y, int z);
+	const Voxel* findVoxel(int x, int y, int z) const;
+	void allocateBlocks(const Mat& depthMap, const Mat& confidenceMap,
+		const Matx44d& pointMatrix, float voxelSize, float depthTruncation,
+		vector<int>& touched);
+	void extractSurface(float voxelSize);
+
+public:
+	Mat triangles;
+
+	RGBDMerger2(void);
+	~RGBDMerger2(void);
+
+	void beginScene(const Mat& calibrationMatrix);
+	void addView(const Mat& image, const Mat& depthMap,
+		const Mat& confidenceMap);
+	Mat finalize();
+
+	// edge length of the voxels, 0 (the default) chooses the median distance
+	// of neighbouring points of the first depth map
+	float getVoxelSize() const;
+	void setVoxelSize(float size);
+
+	// number of allocated voxel blocks of the current scene
+	int getBlockCount() const;
+};
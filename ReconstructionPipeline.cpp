@@ -17,33 +17,32 @@ ReconstructionPipeline::~ReconstructionPipeline(void)
 }
 
 
-void ReconstructionPipeline::reconstructScene(const vector<LightFieldPicture>&
-	lightfields)
+void ReconstructionPipeline::reconstructScene(const vector<string>& lfpPaths)
 {
-	int lfpCount = lightfields.size();
-	vector<Mat> depthMaps = vector<Mat>(lfpCount);
-	vector<Mat> confidenceMaps = vector<Mat>(lfpCount);
-	vector<Mat> aifImages = vector<Mat>(lfpCount);
+	int lfpCount = lfpPaths.size();
 
-	//cout << "starting depth estimation" << endl;
+	// the sub-aperture image atlas is only needed without a memory budget,
+	// otherwise the depth estimation extracts the tiles' images itself
+	const bool extractAtlas = (estimator->getMemoryBudget() == 0);
 
-	// estimate depth,...
+	// load, estimate depth and fuse each view as soon as it is ready, so only
+	// the current light field and the merged model are kept
 	for (int i = 0; i < lfpCount; i++)
 	{
-		estimator->estimateDepth(lightfields.at(i));
-		depthMaps[i] = estimator->getDepthMap();
-		confidenceMaps[i] = estimator->getConfidenceMap();
-		aifImages[i] = estimator->getExtendedDepthOfFieldImage();	// implicite download?
-	}
-
-	//cout << "starting model fusion" << endl;
+		const LightFieldPicture lightfield(lfpPaths.at(i), extractAtlas);
+		if (i == 0)
+			merger->beginScene(lightfield.getCalibrationMatrix());
 
-	// merge partial reconstructions
-	const Mat calibrationMatrix = lightfields.at(0).getCalibrationMatrix();
-	merger->merge(aifImages, depthMaps, confidenceMaps, calibrationMatrix);
+		estimator->estimateDepth(lightfield);
+		merger->addView(estimator->getExtendedDepthOfFieldImage(),	// implicite download?
+			estimator->getDepthMap(), estimator->getConfidenceMap());
+	}
+	merger->finalize();
 
 	// get results from merger
 	this->pointCloud	= merger->pointCloud;
 	this->pointColors	= merger->pointColors;
+	this->pointNormals	= merger->pointNormals;
+	this->pixelIndices	= merger->pixelIndices;
 }
 
@@ -19,11 +19,13 @@ class ReconstructionPipeline
 	RGBDMerger* merger;
 
 public:
-	Mat pointCloud, pointColors;
+	Mat pointCloud, pointColors, pointNormals, pixelIndices;
 
 	ReconstructionPipeline(void);
 	~ReconstructionPipeline(void);
 
-	void reconstructScene(const vector<LightFieldPicture>& lightfields);
+	// loads the light fields one at a time, so that only the current one and
+	// the merged model are kept in memory
+	void reconstructScene(const vector<string>& lfpPaths);
 };
 
@@ -0,0 +1,96 @@
+#include "ScratchArena.h"
+
+
+ScratchArena::ScratchArena(void)
+{
+	this->allocationCount = 0;
+}
+
+
+ScratchArena::~ScratchArena(void)
+{
+}
+
+
+/**
+ * Returns the buffer of the slot after counting whether its user reallocated
+ * it since it was seen last.
+ */
+oclMat& ScratchArena::getDeviceSlot(const int slot)
+{
+	if (slot >= (int) this->deviceBuffers.size())
+	{
+		this->deviceBuffers.resize(slot + 1);
+		this->deviceData.resize(slot + 1, NULL);
+	}
+
+	oclMat& buffer = this->deviceBuffers[slot];
+	if (buffer.data != this->deviceData[slot])
+	{
+		this->deviceData[slot] = buffer.data;
+		this->allocationCount++;
+	}
+
+	return buffer;
+}
+
+
+oclMat& ScratchArena::getDeviceBuffer(const int slot, const Size& size,
+	const int type)
+{
+	oclMat& buffer = getDeviceSlot(slot);
+	if (buffer.size() != size || buffer.type() != type)
+	{
+		buffer.create(size, type);
+		this->deviceData[slot] = buffer.data;
+		this->allocationCount++;
+	}
+
+	return buffer;
+}
+
+
+oclMat& ScratchArena::getDeviceBuffer(const int slot)
+{
+	return getDeviceSlot(slot);
+}
+
+
+Mat& ScratchArena::getHostBuffer(const int slot, const Size& size,
+	const int type)
+{
+	if (slot >= (int) this->hostBuffers.size())
+		this->hostBuffers.resize(slot + 1);
+
+	Mat& buffer = this->hostBuffers[slot];
+	if (buffer.size() != size || buffer.type() != type)
+	{
+		buffer.create(size, type);
+		this->allocationCount++;
+	}
+
+	return buffer;
+}
+
+
+/**
+ * Includes the reallocations of buffers which were not handed out again since
+ * their users reallocated them.
+ */
+size_t ScratchArena::getAllocationCount() const
+{
+	size_t count = this->allocationCount;
+	for (size_t i = 0; i < this->deviceBuffers.size(); i++)
+		if (this->deviceBuffers[i].data != this->deviceData[i])
+			count++;
+
+	return count;
+}
+
+
+void ScratchArena::resetAllocationCount()
+{
+	for (size_t i = 0; i < this->deviceBuffers.size(); i++)
+		this->deviceData[i] = this->deviceBuffers[i].data;
+	this->allocationCount = 0;
+}
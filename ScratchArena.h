@@ -0,0 +1,47 @@
+#pragma once
+
+#include <deque>
+#include <opencv2/core/core.hpp>
+#include <opencv2/ocl/ocl.hpp>
+
+using namespace std;
+using namespace cv;
+using namespace ocl;
+
+/**
+ * A pool of reusable buffers for the temporaries of repeatedly executed
+ * computations.
+ *
+ * Buffers are addressed by slot numbers. A slot's buffer is only (re)allocated
+ * if the requested size or type differs from its current one, so a loop that
+ * requests the same buffers in every iteration allocates in its first
+ * iteration only. The allocation counter can be used to verify that.
+ *
+ * Buffers which are sized by the functions writing them (e.g. the reduction
+ * buffer of ocl::minMax_buf()) are handed out without a size. Their
+ * reallocations are counted by comparing their data pointer with the one
+ * seen last.
+ */
+class ScratchArena
+{
+	// a deque keeps references to existing slots valid while it grows
+	deque<oclMat> deviceBuffers;
+	deque<Mat> hostBuffers;
+	vector<const uchar*> deviceData;	// of each device buffer when last seen
+	size_t allocationCount;
+
+	oclMat& getDeviceSlot(const int slot);
+
+public:
+	ScratchArena(void);
+	~ScratchArena(void);
+
+	oclMat& getDeviceBuffer(const int slot, const Size& size, const int type);
+	// the buffer as it was left by its last user
+	oclMat& getDeviceBuffer(const int slot);
+	Mat& getHostBuffer(const int slot, const Size& size, const int type);
+
+	// number of buffer (re)allocations since construction or the last reset
+	size_t getAllocationCount() const;
+	void resetAllocationCount();
+};
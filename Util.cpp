@@ -165,28 +165,40 @@ oclMat extractRayCountMat(const oclMat& image)
 void normalizeByRayCount(oclMat& image, const oclMat& rayCountMat)
 {
 	oclMat rayCountMatMultiChannel;
+	normalizeByRayCount(image, rayCountMat, rayCountMatMultiChannel);
+}
+
+
+void normalizeByRayCount(oclMat& image, const oclMat& rayCountMat,
+	oclMat& multiChannelRayCount)
+{
+	// the channels only reference rayCountMat
 	vector<oclMat> channels = vector<oclMat>(image.channels());
 	for (int i = 0; i < channels.size(); i++)
 		channels[i] = rayCountMat;
-	ocl::merge(channels, rayCountMatMultiChannel);
+	ocl::merge(channels, multiChannelRayCount);
 
-	ocl::divide(image, rayCountMatMultiChannel, image);
+	ocl::divide(image, multiChannelRayCount, image);
 }
 
 
 void normalize(oclMat& mat)
 {
-	vector<oclMat> channels;
-	ocl::split(mat, channels);
+	oclMat reductionBuffer;
+	normalize(mat, reductionBuffer);
+}
 
-	double minVal, maxVal, totalMaxVal = -1;
-	for(int i = 0; i < channels.size(); i++)
-	{
-		minMaxLoc(channels.at(i), &minVal, &maxVal);
-		totalMaxVal = max(totalMaxVal, maxVal);
-	}
 
-	ocl::multiply(1. / totalMaxVal, mat, mat);
+/**
+ * Divides by the maximum of all channels.
+ */
+void normalize(oclMat& mat, oclMat& reductionBuffer)
+{
+	double minVal, maxVal;
+	ocl::minMax_buf(mat.reshape(1), &minVal, &maxVal, oclMat(),
+		reductionBuffer);
+
+	ocl::multiply(1. / maxVal, mat, mat);
 }
 
 void visualizeCameraTrajectory(const CameraPoseEstimator& estimator,
@@ -233,7 +245,8 @@ void visualizeCameraTrajectory(const CameraPoseEstimator& estimator,
 	myWindow.spin();
 }
 
-void visualizePointCloud(const Mat& pointCloud, const Mat& image)
+void visualizePointCloud(const Mat& pointCloud, const Mat& image,
+	const Mat& pixelIndices)
 {
 	/// Create a window
 	viz::Viz3d myWindow("Coordinate Frame");
@@ -245,28 +258,50 @@ void visualizePointCloud(const Mat& pointCloud, const Mat& image)
 	image.convertTo(colors, CV_8U, 255);
 	viz::WCloud cloudWidget = viz::WCloud(pointCloud, colors);
 
-	const int width		= pointCloud.size().width;
-	const int height	= pointCloud.size().height;
+	// triangulate the pixel grid, skipping pixels without a point
+	Mat indices = pixelIndices;
+	if (indices.empty())
+	{
+		indices = Mat(pointCloud.size(), CV_32SC1);
+		for (int i = 0; i < indices.total(); i++)
+			indices.ptr<int>()[i] = i;
+	}
+
+	const int width		= indices.size().width;
+	const int height	= indices.size().height;
 	vector<int> polygons = vector<int>();
 	for (int y = 0; y < height - 1; y++)
-	for (int x = 0; x < width - 1; x++)
 	{
-		polygons.push_back(3);
-		polygons.push_back(y * width + x);
-		polygons.push_back(y * width + (x + 1));
-		polygons.push_back((y + 1) * width + x);
-
-		polygons.push_back(3);
-		polygons.push_back((y + 1) * width + (x + 1));
-		polygons.push_back((y + 1) * width + x);
-		polygons.push_back(y * width + (x + 1));
+		const int* row0 = indices.ptr<int>(y);
+		const int* row1 = indices.ptr<int>(y + 1);
+		for (int x = 0; x < width - 1; x++)
+		{
+			if (row0[x] >= 0 && row0[x + 1] >= 0 && row1[x] >= 0)
+			{
+				polygons.push_back(3);
+				polygons.push_back(row0[x]);
+				polygons.push_back(row0[x + 1]);
+				polygons.push_back(row1[x]);
+			}
+
+			if (row1[x + 1] >= 0 && row1[x] >= 0 && row0[x + 1] >= 0)
+			{
+				polygons.push_back(3);
+				polygons.push_back(row1[x + 1]);
+				polygons.push_back(row1[x]);
+				polygons.push_back(row0[x + 1]);
+			}
+		}
 	}
 
-	viz::WMesh meshWidget = viz::WMesh(pointCloud.reshape(0, 1), polygons,
-		colors.reshape(0, 1));
-
+	// the cloud shows the points which are not part of any triangle
 	myWindow.showWidget("Point cloud", cloudWidget);
-	//myWindow.showWidget("Mesh", meshWidget);
+	if (!polygons.empty())
+	{
+		viz::WMesh meshWidget = viz::WMesh(pointCloud.reshape(0, 1), polygons,
+			colors.reshape(0, 1));
+		myWindow.showWidget("Mesh", meshWidget);
+	}
 	
 	myWindow.spin();
 }
\ No newline at end of file
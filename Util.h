@@ -23,6 +23,11 @@ void normalizeByRayCount(oclMat& image);
 oclMat extractRayCountMat(const oclMat& image);
 void normalizeByRayCount(oclMat& image, const oclMat& rayCountMat);
 void normalize(oclMat& mat);
+// the same with buffers for their temporaries, which are only reallocated if
+// they do not fit, for repeated calls
+void normalizeByRayCount(oclMat& image, const oclMat& rayCountMat,
+	oclMat& multiChannelRayCount);
+void normalize(oclMat& mat, oclMat& reductionBuffer);
 
 // debugging functions
 void saveImageToPNGFile(string fileName, Mat image);
@@ -31,4 +36,7 @@ void saveImageArc(LightFieldPicture lightfield, string sourceFileName,
 	int imageCount);
 void visualizeCameraTrajectory(const CameraPoseEstimator& estimator,
 	const Matx33d& calibrationMatrix);
-void visualizePointCloud(const Mat& pointCloud, const Mat& colors);
\ No newline at end of file
+// pixelIndices maps the pixels of a compact point cloud to its points (see
+// RGBDMerger), without it the cloud must be image-shaped
+void visualizePointCloud(const Mat& pointCloud, const Mat& colors,
+	const Mat& pixelIndices = Mat());
\ No newline at end of file
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <cmath>
+#include "VocabularyTree.h"
+#include "BinaryIndex.h"
+
+const int VocabularyTree::KMEANS_ITERATIONS			= 10;
+const int VocabularyTree::MAX_TRAINING_DESCRIPTORS	= 200000;
+
+
+/**
+ * Assigns each member of a range to its nearest cluster center.
+ */
+class VocabularyTree::Assigner : public ParallelLoopBody
+{
+	const Mat& descriptors;
+	const vector<int>& members;
+	const Mat& clusterCenters;
+	vector<int>& assignments;
+
+public:
+	Assigner(const Mat& descriptors, const vector<int>& members,
+		const Mat& clusterCenters, vector<int>& assignments) :
+		descriptors(descriptors), members(members),
+		clusterCenters(clusterCenters), assignments(assignments)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		const int length = descriptors.cols;
+		for (int i = range.start; i < range.end; i++)
+		{
+			const uchar* descriptor = descriptors.ptr<uchar>(members[i]);
+			int nearest = 0;
+			int nearestDistance = INT_MAX;
+			for (int c = 0; c < clusterCenters.rows; c++)
+			{
+				const int distance = BinaryIndex::hammingDistance(descriptor,
+					clusterCenters.ptr<uchar>(c), length);
+				if (distance < nearestDistance)
+				{
+					nearest = c;
+					nearestDistance = distance;
+				}
+			}
+			assignments[i] = nearest;
+		}
+	}
+};
+
+
+/**
+ * Quantizes the descriptors of a range to the words of the tree.
+ */
+class VocabularyTree::Quantizer : public ParallelLoopBody
+{
+	const VocabularyTree& tree;
+	const Mat& descriptors;
+	vector<int>& words;
+
+public:
+	Quantizer(const VocabularyTree& tree, const Mat& descriptors,
+		vector<int>& words) :
+		tree(tree), descriptors(descriptors), words(words)
+	{
+	}
+
+	void operator()(const Range& range) const
+	{
+		for (int i = range.start; i < range.end; i++)
+			words[i] = tree.quantizeDescriptor(descriptors.ptr<uchar>(i));
+	}
+};
+
+
+VocabularyTree::VocabularyTree(void)
+{
+	// 10^5 words, as proposed by Nister and Stewenius for small databases
+	this->branchingFactor = 10;
+	this->depth = 5;
+
+	this->descriptorLength = 0;
+	this->imageCount = 0;
+}
+
+
+VocabularyTree::~VocabularyTree(void)
+{
+}
+
+
+void VocabularyTree::train(const vector<Mat>& descriptors)
+{
+	this->descriptorLength = 0;
+	int totalCount = 0;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		CV_Assert(descriptors[i].empty() || (descriptors[i].type() == CV_8UC1
+			&& (this->descriptorLength == 0
+			|| descriptors[i].cols == this->descriptorLength)));
+		if (!descriptors[i].empty())
+			this->descriptorLength = descriptors[i].cols;
+		totalCount += descriptors[i].rows;
+	}
+	CV_Assert(totalCount > 0);
+
+	// 1) gather (a regular subset of) all descriptors
+	const int step = (totalCount + MAX_TRAINING_DESCRIPTORS - 1)
+		/ MAX_TRAINING_DESCRIPTORS;
+	Mat training = Mat((totalCount + step - 1) / step, this->descriptorLength,
+		CV_8UC1);
+	int row = 0;
+	int index = 0;
+	for (int i = 0; i < descriptors.size(); i++)
+		for (int j = 0; j < descriptors[i].rows; j++, index++)
+			if (index % step == 0)
+				descriptors[i].row(j).copyTo(training.row(row++));
+
+	// 2) cluster them recursively, starting at the root, whose center is
+	// never used
+	this->nodes.clear();
+	this->centers.clear();
+	this->wordWeights.clear();
+	Node root = { -1, 0, -1 };
+	this->nodes.push_back(root);
+	this->centers.resize(this->descriptorLength, 0);
+
+	vector<int> members = vector<int>(training.rows);
+	for (int i = 0; i < members.size(); i++)
+		members[i] = i;
+	RNG rng = RNG(0x5EED);
+	buildNode(0, training, members, 0, rng);
+
+	// 3) weight the words by the (smoothed) inverse document frequency,
+	// log((N + 1) / n), so that no word present in the training images has
+	// weight 0, even for a single image
+	const int wordCount = this->wordWeights.size();
+	vector<int> documentCounts = vector<int>(wordCount, 0);
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		vector<pair<int, float>> words;
+		computeBagOfWords(descriptors[i], words);
+		for (int j = 0; j < words.size(); j++)
+			documentCounts[words[j].first]++;
+	}
+	for (int w = 0; w < wordCount; w++)
+		this->wordWeights[w] = (float) log((descriptors.size() + 1.) /
+			max(documentCounts[w], 1));
+
+	clearImages();
+}
+
+
+/**
+ * Divides the members of a node into clusters, one child for each, and
+ * continues with the children until depth is reached or a node has too few
+ * members to divide.
+ */
+void VocabularyTree::buildNode(int node, const Mat& descriptors,
+	vector<int>& members, int level, RNG& rng)
+{
+	Mat clusterCenters;
+	vector<int> assignments;
+	if (level < this->depth && members.size() > this->branchingFactor)
+		clusterDescriptors(descriptors, members, rng, clusterCenters,
+			assignments);
+
+	if (clusterCenters.rows < 2)
+	{
+		this->nodes[node].word = this->wordWeights.size();
+		this->wordWeights.push_back(0);
+		return;
+	}
+
+	// group the members by cluster, leaving out empty clusters
+	vector<vector<int>> clusterMembers = vector<vector<int>>(clusterCenters.rows);
+	for (int i = 0; i < members.size(); i++)
+		clusterMembers[assignments[i]].push_back(members[i]);
+	members = vector<int>();
+
+	const int firstChild = this->nodes.size();
+	for (int c = 0; c < clusterCenters.rows; c++)
+	{
+		if (clusterMembers[c].empty())
+			continue;
+
+		Node child = { -1, 0, -1 };
+		this->nodes.push_back(child);
+		this->centers.insert(this->centers.end(), clusterCenters.ptr<uchar>(c),
+			clusterCenters.ptr<uchar>(c) + this->descriptorLength);
+	}
+	this->nodes[node].firstChild = firstChild;
+	this->nodes[node].childCount = this->nodes.size() - firstChild;
+
+	int child = firstChild;
+	for (int c = 0; c < clusterCenters.rows; c++)
+		if (!clusterMembers[c].empty())
+			buildNode(child++, descriptors, clusterMembers[c], level + 1, rng);
+}
+
+
+/**
+ * k-majority clustering of the members into (up to) branchingFactor clusters
+ * with k-means++ seeding. Fewer clusters are returned if there are fewer
+ * distinct descriptors.
+ */
+void VocabularyTree::clusterDescriptors(const Mat& descriptors,
+	const vector<int>& members, RNG& rng, Mat& clusterCenters,
+	vector<int>& assignments) const
+{
+	const int count = members.size();
+	const int length = this->descriptorLength;
+
+	// 1) seed: every further center is drawn with a probability proportional
+	// to the squared distance to the nearest center drawn so far
+	vector<int> seeds = vector<int>(1, members[rng.uniform(0, count)]);
+	vector<double> distances = vector<double>(count, DBL_MAX);
+	while (seeds.size() < this->branchingFactor)
+	{
+		const uchar* last = descriptors.ptr<uchar>(seeds.back());
+		double sum = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const double distance = BinaryIndex::hammingDistance(last,
+				descriptors.ptr<uchar>(members[i]), length);
+			distances[i] = min(distances[i], distance * distance);
+			sum += distances[i];
+		}
+		if (sum == 0)
+			break;
+
+		double threshold = rng.uniform(0., sum);
+		int i = 0;
+		while (i < count - 1 && (threshold -= distances[i]) > 0)
+			i++;
+		seeds.push_back(members[i]);
+	}
+
+	clusterCenters = Mat(seeds.size(), length, CV_8UC1);
+	for (int c = 0; c < seeds.size(); c++)
+		descriptors.row(seeds[c]).copyTo(clusterCenters.row(c));
+
+	// 2) alternate between assigning the members to the nearest center and
+	// setting every bit of a center to the majority of its members' bits
+	assignments = vector<int>(count, -1);
+	vector<int> previous;
+	vector<int> clusterSizes = vector<int>(seeds.size());
+	vector<int> bitCounts = vector<int>(seeds.size() * length * 8);
+	for (int iteration = 0; iteration < KMEANS_ITERATIONS; iteration++)
+	{
+		previous = assignments;
+		parallel_for_(Range(0, count), Assigner(descriptors, members,
+			clusterCenters, assignments));
+		if (assignments == previous)
+			break;
+
+		fill(clusterSizes.begin(), clusterSizes.end(), 0);
+		fill(bitCounts.begin(), bitCounts.end(), 0);
+		for (int i = 0; i < count; i++)
+		{
+			const uchar* descriptor = descriptors.ptr<uchar>(members[i]);
+			int* bits = bitCounts.data() + assignments[i] * length * 8;
+			clusterSizes[assignments[i]]++;
+			for (int b = 0; b < length * 8; b++)
+				bits[b] += (descriptor[b >> 3] >> (b & 7)) & 1;
+		}
+
+		for (int c = 0; c < seeds.size(); c++)
+		{
+			if (clusterSizes[c] == 0)
+				continue;
+
+			uchar* center = clusterCenters.ptr<uchar>(c);
+			const int* bits = bitCounts.data() + c * length * 8;
+			for (int j = 0; j < length; j++)
+			{
+				uchar byte = 0;
+				for (int b = 0; b < 8; b++)
+					if (2 * bits[8 * j + b] > clusterSizes[c])
+						byte |= 1 << b;
+				center[j] = byte;
+			}
+		}
+	}
+}
+
+
+int VocabularyTree::quantizeDescriptor(const uchar* descriptor) const
+{
+	int node = 0;
+	while (this->nodes[node].childCount > 0)
+	{
+		const Node& parent = this->nodes[node];
+		int nearestDistance = INT_MAX;
+		for (int child = parent.firstChild;
+			child < parent.firstChild + parent.childCount; child++)
+		{
+			const int distance = BinaryIndex::hammingDistance(descriptor,
+				this->centers.data() + child * this->descriptorLength,
+				this->descriptorLength);
+			if (distance < nearestDistance)
+			{
+				node = child;
+				nearestDistance = distance;
+			}
+		}
+	}
+
+	return this->nodes[node].word;
+}
+
+
+/**
+ * L1-normalized histogram of the weighted words of the descriptors as (word,
+ * value) pairs, ordered by word.
+ */
+void VocabularyTree::computeBagOfWords(const Mat& descriptors,
+	vector<pair<int, float>>& words) const
+{
+	words.clear();
+	if (descriptors.empty())
+		return;
+	CV_Assert(descriptors.type() == CV_8UC1 &&
+		descriptors.cols == this->descriptorLength);
+
+	vector<int> descriptorWords = vector<int>(descriptors.rows);
+	parallel_for_(Range(0, descriptors.rows), Quantizer(*this, descriptors,
+		descriptorWords));
+	sort(descriptorWords.begin(), descriptorWords.end());
+
+	float sum = 0;
+	for (int i = 0; i < descriptorWords.size(); i++)
+	{
+		const int word = descriptorWords[i];
+		if (words.empty() || words.back().first != word)
+			words.push_back(pair<int, float>(word, 0));
+		words.back().second += this->wordWeights[word];
+		sum += this->wordWeights[word];
+	}
+
+	if (sum > 0)
+		for (int i = 0; i < words.size(); i++)
+			words[i].second /= sum;
+}
+
+
+bool VocabularyTree::isTrained() const
+{
+	return !this->wordWeights.empty();
+}
+
+
+int VocabularyTree::addImage(const Mat& descriptors)
+{
+	CV_Assert(isTrained());
+
+	vector<pair<int, float>> words;
+	computeBagOfWords(descriptors, words);
+	for (int i = 0; i < words.size(); i++)
+	{
+		Posting posting = { this->imageCount, words[i].second };
+		this->invertedFiles[words[i].first].push_back(posting);
+	}
+
+	return this->imageCount++;
+}
+
+
+void VocabularyTree::clearImages()
+{
+	this->invertedFiles = vector<vector<Posting>>(this->wordWeights.size());
+	this->imageCount = 0;
+}
+
+
+static bool hasHigherScore(const VocabularyTree::Result& a,
+	const VocabularyTree::Result& b)
+{
+	return a.score > b.score;
+}
+
+
+/**
+ * Accumulates the scores of the images in the inverted files of the query's
+ * words: with L1-normalized histograms q and d,
+ * |q - d| = 2 - sum over the common words of (q_i + d_i - |q_i - d_i|).
+ */
+void VocabularyTree::query(const Mat& descriptors, int k,
+	vector<Result>& results) const
+{
+	CV_Assert(isTrained());
+	results.clear();
+
+	vector<pair<int, float>> words;
+	computeBagOfWords(descriptors, words);
+
+	vector<float> scores = vector<float>(this->imageCount, 0);
+	for (int i = 0; i < words.size(); i++)
+	{
+		const float q = words[i].second;
+		const vector<Posting>& postings = this->invertedFiles[words[i].first];
+		for (int j = 0; j < postings.size(); j++)
+			scores[postings[j].image] += q + postings[j].weight
+				- fabs(q - postings[j].weight);
+	}
+
+	for (int image = 0; image < this->imageCount; image++)
+		if (scores[image] > 0)
+		{
+			Result result = { image, scores[image] / 2 };
+			results.push_back(result);
+		}
+
+	const int count = min(k, (int) results.size());
+	partial_sort(results.begin(), results.begin() + count, results.end(),
+		hasHigherScore);
+	results.resize(count);
+}
+
+
+int VocabularyTree::getWordCount() const
+{
+	return this->wordWeights.size();
+}
+
+
+int VocabularyTree::getImageCount() const
+{
+	return this->imageCount;
+}
+
+
+int VocabularyTree::getBranchingFactor() const
+{
+	return this->branchingFactor;
+}
+
+
+void VocabularyTree::setBranchingFactor(int branchingFactor)
+{
+	CV_Assert(branchingFactor >= 2);
+	this->branchingFactor = branchingFactor;
+}
+
+
+int VocabularyTree::getDepth() const
+{
+	return this->depth;
+}
+
+
+void VocabularyTree::setDepth(int depth)
+{
+	CV_Assert(depth >= 1);
+	this->depth = depth;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+/**
+ * An image database for retrieving the images which most likely overlap with
+ * a query image, by comparing bags of binary words:
+ *
+ *     Scalable Recognition with a Vocabulary Tree.
+ *     David Nister and Henrik Stewenius.
+ *     In IEEE Conference on Computer Vision and Pattern Recognition (CVPR),
+ *     2006
+ *
+ * The vocabulary is a tree built by hierarchical k-means clustering of
+ * binary descriptors (like ORB's): the training descriptors are divided into
+ * branchingFactor clusters by Hamming distance, each cluster again, and so on
+ * up to depth levels. As the mean of binary descriptors is not binary, the
+ * centers are the bitwise majority of their members (k-majority, as in
+ * Galvez-Lopez and Tardos, "Bags of Binary Words for Fast Place Recognition
+ * in Image Sequences", IEEE Transactions on Robotics, 2012). Every leaf is
+ * a word, weighted by its inverse document frequency among the training
+ * images.
+ *
+ * A descriptor is quantized by descending to the nearest child on every
+ * level, and an image becomes the L1-normalized histogram of the weighted
+ * words of its descriptors. The inverted file of every word lists the
+ * images containing it, so a query only visits the images which share words
+ * with it. Images are scored by 1 - |q - d|/2 (1 for equal histograms, 0 for
+ * no common word), which can be summed over the common words alone.
+ *
+ * Training and quantization are done in parallel.
+ */
+class VocabularyTree
+{
+	static const int KMEANS_ITERATIONS;
+	static const int MAX_TRAINING_DESCRIPTORS;
+
+	struct Node
+	{
+		int firstChild;		// children are contiguous, none for leaves
+		int childCount;
+		int word;			// -1 for inner nodes
+	};
+
+	// entry of an inverted file
+	struct Posting
+	{
+		int image;
+		float weight;
+	};
+
+	class Assigner;
+	class Quantizer;
+
+	int branchingFactor;
+	int depth;
+
+	int descriptorLength;
+	vector<Node> nodes;
+	vector<uchar> centers;			// descriptorLength bytes per node
+	vector<float> wordWeights;		// inverse document frequencies
+	vector<vector<Posting>> invertedFiles;
+	int imageCount;
+
+	void buildNode(int node, const Mat& descriptors, vector<int>& members,
+		int level, RNG& rng);
+	void clusterDescriptors(const Mat& descriptors, const vector<int>& members,
+		RNG& rng, Mat& clusterCenters, vector<int>& assignments) const;
+	int quantizeDescriptor(const uchar* descriptor) const;
+	void computeBagOfWords(const Mat& descriptors,
+		vector<pair<int, float>>& words) const;
+
+public:
+	// a retrieved image and its similarity to the query in [0, 1]
+	struct Result
+	{
+		int image;
+		float score;
+	};
+
+	VocabularyTree(void);
+	~VocabularyTree(void);
+
+	// builds the vocabulary from the descriptors (CV_8UC1 rows) of a set of
+	// training images and empties the database
+	void train(const vector<Mat>& descriptors);
+	bool isTrained() const;
+
+	// adds an image to the database and returns its index
+	int addImage(const Mat& descriptors);
+	void clearImages();
+
+	// finds the (up to) k database images most similar to the query image,
+	// ordered by decreasing score
+	void query(const Mat& descriptors, int k, vector<Result>& results) const;
+
+	int getWordCount() const;
+	int getImageCount() const;
+
+	// number of children of every node and levels of the tree, which take
+	// effect on the next training
+	int getBranchingFactor() const;
+	void setBranchingFactor(int branchingFactor);
+	int getDepth() const;
+	void setDepth(int depth);
+};
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <new>
 #include "BP-S.h"
+#include "message-kernels.h"
 
 #define private public
 #include "typeTruncatedQuadratic2D.h"
@@ -24,35 +25,8 @@
 //                  Operations on vectors (arrays of size K)               //
 /////////////////////////////////////////////////////////////////////////////
 
-inline void CopyVector(BPS::REAL* to, MRF::CostVal* from, int K)
-{
-    BPS::REAL* to_finish = to + K;
-    do
-	{
-	    *to ++ = *from ++;
-	} while (to < to_finish);
-}
-
-inline void AddVector(BPS::REAL* to, BPS::REAL* from, int K)
-{
-    BPS::REAL* to_finish = to + K;
-    do
-	{
-	    *to ++ += *from ++;
-	} while (to < to_finish);
-}
-
-inline BPS::REAL SubtractMin(BPS::REAL *D, int K)
-{
-    int k;
-    BPS::REAL delta;
-	
-    delta = D[0];
-    for (k=1; k<K; k++) TRUNCATE(delta, D[k]);
-    for (k=0; k<K; k++) D[k] -= delta;
-
-    return delta;
-}
+// CopyVector(), AddVector(), SubtractMin() and UpdateMessageL1() are
+// shared with TRW-S, see message-kernels.h
 
 // Functions UpdateMessageTYPE (see the paper for details):
 //
@@ -65,35 +39,6 @@ inline BPS::REAL SubtractMin(BPS::REAL *D, int K)
 //
 // If dir = 1, then the meaning of i and j is swapped.
 
-///////////////////////////////////////////
-//                  L1                   //
-///////////////////////////////////////////
-
-inline BPS::REAL UpdateMessageL1(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::REAL gamma, MRF::CostVal lambda, MRF::CostVal smoothMax)
-{
-    int k;
-    BPS::REAL delta;
-
-    delta = M[0] = gamma*Di_hat[0] - M[0];
-    for (k=1; k<K; k++)
-	{
-	    M[k] = gamma*Di_hat[k] - M[k];
-	    TRUNCATE(delta, M[k]);
-	    TRUNCATE(M[k], M[k-1] + lambda);
-	}
-
-    M[--k] -= delta;
-    TRUNCATE(M[k], lambda*smoothMax);
-    for (k--; k>=0; k--)
-	{
-	    M[k] -= delta;
-	    TRUNCATE(M[k], M[k+1] + lambda);
-	    TRUNCATE(M[k], lambda*smoothMax);
-	}
-
-    return delta;
-}
-
 ////////////////////////////////////////
 //               L2                   //
 ////////////////////////////////////////
@@ -112,13 +57,7 @@ inline BPS::REAL UpdateMessageL2(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::RE
 
     assert(lambda >= 0);
 
-    Di[0] = gamma*Di_hat[0] - M[0];
-    delta = Di[0];
-    for (k=1; k<K; k++)
-	{
-	    Di[k] = gamma*Di_hat[k] - M[k];
-	    TRUNCATE(delta, Di[k]);
-	}
+    delta = ExcludeMessage(Di, Di_hat, M, gamma, K);
 
     if (lambda == 0)
 	{
@@ -126,15 +65,12 @@ inline BPS::REAL UpdateMessageL2(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::RE
 	    return delta;
 	}
 
+    // the lower envelope of the parabolas is inherently sequential
     for (k=0; k<K; k++) Di_tmp[k] = Di[k];
     tmp->DistanceTransformL2(K, 1, lambda, Di_tmp, M_tmp, parabolas, intersections);
-    for (k=0; k<K; k++) M[k] = (BPS::REAL) M_tmp[k];
+    for (k=0; k<K; k++) M[k] = MRF::toCostVal(M_tmp[k]);
 
-    for (k=0; k<K; k++)
-	{
-	    M[k] -= delta;
-	    TRUNCATE(M[k], lambda*smoothMax);
-	}
+    SubtractAndTruncate(M, delta, MRF::toCostVal((double) lambda*smoothMax), K);
 
     return delta;
 }
@@ -147,30 +83,12 @@ inline BPS::REAL UpdateMessageL2(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::RE
 inline BPS::REAL UpdateMessageFIXED_MATRIX(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::REAL gamma, MRF::CostVal lambda, MRF::CostVal* V, void* buf)
 {
     BPS::REAL* Di = (BPS::REAL*) buf;
-    int ki, kj;
-    BPS::REAL delta;
 
-    for (ki=0; ki<K; ki++)
-	{
-	    Di[ki] = gamma*Di_hat[ki] - M[ki];
-	}
+    // V is symmetric (see MRF::checkArray())
+    ExcludeMessage(Di, Di_hat, M, gamma, K);
+    MinConvolutionColumns(M, Di, V, lambda, K);
 
-    for (kj=0; kj<K; kj++)
-	{
-	    M[kj] = Di[0] + lambda*V[0]; 
-	    V ++;
-	    for (ki=1; ki<K; ki++)
-		{
-		    TRUNCATE(M[kj], Di[ki] + lambda*V[0]);
-		    V ++;
-		}
-	}
-
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
-
-    return delta;
+    return SubtractMin(M, K);
 }
 
 /////////////////////////////////////////////
@@ -180,47 +98,13 @@ inline BPS::REAL UpdateMessageFIXED_MATRIX(BPS::REAL* M, BPS::REAL* Di_hat, int
 inline BPS::REAL UpdateMessageGENERAL(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::REAL gamma, int dir, MRF::CostVal* V, void* buf)
 {
     BPS::REAL* Di = (BPS::REAL*) buf;
-    int ki, kj;
-    BPS::REAL delta;
 
-    for (ki=0; ki<K; ki++)
-	{
-	    Di[ki] = (gamma*Di_hat[ki] - M[ki]);
-	}
-
-    if (dir == 0)
-	{
-	    for (kj=0; kj<K; kj++)
-		{
-		    M[kj] = Di[0] + V[0]; 
-		    V ++;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE(M[kj], Di[ki] + V[0]);
-			    V ++;
-			}
-		}
-	}
-    else
-	{
-	    for (kj=0; kj<K; kj++)
-		{
-		    M[kj] = Di[0] + V[0];
-		    V += K;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE(M[kj], Di[ki] + V[0]);
-			    V += K;
-			}
-		    V -= K*K - 1;
-		}
-	}
+    ExcludeMessage(Di, Di_hat, M, gamma, K);
 
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
+    if (dir == 0) MinConvolutionRows(M, Di, V, 1, K);
+    else          MinConvolutionColumns(M, Di, V, 1, K);
 
-    return delta;
+    return SubtractMin(M, K);
 }
 
 inline BPS::REAL UpdateMessageGENERAL(BPS::REAL* M, BPS::REAL* Di_hat, int K, BPS::REAL gamma, BPS::SmoothCostGeneralFn fn, int i, int j, void* buf)
@@ -229,10 +113,7 @@ inline BPS::REAL UpdateMessageGENERAL(BPS::REAL* M, BPS::REAL* Di_hat, int K, BP
     int ki, kj;
     BPS::REAL delta;
 
-    for (ki=0; ki<K; ki++)
-	{
-	    Di[ki] = (gamma*Di_hat[ki] - M[ki]);
-	}
+    ExcludeMessage(Di, Di_hat, M, gamma, K);
 
     for (kj=0; kj<K; kj++)
 	{
@@ -244,11 +125,7 @@ inline BPS::REAL UpdateMessageGENERAL(BPS::REAL* M, BPS::REAL* Di_hat, int K, BP
 		}
 	}
 
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
-
-    return delta;
+    return SubtractMin(M, K);
 }
 
 
@@ -256,6 +133,7 @@ inline BPS::REAL UpdateMessageGENERAL(BPS::REAL* M, BPS::REAL* Di_hat, int K, BP
 
 
 
+
 BPS::BPS(int width, int height, int nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
 {
     Allocate();
@@ -274,6 +152,8 @@ BPS::~BPS()
     if ( m_DBinary ) delete [] m_DBinary;
     if ( m_horzWeightsBinary ) delete [] m_horzWeightsBinary;
     if ( m_vertWeightsBinary ) delete [] m_vertWeightsBinary;
+    if ( m_Di ) delete [] m_Di;
+    if ( m_buf ) delete [] m_buf;
 }
 
 
@@ -293,8 +173,11 @@ void BPS::Allocate()
     m_DBinary = NULL;
     m_messages = NULL;
     m_messageArraySizeInBytes = 0;
+    m_Di = NULL;
+    m_buf = NULL;
 
     m_answer = new Label[m_nPixels];
+    m_changedLabels = 0;
 }
 
 void BPS::clearAnswer()
@@ -507,6 +390,16 @@ void BPS::initializeAlg()
     m_messages = new REAL[messageNum];
     memset(m_messages, 0, messageNum*sizeof(REAL));
 
+    // allocate scratch buffers of the message updates
+    if (m_type != BINARY)
+	{
+	    int K = m_nLabels;
+	    int L1Size = PaddedMessageLength<REAL>(K)*sizeof(REAL);
+	    int L2Size = 2*K*sizeof(TypeTruncatedQuadratic2D::REAL) + (2*K+1)*sizeof(int) + K*sizeof(REAL);
+	    m_Di = new REAL[K];
+	    m_buf = new char[MAX(L1Size, L2Size)];
+	}
+
     if (m_type == BINARY)
 	{
 	    assert(m_DBinary == NULL && m_horzWeightsBinary == NULL && m_horzWeightsBinary == NULL);
@@ -562,6 +455,8 @@ void BPS::optimizeAlg(int nIterations)
     //          computing solution                //
     ////////////////////////////////////////////////
 
+    m_changedLabels = 0;
+
     if (m_type != BINARY)
 	{
 	    int x, y, n, K = m_nLabels;
@@ -570,8 +465,9 @@ void BPS::optimizeAlg(int nIterations)
 	    REAL* Di;
 	    REAL delta;
 	    int ki, kj;
+	    Label label;
 
-	    Di = new REAL[K];
+	    Di = m_Di;
 
 	    n = 0;
 	    D_ptr = m_D;
@@ -652,18 +548,21 @@ void BPS::optimizeAlg(int nIterations)
 
 			// compute min
 			delta = Di[0];
-			m_answer[n] = 0;
+			label = 0;
 			for (ki=1; ki<K; ki++)
 			    {
 				if (delta > Di[ki])
 				    {
 					delta = Di[ki];
-					m_answer[n] = ki;
+					label = ki;
 				    }
 			    }
+			if (m_answer[n] != label)
+			    {
+				m_answer[n] = label;
+				m_changedLabels ++;
+			    }
 		    }
-
-	    delete [] Di;
 	}
     else // m_type == BINARY
 	{
@@ -685,7 +584,12 @@ void BPS::optimizeAlg(int nIterations)
 			if (y < m_height-1) Di += M_ptr[1]; // message (x,y+1)->(x,y)
 
 			// compute min
-			m_answer[n] = (Di >= 0) ? 0 : 1;
+			Label label = (Di >= 0) ? 0 : 1;
+			if (m_answer[n] != label)
+			    {
+				m_answer[n] = label;
+				m_changedLabels ++;
+			    }
 		    }
 	}
 }
@@ -697,7 +601,7 @@ void BPS::optimize_GRID_L1(int nIterations)
     REAL* M_ptr;
     REAL* Di;
 
-    Di = new REAL[K];
+    Di = m_Di;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -718,12 +622,12 @@ void BPS::optimize_GRID_L1(int nIterations)
 			if (x < m_width-1) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_horzWeights[n] : m_lambda;
-				UpdateMessageL1(M_ptr, Di, K, 1, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr, Di, K, 1, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 			if (y < m_height-1) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_vertWeights[n] : m_lambda;
-				UpdateMessageL1(M_ptr+K, Di, K, 1, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr+K, Di, K, 1, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 		    }
 
@@ -746,17 +650,15 @@ void BPS::optimize_GRID_L1(int nIterations)
 			if (x > 0) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_horzWeights[n-1] : m_lambda;
-				UpdateMessageL1(M_ptr-2*K, Di, K, 1, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr-2*K, Di, K, 1, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 			if (y > 0) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_vertWeights[n-m_width] : m_lambda;
-				UpdateMessageL1(M_ptr-(2*m_width-1)*K, Di, K, 1, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr-(2*m_width-1)*K, Di, K, 1, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 		    }
 	}
-
-    delete [] Di;
 }
 
 void BPS::optimize_GRID_L2(int nIterations)
@@ -767,8 +669,8 @@ void BPS::optimize_GRID_L2(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new char[2*K*sizeof(TypeTruncatedQuadratic2D::REAL) + (2*K+1)*sizeof(int) + K*sizeof(REAL)];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -826,9 +728,6 @@ void BPS::optimize_GRID_L2(int nIterations)
 			    }
 		    }
 	}
-
-    delete [] Di;
-    delete [] (REAL *)buf;
 }
 
 
@@ -914,8 +813,8 @@ void BPS::optimize_GRID_FIXED_MATRIX(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new REAL[K];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -973,9 +872,6 @@ void BPS::optimize_GRID_FIXED_MATRIX(int nIterations)
 			    }
 		    }
 	}
-
-    delete [] Di;
-    delete [] (REAL *)buf;
 }
 
 void BPS::optimize_GRID_GENERAL(int nIterations)
@@ -986,8 +882,8 @@ void BPS::optimize_GRID_GENERAL(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new REAL[K];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -1049,7 +945,4 @@ void BPS::optimize_GRID_GENERAL(int nIterations)
 			    }
 		    }
 	}
-
-    delete [] Di;
-    delete [] (REAL *)buf;
 }
@@ -23,6 +23,7 @@ class BPS : public MRF{
     void setParameters(int /*numParam*/, void * /*param*/){printf("No optional parameters to set"); exit(1);}
     EnergyVal smoothnessEnergy();
     EnergyVal dataEnergy();
+    int changedLabelCount() { return m_changedLabels; }
 
  protected:
     void setData(DataCostFn dcost); 
@@ -69,6 +70,12 @@ class BPS : public MRF{
 
     int	  m_messageArraySizeInBytes;
 
+    int   m_changedLabels; // by the last optimizeAlg()
+
+    // scratch buffers of the message updates, allocated once by initializeAlg()
+    REAL* m_Di;   // size K
+    char* m_buf;  // large enough for any UpdateMessageTYPE()
+
     void optimize_GRID_L1(int nIterations);
     void optimize_GRID_L2(int nIterations);
     void optimize_GRID_FIXED_MATRIX(int nIterations);
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "BlockArena.h"
+
+#define ROUND_UP(size) (((size) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+/*********************************************************************/
+
+BlockArena::BlockArena(int slabSize)
+{
+    m_slabSize  = ROUND_UP(slabSize);
+    m_slabs     = 0;
+    m_current   = 0;
+    m_end       = 0;
+    m_freeLists = 0;
+
+    m_statistics.requests = 0;
+    m_statistics.reuses   = 0;
+    m_statistics.slabs    = 0;
+    m_statistics.bytes    = 0;
+}
+
+/*********************************************************************/
+
+BlockArena::~BlockArena()
+{
+    while ( m_slabs != 0 )
+    {
+        Slab *tmp = m_slabs;
+        m_slabs = m_slabs->m_next;
+        delete [] (char *) tmp;
+    }
+
+    while ( m_freeLists != 0 )
+    {
+        FreeList *tmp = m_freeLists;
+        m_freeLists = m_freeLists->m_next;
+        delete tmp;
+    }
+}
+
+/*********************************************************************/
+
+void *BlockArena::allocate(int size)
+{
+    size = ROUND_UP(size);
+    m_statistics.requests++;
+
+    FreeList *list = freeList(size);
+    if ( list->m_head != 0 )
+    {
+        FreeBlock *block = list->m_head;
+        list->m_head = block->m_next;
+        m_statistics.reuses++;
+        return(block);
+    }
+
+    if ( size > m_slabSize / 4 ) return(allocateSlab(size));
+
+    if ( m_current + size > m_end )
+    {
+        m_current = allocateSlab(m_slabSize);
+        m_end     = m_current + m_slabSize;
+    }
+
+    void *block = m_current;
+    m_current += size;
+    return(block);
+}
+
+/*********************************************************************/
+
+void BlockArena::release(void *block, int size)
+{
+    if ( block == 0 ) return;
+
+    FreeList *list = freeList(ROUND_UP(size));
+    ((FreeBlock *) block)->m_next = list->m_head;
+    list->m_head = (FreeBlock *) block;
+}
+
+/*********************************************************************/
+
+// returns size bytes following the (aligned) header of a new slab
+char *BlockArena::allocateSlab(int size)
+{
+    char *ptr = new char[ROUND_UP(sizeof(Slab)) + size];
+    if ( !ptr ) { fprintf(stderr, "Not enough memory!\n"); exit(1); }
+
+    ((Slab *) ptr)->m_next = m_slabs;
+    m_slabs = (Slab *) ptr;
+
+    m_statistics.slabs++;
+    m_statistics.bytes += ROUND_UP(sizeof(Slab)) + size;
+
+    return(ptr + ROUND_UP(sizeof(Slab)));
+}
+
+/*********************************************************************/
+
+// the users of an arena allocate only a few different block sizes
+BlockArena::FreeList *BlockArena::freeList(int size)
+{
+    FreeList *list;
+
+    for ( list = m_freeLists; list != 0; list = list->m_next )
+        if ( list->m_size == size ) return(list);
+
+    list = new FreeList;
+    list->m_size = size;
+    list->m_head = 0;
+    list->m_next = m_freeLists;
+    m_freeLists  = list;
+    return(list);
+}
+
+/*********************************************************************/
@@ -0,0 +1,65 @@
+/* Arena of memory blocks */
+// Hands out blocks of memory carved from large slabs and keeps the blocks
+// released by its users in free lists (one per block size), so that the
+// next request of the same size reuses them. This suits the data structures
+// of this library, which allocate many blocks of a few fixed sizes and free
+// them all at once: the node and arc blocks of Graph (rebuilt for every
+// expansion or swap move), the blocks of LinkedBlockList and the neighbours
+// of non-grid graphs. All memory is returned to the system only when the
+// arena is destroyed. An arena must not be used by several threads at once.
+
+#ifndef __BLOCKARENA_H__
+#define __BLOCKARENA_H__
+
+#define ARENA_SLAB_SIZE 65536   // bytes, blocks above a quarter of it get a slab of their own
+#define ARENA_ALIGNMENT 16      // of all blocks, sizes are rounded up to a multiple of it
+
+class BlockArena
+{
+public:
+    struct Statistics
+    {
+        long requests;   // calls of allocate()
+        long reuses;     // requests served from released blocks
+        long slabs;      // allocations from the system
+        long bytes;      // total size of the slabs
+    };
+
+    BlockArena(int slabSize = ARENA_SLAB_SIZE);
+    ~BlockArena();
+
+    // returns a block of at least size bytes, aligned to ARENA_ALIGNMENT
+    void *allocate(int size);
+
+    // gives a block back for reuse, size must be the one it was allocated with
+    void release(void *block, int size);
+
+    const Statistics& getStatistics() { return m_statistics; }
+
+private:
+    typedef struct FreeBlockStruct{
+        struct FreeBlockStruct *m_next;
+    } FreeBlock;
+
+    typedef struct FreeListStruct{
+        int        m_size;
+        FreeBlock *m_head;
+        struct FreeListStruct *m_next;
+    } FreeList;
+
+    typedef struct SlabStruct{
+        struct SlabStruct *m_next;
+    } Slab;
+
+    int        m_slabSize;
+    Slab      *m_slabs;
+    char      *m_current;   // unused part of the current slab
+    char      *m_end;
+    FreeList  *m_freeLists;
+    Statistics m_statistics;
+
+    char *allocateSlab(int size);
+    FreeList *freeList(int size);
+};
+
+#endif
@@ -16,8 +16,9 @@ void GCoptimization::initialize_memory()
 
     m_lookupPixVar = (PixelType *) new PixelType[m_nPixels];
     m_labelTable   = (LabelType *) new LabelType[m_nLabels];
+    m_variables    = (Energy::Var *) new Energy::Var[m_nPixels];
 
-    terminateOnError( !m_lookupPixVar || !m_labelTable ,"Not enough memory");
+    terminateOnError( !m_lookupPixVar || !m_labelTable || !m_variables ,"Not enough memory");
 
     for ( int i = 0; i < m_nLabels; i++ )
         m_labelTable[i] = i;
@@ -34,6 +35,7 @@ void GCoptimization::commonGridInitialization(PixelType width, PixelType height,
     m_nPixels     = width*height;
     m_nLabels     = nLabels;
     m_grid_graph  = 1;
+    m_arena       = new BlockArena();
         
 
 }
@@ -60,10 +62,14 @@ void GCoptimization::commonNonGridInitialization(PixelType nupixels, int num_lab
     m_nPixels        = nupixels;
     m_grid_graph         = 0;
 
+    m_arena     = new BlockArena();
     m_neighbors = (LinkedBlockList *) new LinkedBlockList[nupixels];
 
     terminateOnError(!m_neighbors,"Not enough memory");
 
+    for ( int i = 0; i < nupixels; i++ )
+        m_neighbors[i].setArena(m_arena);
+
 }
 
 /**************************************************************************************/
@@ -77,7 +83,7 @@ void GCoptimization::commonInitialization()
 
 /**************************************************************************************/
 /* Use this constructor only for grid graphs                                          */
-GCoptimization::GCoptimization(PixelType width,PixelType height,LabelType nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
+GCoptimization::GCoptimization(PixelType width,PixelType height,int nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
 {
     commonGridInitialization(width,height,nLabels);
     
@@ -104,7 +110,7 @@ GCoptimization::GCoptimization(PixelType nPixels,int nLabels,EnergyFunction *eng
 
 /**************************************************************************************/
 
-void GCoptimization::setData(EnergyTermType* dataArray)
+void GCoptimization::setData(CostVal* dataArray)
 {
     m_datacost  = dataArray;
 }
@@ -120,7 +126,7 @@ void GCoptimization::setData(DataCostFn dataFn)
 
 /**************************************************************************************/
 
-void GCoptimization::setSmoothness(EnergyTermType* V)
+void GCoptimization::setSmoothness(CostVal* V)
 {
     m_smoothcost = V;
 }
@@ -150,7 +156,7 @@ void GCoptimization::setSmoothness(int smoothExp,CostVal smoothMax, CostVal lamb
 
 /**************************************************************************************/
 
-void GCoptimization::setCues(EnergyTermType* hCue, EnergyTermType* vCue)
+void GCoptimization::setCues(CostVal* hCue, CostVal* vCue)
 {
 
     m_horizWeights    = hCue;
@@ -429,14 +435,14 @@ void GCoptimization::add_t_links_FnPix(Energy *e,Energy::Var *variables,int size
 }
 /**************************************************************************************/
 
-void GCoptimization::setNeighbors(PixelType pixel1, int pixel2, EnergyTermType weight)
+void GCoptimization::setNeighbors(PixelType pixel1, int pixel2, CostVal weight)
 {
 
     assert(pixel1 < m_nPixels && pixel1 >= 0 && pixel2 < m_nPixels && pixel2 >= 0);
     assert(m_grid_graph == 0);
 
-    Neighbor *temp1 = (Neighbor *) new Neighbor;
-    Neighbor *temp2 = (Neighbor *) new Neighbor;
+    Neighbor *temp1 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
+    Neighbor *temp2 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
 
     temp1->weight  = weight;
     temp1->to_node = pixel2;
@@ -459,6 +465,8 @@ GCoptimization::~GCoptimization()
     if ( ! m_grid_graph ) delete [] m_neighbors;            
     delete [] m_labelTable;
     delete [] m_lookupPixVar;
+    delete [] m_variables;
+    delete m_arena;
     if (m_needToFreeV) delete [] m_smoothcost;
 }
 
@@ -547,7 +555,7 @@ GCoptimization::EnergyType Swap::oneSwapIteration()
 
 /**************************************************************************************/
 
-GCoptimization::EnergyType Swap::alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
+GCoptimization::EnergyType Swap::alpha_beta_swap(int alpha_label, int beta_label)
 {
     terminateOnError( alpha_label < 0 || alpha_label >= m_nLabels || beta_label < 0 || beta_label >= m_nLabels,
         "Illegal Label to Expand On");
@@ -585,7 +593,7 @@ void Swap::add_t_links_FnPix_swap(Energy *e,Energy::Var *variables,int size,
 void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
 {
     PixelType i,size = 0;
-    Energy *e = new Energy();
+    Energy *e = new Energy(NULL, m_arena);
 
 
     for ( i = 0; i < m_nPixels; i++ )
@@ -598,11 +606,10 @@ void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
         }
     }
 
-    if ( size == 0 ) return;
+    if ( size == 0 ) { delete e; return; }
 
 
-    Energy::Var *variables = (Energy::Var *) new Energy::Var[size];
-    if (!variables) { fprintf(stderr, "Not enough memory!\n"); exit(1); }
+    Energy::Var *variables = m_variables;
     
 
     for ( i = 0; i < size; i++ )
@@ -636,7 +643,6 @@ void Swap::perform_alpha_beta_swap(LabelType alpha_label, LabelType beta_label)
         else m_labeling[m_pixels[i]] = beta_label;
 
 
-    delete [] variables;
     delete e;
 
 }
@@ -937,6 +943,55 @@ void Swap::optimizeAlg(int nIterations)
 
 /**************************************************************************************/
 
+void Expansion::commonExpansionInitialization()
+{
+    m_gridGraphs    = NULL;
+    m_nGridGraphs   = 0;
+    m_recycleFlows  = 0;
+    m_bandCount     = 1;
+    m_tlinks        = NULL;
+    m_changedPixels = 0;
+}
+
+/**************************************************************************************/
+
+Expansion::~Expansion()
+{
+    delete_grid_graphs();
+    delete [] m_tlinks;
+}
+
+/**************************************************************************************/
+
+void Expansion::delete_grid_graphs()
+{
+    for ( int i = 0; i < m_nGridGraphs; i++ )
+        delete m_gridGraphs[i];
+    delete [] m_gridGraphs;
+    m_gridGraphs  = NULL;
+    m_nGridGraphs = 0;
+}
+
+/**************************************************************************************/
+
+void Expansion::setRecycleFlows(bool recycle)
+{
+    if ( recycle != m_recycleFlows ) delete_grid_graphs();
+    m_recycleFlows = recycle;
+}
+
+/**************************************************************************************/
+
+void Expansion::setBandCount(int bandCount)
+{
+    if ( bandCount < 1 ) bandCount = 1;
+    if ( m_grid_graph && bandCount > m_height ) bandCount = m_height;
+    if ( bandCount != m_bandCount ) delete_grid_graphs();
+    m_bandCount = bandCount;
+}
+
+/**************************************************************************************/
+
 
 GCoptimization::EnergyType Expansion::expansion(int max_num_iterations)
 {
@@ -982,7 +1037,7 @@ GCoptimization::EnergyType Expansion::start_expansion(int max_num_iterations )
 
 /**************************************************************************************/
 
-GCoptimization::EnergyType Expansion::alpha_expansion(LabelType label)
+GCoptimization::EnergyType Expansion::alpha_expansion(int label)
 {
     terminateOnError( label < 0 || label >= m_nLabels,"Illegal Label to Expand On");
 
@@ -995,8 +1050,14 @@ GCoptimization::EnergyType Expansion::alpha_expansion(LabelType label)
 
 void Expansion::perform_alpha_expansion(LabelType alpha_label)
 {
+    if ( m_grid_graph )
+    {
+        perform_alpha_expansion_grid(alpha_label);
+        return;
+    }
+
     PixelType i,size = 0; 
-    Energy *e = new Energy();
+    Energy *e = new Energy(NULL, m_arena);
     
 
     
@@ -1012,8 +1073,7 @@ void Expansion::perform_alpha_expansion(LabelType alpha_label)
         
     if ( size > 0 ) 
     {
-        Energy::Var *variables = (Energy::Var *) new Energy::Var[size];
-        if ( !variables) {printf("\nOut of memory, exiting");exit(1);}
+        Energy::Var *variables = m_variables;
 
         for ( i = 0; i < size; i++ )
             variables[i] = e ->add_variable();
@@ -1022,21 +1082,8 @@ void Expansion::perform_alpha_expansion(LabelType alpha_label)
         else  add_t_links_FnPix(e,variables,size,alpha_label);
 
 
-        if ( m_grid_graph )
-        {
-            if ( m_smoothType != FUNCTION )
-            {
-                if (m_varWeights) set_up_expansion_energy_G_ARRAY_VW(size,alpha_label,e,variables);
-                else set_up_expansion_energy_G_ARRAY(size,alpha_label,e,variables);
-            }
-            else set_up_expansion_energy_G_FnPix(size,alpha_label,e,variables);
-            
-        }
-        else
-        {
-            if ( m_smoothType != FUNCTION ) set_up_expansion_energy_NG_ARRAY(size,alpha_label,e,variables);
-            else if ( m_smoothType == FUNCTION) set_up_expansion_energy_NG_FnPix(size,alpha_label,e,variables);
-        }
+        if ( m_smoothType != FUNCTION ) set_up_expansion_energy_NG_ARRAY(size,alpha_label,e,variables);
+        else if ( m_smoothType == FUNCTION) set_up_expansion_energy_NG_FnPix(size,alpha_label,e,variables);
         
         e -> minimize();
     
@@ -1050,8 +1097,6 @@ void Expansion::perform_alpha_expansion(LabelType alpha_label)
                 size++;
             }
         }
-
-        delete [] variables;
     }
 
     delete e;
@@ -1149,205 +1194,221 @@ void Expansion::set_up_expansion_energy_NG_FnPix(int size, LabelType alpha_label
 }
 
 /**********************************************************************************************/
-/* Performs alpha-expansion for  regular grid graph for case when energy terms are NOT        */
-/* specified by a function */
-void Expansion::set_up_expansion_energy_G_ARRAY_VW(int size, LabelType alpha_label,Energy *e,
-                                                      Energy::Var *variables )
+/* Performs alpha-expansion for regular grid graph. The graphs of the previous moves are       */
+/* reused, only their capacities are set to the ones of this move. With several bands, the     */
+/* even bands are expanded in parallel, then the odd ones; the labels of the rows next to a    */
+/* band stay fixed while it is expanded. Bands of the same parity do not touch, so each band's */
+/* move is optimal given its neighbors and none can increase the energy                        */
+
+void Expansion::perform_alpha_expansion_grid(LabelType alpha_label)
 {
-    int i,nPix,pix,x,y;
-    EnergyTermType weight;
+    int b,parity;
+    PixelType changed = 0;
 
+    if ( !m_gridGraphs )
+    {
+        m_nGridGraphs = (m_recycleFlows ? m_nLabels : 1)*m_bandCount;
+        m_gridGraphs  = (GridGraph **) new GridGraph *[m_nGridGraphs];
+        terminateOnError( !m_gridGraphs,"Not enough memory");
 
-    for ( i = size - 1; i >= 0; i-- )
+        for ( b = 0; b < m_nGridGraphs; b++ )
+            m_gridGraphs[b] = NULL;
+    }
+    if ( !m_tlinks )
     {
-        pix = m_lookupPixVar[i];
-        y = pix/m_width;
-        x = pix - y*m_width;
+        m_tlinks = (EnergyTermType *) new EnergyTermType[2*m_nPixels];
+        terminateOnError( !m_tlinks,"Not enough memory");
+    }
 
-        m_lookupPixVar[pix] = i;
+    for ( parity = 0; parity < 2 && parity < m_bandCount; parity++ )
+    {
+#pragma omp parallel for schedule(dynamic) reduction(+:changed)
+        for ( b = parity; b < m_bandCount; b += 2 )
+            changed += expand_band(alpha_label,b);
+    }
 
-        if ( x < m_width - 1 )
-        {
-            nPix = pix + 1;
-            weight = m_horizWeights[pix];
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothcost(alpha_label,alpha_label)*weight,
-                              m_smoothcost(alpha_label,m_labeling[nPix])*weight,
-                              m_smoothcost(m_labeling[pix],alpha_label)*weight,
-                              m_smoothcost(m_labeling[pix],m_labeling[nPix])*weight);
-            else   e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix])*weight,
-                                 m_smoothcost(m_labeling[pix],alpha_label)*weight);
-        }   
+    m_changedPixels = changed;
+}
 
-        if ( y < m_height - 1 )
-        {
-            nPix = pix + m_width;
-            weight = m_vertWeights[pix];
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothcost(alpha_label,alpha_label)*weight ,
-                              m_smoothcost(alpha_label,m_labeling[nPix])*weight,
-                              m_smoothcost(m_labeling[pix],alpha_label)*weight ,
-                              m_smoothcost(m_labeling[pix],m_labeling[nPix])*weight );
-            else   e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix])*weight,
-                                 m_smoothcost(m_labeling[pix],alpha_label)*weight);
-        }   
-        if ( x > 0 )
-        {
-            nPix = pix - 1;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix])*m_horizWeights[nPix],
-                                 m_smoothcost(m_labeling[pix],alpha_label)*m_horizWeights[nPix]);
-        }   
+/**********************************************************************************************/
+/* Expands alpha on the rows of band b, returns the number of pixels whose capacities changed  */
 
-        if ( y > 0 )
-        {
-            nPix = pix - m_width;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothcost(alpha_label,alpha_label)*m_vertWeights[nPix],
-                                 m_smoothcost(m_labeling[pix],alpha_label)*m_vertWeights[nPix]);
-        }   
-            
+GCoptimization::PixelType Expansion::expand_band(LabelType alpha_label,int b)
+{
+    int y0 = b*m_height/m_bandCount, y1 = (b+1)*m_height/m_bandCount;
+    int k = (m_recycleFlows ? alpha_label*m_bandCount : 0) + b;
+
+    if ( !m_gridGraphs[k] ) m_gridGraphs[k] = new GridGraph(m_width,y1-y0);
+    GridGraph *g = m_gridGraphs[k];
+
+    set_up_expansion_graph(alpha_label,g,y0,y1);
+    g -> maxflow();
+
+    for ( PixelType i = 0, pix = y0*m_width; pix < y1*m_width; i++, pix++ )
+    {
+        if ( m_labeling[pix] != alpha_label && g->what_segment(i) == Graph::SOURCE )
+            m_labeling[pix] = alpha_label;
     }
-    
+
+    return(g->get_changed_count());
 }
 
 /**********************************************************************************************/
-/* Performs alpha-expansion for  regular grid graph for case when energy terms are NOT        */
-/* specified by a function */
-void Expansion::set_up_expansion_energy_G_ARRAY(int size, LabelType alpha_label,Energy *e,
-                                                     Energy::Var *variables )
+
+inline GCoptimization::EnergyTermType Expansion::grid_smooth_cost(PixelType pix,PixelType nPix,EnergyTermType weight,
+                                                                   LabelType label1,LabelType label2)
 {
-    int i,nPix,pix,x,y;
+    if ( m_smoothType == FUNCTION ) return(m_smoothFnPix(pix,nPix,label1,label2));
+    return(m_smoothcost(label1,label2)*weight);
+}
 
+/**********************************************************************************************/
+/* Sets the edge between pix and its neighbor nPix in direction dir to the pairwise term       */
+/* A B C D of Energy::add_term2(), pix has variable x and nPix variable y. The terminal        */
+/* capacities are accumulated in m_tlinks. first is the pixel of the first node of g           */
 
-    for ( i = size - 1; i >= 0; i-- )
+void Expansion::add_grid_edge(GridGraph *g,PixelType pix,PixelType nPix,int dir,PixelType first,
+                              EnergyTermType A,EnergyTermType B,EnergyTermType C,EnergyTermType D)
+{
+    if ( A+D > C+B )
     {
-        pix = m_lookupPixVar[i];
-        y = pix/m_width;
-        x = pix - y*m_width;
+        EnergyTermType delta = A+D-C-B;
+        EnergyTermType subtrA = delta/3;
 
-        m_lookupPixVar[pix] = i;
+        A = A-subtrA;
+        C = C+subtrA;
+        B = B+(delta-subtrA*2);
+    }
 
-        if ( x < m_width - 1 )
-        {
-            nPix = pix + 1;
+    m_tlinks[2*pix]   += D;
+    m_tlinks[2*pix+1] += A;
+    B -= A; C -= D;
 
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothcost(alpha_label,alpha_label),
-                              m_smoothcost(alpha_label,m_labeling[nPix]),
-                              m_smoothcost(m_labeling[pix],alpha_label),
-                              m_smoothcost(m_labeling[pix],m_labeling[nPix]));
-            else   e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix]),
-                                 m_smoothcost(m_labeling[pix],alpha_label));
-        }   
+    /* the truncation above makes B+C >= 0 (regularity), up to the rounding of */
+    /* float costs; the capacities of a GridGraph must not be negative          */
+    EnergyTermType BC = B+C;
+    if ( BC < 0 ) BC = 0;
 
-        if ( y < m_height - 1 )
-        {
-            nPix = pix + m_width;
-
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothcost(alpha_label,alpha_label) ,
-                              m_smoothcost(alpha_label,m_labeling[nPix]),
-                              m_smoothcost(m_labeling[pix],alpha_label) ,
-                              m_smoothcost(m_labeling[pix],m_labeling[nPix]) );
-            else   e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix]),
-                                 m_smoothcost(m_labeling[pix],alpha_label));
-        }   
-        if ( x > 0 )
-        {
-            nPix = pix - 1;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothcost(alpha_label,m_labeling[nPix]),
-                                 m_smoothcost(m_labeling[pix],alpha_label) );
-        }   
-
-        if ( y > 0 )
-        {
-            nPix = pix - m_width;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothcost(alpha_label,alpha_label),
-                                 m_smoothcost(m_labeling[pix],alpha_label));
-        }   
-            
+    if ( B < 0 )
+    {
+        m_tlinks[2*pix+1]  += B;
+        m_tlinks[2*nPix+1] -= B;
+        g -> set_edge(pix-first,dir,0,BC);
     }
-    
+    else if ( C < 0 )
+    {
+        m_tlinks[2*pix+1]  -= C;
+        m_tlinks[2*nPix+1] += C;
+        g -> set_edge(pix-first,dir,BC,0);
+    }
+    else g -> set_edge(pix-first,dir,B,C);
 }
 
-
 /**********************************************************************************************/
-/* Performs alpha-expansion for  regular grid graph for case when energy terms are NOT        */
-/* specified by a function */
-void Expansion::set_up_expansion_energy_G_FnPix(int size, LabelType alpha_label,Energy *e,
-                                                     Energy::Var *variables )
-{
-    int i,nPix,pix,x,y;
+/* Sets up the graph of alpha-expansion on the rows [y0,y1) of a grid with the terms of        */
+/* set_up_expansion_energy_NG_ARRAY() and set_up_expansion_energy_NG_FnPix(). Pixels labeled   */
+/* alpha keep their nodes, with all capacities 0, so that the topology never changes. Edges    */
+/* to the rows above and below are terms of one variable, with the labels there fixed          */
 
+void Expansion::set_up_expansion_graph(LabelType alpha_label,GridGraph *g,int y0,int y1)
+{
+    PixelType pix,nPix,first = y0*m_width,last = y1*m_width;
+    LabelType label,nLabel;
+    EnergyTermType weight = 1;
+    int x,y,dir;
 
-    for ( i = size - 1; i >= 0; i-- )
+    for ( pix = first; pix < last; pix++ )
     {
-        pix = m_lookupPixVar[i];
-        y = pix/m_width;
-        x = pix - y*m_width;
-
-        m_lookupPixVar[pix] = i;
-
-        if ( x < m_width - 1 )
+        label = m_labeling[pix];
+        if ( label == alpha_label )
         {
-            nPix = pix + 1;
+            m_tlinks[2*pix] = m_tlinks[2*pix+1] = 0;
+        }
+        else if ( m_dataType == ARRAY )
+        {
+            m_tlinks[2*pix]   = m_datacost(pix,label);
+            m_tlinks[2*pix+1] = m_datacost(pix,alpha_label);
+        }
+        else
+        {
+            m_tlinks[2*pix]   = m_dataFnPix(pix,label);
+            m_tlinks[2*pix+1] = m_dataFnPix(pix,alpha_label);
+        }
+    }
 
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothFnPix(pix,nPix,alpha_label,alpha_label),
-                              m_smoothFnPix(pix,nPix,alpha_label,m_labeling[nPix]),
-                              m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label),
-                              m_smoothFnPix(pix,nPix,m_labeling[pix],m_labeling[nPix]));
-            else   e ->add_term1(variables[i],m_smoothFnPix(pix,nPix,alpha_label,m_labeling[nPix]),
-                                 m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label));
-        }   
+    for ( y = y0, pix = first; y < y1; y++ )
+    for ( x = 0; x < m_width; x++, pix++ )
+    {
+        label = m_labeling[pix];
 
-        if ( y < m_height - 1 )
+        for ( dir = GridGraph::RIGHT; dir <= GridGraph::DOWN; dir++ )
         {
-            nPix = pix + m_width;
+            if ( dir == GridGraph::RIGHT )
+            {
+                if ( x == m_width - 1 ) continue;
+                nPix = pix + 1;
+                if ( m_varWeights ) weight = m_horizWeights[pix];
+            }
+            else
+            {
+                if ( y == m_height - 1 ) continue;
+                nPix = pix + m_width;
+                if ( m_varWeights ) weight = m_vertWeights[pix];
+            }
+            nLabel = m_labeling[nPix];
 
-            if ( m_labeling[nPix] != alpha_label )
-                e ->add_term2(variables[i],variables[m_lookupPixVar[nPix]],
-                              m_smoothFnPix(pix,nPix,alpha_label,alpha_label) ,
-                              m_smoothFnPix(pix,nPix,alpha_label,m_labeling[nPix]),
-                              m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label) ,
-                              m_smoothFnPix(pix,nPix,m_labeling[pix],m_labeling[nPix]) );
-            else   e ->add_term1(variables[i],m_smoothFnPix(pix,nPix,alpha_label,m_labeling[nPix]),
-                                 m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label));
-        }   
-        if ( x > 0 )
-        {
-            nPix = pix - 1;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothFnPix(pix,nPix,alpha_label,m_labeling[nPix]),
-                                 m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label) );
-        }   
+            if ( y == y1 - 1 && dir == GridGraph::DOWN )
+            {
+                /* the row below the band */
+                if ( label != alpha_label )
+                {
+                    m_tlinks[2*pix]   += grid_smooth_cost(pix,nPix,weight,label,nLabel);
+                    m_tlinks[2*pix+1] += grid_smooth_cost(pix,nPix,weight,alpha_label,nLabel);
+                }
+            }
+            else if ( label != alpha_label && nLabel != alpha_label )
+                add_grid_edge(g,pix,nPix,dir,first,
+                              grid_smooth_cost(pix,nPix,weight,alpha_label,alpha_label),
+                              grid_smooth_cost(pix,nPix,weight,alpha_label,nLabel),
+                              grid_smooth_cost(pix,nPix,weight,label,alpha_label),
+                              grid_smooth_cost(pix,nPix,weight,label,nLabel));
+            else
+            {
+                g -> set_edge(pix-first,dir,0,0);
 
-        if ( y > 0 )
+                if ( label != alpha_label )
+                {
+                    m_tlinks[2*pix]   += grid_smooth_cost(pix,nPix,weight,label,alpha_label);
+                    m_tlinks[2*pix+1] += grid_smooth_cost(pix,nPix,weight,alpha_label,alpha_label);
+                }
+                else if ( nLabel != alpha_label )
+                {
+                    m_tlinks[2*nPix]   += grid_smooth_cost(nPix,pix,weight,nLabel,alpha_label);
+                    m_tlinks[2*nPix+1] += grid_smooth_cost(nPix,pix,weight,alpha_label,alpha_label);
+                }
+            }
+        }
+    }
+
+    /* the row above the band */
+    if ( y0 > 0 )
+    {
+        for ( pix = first; pix < first + m_width; pix++ )
         {
-            nPix = pix - m_width;
-    
-            if ( m_labeling[nPix] == alpha_label )
-               e ->add_term1(variables[i],m_smoothFnPix(pix,nPix,alpha_label,alpha_label),
-                                 m_smoothFnPix(pix,nPix,m_labeling[pix],alpha_label));
-        }   
-            
+            label = m_labeling[pix];
+            if ( label == alpha_label ) continue;
+
+            nPix   = pix - m_width;
+            nLabel = m_labeling[nPix];
+            if ( m_varWeights ) weight = m_vertWeights[nPix];
+            m_tlinks[2*pix]   += grid_smooth_cost(nPix,pix,weight,nLabel,label);
+            m_tlinks[2*pix+1] += grid_smooth_cost(nPix,pix,weight,nLabel,alpha_label);
+        }
     }
-    
-}
 
+    for ( pix = first; pix < last; pix++ )
+        g -> set_tweights(pix-first,m_tlinks[2*pix],m_tlinks[2*pix+1]);
+}
 
 /**************************************************************************************/
 
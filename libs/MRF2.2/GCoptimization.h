@@ -31,6 +31,7 @@
 #include "LinkedBlockList.h"
 #include <assert.h>
 #include "graph.h"
+#include "GridGraph.h"
 #include "energy.h"
 #define m_datacost(pix,lab)     (m_datacost[(pix)*m_nLabels+(lab)] )
 #define m_smoothcost(lab1,lab2) (m_smoothcost[(lab1)+(lab2)*m_nLabels] )
@@ -52,7 +53,7 @@ public:
     typedef Graph::captype EnergyTermType;
 
     /* Type of label. Can be set to char, short, int, long */
-    typedef int LabelType;
+    typedef MRF::Label LabelType;
 
     /* Type for pixel. Can be set to  short, int, long */ 
     typedef int PixelType;
@@ -100,7 +101,7 @@ public:
     /* If the desired penalty for neighboring pixels pixel1 and pixel2 is                          */
     /*  V(label1,label2) = weight*SmoothnessPenalty(label1,label2), then                           */
     /* member function setLabel should be called as: setLabel(pixel1,pixel2,weight)                */
-    void setNeighbors(PixelType pixel1, PixelType pixel2, EnergyTermType weight);
+    void setNeighbors(PixelType pixel1, PixelType pixel2, CostVal weight);
 
 
     /* This function can be used to change the label of any pixel at any time      */
@@ -121,6 +122,10 @@ public:
     /* Returns Smooth Energy of current labeling */
     EnergyType smoothnessEnergy();
 
+    /* Returns the allocation counts of the arena that holds the graphs of all moves and the */
+    /* neighborhood system of non-grid graphs                                                 */
+    const BlockArena::Statistics& getAllocationStatistics(){return(m_arena->getStatistics());};
+
 protected:
 	void initializeAlg() {};
 
@@ -129,7 +134,7 @@ protected:
     /* DataCost[pixel*num_labels+l].  If the current neighborhood system is a grid, then                    */
     /* the data term for label l and pixel with coordinates (x,y) is stored at                              */ 
     /* DataCost[(x+y*width)*num_labels + l]. Thus the size of array DataCost is num_pixels*num_labels       */
-     void setData(EnergyTermType *DataCost);
+     void setData(CostVal *DataCost);
 
     /* This function is used to set the data term, and it can be used only if dataSetup = PASS_AS_PARAMETER */
     /* dataFn is a pointer to a function  f(Pixel p, Label l), s.t. the data cost for pixel p to have       */
@@ -141,7 +146,7 @@ protected:
      /*  V is an array of costs, such that V(label1,label2)  is stored at V[label1+num_labels*label2]        */
      /* If graph is a grid, then using this  function only if the smooth costs are not spacially varying     */
      /* that is the smoothness penalty V depends only on labels, but not on pixels                           */
-     void setSmoothness(EnergyTermType* V);
+     void setSmoothness(CostVal* V);
 
     void setSmoothness(int smoothExp,CostVal smoothMax, CostVal lambda);
 
@@ -174,12 +179,17 @@ protected:
     LabelType *m_labeling;
     bool m_random_label_order;
     bool m_needToFreeV;
-    EnergyTermType *m_datacost;
-    EnergyTermType *m_smoothcost;
-    EnergyTermType *m_vertWeights;
-    EnergyTermType *m_horizWeights;
+    CostVal *m_datacost;
+    CostVal *m_smoothcost;
+    CostVal *m_vertWeights;
+    CostVal *m_horizWeights;
     LinkedBlockList *m_neighbors;
 
+    /* Memory of the graphs, reused by all moves, and of the neighborhood system */
+    BlockArena *m_arena;
+    /* Variables of the graph of a move, of size m_nPixels */
+    Energy::Var *m_variables;
+
     LabelType *m_labelTable;
     PixelType *m_lookupPixVar;
     
@@ -232,7 +242,7 @@ public:
     EnergyType oneSwapIteration();
 
     /* Peforms  swap on a pair of labels, specified by the input parameters alpha_label, beta_label */
-    EnergyType alpha_beta_swap(LabelType alpha_label, LabelType beta_label);
+    EnergyType alpha_beta_swap(int alpha_label, int beta_label);
 
 protected:
     void optimizeAlg(int nIterations);
@@ -254,8 +264,9 @@ private:
 class Expansion: public GCoptimization
 {
 public:
-    Expansion(PixelType width,PixelType height,int num_labels,EnergyFunction *eng):GCoptimization(width,height,num_labels,eng){};
-    Expansion(PixelType nPixels, int num_labels,EnergyFunction *eng):GCoptimization(nPixels,num_labels,eng){};
+    Expansion(PixelType width,PixelType height,int num_labels,EnergyFunction *eng):GCoptimization(width,height,num_labels,eng){commonExpansionInitialization();};
+    Expansion(PixelType nPixels, int num_labels,EnergyFunction *eng):GCoptimization(nPixels,num_labels,eng){commonExpansionInitialization();};
+    ~Expansion();
 
 
     /* Peforms expansion algorithm. Runs the number of iterations specified by max_num_iterations */
@@ -270,16 +281,47 @@ public:
     EnergyType oneExpansionIteration();
 
     /* Peforms  expansion on one label, specified by the input parameter alpha_label */
-    EnergyType alpha_expansion(LabelType alpha_label);
+    EnergyType alpha_expansion(int alpha_label);
+
+    /* On grids the graph of the moves is built once. Every move only rewrites its capacities     */
+    /* and computes the maxflow starting from the flow and search trees of an earlier move        */
+    /* (dynamic graph cuts, see GridGraph.h). By default the graph is shared by all labels.       */
+    /* With argument 1 a graph is kept per label, so the move on a label continues from the flow  */
+    /* of the previous move on the same label, which changed only where labels changed since     */
+    /* (Kohli and Torr). This takes number of labels times the memory of one graph               */
+    void setRecycleFlows(bool recycle);
+
+    /* Splits a grid into bandCount horizontal bands of about equal height. A move expands the    */
+    /* even bands in parallel (if compiled with OpenMP), then the odd ones, each with the labels  */
+    /* of the rows next to it fixed. Every band's move is optimal given its neighbors, so the      */
+    /* energy never increases, but the move is not the optimal expansion on the whole grid.        */
+    /* Data and smoothness functions are then called from several threads.                        */
+    /* 1 (default) expands the whole grid at once                                                 */
+    void setBandCount(int bandCount);
+    int getBandCount(){return(m_bandCount);};
+
+    /* Returns the number of pixels whose capacities changed in the last move on a grid */
+    PixelType changedPixelCount(){return(m_changedPixels);};
     
 protected:
     void optimizeAlg(int nIterations);
 
 
 private:
-    void set_up_expansion_energy_G_ARRAY_VW(int size, LabelType alpha_label,Energy* e, Energy::Var *variables);
-    void set_up_expansion_energy_G_ARRAY(int size, LabelType alpha_label,Energy* e, Energy::Var *variables);
-    void set_up_expansion_energy_G_FnPix(int size, LabelType alpha_label,Energy* e, Energy::Var *variables);
+    GridGraph **m_gridGraphs;   /* per band, and per label if flows are recycled, created by the first move */
+    int m_nGridGraphs;
+    bool m_recycleFlows;
+    int m_bandCount;
+    EnergyTermType *m_tlinks;   /* terminal capacities of a move, 2 per pixel */
+    PixelType m_changedPixels;
+
+    void commonExpansionInitialization();
+    void delete_grid_graphs();
+    inline EnergyTermType grid_smooth_cost(PixelType pix,PixelType nPix,EnergyTermType weight,LabelType label1,LabelType label2);
+    void add_grid_edge(GridGraph *g,PixelType pix,PixelType nPix,int dir,PixelType first,EnergyTermType A,EnergyTermType B,EnergyTermType C,EnergyTermType D);
+    void set_up_expansion_graph(LabelType alpha_label,GridGraph *g,int y0,int y1);
+    PixelType expand_band(LabelType alpha_label,int b);
+    void perform_alpha_expansion_grid(LabelType alpha_label);
     void set_up_expansion_energy_NG_ARRAY(int size, LabelType alpha_label,Energy* e, Energy::Var *variables);       
     void set_up_expansion_energy_NG_FnPix(int size, LabelType alpha_label,Energy* e, Energy::Var *variables);       
     void perform_alpha_expansion(LabelType label);  
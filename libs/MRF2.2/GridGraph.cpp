@@ -0,0 +1,765 @@
+/* GridGraph.cpp */
+/*
+    Maxflow of Graph (maxflow.cpp) on a fixed 4-connected grid, with
+    capacities that can be changed between computations. See GridGraph.h.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include "GridGraph.h"
+
+/*
+    special constants for node->parent
+*/
+#define NO_PARENT  0        /* free node */
+#define TERMINAL   1        /* to terminal */
+#define ORPHAN     2        /* orphan */
+#define PARENT_ARC 3        /* PARENT_ARC + d: parent is the neighbour in direction d */
+
+#define PARENT_DIR(i)     ((i)->parent - PARENT_ARC)
+#define REVERSE(d)        ((d) ^ 2)
+
+#define INFINITE_D 1000000000       /* infinite distance to the terminal */
+
+/***********************************************************************/
+
+GridGraph::GridGraph(int _width, int _height, void (*err_function)(const char *))
+{
+    int x, y, n = _width*_height;
+
+    error_function = err_function;
+    width = _width;
+    height = _height;
+
+    shift[RIGHT] = 1;
+    shift[DOWN]  = width;
+    shift[LEFT]  = -1;
+    shift[UP]    = -width;
+
+    nodes  = new node[n];
+    t_caps = new captype[2*n];
+    n_caps = new captype[4*n];
+    if (!nodes || !t_caps || !n_caps) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+
+    memset(nodes, 0, n*sizeof(node));
+    memset(t_caps, 0, 2*n*sizeof(captype));
+    memset(n_caps, 0, 4*n*sizeof(captype));
+
+    for (y=0; y<height; y++)
+    for (x=0; x<width; x++)
+    {
+        node *i = &nodes[x + y*width];
+        i -> next = -1;
+        if (x < width - 1)  i -> arcs |= 1 << RIGHT;
+        if (y < height - 1) i -> arcs |= 1 << DOWN;
+        if (x > 0)          i -> arcs |= 1 << LEFT;
+        if (y > 0)          i -> arcs |= 1 << UP;
+    }
+
+    nodeptr_block = NULL;
+    queue_first[0] = queue_last[0] = -1;
+    queue_first[1] = queue_last[1] = -1;
+    orphan_first = orphan_last = NULL;
+    flow = 0;
+    maxflow_iteration = 0;
+    changed_count = 0;
+    TIME = 0;
+}
+
+GridGraph::~GridGraph()
+{
+    delete [] nodes;
+    delete [] t_caps;
+    delete [] n_caps;
+    if (nodeptr_block) delete nodeptr_block;
+}
+
+/***********************************************************************/
+
+/*
+    Only the difference to the capacities set before is applied to the
+    residual graph: the residual capacity of the terminal arcs changes by
+    it, as with Graph::add_tweights().
+*/
+void GridGraph::set_tweights(int _i, captype cap_source, captype cap_sink)
+{
+    captype *c = &t_caps[2*_i];
+    captype delta_source = cap_source - c[0];
+    captype delta_sink   = cap_sink - c[1];
+    node *i = &nodes[_i];
+
+    if (!delta_source && !delta_sink) return;
+    c[0] = cap_source;
+    c[1] = cap_sink;
+
+    if (i->tr_cap > 0) delta_source += i -> tr_cap;
+    else               delta_sink   -= i -> tr_cap;
+    flow += (delta_source < delta_sink) ? delta_source : delta_sink;
+    i -> tr_cap = delta_source - delta_sink;
+
+    mark_node(_i);
+}
+
+/*
+    The residual capacities of both arcs change by the difference to the
+    capacities set before. If one of them becomes negative, the flow
+    through the arc exceeds its new capacity: the excess is taken back
+    and the terminal arcs of both nodes are adjusted, so that the flow
+    stays valid (Kohli and Torr).
+*/
+void GridGraph::set_edge(int _i, int dir, captype cap, captype rev_cap)
+{
+    int _j = _i + shift[dir];
+    int rev = REVERSE(dir);
+    captype *c = &n_caps[4*_i + dir], *c_rev = &n_caps[4*_j + rev];
+    captype delta = cap - *c, rev_delta = rev_cap - *c_rev;
+    node *i = &nodes[_i], *j = &nodes[_j];
+    captype r_cap, r_rev_cap;
+
+    if (!delta && !rev_delta) return;
+    *c = cap;
+    *c_rev = rev_cap;
+
+    r_cap     = i -> r_cap[dir] + delta;
+    r_rev_cap = j -> r_cap[rev] + rev_delta;
+    if (r_cap < 0)
+    {
+        r_rev_cap += r_cap;
+        i -> tr_cap -= r_cap;
+        j -> tr_cap += r_cap;
+        flow += r_cap;
+        r_cap = 0;
+    }
+    else if (r_rev_cap < 0)
+    {
+        r_cap += r_rev_cap;
+        j -> tr_cap -= r_rev_cap;
+        i -> tr_cap += r_rev_cap;
+        flow += r_rev_cap;
+        r_rev_cap = 0;
+    }
+    i -> r_cap[dir] = r_cap;
+    j -> r_cap[rev] = r_rev_cap;
+
+    mark_node(_i);
+    mark_node(_j);
+}
+
+GridGraph::termtype GridGraph::what_segment(int i)
+{
+    if (nodes[i].parent && !nodes[i].is_sink) return Graph::SOURCE;
+    return Graph::SINK;
+}
+
+/***********************************************************************/
+
+/*
+    Functions for processing active list.
+    i->next is the index of the next node in the list
+    (or i, if i is the last node in the list).
+    i->next is -1 iff i is not in the list.
+
+    There are two queues. Active nodes are added
+    to the end of the second queue and read from
+    the front of the first queue. If the first queue
+    is empty, it is replaced by the second queue
+    (and the second queue becomes empty).
+*/
+
+inline void GridGraph::set_active(int i)
+{
+    if (nodes[i].next < 0)
+    {
+        /* it's not in the list yet */
+        if (queue_last[1] >= 0) nodes[queue_last[1]].next = i;
+        else                    queue_first[1]            = i;
+        queue_last[1] = i;
+        nodes[i].next = i;
+    }
+}
+
+/*
+    Returns the next active node.
+    If it is connected to the sink, it stays in the list,
+    otherwise it is removed from the list
+*/
+inline int GridGraph::next_active()
+{
+    int i;
+
+    while ( 1 )
+    {
+        if ((i=queue_first[0]) < 0)
+        {
+            queue_first[0] = i = queue_first[1];
+            queue_last[0]  = queue_last[1];
+            queue_first[1] = -1;
+            queue_last[1]  = -1;
+            if (i < 0) return -1;
+        }
+
+        /* remove it from the active list */
+        if (nodes[i].next == i) queue_first[0] = queue_last[0] = -1;
+        else                    queue_first[0] = nodes[i].next;
+        nodes[i].next = -1;
+
+        /* a node in the list is active iff it has a parent */
+        if (nodes[i].parent) return i;
+    }
+}
+
+/*
+    Marked nodes are kept in the second queue of active nodes
+    until maxflow() takes them out of their trees.
+*/
+inline void GridGraph::mark_node(int i)
+{
+    set_active(i);
+    nodes[i].is_marked = 1;
+}
+
+/***********************************************************************/
+
+inline void GridGraph::set_orphan_front(int i)
+{
+    nodeptr *np;
+    nodes[i].parent = ORPHAN;
+    np = nodeptr_block -> New();
+    np -> ptr = i;
+    np -> next = orphan_first;
+    orphan_first = np;
+    if (!orphan_last) orphan_last = np;
+}
+
+inline void GridGraph::set_orphan_rear(int i)
+{
+    nodeptr *np;
+    nodes[i].parent = ORPHAN;
+    np = nodeptr_block -> New();
+    np -> ptr = i;
+    if (orphan_last) orphan_last -> next = np;
+    else             orphan_first        = np;
+    orphan_last = np;
+    np -> next = NULL;
+}
+
+/***********************************************************************/
+
+void GridGraph::maxflow_init()
+{
+    node *i;
+
+    queue_first[0] = queue_last[0] = -1;
+    queue_first[1] = queue_last[1] = -1;
+    orphan_first = orphan_last = NULL;
+
+    for (i=nodes; i<nodes+width*height; i++)
+    {
+        i -> next = -1;
+        i -> is_marked = 0;
+        i -> TS = 0;
+        if (i->tr_cap > 0)
+        {
+            /* i is connected to the source */
+            i -> is_sink = 0;
+            i -> parent = TERMINAL;
+            set_active((int)(i - nodes));
+            i -> DIST = 1;
+        }
+        else if (i->tr_cap < 0)
+        {
+            /* i is connected to the sink */
+            i -> is_sink = 1;
+            i -> parent = TERMINAL;
+            set_active((int)(i - nodes));
+            i -> DIST = 1;
+        }
+        else
+        {
+            i -> parent = NO_PARENT;
+        }
+    }
+    TIME = 0;
+    changed_count = width*height;
+}
+
+/*
+    Keeps the search trees of the previous maxflow(). Each marked node
+    becomes a child of the terminal it is connected to now, or an orphan
+    if it is connected to none. Nodes that switch trees take the subtrees
+    rooted at them along as orphans.
+*/
+void GridGraph::maxflow_reuse_trees_init()
+{
+    node *i, *j;
+    int _i, _j, queue = queue_first[1], d;
+    nodeptr *np;
+
+    queue_first[0] = queue_last[0] = -1;
+    queue_first[1] = queue_last[1] = -1;
+    orphan_first = orphan_last = NULL;
+    changed_count = 0;
+
+    TIME ++;
+
+    while ((_i=queue) >= 0)
+    {
+        i = &nodes[_i];
+        queue = i -> next;
+        if (queue == _i) queue = -1;
+        i -> next = -1;
+        i -> is_marked = 0;
+        set_active(_i);
+        changed_count ++;
+
+        if (i->tr_cap == 0)
+        {
+            if (i->parent) set_orphan_rear(_i);
+            continue;
+        }
+
+        if (i->tr_cap > 0)
+        {
+            if (!i->parent || i->is_sink)
+            {
+                i -> is_sink = 0;
+                for (d=0; d<4; d++)
+                if (i->arcs & (1 << d))
+                {
+                    _j = _i + shift[d];
+                    j = &nodes[_j];
+                    if (!j->is_marked)
+                    {
+                        if (j->parent == PARENT_ARC + REVERSE(d)) set_orphan_rear(_j);
+                        if (j->parent && j->is_sink && i->r_cap[d] > 0) set_active(_j);
+                    }
+                }
+            }
+        }
+        else
+        {
+            if (!i->parent || !i->is_sink)
+            {
+                i -> is_sink = 1;
+                for (d=0; d<4; d++)
+                if (i->arcs & (1 << d))
+                {
+                    _j = _i + shift[d];
+                    j = &nodes[_j];
+                    if (!j->is_marked)
+                    {
+                        if (j->parent == PARENT_ARC + REVERSE(d)) set_orphan_rear(_j);
+                        if (j->parent && !j->is_sink && j->r_cap[REVERSE(d)] > 0) set_active(_j);
+                    }
+                }
+            }
+        }
+        i -> parent = TERMINAL;
+        i -> TS = TIME;
+        i -> DIST = 1;
+    }
+
+    /* adoption */
+    while ((np=orphan_first))
+    {
+        orphan_first = np -> next;
+        _i = np -> ptr;
+        nodeptr_block -> Delete(np);
+        if (!orphan_first) orphan_last = NULL;
+        if (nodes[_i].is_sink) process_sink_orphan(_i);
+        else                   process_source_orphan(_i);
+    }
+    /* adoption end */
+}
+
+/***********************************************************************/
+
+/*
+    Augments along the path from the source to s_start, the arc from
+    s_start to its neighbour t_start in direction dir_middle and the
+    path from t_start to the sink.
+*/
+void GridGraph::augment(int s_start, int t_start, int dir_middle)
+{
+    node *i, *p;
+    int d;
+    captype bottleneck;
+
+
+    /* 1. Finding bottleneck capacity */
+    /* 1a - the source tree */
+    bottleneck = nodes[s_start].r_cap[dir_middle];
+    for (i=&nodes[s_start]; ; i=p)
+    {
+        if (i->parent == TERMINAL) break;
+        d = PARENT_DIR(i);
+        p = i + shift[d];
+        if (bottleneck > p->r_cap[REVERSE(d)]) bottleneck = p -> r_cap[REVERSE(d)];
+    }
+    if (bottleneck > i->tr_cap) bottleneck = i -> tr_cap;
+    /* 1b - the sink tree */
+    for (i=&nodes[t_start]; ; i=p)
+    {
+        if (i->parent == TERMINAL) break;
+        d = PARENT_DIR(i);
+        p = i + shift[d];
+        if (bottleneck > i->r_cap[d]) bottleneck = i -> r_cap[d];
+    }
+    if (bottleneck > - i->tr_cap) bottleneck = - i -> tr_cap;
+
+
+    /* 2. Augmenting */
+    /* 2a - the source tree */
+    nodes[s_start].r_cap[dir_middle] -= bottleneck;
+    nodes[t_start].r_cap[REVERSE(dir_middle)] += bottleneck;
+    for (i=&nodes[s_start]; ; i=p)
+    {
+        if (i->parent == TERMINAL) break;
+        d = PARENT_DIR(i);
+        p = i + shift[d];
+        i -> r_cap[d] += bottleneck;
+        p -> r_cap[REVERSE(d)] -= bottleneck;
+        if (!p->r_cap[REVERSE(d)])
+        {
+            /* add i to the adoption list */
+            set_orphan_front((int)(i - nodes));
+        }
+    }
+    i -> tr_cap -= bottleneck;
+    if (!i->tr_cap)
+    {
+        /* add i to the adoption list */
+        set_orphan_front((int)(i - nodes));
+    }
+    /* 2b - the sink tree */
+    for (i=&nodes[t_start]; ; i=p)
+    {
+        if (i->parent == TERMINAL) break;
+        d = PARENT_DIR(i);
+        p = i + shift[d];
+        p -> r_cap[REVERSE(d)] += bottleneck;
+        i -> r_cap[d] -= bottleneck;
+        if (!i->r_cap[d])
+        {
+            /* add i to the adoption list */
+            set_orphan_front((int)(i - nodes));
+        }
+    }
+    i -> tr_cap += bottleneck;
+    if (!i->tr_cap)
+    {
+        /* add i to the adoption list */
+        set_orphan_front((int)(i - nodes));
+    }
+
+
+    flow += bottleneck;
+}
+
+/***********************************************************************/
+
+void GridGraph::process_source_orphan(int _i)
+{
+    node *i = &nodes[_i], *j;
+    int d0, d0_min = -1, dist, dist_min = INFINITE_D;
+
+    /* trying to find a new parent */
+    for (d0=0; d0<4; d0++)
+    if ((i->arcs & (1 << d0)) && i[shift[d0]].r_cap[REVERSE(d0)])
+    {
+        j = i + shift[d0];
+        if (!j->is_sink && j->parent)
+        {
+            /* checking the origin of j */
+            dist = 0;
+            while ( 1 )
+            {
+                if (j->TS == TIME)
+                {
+                    dist += j -> DIST;
+                    break;
+                }
+                dist ++;
+                if (j->parent == TERMINAL)
+                {
+                    j -> TS = TIME;
+                    j -> DIST = 1;
+                    break;
+                }
+                if (j->parent == ORPHAN) { dist = INFINITE_D; break; }
+                j += shift[PARENT_DIR(j)];
+            }
+            if (dist<INFINITE_D) /* j originates from the source - done */
+            {
+                if (dist<dist_min)
+                {
+                    d0_min = d0;
+                    dist_min = dist;
+                }
+                /* set marks along the path */
+                for (j=i+shift[d0]; j->TS!=TIME; j+=shift[PARENT_DIR(j)])
+                {
+                    j -> TS = TIME;
+                    j -> DIST = dist --;
+                }
+            }
+        }
+    }
+
+    if (d0_min >= 0)
+    {
+        i -> parent = PARENT_ARC + d0_min;
+        i -> TS = TIME;
+        i -> DIST = dist_min + 1;
+    }
+    else
+    {
+        /* no parent is found */
+        i -> parent = NO_PARENT;
+        i -> TS = 0;
+
+        /* process neighbors */
+        for (d0=0; d0<4; d0++)
+        if (i->arcs & (1 << d0))
+        {
+            j = i + shift[d0];
+            if (!j->is_sink && j->parent)
+            {
+                if (j->r_cap[REVERSE(d0)]) set_active(_i + shift[d0]);
+                if (j->parent == PARENT_ARC + REVERSE(d0))
+                {
+                    /* add j to the adoption list */
+                    set_orphan_rear(_i + shift[d0]);
+                }
+            }
+        }
+    }
+}
+
+void GridGraph::process_sink_orphan(int _i)
+{
+    node *i = &nodes[_i], *j;
+    int d0, d0_min = -1, dist, dist_min = INFINITE_D;
+
+    /* trying to find a new parent */
+    for (d0=0; d0<4; d0++)
+    if ((i->arcs & (1 << d0)) && i->r_cap[d0])
+    {
+        j = i + shift[d0];
+        if (j->is_sink && j->parent)
+        {
+            /* checking the origin of j */
+            dist = 0;
+            while ( 1 )
+            {
+                if (j->TS == TIME)
+                {
+                    dist += j -> DIST;
+                    break;
+                }
+                dist ++;
+                if (j->parent == TERMINAL)
+                {
+                    j -> TS = TIME;
+                    j -> DIST = 1;
+                    break;
+                }
+                if (j->parent == ORPHAN) { dist = INFINITE_D; break; }
+                j += shift[PARENT_DIR(j)];
+            }
+            if (dist<INFINITE_D) /* j originates from the sink - done */
+            {
+                if (dist<dist_min)
+                {
+                    d0_min = d0;
+                    dist_min = dist;
+                }
+                /* set marks along the path */
+                for (j=i+shift[d0]; j->TS!=TIME; j+=shift[PARENT_DIR(j)])
+                {
+                    j -> TS = TIME;
+                    j -> DIST = dist --;
+                }
+            }
+        }
+    }
+
+    if (d0_min >= 0)
+    {
+        i -> parent = PARENT_ARC + d0_min;
+        i -> TS = TIME;
+        i -> DIST = dist_min + 1;
+    }
+    else
+    {
+        /* no parent is found */
+        i -> parent = NO_PARENT;
+        i -> TS = 0;
+
+        /* process neighbors */
+        for (d0=0; d0<4; d0++)
+        if (i->arcs & (1 << d0))
+        {
+            j = i + shift[d0];
+            if (j->is_sink && j->parent)
+            {
+                if (i->r_cap[d0]) set_active(_i + shift[d0]);
+                if (j->parent == PARENT_ARC + REVERSE(d0))
+                {
+                    /* add j to the adoption list */
+                    set_orphan_rear(_i + shift[d0]);
+                }
+            }
+        }
+    }
+}
+
+/***********************************************************************/
+
+GridGraph::flowtype GridGraph::maxflow()
+{
+    node *i, *j;
+    int _i, _j, d, current_node = -1, s_start = -1, t_start = -1, dir_middle = 0;
+    nodeptr *np, *np_next;
+
+    if (!nodeptr_block) nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
+
+    if (maxflow_iteration == 0) maxflow_init();
+    else                        maxflow_reuse_trees_init();
+
+    while ( 1 )
+    {
+        if ((_i=current_node) >= 0)
+        {
+            nodes[_i].next = -1; /* remove active flag */
+            if (!nodes[_i].parent) _i = -1;
+        }
+        if (_i < 0)
+        {
+            if ((_i = next_active()) < 0) break;
+        }
+        i = &nodes[_i];
+
+        /* growth */
+        s_start = -1;
+
+        if (!i->is_sink)
+        {
+            /* grow source tree */
+            for (d=0; d<4; d++)
+            if (i->r_cap[d])
+            {
+                _j = _i + shift[d];
+                j = &nodes[_j];
+                if (!j->parent)
+                {
+                    j -> is_sink = 0;
+                    j -> parent = PARENT_ARC + REVERSE(d);
+                    j -> TS = i -> TS;
+                    j -> DIST = i -> DIST + 1;
+                    set_active(_j);
+                }
+                else if (j->is_sink)
+                {
+                    s_start = _i;
+                    t_start = _j;
+                    dir_middle = d;
+                    break;
+                }
+                else if (j->TS <= i->TS &&
+                         j->DIST > i->DIST)
+                {
+                    /* heuristic - trying to make the distance from j to the source shorter */
+                    j -> parent = PARENT_ARC + REVERSE(d);
+                    j -> TS = i -> TS;
+                    j -> DIST = i -> DIST + 1;
+                }
+            }
+        }
+        else
+        {
+            /* grow sink tree */
+            for (d=0; d<4; d++)
+            if ((i->arcs & (1 << d)) && i[shift[d]].r_cap[REVERSE(d)])
+            {
+                _j = _i + shift[d];
+                j = &nodes[_j];
+                if (!j->parent)
+                {
+                    j -> is_sink = 1;
+                    j -> parent = PARENT_ARC + REVERSE(d);
+                    j -> TS = i -> TS;
+                    j -> DIST = i -> DIST + 1;
+                    set_active(_j);
+                }
+                else if (!j->is_sink)
+                {
+                    s_start = _j;
+                    t_start = _i;
+                    dir_middle = REVERSE(d);
+                    break;
+                }
+                else if (j->TS <= i->TS &&
+                         j->DIST > i->DIST)
+                {
+                    /* heuristic - trying to make the distance from j to the sink shorter */
+                    j -> parent = PARENT_ARC + REVERSE(d);
+                    j -> TS = i -> TS;
+                    j -> DIST = i -> DIST + 1;
+                }
+            }
+        }
+
+        TIME ++;
+
+        if (s_start >= 0)
+        {
+            i -> next = _i; /* set active flag */
+            current_node = _i;
+
+            /* augmentation */
+            augment(s_start, t_start, dir_middle);
+            /* augmentation end */
+
+            /* adoption */
+            while ((np=orphan_first))
+            {
+                np_next = np -> next;
+                np -> next = NULL;
+
+                while ((np=orphan_first))
+                {
+                    orphan_first = np -> next;
+                    _i = np -> ptr;
+                    nodeptr_block -> Delete(np);
+                    if (!orphan_first) orphan_last = NULL;
+                    if (nodes[_i].is_sink) process_sink_orphan(_i);
+                    else                   process_source_orphan(_i);
+                }
+
+                orphan_first = np_next;
+            }
+            /* adoption end */
+        }
+        else current_node = -1;
+    }
+
+    maxflow_iteration ++;
+
+    return flow;
+}
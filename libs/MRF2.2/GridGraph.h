@@ -0,0 +1,160 @@
+/* GridGraph.h */
+/*
+    Maxflow on a 4-connected grid whose capacities change between
+    computations (dynamic graph cuts).
+
+    The search trees and the augmenting path algorithm are those of
+    Graph (maxflow.cpp), see
+
+        An Experimental Comparison of Min-Cut/Max-Flow Algorithms
+        for Energy Minimization in Vision.
+        Yuri Boykov and Vladimir Kolmogorov.
+        In IEEE Transactions on Pattern Analysis and Machine Intelligence (PAMI),
+        September 2004
+
+    The topology is fixed: node i is the pixel (x,y) with i = x + y*width
+    and has arcs to its four neighbours. Capacities are set (not added)
+    by set_tweights() and set_edge(), any number of times. Except for the
+    first call, maxflow() starts from the flow and the search trees left
+    by the previous call: the changes of the capacities are applied to the
+    residual graph as in
+
+        Dynamic Graph Cuts for Efficient Inference in Markov Random Fields.
+        Pushmeet Kohli and Philip H. S. Torr.
+        In IEEE Transactions on Pattern Analysis and Machine Intelligence (PAMI),
+        December 2007
+
+    and only the nodes they touch are taken out of their trees (Kolmogorov's
+    maxflow v3.0 "reuse_trees"). If few capacities change, maxflow() does a
+    fraction of the work of a computation from scratch.
+*/
+
+#ifndef __GRIDGRAPH_H__
+#define __GRIDGRAPH_H__
+
+#include "block.h"
+#include "graph.h"
+
+class GridGraph
+{
+public:
+    typedef Graph::captype captype;
+    typedef Graph::flowtype flowtype;
+    typedef Graph::termtype termtype;
+
+    /* directions of the arcs of a node */
+    typedef enum
+    {
+        RIGHT = 0,  /* to (x+1,y) */
+        DOWN  = 1,  /* to (x,y+1) */
+        LEFT  = 2,  /* to (x-1,y) */
+        UP    = 3   /* to (x,y-1) */
+    } direction;
+
+    /* Constructor. All capacities are 0. Optional argument is the
+       function which will be called if an error occurs, as for Graph */
+    GridGraph(int width, int height, void (*err_function)(const char *) = NULL);
+
+    /* Destructor */
+    ~GridGraph();
+
+    /* Sets the weights of the edges 'SOURCE->i' and 'i->SINK'.
+       Weights can be negative */
+    void set_tweights(int i, captype cap_source, captype cap_sink);
+
+    /* Sets the weights of the edge between i and its neighbour in
+       direction 'dir' (RIGHT or DOWN): 'cap' from i to the neighbour,
+       'rev_cap' back. Weights must not be negative */
+    void set_edge(int i, int dir, captype cap, captype rev_cap);
+
+    /* Computes the maxflow of the current capacities. Returns the flow
+       up to a constant (negative terminal weights and lowered capacities
+       are handled by reparametrization) */
+    flowtype maxflow();
+
+    /* After the maxflow is computed, this function returns to which
+       segment the node 'i' belongs (Graph::SOURCE or Graph::SINK).
+       Nodes in neither search tree belong to the sink, as in Graph */
+    termtype what_segment(int i);
+
+    /* Number of nodes whose capacities changed before the last maxflow(),
+       all nodes for the first one */
+    int get_changed_count() { return changed_count; }
+
+/***********************************************************************/
+/***********************************************************************/
+/***********************************************************************/
+
+private:
+    /* node structure */
+    typedef struct node_st
+    {
+        int             next;       /* index of the next active node (or of itself
+                                       if it is the last node in the list), -1 if
+                                       the node is not in the list */
+        int             TS;         /* timestamp showing when DIST was computed */
+        int             DIST;       /* distance to the terminal */
+
+        captype         tr_cap;     /* if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
+                                       otherwise         -tr_cap is residual capacity of the arc node->SINK */
+        captype         r_cap[4];   /* residual capacities of the arcs to the neighbours */
+
+        char            parent;     /* NO_PARENT, TERMINAL, ORPHAN or
+                                       PARENT_ARC + direction of the parent */
+        char            is_sink;    /* flag showing whether the node is in the source or in the sink tree */
+        char            is_marked;  /* capacities of the node changed since the last maxflow() */
+        unsigned char   arcs;       /* bit d is set if the node has a neighbour in direction d */
+    } node;
+
+    /* 'pointer to node' structure */
+    typedef struct nodeptr_st
+    {
+        int             ptr;
+        nodeptr_st      *next;
+    } nodeptr;
+
+    int                 width, height;
+    node                *nodes;
+    int                 shift[4];   /* index offsets of the neighbours */
+
+    /* capacities as last set, 2 per node for the terminals and 4 per node
+       for the arcs, the changes are applied to the residual graph */
+    captype             *t_caps;
+    captype             *n_caps;
+
+    DBlock<nodeptr>     *nodeptr_block;
+
+    void    (*error_function)(const char *);  /* this function is called if a error occurs,
+                                           with a corresponding error message
+                                           (or exit(1) is called if it's NULL) */
+
+    flowtype            flow;       /* total flow */
+    int                 maxflow_iteration;
+    int                 changed_count;
+
+/***********************************************************************/
+
+    int                 queue_first[2], queue_last[2];      /* list of active nodes */
+    nodeptr             *orphan_first, *orphan_last;        /* list of pointers to orphans */
+    int                 TIME;                               /* monotonically increasing global counter */
+
+/***********************************************************************/
+
+    /* functions for processing active list */
+    void set_active(int i);
+    int next_active();
+
+    /* functions for the adoption list */
+    void set_orphan_front(int i);
+    void set_orphan_rear(int i);
+
+    void mark_node(int i);
+
+    void maxflow_init();
+    void maxflow_reuse_trees_init();
+    void augment(int s_start, int t_start, int dir_middle);
+    void process_source_orphan(int i);
+    void process_sink_orphan(int i);
+};
+
+#endif
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "HBP.h"
+#include "message-kernels.h"
+
+#define m_D(pix,l)  m_D[(pix)*m_nLabels+(l)]
+#define m_V(l1,l2)  m_V[(l1)*m_nLabels+(l2)]
+
+#define MAX(a,b)  (((a) > (b)) ? (a) : (b))
+
+// The messages of a level are stored in 4 planes, plane d holds the messages
+// every node received from its neighbour in direction d (the message of node
+// (x,y) starts at ((d*height + y)*width + x)*K). Messages from outside the
+// grid stay 0.
+enum { FROM_LEFT, FROM_RIGHT, FROM_UP, FROM_DOWN };
+
+const int HBP::MIN_LEVEL_SIZE = 8;
+
+static inline int currentThread()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+
+HBP::HBP(int width, int height, int nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
+{
+    Allocate();
+}
+
+HBP::~HBP()
+{
+    int l;
+
+    delete[] m_answer;
+    if ( m_needToFreeD ) delete [] m_D;
+    if ( m_needToFreeV ) delete [] m_V;
+    if ( m_levels )
+	{
+	    for (l=0; l<m_levelCount; l++)
+		{
+		    delete [] m_levels[l].messages;
+		    if (l == 0) continue;
+		    delete [] m_levels[l].D;
+		    if ( m_levels[l].horzWeights ) delete [] m_levels[l].horzWeights;
+		    if ( m_levels[l].vertWeights ) delete [] m_levels[l].vertWeights;
+		}
+	    delete [] m_levels;
+	}
+    if ( m_scratch ) delete [] m_scratch;
+}
+
+
+void HBP::Allocate()
+{
+    m_type = NONE;
+    m_needToFreeV = false;
+    m_needToFreeD = false;
+
+    m_D = NULL;
+    m_V = NULL;
+    m_horzWeights = NULL;
+    m_vertWeights = NULL;
+
+    m_levelCount = 0;
+    m_levels = NULL;
+    m_coarseIterations = 5;
+    m_coarseDone = false;
+
+    m_nThreads = 0;
+    m_nScratchSlots = 0;
+    m_scratchSize = 0;
+    m_scratch = NULL;
+
+    m_answer = new Label[m_nPixels];
+    m_changedLabels = 0;
+}
+
+void HBP::setLevelCount(int levelCount)
+{
+    assert(levelCount >= 0 && m_levels == NULL);
+    m_levelCount = levelCount;
+}
+
+void HBP::clearAnswer()
+{
+    memset(m_answer, 0, m_nPixels*sizeof(Label));
+    for (int l=0; m_levels && l<m_levelCount; l++)
+	{
+	    memset(m_levels[l].messages, 0, 4*m_levels[l].width*m_levels[l].height*m_nLabels*sizeof(REAL));
+	}
+    m_coarseDone = false;
+}
+
+
+MRF::EnergyVal HBP::smoothnessEnergy()
+{
+    EnergyVal eng = (EnergyVal) 0;
+    EnergyVal weight;
+    int x,y,pix;
+
+    for ( y = 0; y < m_height; y++ )
+	for ( x = 1; x < m_width; x++ )
+	    {
+		pix    = x+y*m_width;
+		weight = m_varWeights ? m_horzWeights[pix-1] :  1;
+		eng = eng + m_V(m_answer[pix],m_answer[pix-1])*weight;
+	    }
+
+    for ( y = 1; y < m_height; y++ )
+	for ( x = 0; x < m_width; x++ )
+	    {
+		pix = x+y*m_width;
+		weight = m_varWeights ? m_vertWeights[pix-m_width] :  1;
+		eng = eng + m_V(m_answer[pix],m_answer[pix-m_width])*weight;
+	    }
+
+    return(eng);
+}
+
+
+MRF::EnergyVal HBP::dataEnergy()
+{
+    EnergyVal eng = (EnergyVal) 0;
+
+    for ( int i = 0; i < m_nPixels; i++ )
+	eng = eng + m_D(i,m_answer[i]);
+
+    return(eng);
+}
+
+
+void HBP::setData(DataCostFn dcost)
+{
+    int i, k;
+
+    m_dataFn = dcost;
+    CostVal* ptr;
+    m_D = new CostVal[m_nPixels*m_nLabels];
+
+    for (ptr=m_D, i=0; i<m_nPixels; i++)
+	for (k=0; k<m_nLabels; k++, ptr++)
+	    {
+		*ptr = m_dataFn(i,k);
+	    }
+    m_needToFreeD = true;
+}
+
+void HBP::setData(CostVal* data)
+{
+    m_D = data;
+    m_needToFreeD = false;
+}
+
+
+void HBP::setSmoothness(SmoothCostGeneralFn /*cost*/)
+{
+    printf("\nHBP is not implemented for general smoothness functions, exiting!");
+    exit(1);
+}
+
+void HBP::setSmoothness(CostVal* V)
+{
+    m_type = FIXED_MATRIX;
+    m_V = V;
+}
+
+
+void HBP::setSmoothness(int smoothExp,CostVal smoothMax, CostVal lambda)
+{
+    assert(smoothExp == 1 || smoothExp == 2);
+    assert(lambda >= 0);
+
+    m_type = (smoothExp == 1) ? L1 : L2;
+
+    int ki, kj;
+    CostVal cost;
+
+    m_needToFreeV = true;
+
+    m_V = new CostVal[m_nLabels*m_nLabels];
+
+    for (ki=0; ki<m_nLabels; ki++)
+	for (kj=ki; kj<m_nLabels; kj++)
+	    {
+		cost = (CostVal) ((smoothExp == 1) ? kj - ki : (kj - ki)*(kj - ki));
+		if (cost > smoothMax) cost = smoothMax;
+		m_V[ki*m_nLabels + kj] = m_V[kj*m_nLabels + ki] = cost*lambda;
+	    }
+
+    m_smoothMax = smoothMax;
+    m_lambda = lambda;
+}
+
+
+void HBP::setCues(CostVal* hCue, CostVal* vCue)
+{
+    m_horzWeights = hCue;
+    m_vertWeights  = vCue;
+}
+
+
+void HBP::initializeAlg()
+{
+    assert(m_type != NONE);
+
+    if (!m_grid_graph) {printf("\nHBP is not implemented for nongrids, exiting!");exit(1);}
+
+    int l, w, h;
+
+    if (m_levelCount == 0)
+	{
+	    m_levelCount = 1;
+	    for (w=(m_width+1)/2, h=(m_height+1)/2; w >= MIN_LEVEL_SIZE && h >= MIN_LEVEL_SIZE; w=(w+1)/2, h=(h+1)/2)
+		{
+		    m_levelCount ++;
+		}
+	}
+
+    m_levels = new Level[m_levelCount];
+    m_levels[0].width = m_width;
+    m_levels[0].height = m_height;
+    m_levels[0].D = m_D;
+    m_levels[0].horzWeights = (m_varWeights) ? m_horzWeights : NULL;
+    m_levels[0].vertWeights = (m_varWeights) ? m_vertWeights : NULL;
+
+    for (l=1; l<m_levelCount; l++) buildLevel(l);
+
+    for (l=0; l<m_levelCount; l++)
+	{
+	    int messageNum = 4*m_levels[l].width*m_levels[l].height*m_nLabels;
+	    m_levels[l].messages = new REAL[messageNum];
+	    memset(m_levels[l].messages, 0, messageNum*sizeof(REAL));
+	}
+
+    m_coarseDone = false;
+}
+
+// sums up the data costs of 2x2 blocks of level l-1 and averages the weights
+// of the (one or two) edges between neighbouring blocks
+void HBP::buildLevel(int l)
+{
+    const Level& fine = m_levels[l-1];
+    Level& coarse = m_levels[l];
+    const int K = m_nLabels;
+    int x, y, dx, dy, n;
+
+    coarse.width = (fine.width+1)/2;
+    coarse.height = (fine.height+1)/2;
+    coarse.D = new CostVal[coarse.width*coarse.height*K];
+    memset(coarse.D, 0, coarse.width*coarse.height*K*sizeof(CostVal));
+
+    for (y=0; y<fine.height; y++)
+	for (x=0; x<fine.width; x++)
+	    {
+		AddVector(coarse.D + ((y/2)*coarse.width + x/2)*K, fine.D + (y*fine.width + x)*K, K);
+	    }
+
+    coarse.horzWeights = NULL;
+    coarse.vertWeights = NULL;
+    if (fine.horzWeights == NULL) return;
+
+    coarse.horzWeights = new CostVal[coarse.width*coarse.height];
+    coarse.vertWeights = new CostVal[coarse.width*coarse.height];
+
+    for (y=0; y<coarse.height; y++)
+	for (x=0; x<coarse.width; x++)
+	    {
+		CostVal h = 0, v = 0;
+
+		// between the columns 2x+1 and 2x+2 (rows 2y and 2y+1) of the fine level
+		for (n=0, dy=0; dy<2 && 2*y+dy<fine.height && 2*x+2<fine.width; dy++, n++)
+		    {
+			h += fine.horzWeights[(2*y+dy)*fine.width + 2*x+1];
+		    }
+		coarse.horzWeights[y*coarse.width + x] = (n > 0) ? h/n : 0;
+
+		// between the rows 2y+1 and 2y+2 (columns 2x and 2x+1) of the fine level
+		for (n=0, dx=0; dx<2 && 2*x+dx<fine.width && 2*y+2<fine.height; dx++, n++)
+		    {
+			v += fine.vertWeights[(2*y+1)*fine.width + 2*x+dx];
+		    }
+		coarse.vertWeights[y*coarse.width + x] = (n > 0) ? v/n : 0;
+	    }
+}
+
+void HBP::allocateScratch(int nSlots)
+{
+    if (nSlots <= m_nScratchSlots) return;
+
+    if ( m_scratch ) delete [] m_scratch;
+
+    // Di_hat and the buffer of the message update
+    m_scratchSize = 2*PaddedMessageLength<REAL>(m_nLabels);
+    m_scratch = new REAL[nSlots*m_scratchSize];
+    m_nScratchSlots = nSlots;
+}
+
+
+void HBP::optimizeAlg(int nIterations)
+{
+    assert(m_type != NONE);
+
+    int l, i;
+
+#ifdef _OPENMP
+    const int nThreads = (m_nThreads > 0) ? m_nThreads : omp_get_max_threads();
+#else
+    const int nThreads = 1;
+#endif
+    allocateScratch(nThreads);
+
+    if (!m_coarseDone)
+	{
+	    for (l=m_levelCount-1; l>0; l--)
+		{
+		    for (i=0; i<m_coarseIterations; i++) iterate(m_levels[l], nThreads);
+		    copyMessagesDown(l);
+		}
+	    m_coarseDone = true;
+	}
+
+    for (i=0; i<nIterations; i++) iterate(m_levels[0], nThreads);
+
+    ////////////////////////////////////////////////
+    //          computing solution                //
+    ////////////////////////////////////////////////
+
+    const int K = m_nLabels;
+    const int plane = m_nPixels*K;
+    int changedLabels = 0;
+
+#pragma omp parallel for num_threads(nThreads) schedule(static) reduction(+:changedLabels)
+    for (int y=0; y<m_height; y++)
+	{
+	    REAL* Di = m_scratch + currentThread()*m_scratchSize;
+
+	    for (int x=0; x<m_width; x++)
+		{
+		    const int n = x + y*m_width;
+		    const REAL* M = m_levels[0].messages + n*K;
+		    int d, k;
+		    Label label = 0;
+
+		    CopyVector(Di, m_D + n*K, K);
+		    for (d=0; d<4; d++) AddVector(Di, M + d*plane, K);
+		    for (k=1; k<K; k++) if (Di[k] < Di[label]) label = k;
+
+		    if (m_answer[n] != label)
+			{
+			    m_answer[n] = label;
+			    changedLabels++;
+			}
+		}
+	}
+    m_changedLabels = changedLabels;
+}
+
+// one iteration of the checkerboard schedule, the nodes of one colour only
+// write the messages of the other colour
+void HBP::iterate(const Level& level, int nThreads)
+{
+    for (int parity=0; parity<2; parity++)
+	{
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+	    for (int y=0; y<level.height; y++)
+		{
+		    REAL* buf = m_scratch + currentThread()*m_scratchSize;
+
+		    for (int x=(y+parity)%2; x<level.width; x+=2) sendMessages(level, x, y, buf);
+		}
+	}
+}
+
+void HBP::sendMessages(const Level& level, int x, int y, REAL* buf)
+{
+    const int K = m_nLabels;
+    const int plane = level.width*level.height*K;
+    const int n = x + y*level.width;
+    REAL* M = level.messages + n*K;
+    REAL* Di_hat = buf;
+    int d;
+
+    buf += PaddedMessageLength<REAL>(K);
+
+    CopyVector(Di_hat, level.D + n*K, K);
+    for (d=0; d<4; d++) AddVector(Di_hat, M + d*plane, K);
+
+    if (x > 0)
+	sendMessage(Di_hat, M + FROM_LEFT*plane, M - K + FROM_RIGHT*plane,
+		    (level.horzWeights) ? level.horzWeights[n-1] : 1, buf);
+    if (x < level.width-1)
+	sendMessage(Di_hat, M + FROM_RIGHT*plane, M + K + FROM_LEFT*plane,
+		    (level.horzWeights) ? level.horzWeights[n] : 1, buf);
+    if (y > 0)
+	sendMessage(Di_hat, M + FROM_UP*plane, M - level.width*K + FROM_DOWN*plane,
+		    (level.vertWeights) ? level.vertWeights[n-level.width] : 1, buf);
+    if (y < level.height-1)
+	sendMessage(Di_hat, M + FROM_DOWN*plane, M + level.width*K + FROM_UP*plane,
+		    (level.vertWeights) ? level.vertWeights[n] : 1, buf);
+}
+
+// to[kj] := min_{ki} (Di_hat[ki] - from[ki] + weight*V[ki,kj]), normalized
+// to a minimum of 0; from is the message in the opposite direction
+void HBP::sendMessage(const REAL* Di_hat, const REAL* from, REAL* to, CostVal weight, REAL* buf)
+{
+    const int K = m_nLabels;
+
+    if (m_type == L1)
+	{
+	    memcpy(to, from, K*sizeof(REAL));
+	    UpdateMessageL1(to, Di_hat, K, 1, weight*m_lambda, m_smoothMax, buf);
+	}
+    else
+	{
+	    ExcludeMessage(buf, Di_hat, from, 1, K);
+	    MinConvolutionColumns(to, buf, m_V, weight, K);
+	    SubtractMin(to, K);
+	}
+}
+
+// initializes the messages of level l-1 with those of the blocks on level l
+void HBP::copyMessagesDown(int l)
+{
+    const Level& fine = m_levels[l-1];
+    const Level& coarse = m_levels[l];
+    const int K = m_nLabels;
+    int d, x, y;
+
+    for (d=0; d<4; d++)
+	for (y=0; y<fine.height; y++)
+	    for (x=0; x<fine.width; x++)
+		{
+		    memcpy(fine.messages + ((d*fine.height + y)*fine.width + x)*K,
+			   coarse.messages + ((d*coarse.height + y/2)*coarse.width + x/2)*K,
+			   K*sizeof(REAL));
+		}
+}
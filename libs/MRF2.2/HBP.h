@@ -0,0 +1,129 @@
+#ifndef __HBP_H__
+#define __HBP_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "mrf.h"
+
+// Hierarchical (coarse-to-fine) min-sum belief propagation on 2D grids, see
+// P. F. Felzenszwalb and D. P. Huttenlocher: "Efficient Belief Propagation
+// for Early Vision", IJCV 70(1), 2006.
+//
+// Level 0 is the grid itself, each further level merges blocks of 2x2 nodes
+// of the level below into one node. The data costs of a block are summed up,
+// the smoothness term is the same on all levels (weights set by setCues() are
+// averaged over the edges between two blocks). The first optimize() after
+// initialize() or clearAnswer() runs getCoarseIterations() iterations on
+// every coarse level, from the coarsest one down, and initializes the
+// messages of each node with those of its block on the level above. All
+// iterations requested are run on level 0. As a message crosses 2^l nodes
+// per iteration on level l, information spreads across large regions without
+// texture in far fewer iterations than with flat BP (see bench-hbp.cpp).
+// BP-S, whose sequential sweeps carry a message across the whole grid in one
+// iteration, gets there in about as few iterations, takes less time and may
+// converge to a slightly lower energy; HBP is the parallel alternative.
+//
+// An iteration sends the messages of all nodes with (x + y) even, then those
+// of all nodes with (x + y) odd. The nodes of one colour run in parallel, the
+// result does not depend on the number of threads.
+//
+// Only data costs given as an array or function and smoothness costs given
+// as a matrix or as truncated L1/L2 distances are supported.
+
+class HBP : public MRF{
+ public:
+    typedef CostVal REAL;
+
+    HBP(int width, int height, int nLabels, EnergyFunction *eng);
+    ~HBP();
+    void setNeighbors(int /*pix1*/, int /*pix2*/, CostVal /*weight*/){printf("Not implemented"); exit(1);}
+    Label getLabel(int pixel){return(m_answer[pixel]);};
+    void setLabel(int pixel,Label label){m_answer[pixel] = label;};
+    Label* getAnswerPtr(){return(m_answer);};
+    void clearAnswer();
+    void setParameters(int /*numParam*/, void * /*param*/){printf("No optional parameters to set"); exit(1);}
+    EnergyVal smoothnessEnergy();
+    EnergyVal dataEnergy();
+    int changedLabelCount() { return m_changedLabels; }
+
+    // Number of levels including level 0. With 0 (the default) levels are
+    // added as long as both sides of the coarsest one have at least
+    // MIN_LEVEL_SIZE nodes. Has to be called before initialize().
+    void setLevelCount(int levelCount);
+    int getLevelCount() { return m_levelCount; } // the actual count after initialize()
+
+    // iterations on each coarse level, 5 by default
+    void setCoarseIterations(int iterations) { m_coarseIterations = iterations; }
+    int getCoarseIterations() { return m_coarseIterations; }
+
+    // 0 uses OpenMP's default, without OpenMP all work is done serially
+    void setNumThreads(int nThreads) { m_nThreads = nThreads; }
+    int getNumThreads() { return m_nThreads; }
+
+    static const int MIN_LEVEL_SIZE;
+
+ protected:
+    void setData(DataCostFn dcost);
+    void setData(CostVal* data);
+    void setSmoothness(SmoothCostGeneralFn cost);
+    void setSmoothness(CostVal* V);
+    void setSmoothness(int smoothExp,CostVal smoothMax, CostVal lambda);
+    void setCues(CostVal* hCue, CostVal* vCue);
+    void Allocate();
+    void initializeAlg();
+    void optimizeAlg(int nIterations);
+
+ private:
+
+    enum
+	{
+	    NONE,
+	    L1,
+	    L2,
+	    FIXED_MATRIX
+	} m_type;
+
+    CostVal m_smoothMax; // used only if
+    CostVal m_lambda;    // m_type == L1 or m_type == L2
+
+    struct Level
+    {
+	int width, height;
+	CostVal* D;           // width*height*K data costs
+	CostVal* horzWeights; // as in setCues(), NULL without cues
+	CostVal* vertWeights;
+	REAL* messages;       // 4 planes of width*height*K, see HBP.cpp
+    };
+
+    Label *m_answer;
+    CostVal *m_V; // array of size nLabels^2
+    CostVal *m_D;
+    CostVal *m_horzWeights;
+    CostVal *m_vertWeights;
+    DataCostFn m_dataFn;
+    bool m_needToFreeV;
+    bool m_needToFreeD;
+
+    int    m_levelCount;
+    Level* m_levels;     // level 0 shares m_D and the cues
+    int    m_coarseIterations;
+    bool   m_coarseDone; // coarse levels have been run since clearAnswer()
+
+    int   m_nThreads;
+    int   m_nScratchSlots;
+    int   m_scratchSize; // values per thread
+    REAL* m_scratch;
+
+    int   m_changedLabels; // by the last optimizeAlg()
+
+    void buildLevel(int l);
+    void allocateScratch(int nSlots);
+    void iterate(const Level& level, int nThreads);
+    void sendMessages(const Level& level, int x, int y, REAL* buf);
+    void sendMessage(const REAL* Di_hat, const REAL* from, REAL* to, CostVal weight, REAL* buf);
+    void copyMessagesDown(int l);
+};
+
+#endif /*  __HBP_H__ */
@@ -27,6 +27,7 @@ ICM::~ICM()
     delete[] m_answer;
     if (!m_grid_graph) delete[] m_neighbors;
     if ( m_needToFreeV ) delete[] m_V;
+    delete m_arena;
 }
 
 
@@ -35,10 +36,13 @@ void ICM::initializeAlg()
     m_answer = (Label *) new Label[m_nPixels];
     if ( !m_answer ){printf("\nNot enough memory, exiting");exit(0);}
 
+    m_arena = new BlockArena();
+
     if (!m_grid_graph)
     {
         m_neighbors = (LinkedBlockList *) new LinkedBlockList[m_nPixels];
         if (!m_neighbors) {printf("Not enough memory,exiting");exit(0);};
+        for (int i = 0; i < m_nPixels; i++) m_neighbors[i].setArena(m_arena);
     }
 }
 
@@ -53,8 +57,8 @@ void ICM::setNeighbors(int pixel1, int pixel2, CostVal weight)
     assert(pixel1 < m_nPixels && pixel1 >= 0 && pixel2 < m_nPixels && pixel2 >= 0);
 
 
-    Neighbor *temp1 = (Neighbor *) new Neighbor;
-    Neighbor *temp2 = (Neighbor *) new Neighbor;
+    Neighbor *temp1 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
+    Neighbor *temp2 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
 
     if ( !temp1 || ! temp2 ) {printf("\nNot enough memory, exiting");exit(0);}
 
@@ -22,6 +22,8 @@ public:
     void setParameters(int /*numParam*/, void * /*param*/){printf("No optional parameters to set"); exit(1);}
     EnergyVal smoothnessEnergy();
     EnergyVal dataEnergy();
+    // allocation counts of the neighborhood system of non-grid graphs
+    const BlockArena::Statistics& getAllocationStatistics(){return(m_arena->getStatistics());};
 
 protected:
     void setData(DataCostFn dcost); 
@@ -49,6 +51,7 @@ private:
     } Neighbor;
 
     LinkedBlockList *m_neighbors;
+    BlockArena *m_arena; // holds the neighbors and the blocks of m_neighbors
 };
 
 
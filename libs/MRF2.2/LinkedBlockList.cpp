@@ -6,7 +6,7 @@ void LinkedBlockList::addFront(ListType item) {
 
     if ( m_head_block_size == GCLL_BLOCK_SIZE )
     {
-        LLBlock *tmp      = (LLBlock *) new LLBlock;
+        LLBlock *tmp      = (m_arena) ? (LLBlock *) m_arena->allocate(sizeof(LLBlock)) : new LLBlock;
         tmp -> m_next     = m_head;
         m_head            = tmp;
         m_head_block_size = 0;
@@ -56,7 +56,8 @@ LinkedBlockList::~LinkedBlockList()
     {
         tmp = m_head;
         m_head = m_head->m_next;
-        delete tmp;
+        if ( m_arena ) m_arena->release(tmp, sizeof(LLBlock));
+        else delete tmp;
     }
 };
 
@@ -9,6 +9,8 @@
 #ifndef __LINKEDBLOCKLIST_H__
 #define __LINKEDBLOCKLIST_H__
 
+#include "BlockArena.h"
+
 #define GCLL_BLOCK_SIZE 4  
 // GCLL_BLOCKSIZE should "fit" into the type BlockType. That is 
 // if GCLL_BLOCKSIZE is larger than 255 but smaller than largest short integer
@@ -23,9 +25,13 @@ class LinkedBlockList{
 public: 
     void addFront(ListType item);
     inline bool isEmpty(){if (m_head == 0) return(true); else return(false);};
-    inline LinkedBlockList(){m_head = 0; m_head_block_size = GCLL_BLOCK_SIZE;}; 
+    inline LinkedBlockList(){m_head = 0; m_head_block_size = GCLL_BLOCK_SIZE; m_arena = 0;}; 
     ~LinkedBlockList();
 
+    // Takes the blocks from arena instead of the heap, has to be called
+    // before the first addFront(). The arena has to outlive the list.
+    inline void setArena(BlockArena *arena){m_arena = arena;};
+
     // Next three functins are for the linked list traversal
     inline void setCursorFront(){m_cursor = m_head; m_cursor_ind = 0;};
     ListType next();
@@ -44,6 +50,8 @@ private:
     BlockType m_cursor_ind;
     // For block traversal, points to current block in the linked list
     LLBlock *m_cursor;
+    // Source of the blocks, 0 for the heap
+    BlockArena *m_arena;
 };
 
 #endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <math.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "MRFDriver.h"
+
+// a monotonic clock, as OpenCV's getTickCount() uses
+double MRFDriver::wallTime()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+#endif
+}
+
+MRFDriver::Criteria::Criteria()
+{
+    maxIterations = 100;
+    minRelativeDecrease = -1;
+    maxChangedFraction = -1;
+    maxRelativeGap = -1;
+    timeBudget = 0;
+}
+
+MRFDriver::MRFDriver(MRF* mrf, const Criteria& criteria)
+{
+    m_mrf = mrf;
+    m_criteria = criteria;
+    m_verbose = false;
+
+    m_statistics.iterations = 0;
+    m_statistics.energy = 0;
+    m_statistics.bestIteration = 0;
+    m_statistics.lowerBound = 0;
+    m_statistics.changedFraction = -1;
+    m_statistics.time = 0;
+    m_statistics.cpuTime = 0;
+    m_statistics.reason = NOT_STOPPED;
+}
+
+MRFDriver::StopReason MRFDriver::run()
+{
+    const bool useBound = m_mrf->hasLowerBound() && m_criteria.maxRelativeGap >= 0;
+    const bool useEnergy = m_criteria.minRelativeDecrease >= 0 || useBound || m_verbose;
+    const int nPixels = m_mrf->pixelCount();
+
+    Statistics& s = m_statistics;
+    s.iterations = 0;
+    s.energy = (useEnergy) ? m_mrf->totalEnergy() : 0;
+    s.bestIteration = 0;
+    s.lowerBound = 0;
+    s.changedFraction = -1;
+    s.time = 0;
+    s.cpuTime = 0;
+    s.reason = NOT_STOPPED;
+
+    if (m_verbose) printf("Energy at the start = %g\n", (float) s.energy);
+
+    // the labeling with the lowest energy so far
+    MRF::Label* bestLabels = (useEnergy) ? new MRF::Label[nPixels] : NULL;
+    double bestEnergy = s.energy;
+    if (useEnergy)
+	for (int i = 0; i < nPixels; i ++) bestLabels[i] = m_mrf->getLabel(i);
+
+    while (s.reason == NOT_STOPPED)
+	{
+	    float cpuTime;
+	    double start = wallTime();
+	    m_mrf->optimize(1, cpuTime);
+	    s.time += wallTime() - start;
+	    s.cpuTime += cpuTime;
+	    s.iterations ++;
+
+	    double previousEnergy = s.energy;
+	    if (useEnergy) s.energy = m_mrf->totalEnergy();
+	    if (m_mrf->hasLowerBound()) s.lowerBound = m_mrf->lowerBound();
+	    if (useEnergy && s.energy < bestEnergy)
+		{
+		    bestEnergy = s.energy;
+		    s.bestIteration = s.iterations;
+		    for (int i = 0; i < nPixels; i ++) bestLabels[i] = m_mrf->getLabel(i);
+		}
+	    int changed = m_mrf->changedLabelCount();
+	    s.changedFraction = (changed >= 0) ? (double) changed / nPixels : -1;
+
+	    if (m_verbose)
+		{
+		    printf("Iteration %d: energy = %g", s.iterations, (float) s.energy);
+		    if (m_mrf->hasLowerBound()) printf(", lower bound = %f", s.lowerBound);
+		    if (changed >= 0) printf(", %d labels changed", changed);
+		    printf(" (%.3f secs)\n", s.time);
+		}
+
+	    if (useBound && s.energy - s.lowerBound <= m_criteria.maxRelativeGap * fabs(s.energy))
+		s.reason = GAP_REACHED;
+	    else if (m_criteria.minRelativeDecrease >= 0 && previousEnergy - s.energy >= 0 &&
+		     previousEnergy - s.energy <= m_criteria.minRelativeDecrease * fabs(previousEnergy))
+		s.reason = ENERGY_CONVERGED;
+	    else if (m_criteria.maxChangedFraction >= 0 && s.changedFraction >= 0 && s.iterations > 1 &&
+		     s.changedFraction <= m_criteria.maxChangedFraction)
+		s.reason = LABELS_CONVERGED;
+	    else if (s.iterations >= m_criteria.maxIterations)
+		s.reason = MAX_ITERATIONS;
+	    else if (m_criteria.timeBudget > 0 && s.time >= m_criteria.timeBudget)
+		s.reason = TIME_BUDGET_EXCEEDED;
+	}
+
+    if (m_verbose) printf("Stopped after %d iterations (%.3f secs): %s\n",
+			  s.iterations, s.time, describe(s.reason));
+
+    if (useEnergy && s.energy > bestEnergy)
+	{
+	    for (int i = 0; i < nPixels; i ++) m_mrf->setLabel(i, bestLabels[i]);
+	    s.energy = bestEnergy;
+	    if (m_verbose) printf("Restored the labeling of iteration %d, energy = %g\n",
+				  s.bestIteration, (float) s.energy);
+	}
+    else
+	s.bestIteration = s.iterations;
+    delete [] bestLabels;
+
+    return s.reason;
+}
+
+const char* MRFDriver::describe(StopReason reason)
+{
+    switch (reason)
+	{
+	case MAX_ITERATIONS:       return "maximum number of iterations";
+	case ENERGY_CONVERGED:     return "energy converged";
+	case LABELS_CONVERGED:     return "labeling converged";
+	case GAP_REACHED:          return "lower bound gap reached";
+	case TIME_BUDGET_EXCEEDED: return "time budget exceeded";
+	default:                   return "not stopped";
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef __MRFDRIVER_H__
+#define __MRFDRIVER_H__
+
+#include "mrf.h"
+
+// Runs the iterations of an optimization algorithm until one of several
+// stopping criteria is met:
+//
+//   maxIterations        number of iterations (always applies)
+//   minRelativeDecrease  (E_previous - E) / |E_previous| of one iteration,
+//                        which must not be negative: the energy of TRW-S
+//                        and BP-S may rise temporarily
+//   maxChangedFraction   fraction of the labels changed by one iteration
+//   maxRelativeGap       (E - lowerBound) / |E|, if the algorithm computes
+//                        a lower bound (TRW-S)
+//   timeBudget           wall-clock seconds spent in optimize()
+//
+// A negative value (or 0 for the time budget) disables a criterion.
+//
+// The driver does not touch the labeling itself: the energy is computed
+// (one pass over the graph) only if a criterion or the verbose output needs
+// it, the label changes are counted by the algorithm while it writes them
+// (MRF::changedLabelCount()). The label change criterion is skipped for
+// algorithms that do not count them, and after the first iteration, whose
+// changes are relative to the initial labeling.
+//
+// Whenever the energy is computed, the driver keeps a copy of the labeling
+// with the lowest energy seen and restores it when the algorithm stops at a
+// higher energy.
+
+class MRFDriver
+{
+ public:
+    enum StopReason
+	{
+	    NOT_STOPPED,
+	    MAX_ITERATIONS,
+	    ENERGY_CONVERGED,
+	    LABELS_CONVERGED,
+	    GAP_REACHED,
+	    TIME_BUDGET_EXCEEDED
+	};
+
+    struct Criteria
+    {
+	int    maxIterations;
+	double minRelativeDecrease;
+	double maxChangedFraction;
+	double maxRelativeGap;
+	double timeBudget;
+
+	Criteria(); // 100 iterations, all other criteria disabled
+    };
+
+    // state after the last iteration of run()
+    struct Statistics
+    {
+	int    iterations;
+	double energy;          // 0 if it was not computed
+	int    bestIteration;   // of the labeling left in the MRF (0: initial)
+	double lowerBound;      // 0 if the algorithm has no lower bound
+	double changedFraction; // -1 if the labels were not counted
+	double time;            // wall-clock seconds, optimize() only
+	double cpuTime;         // summed up times reported by optimize()
+	StopReason reason;
+    };
+
+    MRFDriver(MRF* mrf, const Criteria& criteria = Criteria());
+
+    void setCriteria(const Criteria& criteria) { m_criteria = criteria; }
+    const Criteria& getCriteria() { return m_criteria; }
+
+    // prints energy, lower bound and label changes after every iteration;
+    // off by default, as it computes the energy and copies the labeling after
+    // every iteration even if no criterion needs them
+    void setVerbose(bool verbose) { m_verbose = verbose; }
+
+    // runs optimize(1, ...) until a criterion is met, the MRF has to be
+    // initialized
+    StopReason run();
+
+    const Statistics& getStatistics() { return m_statistics; }
+
+    static const char* describe(StopReason reason);
+
+    // wall-clock seconds since an arbitrary point, also while several
+    // threads run; MRF::optimize() measures the processor time of all threads
+    static double wallTime();
+
+ private:
+    MRF*       m_mrf;
+    Criteria   m_criteria;
+    Statistics m_statistics;
+    bool       m_verbose;
+};
+
+#endif /* __MRFDRIVER_H__ */
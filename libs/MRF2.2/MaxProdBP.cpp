@@ -3,12 +3,23 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "MaxProdBP.h"
 #include "regions-new.h"
 
 #define m_D(pix,l)  m_D[(pix)*m_nLabels+(l)]
 #define m_V(l1,l2)  m_V[(l1)*m_nLabels+(l2)]
 
+static inline int currentThread()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
 
 		
 
@@ -26,9 +37,13 @@ MaxProdBP::MaxProdBP(int nPixels, int nLabels,EnergyFunction *eng):MRF(nPixels,n
 MaxProdBP::~MaxProdBP()
 { 
 	delete[] m_answer;
+	delete[] m_scratchMatrix;
+	delete[] m_messageBuffers;
+	delete[] m_baseBuffers;
 	if (m_message_chunk) delete[] m_message_chunk;
 	if (!m_grid_graph) delete[] m_neighbors;
 	if ( m_needToFreeV ) delete[] m_V;
+	delete m_arena;
 }
 
 
@@ -41,13 +56,15 @@ void MaxProdBP::BPinitializeAlg()
 	m_answer = (Label *) new Label[m_nPixels];
 	if ( !m_answer ){printf("\nNot enough memory, exiting");exit(0);}
 
-	m_scratchMatrix = new FLOATTYPE[m_nLabels * m_nLabels];
-	// MEMORY LEAK? where does this ever get deleted??
-
-	nodeArray =     new OneNodeCluster[m_nPixels];
-	// MEMORY LEAK? where does this ever get deleted??
-
-	OneNodeCluster::numStates = m_nLabels;
+	m_nThreads = 0;
+	m_schedule = ROW_COLUMN_SWEEPS;
+	m_changedLabels = 0;
+	m_nScratchSlots = 0;
+	m_scratchMatrix = NULL;
+	m_messageBuffers = NULL;
+	m_baseBuffers = NULL;
+	allocateScratch(1);
+	m_arena = new BlockArena();
 
 	if (!m_grid_graph)
 	{
@@ -55,6 +72,7 @@ void MaxProdBP::BPinitializeAlg()
 	  // Only Grid Graphs are supported
 		m_neighbors = (LinkedBlockList *) new LinkedBlockList[m_nPixels];
 		if (!m_neighbors) {printf("Not enough memory,exiting");exit(0);};
+		for (int i = 0; i < m_nPixels; i++) m_neighbors[i].setArena(m_arena);
 	}
 	else
 	{
@@ -65,7 +83,8 @@ void MaxProdBP::BPinitializeAlg()
 	  if ( !m_message_chunk ){printf("\nNot enough memory for messages, exiting");exit(0);}
 	  for(int i = 0; i < clen; i++)
 	    m_message_chunk[i]=0;
-	  initOneNodeMsgMem(nodeArray, m_message_chunk, m_nPixels, m_nLabels);
+	  for(int d = 0; d < 4; d++)
+	    m_messagePlanes[d] = m_message_chunk + d * m_nPixels * m_nLabels;
 	}
 }
 
@@ -132,7 +151,58 @@ bool MaxProdBP::varWeights()
 
 FLOATTYPE *MaxProdBP::getScratchMatrix()
 {
-  return m_scratchMatrix;
+  return m_scratchMatrix + currentThread() * m_nLabels * m_nLabels;
+}
+
+FLOATTYPE *MaxProdBP::getMessageBuffer()
+{
+  return m_messageBuffers + currentThread() * 2 * m_nLabels;
+}
+
+FLOATTYPE *MaxProdBP::getBaseBuffer()
+{
+  const int length = (m_width > m_height) ? m_width : m_height;
+  return m_baseBuffers + currentThread() * length * m_nLabels;
+}
+
+FLOATTYPE *MaxProdBP::getMessagePlane(int direction)
+{
+  return m_messagePlanes[direction];
+}
+
+void MaxProdBP::allocateScratch(int nSlots)
+{
+  if (nSlots <= m_nScratchSlots)
+    return;
+
+  delete[] m_scratchMatrix;
+  delete[] m_messageBuffers;
+  delete[] m_baseBuffers;
+  const int length = !m_grid_graph ? 0 : (m_width > m_height) ? m_width : m_height;
+  m_nScratchSlots = nSlots;
+  m_scratchMatrix = new FLOATTYPE[nSlots * m_nLabels * m_nLabels];
+  m_messageBuffers = new FLOATTYPE[nSlots * 2 * m_nLabels];
+  m_baseBuffers = new FLOATTYPE[nSlots * length * m_nLabels];
+}
+
+void MaxProdBP::setNumThreads(int nThreads)
+{
+  m_nThreads = nThreads;
+}
+
+int MaxProdBP::getNumThreads()
+{
+  return m_nThreads;
+}
+
+void MaxProdBP::setSchedule(Schedule schedule)
+{
+  m_schedule = schedule;
+}
+
+MaxProdBP::Schedule MaxProdBP::getSchedule()
+{
+  return m_schedule;
 }
 
 void MaxProdBP::clearAnswer()
@@ -149,8 +219,8 @@ void MaxProdBP::setNeighbors(int pixel1, int pixel2, CostVal weight)
 	assert(pixel1 < m_nPixels && pixel1 >= 0 && pixel2 < m_nPixels && pixel2 >= 0);
 
 
-	Neighbor *temp1 = (Neighbor *) new Neighbor;
-	Neighbor *temp2 = (Neighbor *) new Neighbor;
+	Neighbor *temp1 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
+	Neighbor *temp2 = (Neighbor *) m_arena->allocate(sizeof(Neighbor));
 
 	if ( !temp1 || ! temp2 ) {printf("\nNot enough memory, exiting");exit(0);}
 
@@ -247,7 +317,6 @@ void MaxProdBP::setData(DataCostFn dcost)
   FloatType *cData = m_ExpData;
   for ( i= 0; i < m_nPixels; i++)
   {
-    nodeArray[i].localEv = cData;
     for( j = 0; j < m_nLabels; j++)
     {
       *cData = (float)m_dataFn(i,j);
@@ -273,7 +342,6 @@ void MaxProdBP::setData(CostVal* data)
   FloatType *cData = m_ExpData;
   for ( i= 0; i < m_nPixels; i++)
   {
-    nodeArray[i].localEv = cData;
     for( j = 0; j < m_nLabels; j++)
     {
       *cData = (float)m_D(i,j);
@@ -339,28 +407,59 @@ void MaxProdBP::optimizeAlg(int nIterations)
 	int numRows = getHeight();
 	int numCols = getWidth();
 	const FLOATTYPE alpha = 0.8f;
+
+#ifdef _OPENMP
+	const int nThreads = (m_nThreads > 0) ? m_nThreads : omp_get_max_threads();
+#else
+	const int nThreads = 1;
+#endif
+	allocateScratch(nThreads);
+
 	for (int niter=0; niter < nIterations; niter++)
 	{
-	  for(int r = 0; r < numRows; r++)
+	  if (m_schedule == CHECKERBOARD)
 	  {
-	    computeMessagesLeftRight(nodeArray, numCols, numRows, r, alpha, this);
+	    for(int parity = 0; parity < 2; parity++)
+	    {
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+	      for(int r = 0; r < numRows; r++)
+	      {
+	        computeMessagesCheckerboard(this, r, parity, alpha);
+	      }
+	    }
 	  }
-	  for(int c = 0; c < numCols; c++)
+	  else
 	  {
-	    computeMessagesUpDown(nodeArray, numCols, numRows, c, alpha, this);
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+	    for(int r = 0; r < numRows; r++)
+	    {
+	      computeMessagesLeftRight(this, r, alpha);
+	    }
+#pragma omp parallel for num_threads(nThreads) schedule(static)
+	    for(int c = 0; c < numCols; c++)
+	    {
+	      computeMessagesUpDown(this, c, alpha);
+	    }
 	  }
 	}
 
       
       Label *currAssign = m_answer;
+      int changedLabels = 0;
+#pragma omp parallel for num_threads(nThreads) schedule(static) reduction(+:changedLabels)
       for(int m = 0; m < numRows; m++)
       {
 	for(int n = 0; n < numCols; n++)
 	{
-	  int maxInd = nodeArray[m*numCols+n].getBeliefMaxInd();
-	  currAssign[m * numCols +n] = maxInd;
+	  int maxInd = getBeliefMaxInd(this, m, n);
+	  if (currAssign[m * numCols +n] != maxInd)
+	  {
+	    currAssign[m * numCols +n] = maxInd;
+	    changedLabels++;
+	  }
 	}
       }
+      m_changedLabels = changedLabels;
 
 }
 
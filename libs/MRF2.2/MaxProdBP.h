@@ -15,6 +15,19 @@ class MaxProdBP;
 
 class MaxProdBP : public MRF{
 public:
+  // order of the message updates within an iteration:
+  // ROW_COLUMN_SWEEPS - left/right sweeps along all rows, then up/down sweeps
+  //                     along all columns (rows/columns run in parallel)
+  // CHECKERBOARD      - all messages of the "red" nodes ((x + y) even), then
+  //                     those of the "black" nodes (nodes run in parallel)
+  // Both schedules are free of races, their results do not depend on the
+  // number of threads.
+  enum Schedule
+    {
+      ROW_COLUMN_SWEEPS,
+      CHECKERBOARD
+    };
+
 	MaxProdBP(int width, int height, int nLabels, EnergyFunction *eng);
 	MaxProdBP(int nPixels, int nLabels,EnergyFunction *eng);
 	~MaxProdBP();
@@ -29,11 +42,22 @@ public:
   EnergyFunction *getEnergyFunction();
   int getWidth();
   int getHeight();
-  FLOATTYPE *getScratchMatrix();
+  FLOATTYPE *getScratchMatrix();    // of the calling thread
+  FLOATTYPE *getMessageBuffer();    // of the calling thread, 2 * nLabels
+  FLOATTYPE *getBaseBuffer();       // of the calling thread, one row/column
+  FLOATTYPE *getMessagePlane(int direction);
+  // 0 uses OpenMP's default, without OpenMP all work is done serially
+  void setNumThreads(int nThreads);
+  int getNumThreads();
+  void setSchedule(Schedule schedule);
+  Schedule getSchedule();
+  int changedLabelCount(){return m_changedLabels;};
+  // allocation counts of the neighborhood system of non-grid graphs
+  const BlockArena::Statistics& getAllocationStatistics(){return m_arena->getStatistics();};
   int getNLabels();
   bool varWeights();
   void setExpScale(int expScale);
-  friend void getPsiMat(OneNodeCluster &cluster, FLOATTYPE *&destMatrix, 
+  friend void getPsiMat(FLOATTYPE *&destMatrix, 
 			int r, int c, MaxProdBP *mrf, int direction, FLOATTYPE &var_weight);
 
   InputType getSmoothType();
@@ -68,6 +92,7 @@ protected:
 	void initializeAlg();
 	void BPinitializeAlg();
 	void optimizeAlg(int nIterations);
+	void allocateScratch(int nSlots);
 
 private:
 	Label *m_answer;
@@ -79,16 +104,23 @@ private:
 	DataCostFn m_dataFn;
 	SmoothCostGeneralFn m_smoothFn;
 	bool m_needToFreeV;
+  int m_nThreads;
+  Schedule m_schedule;
+  int m_changedLabels;  // by the last optimizeAlg()
+  int m_nScratchSlots;              // one slot per thread
   FLOATTYPE *m_scratchMatrix;
+  FLOATTYPE *m_messageBuffers;
+  FLOATTYPE *m_baseBuffers;
   FLOATTYPE *m_ExpData;
   FLOATTYPE *m_message_chunk;
-  OneNodeCluster *nodeArray;
+  FLOATTYPE *m_messagePlanes[4];    // see regions-new.h for the layout
   typedef struct NeighborStruct {
     int     to_node;
     CostVal weight;
   } Neighbor;
 
   LinkedBlockList *m_neighbors;
+  BlockArena *m_arena;  // holds the neighbors and the blocks of m_neighbors
 };
 
 
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <new>
 #include "TRW-S.h"
+#include "message-kernels.h"
 
 #define private public
 #include "typeTruncatedQuadratic2D.h"
@@ -24,35 +25,8 @@
 //                  Operations on vectors (arrays of size K)               //
 /////////////////////////////////////////////////////////////////////////////
 
-inline void CopyVector(TRWS::REAL* to, MRF::CostVal* from, int K)
-{
-    TRWS::REAL* to_finish = to + K;
-    do
-	{
-	    *to ++ = *from ++;
-	} while (to < to_finish);
-}
-
-inline void AddVector(TRWS::REAL* to, TRWS::REAL* from, int K)
-{
-    TRWS::REAL* to_finish = to + K;
-    do
-	{
-	    *to ++ += *from ++;
-	} while (to < to_finish);
-}
-
-inline TRWS::REAL SubtractMin(TRWS::REAL *D, int K)
-{
-    int k;
-    TRWS::REAL delta;
-	
-    delta = D[0];
-    for (k=1; k<K; k++) TRUNCATE(delta, D[k]);
-    for (k=0; k<K; k++) D[k] -= delta;
-
-    return delta;
-}
+// CopyVector(), AddVector(), SubtractMin() and UpdateMessageL1() are
+// shared with BP-S, see message-kernels.h
 
 // Functions UpdateMessageTYPE (see the paper for details):
 //
@@ -65,35 +39,6 @@ inline TRWS::REAL SubtractMin(TRWS::REAL *D, int K)
 //
 // If dir = 1, then the meaning of i and j is swapped.
 
-///////////////////////////////////////////
-//                  L1                   //
-///////////////////////////////////////////
-
-inline TRWS::REAL UpdateMessageL1(TRWS::REAL* M, TRWS::REAL* Di_hat, int K, TRWS::REAL gamma, MRF::CostVal lambda, MRF::CostVal smoothMax)
-{
-    int k;
-    TRWS::REAL delta;
-
-    delta = M[0] = gamma*Di_hat[0] - M[0];
-    for (k=1; k<K; k++)
-	{
-	    M[k] = gamma*Di_hat[k] - M[k];
-	    TRUNCATE(delta, M[k]);
-	    TRUNCATE(M[k], M[k-1] + lambda);
-	}
-
-    M[--k] -= delta;
-    TRUNCATE(M[k], lambda*smoothMax);
-    for (k--; k>=0; k--)
-	{
-	    M[k] -= delta;
-	    TRUNCATE(M[k], M[k+1] + lambda);
-	    TRUNCATE(M[k], lambda*smoothMax);
-	}
-
-    return delta;
-}
-
 ////////////////////////////////////////
 //               L2                   //
 ////////////////////////////////////////
@@ -110,13 +55,7 @@ inline TRWS::REAL UpdateMessageL2(TRWS::REAL* M, TRWS::REAL* Di_hat, int K, TRWS
 
     assert(lambda >= 0);
 
-    Di[0] = gamma*Di_hat[0] - M[0];
-    delta = Di[0];
-    for (k=1; k<K; k++)
-	{
-	    Di[k] = gamma*Di_hat[k] - M[k];
-	    TRUNCATE(delta, Di[k]);
-	}
+    delta = ExcludeMessage(Di, Di_hat, M, gamma, K);
 
     if (lambda == 0)
 	{
@@ -124,13 +63,10 @@ inline TRWS::REAL UpdateMessageL2(TRWS::REAL* M, TRWS::REAL* Di_hat, int K, TRWS
 	    return delta;
 	}
 
+    // the lower envelope of the parabolas is inherently sequential
     tmp->DistanceTransformL2(K, 1, lambda, Di, M, parabolas, intersections);
 
-    for (k=0; k<K; k++)
-	{
-	    M[k] -= delta;
-	    TRUNCATE(M[k], lambda*smoothMax);
-	}
+    SubtractAndTruncate(M, delta, (TRWS::REAL) (lambda*smoothMax), K);
 
     return delta;
 }
@@ -148,55 +84,37 @@ inline TRWS::REAL UpdateMessageFIXED_MATRIX(TRWS::REAL* M, TRWS::REAL* Di_hat, i
 
     if (lambda == 0)
 	{
-	    delta = gamma*Di_hat[0] - M[0];
-	    M[0] = 0;
-	    for (ki=1; ki<K; ki++) 
-		{
-		    TRUNCATE(delta, gamma*Di_hat[ki] - M[ki]);
-		    M[ki] = 0;
-		}
+	    delta = ExcludeMessage(Di, Di_hat, M, gamma, K);
+	    for (ki=0; ki<K; ki++) M[ki] = 0;
 	    return delta;
 	}
 
-    for (ki=0; ki<K; ki++)
+    if (lambda > 0)
 	{
-	    Di[ki] = (gamma*Di_hat[ki] - M[ki]) * (1/(TRWS::REAL)lambda);
+	    // V is symmetric (see MRF::checkArray())
+	    ExcludeMessage(Di, Di_hat, M, gamma, K);
+	    MinConvolutionColumns(M, Di, V, (TRWS::REAL) lambda, K);
+	    return SubtractMin(M, K);
 	}
 
-    if (lambda > 0)
+    for (ki=0; ki<K; ki++)
 	{
-	    for (kj=0; kj<K; kj++)
-		{
-		    M[kj] = Di[0] + V[0]; 
-		    V ++;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE(M[kj], Di[ki] + V[0]);
-			    V ++;
-			}
-		    M[kj] *= lambda;
-		}
+	    Di[ki] = (gamma*Di_hat[ki] - M[ki]) * (1/(TRWS::REAL)lambda);
 	}
-    else
+
+    for (kj=0; kj<K; kj++)
 	{
-	    for (kj=0; kj<K; kj++)
+	    M[kj] = Di[0] + V[0]; 
+	    V ++;
+	    for (ki=1; ki<K; ki++)
 		{
-		    M[kj] = Di[0] + V[0]; 
+		    TRUNCATE_MAX(M[kj], Di[ki] + V[0]);
 		    V ++;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE_MAX(M[kj], Di[ki] + V[0]);
-			    V ++;
-			}
-		    M[kj] *= lambda;
 		}
+	    M[kj] *= lambda;
 	}
 
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
-
-    return delta;
+    return SubtractMin(M, K);
 }
 
 /////////////////////////////////////////////
@@ -206,47 +124,13 @@ inline TRWS::REAL UpdateMessageFIXED_MATRIX(TRWS::REAL* M, TRWS::REAL* Di_hat, i
 inline TRWS::REAL UpdateMessageGENERAL(TRWS::REAL* M, TRWS::REAL* Di_hat, int K, TRWS::REAL gamma, int dir, MRF::CostVal* V, void* buf)
 {
     TRWS::REAL* Di = (TRWS::REAL*) buf;
-    int ki, kj;
-    TRWS::REAL delta;
-
-    for (ki=0; ki<K; ki++)
-	{
-	    Di[ki] = (gamma*Di_hat[ki] - M[ki]);
-	}
 
-    if (dir == 0)
-	{
-	    for (kj=0; kj<K; kj++)
-		{
-		    M[kj] = Di[0] + V[0]; 
-		    V ++;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE(M[kj], Di[ki] + V[0]);
-			    V ++;
-			}
-		}
-	}
-    else
-	{
-	    for (kj=0; kj<K; kj++)
-		{
-		    M[kj] = Di[0] + V[0];
-		    V += K;
-		    for (ki=1; ki<K; ki++)
-			{
-			    TRUNCATE(M[kj], Di[ki] + V[0]);
-			    V += K;
-			}
-		    V -= K*K - 1;
-		}
-	}
+    ExcludeMessage(Di, Di_hat, M, gamma, K);
 
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
+    if (dir == 0) MinConvolutionRows(M, Di, V, (TRWS::REAL) 1, K);
+    else          MinConvolutionColumns(M, Di, V, (TRWS::REAL) 1, K);
 
-    return delta;
+    return SubtractMin(M, K);
 }
 
 inline TRWS::REAL UpdateMessageGENERAL(TRWS::REAL* M, TRWS::REAL* Di_hat, int K, TRWS::REAL gamma, TRWS::SmoothCostGeneralFn fn, int i, int j, void* buf)
@@ -255,10 +139,7 @@ inline TRWS::REAL UpdateMessageGENERAL(TRWS::REAL* M, TRWS::REAL* Di_hat, int K,
     int ki, kj;
     TRWS::REAL delta;
 
-    for (ki=0; ki<K; ki++)
-	{
-	    Di[ki] = (gamma*Di_hat[ki] - M[ki]);
-	}
+    ExcludeMessage(Di, Di_hat, M, gamma, K);
 
     for (kj=0; kj<K; kj++)
 	{
@@ -270,11 +151,7 @@ inline TRWS::REAL UpdateMessageGENERAL(TRWS::REAL* M, TRWS::REAL* Di_hat, int K,
 		}
 	}
 
-    delta = M[0];
-    for (kj=1; kj<K; kj++) TRUNCATE(delta, M[kj]);
-    for (kj=0; kj<K; kj++) M[kj] -= delta;
-
-    return delta;
+    return SubtractMin(M, K);
 }
 
 
@@ -282,6 +159,7 @@ inline TRWS::REAL UpdateMessageGENERAL(TRWS::REAL* M, TRWS::REAL* Di_hat, int K,
 
 
 
+
 TRWS::TRWS(int width, int height, int nLabels,EnergyFunction *eng):MRF(width,height,nLabels,eng)
 {
     Allocate();
@@ -300,6 +178,10 @@ TRWS::~TRWS()
     if ( m_DBinary ) delete [] m_DBinary;
     if ( m_horzWeightsBinary ) delete [] m_horzWeightsBinary;
     if ( m_vertWeightsBinary ) delete [] m_vertWeightsBinary;
+    if ( m_Di ) delete [] m_Di;
+    if ( m_buf ) delete [] m_buf;
+    if ( m_boundaryMessages ) delete [] m_boundaryMessages;
+    if ( m_bandScratch ) delete [] m_bandScratch;
 }
 
 
@@ -319,8 +201,18 @@ void TRWS::Allocate()
     m_DBinary = NULL;
     m_messages = NULL;
     m_messageArraySizeInBytes = 0;
+    m_Di = NULL;
+    m_buf = NULL;
+
+    m_bandCount = 1;
+    m_allocatedBandCount = 0;
+    m_boundaryMessages = NULL;
+    m_boundaryParity = 0;
+    m_bandScratch = NULL;
+    m_bandScratchSize = 0;
 
     m_answer = new Label[m_nPixels];
+    m_changedLabels = 0;
 }
 
 void TRWS::clearAnswer()
@@ -330,6 +222,17 @@ void TRWS::clearAnswer()
 	{
 	    memset(m_messages, 0, m_messageArraySizeInBytes);
 	}
+    if (m_boundaryMessages)
+	{
+	    memset(m_boundaryMessages, 0, 4*(m_allocatedBandCount-1)*m_width*m_nLabels*sizeof(REAL));
+	}
+}
+
+void TRWS::setBandCount(int bandCount)
+{
+    if (bandCount < 1) bandCount = 1;
+    if (m_grid_graph && bandCount > m_height) bandCount = m_height;
+    m_bandCount = bandCount;
 }
 
 
@@ -530,6 +433,17 @@ void TRWS::initializeAlg()
     m_messages = new REAL[messageNum];
     memset(m_messages, 0, messageNum*sizeof(REAL));
 
+    // allocate scratch buffers of the message updates
+    if (m_type != BINARY)
+	{
+	    int K = m_nLabels;
+	    int L1Size = PaddedMessageLength<REAL>(K)*sizeof(REAL);
+	    int L2Size = (2*K+1)*sizeof(int) + K*sizeof(REAL);
+	    m_Di = new REAL[K];
+	    m_buf = new char[MAX(L1Size, L2Size)];
+	    m_bandScratchSize = K + (MAX(L1Size, L2Size) + sizeof(REAL) - 1) / sizeof(REAL);
+	}
+
     if (m_type == BINARY)
 	{
 	    assert(m_DBinary == NULL && m_horzWeightsBinary == NULL && m_horzWeightsBinary == NULL);
@@ -565,7 +479,11 @@ void TRWS::optimizeAlg(int nIterations)
 {
     assert(m_type != NONE);
 
-    if (m_grid_graph)
+    if (usesBands())
+	{
+	    optimize_GRID_BANDS(nIterations);
+	}
+    else if (m_grid_graph)
 	{
 	    switch (m_type)
 		{
@@ -585,6 +503,8 @@ void TRWS::optimizeAlg(int nIterations)
     //          computing solution                //
     ////////////////////////////////////////////////
 
+    m_changedLabels = 0;
+
     if (m_type != BINARY)
 	{
 	    int x, y, n, K = m_nLabels;
@@ -593,8 +513,9 @@ void TRWS::optimizeAlg(int nIterations)
 	    REAL* Di;
 	    REAL delta;
 	    int ki, kj;
+	    Label label;
 
-	    Di = new REAL[K];
+	    Di = m_Di;
 
 	    n = 0;
 	    D_ptr = m_D;
@@ -675,18 +596,21 @@ void TRWS::optimizeAlg(int nIterations)
 
 			// compute min
 			delta = Di[0];
-			m_answer[n] = 0;
+			label = 0;
 			for (ki=1; ki<K; ki++)
 			    {
 				if (delta > Di[ki])
 				    {
 					delta = Di[ki];
-					m_answer[n] = ki;
+					label = ki;
 				    }
 			    }
+			if (m_answer[n] != label)
+			    {
+				m_answer[n] = label;
+				m_changedLabels ++;
+			    }
 		    }
-
-	    delete [] Di;
 	}
     else // m_type == BINARY
 	{
@@ -708,7 +632,12 @@ void TRWS::optimizeAlg(int nIterations)
 			if (y < m_height-1) Di += M_ptr[1]; // message (x,y+1)->(x,y)
 
 			// compute min
-			m_answer[n] = (Di >= 0) ? 0 : 1;
+			Label label = (Di >= 0) ? 0 : 1;
+			if (m_answer[n] != label)
+			    {
+				m_answer[n] = label;
+				m_changedLabels ++;
+			    }
 		    }
 	}
 }
@@ -720,7 +649,7 @@ void TRWS::optimize_GRID_L1(int nIterations)
     REAL* M_ptr;
     REAL* Di;
 
-    Di = new REAL[K];
+    Di = m_Di;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -741,12 +670,12 @@ void TRWS::optimize_GRID_L1(int nIterations)
 			if (x < m_width-1) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_horzWeights[n] : m_lambda;
-				UpdateMessageL1(M_ptr, Di, K, 0.5, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr, Di, K, 0.5, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 			if (y < m_height-1) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_vertWeights[n] : m_lambda;
-				UpdateMessageL1(M_ptr+K, Di, K, 0.5, lambda, m_smoothMax);
+				UpdateMessageL1(M_ptr+K, Di, K, 0.5, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 		    }
 
@@ -771,17 +700,15 @@ void TRWS::optimize_GRID_L1(int nIterations)
 			if (x > 0) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_horzWeights[n-1] : m_lambda;
-				m_lowerBound += UpdateMessageL1(M_ptr-2*K, Di, K, 0.5, lambda, m_smoothMax);
+				m_lowerBound += UpdateMessageL1(M_ptr-2*K, Di, K, 0.5, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 			if (y > 0) 
 			    {
 				CostVal lambda = (m_varWeights) ? m_lambda*m_vertWeights[n-m_width] : m_lambda;
-				m_lowerBound += UpdateMessageL1(M_ptr-(2*m_width-1)*K, Di, K, 0.5, lambda, m_smoothMax);
+				m_lowerBound += UpdateMessageL1(M_ptr-(2*m_width-1)*K, Di, K, 0.5, lambda, m_smoothMax, (REAL*) m_buf);
 			    }
 		    }
 	}
-
-    delete [] Di;
 }
 
 void TRWS::optimize_GRID_L2(int nIterations)
@@ -792,8 +719,8 @@ void TRWS::optimize_GRID_L2(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new char[(2*K+1)*sizeof(int) + K*sizeof(REAL)];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -853,9 +780,6 @@ void TRWS::optimize_GRID_L2(int nIterations)
 			    }
 		    }
 	}
-
-    delete [] Di;
-    delete [] (char *)buf;
 }
 
 
@@ -943,8 +867,8 @@ void TRWS::optimize_GRID_FIXED_MATRIX(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new REAL[K];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -1004,9 +928,6 @@ void TRWS::optimize_GRID_FIXED_MATRIX(int nIterations)
 			    }
 		    }
 	}
-
-    delete [] Di;
-    delete [] (REAL *)buf;
 }
 
 void TRWS::optimize_GRID_GENERAL(int nIterations)
@@ -1017,8 +938,8 @@ void TRWS::optimize_GRID_GENERAL(int nIterations)
     REAL* Di;
     void* buf;
 
-    Di = new REAL[K];
-    buf = new REAL[K];
+    Di = m_Di;
+    buf = m_buf;
 
     for ( ; nIterations > 0; nIterations --)
 	{
@@ -1081,7 +1002,189 @@ void TRWS::optimize_GRID_GENERAL(int nIterations)
 			    }
 		    }
 	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//                  Banded schedule                                        //
+/////////////////////////////////////////////////////////////////////////////
+
+// The rows [y0, y1) of a band are processed like the whole grid in the
+// sequential schedule.  The messages across the upper and lower boundary
+// of the band are read from the previous iteration's planes (downIn, upIn)
+// instead of the message array and written to the current iteration's
+// planes (downOut, upOut), so that no band touches another band's data.
+
+void TRWS::allocateBands()
+{
+    int b, x, K = m_nLabels;
+    int planeSize = m_width*K;
+
+    if ( m_boundaryMessages ) delete [] m_boundaryMessages;
+    if ( m_bandScratch ) delete [] m_bandScratch;
+
+    m_allocatedBandCount = m_bandCount;
+    m_boundaryMessages = new REAL[4*(m_bandCount-1)*planeSize];
+    m_bandScratch = new REAL[m_bandCount*m_bandScratchSize];
+    m_boundaryParity = 0;
+
+    // start from the messages of the sequential schedule: after its
+    // backward pass, the message array holds the messages sent up
+    memset(m_boundaryMessages, 0, 4*(m_bandCount-1)*planeSize*sizeof(REAL));
+    for (b=0; b<m_bandCount-1; b++)
+	{
+	    int y = (b+1)*m_height/m_bandCount - 1;
+	    REAL* up = boundaryPlane(b, false, true);
+	    for (x=0; x<m_width; x++)
+		{
+		    memcpy(up + x*K, m_messages + (2*(x+y*m_width)+1)*K, K*sizeof(REAL));
+		}
+	}
+}
+
+TRWS::REAL* TRWS::boundaryPlane(int boundary, bool down, bool previous)
+{
+    int plane = 2*(down ? 0 : 1) + ((previous ? 1 : 0) ^ m_boundaryParity);
+    return m_boundaryMessages + (plane*(m_allocatedBandCount-1) + boundary)*m_width*m_nLabels;
+}
+
+void TRWS::optimize_GRID_BANDS(int nIterations)
+{
+    int b, x, K = m_nLabels;
+
+    if (m_allocatedBandCount != m_bandCount) allocateBands();
 
-    delete [] Di;
-    delete [] (REAL *)buf;
+    for ( ; nIterations > 0; nIterations --)
+	{
+	    // the bands are independent within an iteration
+#pragma omp parallel for schedule(static, 1)
+	    for (b=0; b<m_bandCount; b++)
+		{
+		    int y0 = b*m_height/m_bandCount;
+		    int y1 = (b+1)*m_height/m_bandCount;
+		    bool first = (b == 0), last = (b == m_bandCount-1);
+
+		    sweepBand(y0, y1,
+			      first ? NULL : boundaryPlane(b-1, true, true),
+			      last  ? NULL : boundaryPlane(b,   true, false),
+			      last  ? NULL : boundaryPlane(b,   false, true),
+			      first ? NULL : boundaryPlane(b-1, false, false),
+			      m_bandScratch + b*m_bandScratchSize);
+		}
+
+	    // the current messages become the previous ones
+	    m_boundaryParity ^= 1;
+
+	    // the bands' bounds stem from boundary messages of different
+	    // iterations, their sum is no bound of the energy
+	    m_lowerBound = 0;
+	}
+
+    // store the messages sent up in the message array as the sequential
+    // schedule does, for computing the solution
+    for (b=0; b<m_bandCount-1; b++)
+	{
+	    int y = (b+1)*m_height/m_bandCount - 1;
+	    REAL* up = boundaryPlane(b, false, true);
+	    for (x=0; x<m_width; x++)
+		{
+		    memcpy(m_messages + (2*(x+y*m_width)+1)*K, up + x*K, K*sizeof(REAL));
+		}
+	}
+}
+
+void TRWS::sweepBand(int y0, int y1, const REAL* downIn, REAL* downOut,
+		     const REAL* upIn, REAL* upOut, REAL* scratch)
+{
+    int x, y, n, K = m_nLabels;
+    REAL* Di = scratch;
+    void* buf = scratch + K;
+    REAL* M_ptr;
+    const REAL* above;
+    const REAL* below;
+
+    // forward pass
+    for (y=y0; y<y1; y++)
+	for (x=0; x<m_width; x++)
+	    {
+		n = x + y*m_width;
+		M_ptr = m_messages + 2*n*K;
+		if (y > y0) above = M_ptr-(2*m_width-1)*K;
+		else        above = (downIn) ? downIn + x*K : NULL;
+		if (y < y1-1) below = M_ptr+K;
+		else          below = (upIn) ? upIn + x*K : NULL;
+
+		gatherMessages(Di, x, n, above, below);
+
+		if (x < m_width-1) updateMessage(M_ptr, Di, n, n+1, buf);
+		if (y < y1-1) updateMessage(M_ptr+K, Di, n, n+m_width, buf);
+		else if (below)
+		    {
+			REAL* M = downOut + x*K;
+			memcpy(M, below, K*sizeof(REAL));
+			updateMessage(M, Di, n, n+m_width, buf);
+		    }
+	    }
+
+    // backward pass
+    for (y=y1-1; y>=y0; y--)
+	for (x=m_width-1; x>=0; x--)
+	    {
+		n = x + y*m_width;
+		M_ptr = m_messages + 2*n*K;
+		if (y > y0) above = M_ptr-(2*m_width-1)*K;
+		else        above = (downIn) ? downIn + x*K : NULL;
+		if (y < y1-1) below = M_ptr+K;
+		else          below = (upIn) ? upIn + x*K : NULL;
+
+		gatherMessages(Di, x, n, above, below);
+
+		// normalize Di
+		SubtractMin(Di, K);
+
+		if (x > 0) updateMessage(M_ptr-2*K, Di, n, n-1, buf);
+		if (y > y0) updateMessage(M_ptr-(2*m_width-1)*K, Di, n, n-m_width, buf);
+		else if (above)
+		    {
+			REAL* M = upOut + x*K;
+			memcpy(M, above, K*sizeof(REAL));
+			updateMessage(M, Di, n, n-m_width, buf);
+		    }
+	    }
+}
+
+// Di := data costs of node n plus its incoming messages, above and below
+// are the messages from the nodes above and below (NULL if there are none)
+void TRWS::gatherMessages(REAL* Di, int x, int n, const REAL* above, const REAL* below)
+{
+    int K = m_nLabels;
+    REAL* M_ptr = m_messages + 2*n*K;
+
+    CopyVector(Di, m_D + n*K, K);
+    if (x > 0) AddVector(Di, M_ptr-2*K, K); // message (x-1,y)->(x,y)
+    if (above) AddVector(Di, above, K); // message (x,y-1)->(x,y)
+    if (x < m_width-1) AddVector(Di, M_ptr, K); // message (x+1,y)->(x,y)
+    if (below) AddVector(Di, below, K); // message (x,y+1)->(x,y)
+}
+
+// updates message M from node n to its grid neighbor
+TRWS::REAL TRWS::updateMessage(REAL* M, REAL* Di, int n, int neighbor, void* buf)
+{
+    int K = m_nLabels;
+    int edge = (n < neighbor) ? n : neighbor;
+    int vertical = (n - neighbor == m_width || neighbor - n == m_width) ? 1 : 0;
+    CostVal weight = (!m_varWeights) ? 1 : (vertical) ? m_vertWeights[edge] : m_horzWeights[edge];
+
+    switch (m_type)
+	{
+	case L1:
+	    return UpdateMessageL1(M, Di, K, 0.5, m_lambda*weight, m_smoothMax, (REAL*) buf);
+	case L2:
+	    return UpdateMessageL2(M, Di, K, 0.5, m_lambda*weight, m_smoothMax, buf);
+	case FIXED_MATRIX:
+	    return UpdateMessageFIXED_MATRIX(M, Di, K, 0.5, weight, m_V, buf);
+	case GENERAL:
+	    if (m_V) return UpdateMessageGENERAL(M, Di, K, 0.5, (n < neighbor) ? 0 : 1, m_V + (2*edge+vertical)*K*K, buf);
+	    else     return UpdateMessageGENERAL(M, Di, K, 0.5, m_smoothFn, n, neighbor, buf);
+	default: assert(0); exit(1);
+	}
 }
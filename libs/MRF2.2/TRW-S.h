@@ -23,7 +23,21 @@ class TRWS : public MRF{
     void setParameters(int /*numParam*/, void * /*param*/){printf("No optional parameters to set"); exit(1);}
     EnergyVal smoothnessEnergy();
     EnergyVal dataEnergy();
+    int changedLabelCount() { return m_changedLabels; }
     double lowerBound() { return (double)m_lowerBound; }
+    bool hasLowerBound() { return !usesBands(); }
+
+    // Splits the grid into bandCount horizontal bands of about equal height,
+    // whose forward and backward passes run in parallel (if compiled with
+    // OpenMP).  Messages across band boundaries are exchanged after every
+    // iteration, so they lag one iteration behind.  The bands' bounds do not
+    // add up to a lower bound of the energy, so there is none in this mode
+    // (hasLowerBound() is false), and the energy may converge higher than
+    // with the sequential schedule.  1 (default) runs the sequential
+    // schedule.  Binary problems (2 labels, L1) always use the sequential
+    // schedule.
+    void setBandCount(int bandCount);
+    int getBandCount() { return m_bandCount; }
 
     // For general smoothness functions, this code tries to cache all function values in an array
     // for efficiency.  To prevent this, call the following function before calling initialize():
@@ -74,6 +88,23 @@ class TRWS : public MRF{
 
     int	  m_messageArraySizeInBytes;
 
+    int   m_changedLabels; // by the last optimizeAlg()
+
+    // scratch buffers of the message updates, allocated once by initializeAlg()
+    REAL* m_Di;   // size K
+    char* m_buf;  // large enough for any UpdateMessageTYPE()
+
+    // banded schedule: the messages across the boundary between band b and
+    // b+1 are stored in 4 planes of width*K values each: the messages sent
+    // down and up in the previous iteration (read) and in the current one
+    // (written), see boundaryPlane()
+    int   m_bandCount;
+    int   m_allocatedBandCount;
+    REAL* m_boundaryMessages;
+    int   m_boundaryParity;
+    REAL* m_bandScratch;        // Di and the update buffer of each band
+    int   m_bandScratchSize;
+
     REAL m_lowerBound;
 
     void optimize_GRID_L1(int nIterations);
@@ -81,6 +112,15 @@ class TRWS : public MRF{
     void optimize_GRID_FIXED_MATRIX(int nIterations);
     void optimize_GRID_GENERAL(int nIterations);
     void optimize_GRID_BINARY(int nIterations);
+    void optimize_GRID_BANDS(int nIterations);
+    bool usesBands() { return m_grid_graph && m_bandCount > 1 && m_type != BINARY; }
+
+    void allocateBands();
+    REAL* boundaryPlane(int boundary, bool down, bool previous);
+    void sweepBand(int y0, int y1, const REAL* downIn, REAL* downOut,
+		   const REAL* upIn, REAL* upOut, REAL* scratch);
+    void gatherMessages(REAL* Di, int x, int n, const REAL* above, const REAL* below);
+    REAL updateMessage(REAL* M, REAL* Di, int n, int neighbor, void* buf);
 };
 
 #endif /*  __TRWS_H__ */
@@ -0,0 +1,118 @@
+// bench-expansion.cpp -- alpha-expansion on bands of the grid against the whole grid
+
+static const char *usage = "usage: %s [width height]\n";
+
+// Runs alpha-expansion on the depth labeling energy of the CDC depth
+// estimator (data costs of two weighted cues in [0,1] per label, truncated L1
+// smoothness) until its energy converges, first on the whole grid, then with
+// the grid split into 2, 4 and 8 bands that are expanded in parallel.
+// Printed are the iterations, times and energies of all runs, and how much
+// the energy of the bands exceeds the one of the whole grid.
+
+#include "mrf.h"
+#include "GCoptimization.h"
+#include "MRFDriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static int sizeX = 330;
+static int sizeY = 380;
+
+static const int numLabels = 26;            // DEPTH_RESOLUTION + 1
+static const MRF::CostVal truncation = 4;   // LABELING_TRUNCATION
+static const MRF::CostVal smoothness = 0.05f; // LABELING_SMOOTHNESS
+static const double convergence = 0.001;    // LABELING_CONVERGENCE
+static const int maxIterations = 20;        // LABELING_MAX_ITERATIONS
+
+// ground truth of slanted planes, cue costs that grow with the distance to
+// it, weighted by random confidences, plus noise
+void generateDataCost(MRF::CostVal *D)
+{
+    for (int y = 0; y < sizeY; y++)
+	for (int x = 0; x < sizeX; x++, D += numLabels) {
+	    int truth = ((x / 64) * 5 + (y / 48) * 3 + x / 40) % numLabels;
+	    for (int l = 0; l < numLabels; l++)
+		D[l] = 0;
+	    for (int cue = 0; cue < 2; cue++) {
+		MRF::CostVal weight = ((MRF::CostVal)(rand() % 100)) / 100;
+		for (int l = 0; l < numLabels; l++) {
+		    int d = (l > truth) ? l - truth : truth - l;
+		    MRF::CostVal cost = (d < 8) ? (MRF::CostVal) d / 8 : 1;
+		    MRF::CostVal noise = ((MRF::CostVal)(rand() % 100)) / 500;
+		    D[l] += weight * (cost + noise);
+		}
+	    }
+	}
+}
+
+// runs expansion with bandCount bands until the energy converges, prints how
+// it compares to the reference run (if reference > 0), returns its energy
+// and time
+void run(EnergyFunction *energy, int bandCount, MRF::EnergyVal reference, double referenceTime,
+	 MRF::EnergyVal& result, double& time)
+{
+    Expansion *expansion = new Expansion(sizeX,sizeY,numLabels,energy);
+    expansion->setBandCount(bandCount);
+    expansion->initialize();
+    expansion->clearAnswer();
+
+    MRFDriver::Criteria criteria;
+    criteria.maxIterations = maxIterations;
+    criteria.minRelativeDecrease = convergence;
+    MRFDriver driver(expansion, criteria);
+    driver.run();
+
+    const MRFDriver::Statistics& s = driver.getStatistics();
+    printf("%5d  %10d  %8.3f  %12g", expansion->getBandCount(), s.iterations, s.time, (float) s.energy);
+    if (reference > 0)
+	printf("  %+.4f%%  %.2fx", 100 * (s.energy - reference) / reference, referenceTime / s.time);
+    printf("\n");
+
+    result = (MRF::EnergyVal) s.energy;
+    time = s.time;
+    delete expansion;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 && argc != 3) {
+	fprintf(stderr, usage, argv[0]);
+	exit(1);
+    }
+    if (argc == 3) {
+	sizeX = atoi(argv[1]);
+	sizeY = atoi(argv[2]);
+    }
+
+    srand(1124285485);
+
+    MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+    generateDataCost(D);
+
+    DataCost data(D);
+    SmoothnessCost smooth(1, truncation, smoothness);
+    EnergyFunction energy(&data, &smooth);
+
+#ifdef _OPENMP
+    int nThreads = omp_get_max_threads();
+#else
+    int nThreads = 1;
+#endif
+    printf("******* depth labeling: %dx%d pixels, %d labels, %d threads *****\n",
+	   sizeX, sizeY, numLabels, nThreads);
+    printf("bands  iterations  time [s]        energy  vs. 1 band, speedup\n");
+
+    MRF::EnergyVal reference, result;
+    double referenceTime, time;
+    run(&energy, 1, 0, 0, reference, referenceTime);
+    for (int bandCount = 2; bandCount <= 8; bandCount *= 2)
+	run(&energy, bandCount, reference, referenceTime, result, time);
+
+    delete[] D;
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+// bench-hbp.cpp -- hierarchical BP against flat BP and BP-S
+
+static const char *usage = "usage: %s [width height blockSize]\n";
+
+// Runs HBP on a grid of the size of a depth map of the CDC depth estimator
+// (by default the spatial resolution of a first generation Lytro light
+// field) until its energy converges, then runs flat BP (HBP with a single
+// level, MaxProdBP) and BP-S until they reach the same energy, and then on
+// until their own energies converge. The data costs only carry information
+// along the borders of large blocks, as a textureless region would, so the
+// labels have to be propagated into the blocks by the smoothness term.
+// Printed are the iterations and times of all solvers to reach the energy of
+// HBP, relative to those of HBP, and the energies they converge to, relative
+// to the one of HBP (negative if lower).
+
+#include "mrf.h"
+#include "MaxProdBP.h"
+#include "BP-S.h"
+#include "HBP.h"
+#include "MRFDriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int sizeX = 330;
+static int sizeY = 380;
+static int blockSize = 64;
+
+static const double convergence = 0.001; // as the CDC depth labeling
+static const int maxIterations = 1000;
+
+// noisy data costs of a blocky ground truth labeling, flat (0) except for a
+// border of 2 pixels of every block
+void generateDataCost(MRF::CostVal *D, int numLabels)
+{
+    for (int y = 0; y < sizeY; y++)
+	for (int x = 0; x < sizeX; x++) {
+	    int truth = ((x / blockSize) * 7 + (y / blockSize) * 3) % numLabels;
+	    int bx = x % blockSize, by = y % blockSize;
+	    bool textured = bx < 2 || by < 2 || bx >= blockSize - 2 || by >= blockSize - 2;
+	    for (int l = 0; l < numLabels; l++) {
+		MRF::CostVal noise = ((MRF::CostVal)(rand() % 100)) / 50;
+		*D++ = (textured) ? (MRF::CostVal)((l > truth) ? l - truth : truth - l) + noise : 0;
+	    }
+	}
+}
+
+// runs mrf until its energy drops to target, returns the energy reached
+MRF::EnergyVal runUntil(MRF *mrf, MRF::EnergyVal target, int& iterations, double& time)
+{
+    MRF::EnergyVal energy = mrf->totalEnergy();
+    time = 0;
+    for (iterations = 0; iterations < maxIterations && energy > target; iterations++) {
+	float t;
+	double start = MRFDriver::wallTime();
+	mrf->optimize(1, t);
+	time += MRFDriver::wallTime() - start;
+	energy = mrf->totalEnergy();
+    }
+    return energy;
+}
+
+// runs mrf until it reaches the energy of HBP, then until its energy
+// converges
+void runOther(MRF *mrf, const char *name, MRF::EnergyVal target,
+	      double hbpTime)
+{
+    int iterations;
+    double time;
+
+    mrf->initialize();
+    mrf->clearAnswer();
+    MRF::EnergyVal energy = runUntil(mrf, target, iterations, time);
+
+    if (energy > target)
+	printf("%-10s %10s  %8s  %8s", name, "-", "-", "-");
+    else
+	printf("%-10s %10d  %8.3f  %7.1fx", name, iterations, time, time / hbpTime);
+
+    MRFDriver::Criteria criteria;
+    criteria.maxIterations = maxIterations - iterations;
+    criteria.minRelativeDecrease = convergence;
+    MRFDriver driver(mrf, criteria);
+    if (iterations < maxIterations) driver.run();
+
+    const MRFDriver::Statistics& s = driver.getStatistics();
+    energy = mrf->totalEnergy();
+    printf("  %10d  %8.3f  %12g  %+8.3f%%\n", iterations + s.iterations,
+	   time + s.time, (float) energy, 100 * (energy - target) / target);
+
+    delete mrf;
+}
+
+void runEnergy(EnergyFunction *energy, int numLabels, const char *name)
+{
+    printf("\n******* %s: %dx%d pixels, %d labels, blocks of %d pixels *****\n",
+	   name, sizeX, sizeY, numLabels, blockSize);
+    printf("           to the energy of HBP             converged\n");
+    printf("solver     iterations  time [s]  vs. HBP  iterations  time [s]        energy   vs. HBP\n");
+
+    HBP *hbp = new HBP(sizeX,sizeY,numLabels,energy);
+    hbp->initialize();
+    hbp->clearAnswer();
+
+    MRFDriver::Criteria criteria;
+    criteria.maxIterations = maxIterations;
+    criteria.minRelativeDecrease = convergence;
+    MRFDriver driver(hbp, criteria);
+    driver.run();
+
+    const MRFDriver::Statistics& s = driver.getStatistics();
+    printf("%-10s %10d  %8.3f  %7.1fx  %10d  %8.3f  %12g  %+8.3f%%  (%d levels, %d iterations each)\n",
+	   "HBP", s.iterations, s.time, 1.0, s.iterations, s.time, (float) s.energy, 0.0,
+	   hbp->getLevelCount(), hbp->getCoarseIterations());
+
+    HBP *flat = new HBP(sizeX,sizeY,numLabels,energy);
+    flat->setLevelCount(1);
+    runOther(flat, "HBP flat", (MRF::EnergyVal) s.energy, s.time);
+    runOther(new MaxProdBP(sizeX,sizeY,numLabels,energy), "MaxProdBP",
+	     (MRF::EnergyVal) s.energy, s.time);
+    runOther(new BPS(sizeX,sizeY,numLabels,energy), "BP-S",
+	     (MRF::EnergyVal) s.energy, s.time);
+
+    delete hbp;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 && argc != 4) {
+	fprintf(stderr, usage, argv[0]);
+	exit(1);
+    }
+    if (argc == 4) {
+	sizeX = atoi(argv[1]);
+	sizeY = atoi(argv[2]);
+	blockSize = atoi(argv[3]);
+    }
+
+    srand(1124285485);
+
+    // cue selection of the CDC depth estimator
+    {
+	const int numLabels = 2;
+	MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+	MRF::CostVal V[numLabels*numLabels] = { 0, 1, 1, 0 };
+	generateDataCost(D, numLabels);
+
+	DataCost data(D);
+	SmoothnessCost smooth(V);
+	EnergyFunction energy(&data, &smooth);
+	runEnergy(&energy, numLabels, "cue selection");
+
+	delete[] D;
+    }
+
+    // depth labeling of the CDC depth estimator
+    {
+	const int numLabels = 26;
+	MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+	generateDataCost(D, numLabels);
+
+	DataCost data(D);
+	SmoothnessCost smooth(1, (MRF::CostVal) 4, (MRF::CostVal) 0.5);
+	EnergyFunction energy(&data, &smooth);
+	runEnergy(&energy, numLabels, "depth labeling");
+
+	delete[] D;
+    }
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+// bench-maxprodbp.cpp -- thread scaling of MaxProdBP's parallel schedules
+
+static const char *usage = "usage: %s [width height iterations]\n";
+
+// Runs MaxProdBP on a grid of the size of a depth map of the CDC depth
+// estimator (by default the spatial resolution of a first generation Lytro
+// light field) for both of its energies:
+//  - cue selection:  2 labels, smoothness given as an array
+//  - depth labeling: 26 labels (one per alpha value), truncated linear
+// Every schedule is run with 1 to 64 threads. The labeling of each run is
+// compared with the one of the single-threaded run, which it has to match.
+
+#include "mrf.h"
+#include "MaxProdBP.h"
+#include "MRFDriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int sizeX = 330;
+static int sizeY = 380;
+static int iterations = 10;
+
+static const int maxThreads = 64;
+
+// noisy data costs around a blocky ground truth labeling
+void generateDataCost(MRF::CostVal *D, int numLabels)
+{
+    for (int y = 0; y < sizeY; y++)
+	for (int x = 0; x < sizeX; x++) {
+	    int truth = ((x / 40) * 7 + (y / 30) * 3) % numLabels;
+	    for (int l = 0; l < numLabels; l++) {
+		MRF::CostVal noise = ((MRF::CostVal)(rand() % 100)) / 50;
+		*D++ = (MRF::CostVal)((l > truth) ? l - truth : truth - l) + noise;
+	    }
+	}
+}
+
+void runSchedule(EnergyFunction *energy, int numLabels,
+		 MaxProdBP::Schedule schedule, const char *name)
+{
+    MRF::Label *reference = new MRF::Label[sizeX*sizeY];
+    double referenceTime = 0;
+
+    printf("\n%s schedule\n", name);
+    printf("threads  time [s]  speedup        energy  labeling\n");
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+	MaxProdBP *mrf = new MaxProdBP(sizeX,sizeY,numLabels,energy);
+	mrf->setNumThreads(threads);
+	mrf->setSchedule(schedule);
+	mrf->initialize();
+	mrf->clearAnswer();
+
+	double start = MRFDriver::wallTime();
+	float t;
+	mrf->optimize(iterations, t);
+	double time = MRFDriver::wallTime() - start;
+
+	const char *match = "reference";
+	if (threads == 1) {
+	    memcpy(reference, mrf->getAnswerPtr(), sizeX*sizeY*sizeof(MRF::Label));
+	    referenceTime = time;
+	}
+	else if (memcmp(reference, mrf->getAnswerPtr(), sizeX*sizeY*sizeof(MRF::Label)) == 0)
+	    match = "identical";
+	else
+	    match = "DIFFERENT";
+
+	printf("%7d  %8.3f  %7.2f  %12g  %s\n", threads, time, referenceTime / time,
+	       (float) mrf->totalEnergy(), match);
+
+	delete mrf;
+    }
+
+    delete[] reference;
+}
+
+void runEnergy(EnergyFunction *energy, int numLabels, const char *name)
+{
+    printf("\n******* %s: %dx%d pixels, %d labels, %d iterations *****\n",
+	   name, sizeX, sizeY, numLabels, iterations);
+
+    runSchedule(energy, numLabels, MaxProdBP::ROW_COLUMN_SWEEPS, "row/column sweeps");
+    runSchedule(energy, numLabels, MaxProdBP::CHECKERBOARD, "checkerboard");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 && argc != 4) {
+	fprintf(stderr, usage, argv[0]);
+	exit(1);
+    }
+    if (argc == 4) {
+	sizeX = atoi(argv[1]);
+	sizeY = atoi(argv[2]);
+	iterations = atoi(argv[3]);
+    }
+
+    srand(1124285485);
+
+#ifndef _OPENMP
+    printf("built without OpenMP, all runs are serial\n");
+#endif
+
+    // cue selection of the CDC depth estimator
+    {
+	const int numLabels = 2;
+	MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+	MRF::CostVal V[numLabels*numLabels] = { 0, 1, 1, 0 };
+	generateDataCost(D, numLabels);
+
+	DataCost data(D);
+	SmoothnessCost smooth(V);
+	EnergyFunction energy(&data, &smooth);
+	runEnergy(&energy, numLabels, "cue selection");
+
+	delete[] D;
+    }
+
+    // depth labeling of the CDC depth estimator
+    {
+	const int numLabels = 26;
+	MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+	generateDataCost(D, numLabels);
+
+	DataCost data(D);
+	SmoothnessCost smooth(1, (MRF::CostVal) 4, (MRF::CostVal) 0.5);
+	EnergyFunction energy(&data, &smooth);
+	runEnergy(&energy, numLabels, "depth labeling");
+
+	delete[] D;
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+// bench-trws.cpp -- banded TRW-S against sequential TRW-S, and its lower bound
+
+static const char *usage = "usage: %s [width height iterations]\n";
+
+// Runs TRW-S on a random truncated linear energy, first with the sequential
+// schedule, then with the grid split into 4 and 25 bands. After every
+// iteration the lower bound of the sequential schedule is checked against
+// the energy of its labeling, and at the end against the lowest energy of all
+// runs; banded runs must not report a bound at all.
+// Printed are the energies, bounds and times of all runs. Returns 1 if a
+// check fails.
+
+#include "mrf.h"
+#include "TRW-S.h"
+#include "MRFDriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+static int sizeX = 120;
+static int sizeY = 100;
+static int iterations = 30;
+
+static const int numLabels = 16;
+static const MRF::CostVal truncation = 4;
+static const MRF::CostVal lambda = 3;
+
+// slack for the rounding of float costs, relative to the energy
+static const double tolerance = 1e-5;
+
+// random data costs, independent per pixel and label
+void generateDataCost(MRF::CostVal *D)
+{
+    for (int i = 0; i < sizeX*sizeY*numLabels; i++)
+	D[i] = (MRF::CostVal)(rand() % 100) / 10;
+}
+
+// runs TRW-S with bandCount bands, returns the lowest energy it reached and
+// the number of failed checks in failures
+MRF::EnergyVal run(EnergyFunction *energy, int bandCount, double& bound, int& failures)
+{
+    TRWS *trws = new TRWS(sizeX,sizeY,numLabels,energy);
+    trws->setBandCount(bandCount);
+    trws->initialize();
+    trws->clearAnswer();
+
+    MRFDriver::Criteria criteria;
+    criteria.maxIterations = 1;
+    MRFDriver driver(trws, criteria);
+
+    MRF::EnergyVal best = trws->totalEnergy();
+    double time = 0;
+    bound = 0;
+    for (int i = 0; i < iterations; i++) {
+	driver.run();
+	time += driver.getStatistics().time;
+	MRF::EnergyVal E = trws->totalEnergy();
+	if (E < best) best = E;
+
+	if (trws->hasLowerBound()) {
+	    bound = trws->lowerBound();
+	    if (bound > E + tolerance * fabs(E)) {
+		printf("FAILED: lower bound %f above energy %f after iteration %d\n",
+		       bound, (float) E, i + 1);
+		failures++;
+	    }
+	}
+    }
+
+    printf("%5d  %12g  ", trws->getBandCount(), (float) best);
+    if (trws->hasLowerBound()) printf("%12.2f", bound);
+    else                       printf("%12s", "none");
+    printf("  %8.3f\n", time);
+
+    if (bandCount > 1 && trws->hasLowerBound()) {
+	printf("FAILED: banded schedule reports a lower bound\n");
+	failures++;
+    }
+
+    delete trws;
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 && argc != 4) {
+	fprintf(stderr, usage, argv[0]);
+	exit(1);
+    }
+    if (argc == 4) {
+	sizeX = atoi(argv[1]);
+	sizeY = atoi(argv[2]);
+	iterations = atoi(argv[3]);
+    }
+
+    srand(1124285485);
+
+    MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+    generateDataCost(D);
+
+    DataCost data(D);
+    SmoothnessCost smooth(1, truncation, lambda);
+    EnergyFunction energy(&data, &smooth);
+
+    printf("%dx%d pixels, %d labels, %d iterations\n", sizeX, sizeY, numLabels, iterations);
+    printf("bands        energy   lower bound  time [s]\n");
+
+    int failures = 0;
+    double bound, ignored;
+    MRF::EnergyVal best = run(&energy, 1, bound, failures);
+    const int bandCounts[] = { 4, 25 };
+    for (int i = 0; i < 2; i++) {
+	MRF::EnergyVal E = run(&energy, bandCounts[i], ignored, failures);
+	if (E < best) best = E;
+    }
+
+    if (bound > best + tolerance * fabs(best)) {
+	printf("FAILED: lower bound %f above the lowest energy %f\n", bound, (float) best);
+	failures++;
+    }
+
+    delete[] D;
+    if (failures == 0) printf("passed\n");
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+// bench-types.cpp -- compact types (8-bit labels, 16-bit costs) against float costs
+
+static const char *usage = "usage: %s [width height]\n";
+
+// Runs all grid solvers on the depth labeling energy of the CDC depth
+// estimator (data costs of two weighted cues in [0,2.4] per label, truncated
+// L1 smoothness) until their energies converge, for a weak and a strong
+// smoothness term. Built without MRF_COMPACT_TYPES, it writes the energies,
+// times and labelings to bench-types.dat; built with it (costs scaled by
+// 1000), it reads them back and prints, per solver, how much its energy
+// exceeds the one of the float build, the fraction of labels that differ
+// and the speedup. "make compare-types" builds and runs both.
+
+#include "mrf.h"
+#include "ICM.h"
+#include "GCoptimization.h"
+#include "MaxProdBP.h"
+#include "TRW-S.h"
+#include "BP-S.h"
+#include "HBP.h"
+#include "MRFDriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int sizeX = 330;
+static int sizeY = 380;
+
+static const int numLabels = 26;            // DEPTH_RESOLUTION + 1
+static const int truncation = 4;            // LABELING_TRUNCATION
+static const double convergence = 0.001;    // LABELING_CONVERGENCE
+static const int maxIterations = 20;        // LABELING_MAX_ITERATIONS
+
+static const int numSmoothness = 2;
+static const double smoothness[numSmoothness] = { 0.05, 1 };
+
+static const int numSolvers = 6;
+static const char *solverNames[numSolvers] = { "ICM", "Expansion", "MaxProdBP", "TRW-S", "BP-S", "HBP" };
+
+static const char *dataFile = "bench-types.dat";
+
+#ifdef MRF_COMPACT_TYPES
+static const double scale = 1000;
+#else
+static const double scale = 1;
+#endif
+
+// ground truth of slanted planes, cue costs that grow with the distance to
+// it, weighted by random confidences, plus noise; the same costs in both
+// builds, converted to CostVal at the end
+void generateDataCost(MRF::CostVal *D)
+{
+    double *costs = new double[numLabels];
+    for (int y = 0; y < sizeY; y++)
+	for (int x = 0; x < sizeX; x++, D += numLabels) {
+	    int truth = ((x / 64) * 5 + (y / 48) * 3 + x / 40) % numLabels;
+	    for (int l = 0; l < numLabels; l++)
+		costs[l] = 0;
+	    for (int cue = 0; cue < 2; cue++) {
+		double weight = (rand() % 100) / 100.0;
+		for (int l = 0; l < numLabels; l++) {
+		    int d = (l > truth) ? l - truth : truth - l;
+		    double cost = (d < 8) ? d / 8.0 : 1;
+		    double noise = (rand() % 100) / 500.0;
+		    costs[l] += weight * (cost + noise);
+		}
+	    }
+	    for (int l = 0; l < numLabels; l++)
+		D[l] = MRF::toCostVal(scale * costs[l]);
+	}
+    delete[] costs;
+}
+
+MRF *createSolver(int solver, EnergyFunction *energy)
+{
+    switch (solver) {
+    case 0:  return new ICM(sizeX,sizeY,numLabels,energy);
+    case 1:  return new Expansion(sizeX,sizeY,numLabels,energy);
+    case 2:  return new MaxProdBP(sizeX,sizeY,numLabels,energy);
+    case 3:  return new TRWS(sizeX,sizeY,numLabels,energy);
+    case 4:  return new BPS(sizeX,sizeY,numLabels,energy);
+    default: return new HBP(sizeX,sizeY,numLabels,energy);
+    }
+}
+
+// runs the solver until its energy converges, returns its energy (unscaled)
+// and time and copies its labeling to labels
+double run(int solver, EnergyFunction *energy, double& time, int *labels)
+{
+    MRF *mrf = createSolver(solver, energy);
+    mrf->initialize();
+    mrf->clearAnswer();
+
+    MRFDriver::Criteria criteria;
+    criteria.maxIterations = maxIterations;
+    criteria.minRelativeDecrease = convergence;
+    MRFDriver driver(mrf, criteria);
+    driver.run();
+
+    time = driver.getStatistics().time;
+    double E = mrf->totalEnergy() / scale;
+    for (int i = 0; i < sizeX*sizeY; i++)
+	labels[i] = mrf->getLabel(i);
+
+    delete mrf;
+    return E;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 1 && argc != 3) {
+	fprintf(stderr, usage, argv[0]);
+	exit(1);
+    }
+    if (argc == 3) {
+	sizeX = atoi(argv[1]);
+	sizeY = atoi(argv[2]);
+    }
+
+#ifdef MRF_COMPACT_TYPES
+    FILE *file = fopen(dataFile, "rb");
+    if (!file) {
+	fprintf(stderr, "%s: cannot read %s, run the float build first\n", argv[0], dataFile);
+	exit(1);
+    }
+    int fileSize[2];
+    if (fread(fileSize, sizeof(int), 2, file) != 2 || fileSize[0] != sizeX || fileSize[1] != sizeY) {
+	fprintf(stderr, "%s: %s is not of a %dx%d grid\n", argv[0], dataFile, sizeX, sizeY);
+	exit(1);
+    }
+    int *floatLabels = new int[sizeX*sizeY];
+#else
+    FILE *file = fopen(dataFile, "wb");
+    if (!file) {
+	fprintf(stderr, "%s: cannot write %s\n", argv[0], dataFile);
+	exit(1);
+    }
+    int fileSize[2] = { sizeX, sizeY };
+    fwrite(fileSize, sizeof(int), 2, file);
+#endif
+
+    MRF::CostVal *D = new MRF::CostVal[sizeX*sizeY*numLabels];
+    int *labels = new int[sizeX*sizeY];
+
+    for (int s = 0; s < numSmoothness; s++) {
+	srand(1124285485);
+	generateDataCost(D);
+
+	DataCost data(D);
+	SmoothnessCost smooth(1, truncation, MRF::toCostVal(scale * smoothness[s]));
+	EnergyFunction energy(&data, &smooth);
+
+#ifdef MRF_COMPACT_TYPES
+	printf("\n******* compact types against float: %dx%d pixels, %d labels, smoothness %g *****\n",
+	       sizeX, sizeY, numLabels, smoothness[s]);
+	printf("solver      time [s]        energy  vs. float  labels differing  speedup\n");
+#else
+	printf("\n******* float: %dx%d pixels, %d labels, smoothness %g *****\n",
+	       sizeX, sizeY, numLabels, smoothness[s]);
+	printf("solver      time [s]        energy\n");
+#endif
+
+	for (int solver = 0; solver < numSolvers; solver++) {
+	    double time;
+	    double E = run(solver, &energy, time, labels);
+	    printf("%-10s  %8.3f  %12g", solverNames[solver], time, E);
+
+#ifdef MRF_COMPACT_TYPES
+	    double floatE, floatTime;
+	    if (fread(&floatE, sizeof(double), 1, file) != 1 ||
+		fread(&floatTime, sizeof(double), 1, file) != 1 ||
+		fread(floatLabels, sizeof(int), sizeX*sizeY, file) != (size_t) (sizeX*sizeY)) {
+		fprintf(stderr, "\n%s: %s is truncated\n", argv[0], dataFile);
+		exit(1);
+	    }
+	    int differing = 0;
+	    for (int i = 0; i < sizeX*sizeY; i++)
+		if (labels[i] != floatLabels[i]) differing++;
+	    printf("  %+8.4f%%  %15.3f%%  %6.2fx", 100 * (E - floatE) / floatE,
+		   100.0 * differing / (sizeX*sizeY), floatTime / time);
+#else
+	    fwrite(&E, sizeof(double), 1, file);
+	    fwrite(&time, sizeof(double), 1, file);
+	    fwrite(labels, sizeof(int), sizeX*sizeY, file);
+#endif
+	    printf("\n");
+	}
+    }
+
+    fclose(file);
+    delete[] labels;
+    delete[] D;
+#ifdef MRF_COMPACT_TYPES
+    delete[] floatLabels;
+#endif
+
+    return 0;
+}
@@ -110,6 +110,7 @@
 #define __BLOCK_H__
 
 #include <stdlib.h>
+#include "BlockArena.h"
 
 /***********************************************************************/
 /***********************************************************************/
@@ -125,7 +126,7 @@ public:
     Block(int size, void (*err_function)(char *) = NULL) { first = last = NULL; block_size = size; error_function = err_function; }
 
     /* Destructor. Deallocates all items added so far */
-    ~Block() { while (first) { block *next = first -> next; delete first; first = next; } }
+    ~Block() { while (first) { block *next = first -> next; delete [] (char *) first; first = next; } }
 
     /* Allocates 'num' consecutive items; returns pointer
        to the first item. 'num' cannot be greater than the
@@ -222,11 +223,13 @@ public:
     /* Constructor. Arguments are the block size and
        (optionally) the pointer to the function which
        will be called if allocation failed; the message
-       passed to this function is "Not enough memory!" */
-    DBlock(int size, void (*err_function)(const char *) = NULL) { first = NULL; first_free = NULL; block_size = size; error_function = err_function; }
+       passed to this function is "Not enough memory!",
+       and the arena the blocks are taken from (if NULL,
+       they are allocated with 'new') */
+    DBlock(int size, void (*err_function)(const char *) = NULL, BlockArena *block_arena = NULL) { first = NULL; first_free = NULL; block_size = size; error_function = err_function; arena = block_arena; }
 
     /* Destructor. Deallocates all items added so far */
-    ~DBlock() { while (first) { block *next = first -> next; delete first; first = next; } }
+    ~DBlock() { while (first) { block *next = first -> next; if (arena) arena -> release(first, block_bytes()); else delete [] (char *) first; first = next; } }
 
     /* Allocates one item */
     Type *New()
@@ -236,7 +239,7 @@ public:
         if (!first_free)
         {
             block *next = first;
-            first = (block *) new char [sizeof(block) + (block_size-1)*sizeof(block_item)];
+            first = (block *) ((arena) ? arena -> allocate(block_bytes()) : new char [block_bytes()]);
             if (!first) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
             first_free = & (first -> data[0] );
             for (item=first_free; item<first_free+block_size-1; item++)
@@ -276,6 +279,9 @@ private:
     int         block_size;
     block       *first;
     block_item  *first_free;
+    BlockArena  *arena;
+
+    int block_bytes() { return sizeof(block) + (block_size-1)*sizeof(block_item); }
 
     void    (*error_function)(const char *);
 };
@@ -131,8 +131,9 @@ public:
     /* Constructor. Optional argument is the pointer to the
        function which will be called if an error occurs;
        an error message is passed to this function. If this
-       argument is omitted, exit(1) will be called. */
-    Energy(void (*err_function)(const char *) = NULL);
+       argument is omitted, exit(1) will be called.
+       The graph takes its memory from 'arena' (see Graph). */
+    Energy(void (*err_function)(const char *) = NULL, BlockArena *arena = NULL);
 
     /* Destructor */
     ~Energy();
@@ -219,7 +220,7 @@ private:
 /************************  Implementation ******************************/
 /***********************************************************************/
 
-inline Energy::Energy(void (*err_function)(const char *)) : Graph(err_function)
+inline Energy::Energy(void (*err_function)(const char *), BlockArena *arena) : Graph(err_function, arena)
 {
     Econst = 0;
     error_function = err_function;
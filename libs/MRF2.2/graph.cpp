@@ -21,9 +21,11 @@
 #include <stdio.h>
 #include "graph.h"
 
-Graph::Graph(void (*err_function)(const char *))
+Graph::Graph(void (*err_function)(const char *), BlockArena *block_arena)
 {
     error_function = err_function;
+    own_arena = (block_arena == NULL);
+    arena = (own_arena) ? new BlockArena() : block_arena;
     node_block_first = NULL;
     arc_for_block_first = NULL;
     arc_rev_block_first = NULL;
@@ -35,23 +37,25 @@ Graph::~Graph()
     while (node_block_first)
     {
         node_block *next = node_block_first -> next;
-        delete node_block_first;
+        arena -> release(node_block_first, sizeof(node_block));
         node_block_first = next;
     }
 
     while (arc_for_block_first)
     {
         arc_for_block *next = arc_for_block_first -> next;
-        delete arc_for_block_first -> start;
+        arena -> release(arc_for_block_first -> start, sizeof(arc_for_block)+1);
         arc_for_block_first = next;
     }
 
     while (arc_rev_block_first)
     {
         arc_rev_block *next = arc_rev_block_first -> next;
-        delete arc_rev_block_first -> start;
+        arena -> release(arc_rev_block_first -> start, sizeof(arc_rev_block)+1);
         arc_rev_block_first = next;
     }
+
+    if (own_arena) delete arena;
 }
 
 Graph::node_id Graph::add_node()
@@ -61,7 +65,7 @@ Graph::node_id Graph::add_node()
     if (!node_block_first || node_block_first->current+1 > &node_block_first->nodes[NODE_BLOCK_SIZE-1])
     {
         node_block *next = node_block_first;
-        node_block_first = (node_block *) new node_block;
+        node_block_first = (node_block *) arena -> allocate(sizeof(node_block));
         if (!node_block_first) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
         node_block_first -> current = & ( node_block_first -> nodes[0] );
         node_block_first -> next = next;
@@ -84,7 +88,7 @@ void Graph::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
     if (!arc_for_block_first || arc_for_block_first->current+1 > &arc_for_block_first->arcs_for[ARC_BLOCK_SIZE])
     {
         arc_for_block *next = arc_for_block_first;
-        char *ptr = new char[sizeof(arc_for_block)+1];
+        char *ptr = (char *) arena -> allocate(sizeof(arc_for_block)+1);
         if (!ptr) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
         if ((PTR_CAST)ptr & 1) arc_for_block_first = (arc_for_block *) (ptr + 1);
         else              arc_for_block_first = (arc_for_block *) ptr;
@@ -96,7 +100,7 @@ void Graph::add_edge(node_id from, node_id to, captype cap, captype rev_cap)
     if (!arc_rev_block_first || arc_rev_block_first->current+1 > &arc_rev_block_first->arcs_rev[ARC_BLOCK_SIZE])
     {
         arc_rev_block *next = arc_rev_block_first;
-        char *ptr = new char[sizeof(arc_rev_block)+1];
+        char *ptr = (char *) arena -> allocate(sizeof(arc_rev_block)+1);
         if (!ptr) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
         if ((PTR_CAST)ptr & 1) arc_rev_block_first = (arc_rev_block *) (ptr + 1);
         else              arc_rev_block_first = (arc_rev_block *) ptr;
@@ -189,7 +193,7 @@ void Graph::prepare_graph()
                 if (ab_for == NULL)
                 {
                     arc_for_block *next = arc_for_block_first;
-                    char *ptr = new char[sizeof(arc_for_block)+1];
+                    char *ptr = (char *) arena -> allocate(sizeof(arc_for_block)+1);
                     if (!ptr) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
                     if ((PTR_CAST)ptr & 1) arc_for_block_first = (arc_for_block *) (ptr + 1);
                     else              arc_for_block_first = (arc_for_block *) ptr;
@@ -222,7 +226,7 @@ void Graph::prepare_graph()
                 if (ab_rev == NULL)
                 {
                     arc_rev_block *next = arc_rev_block_first;
-                    char *ptr = new char[sizeof(arc_rev_block)+1];
+                    char *ptr = (char *) arena -> allocate(sizeof(arc_rev_block)+1);
                     if (!ptr) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
                     if ((PTR_CAST)ptr & 1) arc_rev_block_first = (arc_rev_block *) (ptr + 1);
                     else              arc_rev_block_first = (arc_rev_block *) ptr;
@@ -52,6 +52,7 @@
 
 
 #include "block.h"
+#include "BlockArena.h"
 #include "mrf.h"
 
 /*
@@ -72,7 +73,11 @@ public:
         SINK    = 1
     } termtype; /* terminals */
 
+#ifdef MRF_COMPACT_TYPES
+    typedef int captype;    /* capacities are sums of 16-bit costs, see mrf.h */
+#else
     typedef MRF::CostVal captype;
+#endif
 
     /* Type of total flow */
     typedef MRF::EnergyVal flowtype;
@@ -84,8 +89,13 @@ public:
     /* Constructor. Optional argument is the pointer to the
        function which will be called if an error occurs;
        an error message is passed to this function. If this
-       argument is omitted, exit(1) will be called. */
-    Graph(void (*err_function)(const char *) = NULL);
+       argument is omitted, exit(1) will be called.
+       Node and arc blocks are taken from 'arena' and given
+       back to it by the destructor, so that graphs built one
+       after another (e.g. one per expansion move) reuse the
+       same memory. If it is omitted, the graph uses an arena
+       of its own. */
+    Graph(void (*err_function)(const char *) = NULL, BlockArena *arena = NULL);
 
     /* Destructor */
     ~Graph();
@@ -233,6 +243,9 @@ private:
     arc_rev_block       *arc_rev_block_first;
     DBlock<nodeptr>     *nodeptr_block;
 
+    BlockArena          *arena;
+    bool                own_arena;
+
     void    (*error_function)(const char *);  /* this function is called if a error occurs,
                                            with a corresponding error message
                                            (or exit(1) is called if it's NULL) */
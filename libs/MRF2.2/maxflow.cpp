@@ -660,7 +660,7 @@ Graph::flowtype Graph::maxflow()
 
     prepare_graph();
     maxflow_init();
-    nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
+    nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function, arena);
 
     while ( 1 )
     {
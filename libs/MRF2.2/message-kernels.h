@@ -0,0 +1,650 @@
+// message-kernels.h -- vectorized message updates of TRW-S and BP-S
+//
+// Both solvers represent a message as an array of K values (one per label)
+// and spend almost all of their time in a few operations on such arrays:
+// summing messages, normalizing them and computing the min-convolution of
+// a message with the smoothness term.  This header provides these
+// operations for both message types (TRWS::REAL = double, BPS::REAL =
+// CostVal = float).  With MRF_COMPACT_TYPES (see mrf.h) the costs are short
+// and so are the messages of BP-S and HBP, whose arithmetic saturates at the
+// limits of short instead of wrapping around; the largest value stands in
+// for +inf.
+//
+// The instruction set is chosen at compile time:
+//   __AVX2__             8 floats / 4 doubles / 8 shorts per register
+//   SSE2 (every x86-64)  4 floats / 2 doubles / 8 shorts per register
+//   otherwise            scalar code
+// Define MRF_NO_SIMD to force the scalar code.
+//
+// Functions that need temporary storage take it as an argument, so that the
+// solvers can allocate it once instead of in every call.
+
+#ifndef __MESSAGE_KERNELS_H__
+#define __MESSAGE_KERNELS_H__
+
+#include <limits>
+#include <limits.h>
+#include "mrf.h"
+
+#if !defined(MRF_NO_SIMD) && defined(__AVX2__)
+#define MRF_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(MRF_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MRF_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//                  Registers of W message values                          //
+/////////////////////////////////////////////////////////////////////////////
+
+// Every register type provides element-wise arithmetic and
+//   ramp()            (0, 1, ..., W-1)
+//   prefixMin(v)      lane i := min(v[0..i])
+//   suffixMin(v)      lane i := min(v[i..W-1])
+//   broadcastFirst/Last(v)
+//   horizontalMin(v)
+
+template <typename REAL>
+struct ScalarRegister
+{
+    typedef REAL Scalar;
+    typedef REAL T;
+    enum { WIDTH = 1 };
+
+    static T load(const REAL* p) { return *p; }
+    static T loadCost(const MRF::CostVal* p) { return (REAL) *p; }
+    static void store(REAL* p, T v) { *p = v; }
+    static T set1(REAL a) { return a; }
+    static T add(T a, T b) { return a + b; }
+    static T sub(T a, T b) { return a - b; }
+    static T mul(T a, T b) { return a * b; }
+    static T min(T a, T b) { return (a < b) ? a : b; }
+    static T ramp() { return 0; }
+    static T prefixMin(T v) { return v; }
+    static T suffixMin(T v) { return v; }
+    static T broadcastFirst(T v) { return v; }
+    static T broadcastLast(T v) { return v; }
+    static REAL horizontalMin(T v) { return v; }
+};
+
+template <>
+struct ScalarRegister<short>
+{
+    typedef short Scalar;
+    typedef short T;
+    enum { WIDTH = 1 };
+
+    static T saturate(int a) { return (T) ((a > SHRT_MAX) ? SHRT_MAX : (a < SHRT_MIN) ? SHRT_MIN : a); }
+
+    static T load(const short* p) { return *p; }
+    static T loadCost(const MRF::CostVal* p) { return (short) *p; }
+    static void store(short* p, T v) { *p = v; }
+    static T set1(short a) { return a; }
+    static T add(T a, T b) { return saturate(a + b); }
+    static T sub(T a, T b) { return saturate(a - b); }
+    static T mul(T a, T b) { return saturate(a * b); }
+    static T min(T a, T b) { return (a < b) ? a : b; }
+    static T ramp() { return 0; }
+    static T prefixMin(T v) { return v; }
+    static T suffixMin(T v) { return v; }
+    static T broadcastFirst(T v) { return v; }
+    static T broadcastLast(T v) { return v; }
+    static short horizontalMin(T v) { return v; }
+};
+
+// +inf of the message type, the largest value of integer messages
+template <typename REAL>
+inline REAL Infinity()
+{
+    return (std::numeric_limits<REAL>::has_infinity) ? std::numeric_limits<REAL>::infinity() : std::numeric_limits<REAL>::max();
+}
+
+#if defined(MRF_SIMD_AVX2)
+
+struct FloatRegister
+{
+    typedef float Scalar;
+    typedef __m256 T;
+    enum { WIDTH = 8 };
+
+    static T load(const float* p) { return _mm256_loadu_ps(p); }
+#ifdef MRF_COMPACT_TYPES
+    static T loadCost(const MRF::CostVal* p)
+    {
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) p)));
+    }
+#else
+    static T loadCost(const MRF::CostVal* p) { return _mm256_loadu_ps(p); }
+#endif
+    static void store(float* p, T v) { _mm256_storeu_ps(p, v); }
+    static T set1(float a) { return _mm256_set1_ps(a); }
+    static T add(T a, T b) { return _mm256_add_ps(a, b); }
+    static T sub(T a, T b) { return _mm256_sub_ps(a, b); }
+    static T mul(T a, T b) { return _mm256_mul_ps(a, b); }
+    static T min(T a, T b) { return _mm256_min_ps(a, b); }
+    static T ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+    static T prefixMin(T v)
+    {
+	const T inf = set1(std::numeric_limits<float>::infinity());
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)), inf, 0x01));
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5)), inf, 0x03));
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3)), inf, 0x0F));
+	return v;
+    }
+
+    static T suffixMin(T v)
+    {
+	const T inf = set1(std::numeric_limits<float>::infinity());
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 7)), inf, 0x80));
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 7, 7)), inf, 0xC0));
+	v = min(v, _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(4, 5, 6, 7, 7, 7, 7, 7)), inf, 0xF0));
+	return v;
+    }
+
+    static T broadcastFirst(T v) { return _mm256_broadcastss_ps(_mm256_castps256_ps128(v)); }
+    static T broadcastLast(T v) { return _mm256_permutevar8x32_ps(v, _mm256_set1_epi32(7)); }
+
+    static float horizontalMin(T v)
+    {
+	__m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_min_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(m);
+    }
+};
+
+struct DoubleRegister
+{
+    typedef double Scalar;
+    typedef __m256d T;
+    enum { WIDTH = 4 };
+
+    static T load(const double* p) { return _mm256_loadu_pd(p); }
+#ifdef MRF_COMPACT_TYPES
+    static T loadCost(const MRF::CostVal* p)
+    {
+	return _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) p)));
+    }
+#else
+    static T loadCost(const MRF::CostVal* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+#endif
+    static void store(double* p, T v) { _mm256_storeu_pd(p, v); }
+    static T set1(double a) { return _mm256_set1_pd(a); }
+    static T add(T a, T b) { return _mm256_add_pd(a, b); }
+    static T sub(T a, T b) { return _mm256_sub_pd(a, b); }
+    static T mul(T a, T b) { return _mm256_mul_pd(a, b); }
+    static T min(T a, T b) { return _mm256_min_pd(a, b); }
+    static T ramp() { return _mm256_setr_pd(0, 1, 2, 3); }
+
+    static T prefixMin(T v)
+    {
+	const T inf = set1(std::numeric_limits<double>::infinity());
+	v = min(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2, 1, 0, 0)), inf, 0x1));
+	v = min(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 0, 0, 0)), inf, 0x3));
+	return v;
+    }
+
+    static T suffixMin(T v)
+    {
+	const T inf = set1(std::numeric_limits<double>::infinity());
+	v = min(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 2, 1)), inf, 0x8));
+	v = min(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 2)), inf, 0xC));
+	return v;
+    }
+
+    static T broadcastFirst(T v) { return _mm256_permute4x64_pd(v, 0x00); }
+    static T broadcastLast(T v) { return _mm256_permute4x64_pd(v, 0xFF); }
+
+    static double horizontalMin(T v)
+    {
+	__m128d m = _mm_min_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+	return _mm_cvtsd_f64(m);
+    }
+};
+
+#elif defined(MRF_SIMD_SSE2)
+
+struct FloatRegister
+{
+    typedef float Scalar;
+    typedef __m128 T;
+    enum { WIDTH = 4 };
+
+    static T load(const float* p) { return _mm_loadu_ps(p); }
+#ifdef MRF_COMPACT_TYPES
+    // sign extension: each short in the upper half of a 32-bit lane, shifted down
+    static T loadCost(const MRF::CostVal* p)
+    {
+	__m128i c = _mm_loadl_epi64((const __m128i*) p);
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16));
+    }
+#else
+    static T loadCost(const MRF::CostVal* p) { return _mm_loadu_ps(p); }
+#endif
+    static void store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T set1(float a) { return _mm_set1_ps(a); }
+    static T add(T a, T b) { return _mm_add_ps(a, b); }
+    static T sub(T a, T b) { return _mm_sub_ps(a, b); }
+    static T mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static T min(T a, T b) { return _mm_min_ps(a, b); }
+    static T ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+
+    // shifts the lanes by whole bytes and fills the vacated lanes with
+    // +inf (the shifted-in zero bits OR'ed with the bits of +inf)
+    static T prefixMin(T v)
+    {
+	const float inf = std::numeric_limits<float>::infinity();
+	__m128i i = _mm_castps_si128(v);
+	v = min(v, _mm_or_ps(_mm_castsi128_ps(_mm_slli_si128(i, 4)), _mm_setr_ps(inf, 0, 0, 0)));
+	i = _mm_castps_si128(v);
+	v = min(v, _mm_or_ps(_mm_castsi128_ps(_mm_slli_si128(i, 8)), _mm_setr_ps(inf, inf, 0, 0)));
+	return v;
+    }
+
+    static T suffixMin(T v)
+    {
+	const float inf = std::numeric_limits<float>::infinity();
+	__m128i i = _mm_castps_si128(v);
+	v = min(v, _mm_or_ps(_mm_castsi128_ps(_mm_srli_si128(i, 4)), _mm_setr_ps(0, 0, 0, inf)));
+	i = _mm_castps_si128(v);
+	v = min(v, _mm_or_ps(_mm_castsi128_ps(_mm_srli_si128(i, 8)), _mm_setr_ps(0, 0, inf, inf)));
+	return v;
+    }
+
+    static T broadcastFirst(T v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)); }
+    static T broadcastLast(T v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+
+    static float horizontalMin(T v)
+    {
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+    }
+};
+
+struct DoubleRegister
+{
+    typedef double Scalar;
+    typedef __m128d T;
+    enum { WIDTH = 2 };
+
+    static T load(const double* p) { return _mm_loadu_pd(p); }
+    static T loadCost(const MRF::CostVal* p)
+    {
+#ifdef MRF_COMPACT_TYPES
+	__m128i c = _mm_cvtsi32_si128(*(const int*) p);
+	return _mm_cvtepi32_pd(_mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16));
+#else
+	return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*) p)));
+#endif
+    }
+    static void store(double* p, T v) { _mm_storeu_pd(p, v); }
+    static T set1(double a) { return _mm_set1_pd(a); }
+    static T add(T a, T b) { return _mm_add_pd(a, b); }
+    static T sub(T a, T b) { return _mm_sub_pd(a, b); }
+    static T mul(T a, T b) { return _mm_mul_pd(a, b); }
+    static T min(T a, T b) { return _mm_min_pd(a, b); }
+    static T ramp() { return _mm_setr_pd(0, 1); }
+
+    static T prefixMin(T v)
+    {
+	return min(v, _mm_unpacklo_pd(_mm_set_sd(std::numeric_limits<double>::infinity()), v));
+    }
+
+    static T suffixMin(T v)
+    {
+	return min(v, _mm_unpackhi_pd(v, _mm_set1_pd(std::numeric_limits<double>::infinity())));
+    }
+
+    static T broadcastFirst(T v) { return _mm_unpacklo_pd(v, v); }
+    static T broadcastLast(T v) { return _mm_unpackhi_pd(v, v); }
+
+    static double horizontalMin(T v) { return _mm_cvtsd_f64(_mm_min_sd(v, _mm_unpackhi_pd(v, v))); }
+};
+
+#else
+
+typedef ScalarRegister<float> FloatRegister;
+typedef ScalarRegister<double> DoubleRegister;
+
+#endif
+
+#if defined(MRF_COMPACT_TYPES) && (defined(MRF_SIMD_AVX2) || defined(MRF_SIMD_SSE2))
+
+// 8 shorts per register with AVX2 as well: messages have tens of labels, of
+// which 16-lane registers would leave too many to the scalar code
+struct ShortRegister
+{
+    typedef short Scalar;
+    typedef __m128i T;
+    enum { WIDTH = 8 };
+
+    static T load(const short* p) { return _mm_loadu_si128((const T*) p); }
+    static T loadCost(const MRF::CostVal* p) { return _mm_loadu_si128((const T*) p); }
+    static void store(short* p, T v) { _mm_storeu_si128((T*) p, v); }
+    static T set1(short a) { return _mm_set1_epi16(a); }
+    static T add(T a, T b) { return _mm_adds_epi16(a, b); }
+    static T sub(T a, T b) { return _mm_subs_epi16(a, b); }
+    static T min(T a, T b) { return _mm_min_epi16(a, b); }
+    static T ramp() { return _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7); }
+
+    // full 32-bit products, packed back with saturation
+    static T mul(T a, T b)
+    {
+	T lo = _mm_mullo_epi16(a, b), hi = _mm_mulhi_epi16(a, b);
+	return _mm_packs_epi32(_mm_unpacklo_epi16(lo, hi), _mm_unpackhi_epi16(lo, hi));
+    }
+
+    // as FloatRegister, the vacated lanes are OR'ed with +inf = 0x7fff
+    static T prefixMin(T v)
+    {
+	const short inf = SHRT_MAX;
+	v = min(v, _mm_or_si128(_mm_slli_si128(v, 2), _mm_setr_epi16(inf, 0, 0, 0, 0, 0, 0, 0)));
+	v = min(v, _mm_or_si128(_mm_slli_si128(v, 4), _mm_setr_epi16(inf, inf, 0, 0, 0, 0, 0, 0)));
+	v = min(v, _mm_or_si128(_mm_slli_si128(v, 8), _mm_setr_epi16(inf, inf, inf, inf, 0, 0, 0, 0)));
+	return v;
+    }
+
+    static T suffixMin(T v)
+    {
+	const short inf = SHRT_MAX;
+	v = min(v, _mm_or_si128(_mm_srli_si128(v, 2), _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, inf)));
+	v = min(v, _mm_or_si128(_mm_srli_si128(v, 4), _mm_setr_epi16(0, 0, 0, 0, 0, 0, inf, inf)));
+	v = min(v, _mm_or_si128(_mm_srli_si128(v, 8), _mm_setr_epi16(0, 0, 0, 0, inf, inf, inf, inf)));
+	return v;
+    }
+
+    static T broadcastFirst(T v) { return _mm_shuffle_epi32(_mm_shufflelo_epi16(v, 0), 0); }
+    static T broadcastLast(T v) { return _mm_shuffle_epi32(_mm_shufflehi_epi16(v, 0xFF), 0xFF); }
+
+    static short horizontalMin(T v)
+    {
+	v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_epi16(v, _mm_srli_epi32(v, 16));
+	return (short) _mm_cvtsi128_si32(v);
+    }
+};
+
+#elif defined(MRF_COMPACT_TYPES)
+
+typedef ScalarRegister<short> ShortRegister;
+
+#endif
+
+template <typename REAL> struct RegisterOf;
+template <> struct RegisterOf<float>  { typedef FloatRegister Type; };
+template <> struct RegisterOf<double> { typedef DoubleRegister Type; };
+#ifdef MRF_COMPACT_TYPES
+template <> struct RegisterOf<short>  { typedef ShortRegister Type; };
+#endif
+
+// scalar parameters of the functions below are declared as Scalar<REAL>::Type,
+// so that REAL is deduced from the message pointers only
+template <typename REAL> struct Scalar { typedef REAL Type; };
+
+// number of values of the scratch buffer required by UpdateMessageL1()
+template <typename REAL>
+inline int PaddedMessageLength(int K)
+{
+    const int W = RegisterOf<REAL>::Type::WIDTH;
+    return (K + W - 1) / W * W;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//                  Operations on vectors (arrays of size K)               //
+/////////////////////////////////////////////////////////////////////////////
+
+template <typename REAL>
+inline void CopyVector(REAL* to, const MRF::CostVal* from, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    int k;
+
+    for (k=0; k+R::WIDTH<=K; k+=R::WIDTH) R::store(to+k, R::loadCost(from+k));
+    for ( ; k<K; k++) to[k] = (REAL) from[k];
+}
+
+template <typename REAL>
+inline void AddVector(REAL* to, const REAL* from, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    int k;
+
+    for (k=0; k+R::WIDTH<=K; k+=R::WIDTH) R::store(to+k, R::add(R::load(to+k), R::load(from+k)));
+    for ( ; k<K; k++) to[k] = ScalarRegister<REAL>::add(to[k], from[k]);
+}
+
+template <typename REAL>
+inline REAL MinVector(const REAL* D, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    typename R::T m = R::set1(Infinity<REAL>());
+    int k;
+
+    for (k=0; k+R::WIDTH<=K; k+=R::WIDTH) m = R::min(m, R::load(D+k));
+    REAL delta = R::horizontalMin(m);
+    for ( ; k<K; k++) if (delta > D[k]) delta = D[k];
+
+    return delta;
+}
+
+// D[k] := min(D[k] - delta, bound)
+template <typename REAL>
+inline void SubtractAndTruncate(REAL* D, typename Scalar<REAL>::Type delta, typename Scalar<REAL>::Type bound, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    typedef ScalarRegister<REAL> S;
+    const typename R::T d = R::set1(delta), b = R::set1(bound);
+    int k;
+
+    for (k=0; k+R::WIDTH<=K; k+=R::WIDTH) R::store(D+k, R::min(R::sub(R::load(D+k), d), b));
+    for ( ; k<K; k++) D[k] = S::min(S::sub(D[k], delta), bound);
+}
+
+template <typename REAL>
+inline REAL SubtractMin(REAL *D, int K)
+{
+    REAL delta = MinVector(D, K);
+    SubtractAndTruncate(D, delta, Infinity<REAL>(), K);
+    return delta;
+}
+
+// Di[k] := gamma*Di_hat[k] - M[k], returns min_k Di[k]
+template <typename REAL>
+inline REAL ExcludeMessage(REAL* Di, const REAL* Di_hat, const REAL* M, typename Scalar<REAL>::Type gamma, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    typedef ScalarRegister<REAL> S;
+    const typename R::T g = R::set1(gamma);
+    typename R::T m = R::set1(Infinity<REAL>());
+    int k;
+
+    for (k=0; k+R::WIDTH<=K; k+=R::WIDTH)
+	{
+	    typename R::T d = R::sub(R::mul(g, R::load(Di_hat+k)), R::load(M+k));
+	    m = R::min(m, d);
+	    R::store(Di+k, d);
+	}
+    REAL delta = R::horizontalMin(m);
+    for ( ; k<K; k++)
+	{
+	    Di[k] = S::sub(S::mul(gamma, Di_hat[k]), M[k]);
+	    if (delta > Di[k]) delta = Di[k];
+	}
+
+    return delta;
+}
+
+// M[kj] := min_{ki} (Di[ki] + lambda*V[ki*K + kj])
+//
+// Vectorized over kj, every row of V is read contiguously.
+template <typename REAL>
+inline void MinConvolutionColumns(REAL* M, const REAL* Di, const MRF::CostVal* V, typename Scalar<REAL>::Type lambda, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    typedef ScalarRegister<REAL> S;
+    const typename R::T l = R::set1(lambda);
+    int ki, kj;
+
+    for (kj=0; kj+R::WIDTH<=K; kj+=R::WIDTH)
+	{
+	    typename R::T m = R::add(R::set1(Di[0]), R::mul(l, R::loadCost(V+kj)));
+	    for (ki=1; ki<K; ki++)
+		{
+		    m = R::min(m, R::add(R::set1(Di[ki]), R::mul(l, R::loadCost(V+ki*K+kj))));
+		}
+	    R::store(M+kj, m);
+	}
+    for ( ; kj<K; kj++)
+	{
+	    M[kj] = S::add(Di[0], S::mul(lambda, (REAL) V[kj]));
+	    for (ki=1; ki<K; ki++)
+		{
+		    REAL m = S::add(Di[ki], S::mul(lambda, (REAL) V[ki*K+kj]));
+		    if (M[kj] > m) M[kj] = m;
+		}
+	}
+}
+
+// M[kj] := min_{ki} (Di[ki] + lambda*V[kj*K + ki])
+//
+// Vectorized over ki with a horizontal minimum per kj.
+template <typename REAL>
+inline void MinConvolutionRows(REAL* M, const REAL* Di, const MRF::CostVal* V, typename Scalar<REAL>::Type lambda, int K)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+    typedef ScalarRegister<REAL> S;
+    const typename R::T l = R::set1(lambda);
+    int ki, kj;
+
+    for (kj=0; kj<K; kj++, V+=K)
+	{
+	    typename R::T m = R::set1(Infinity<REAL>());
+	    for (ki=0; ki+R::WIDTH<=K; ki+=R::WIDTH)
+		{
+		    m = R::min(m, R::add(R::load(Di+ki), R::mul(l, R::loadCost(V+ki))));
+		}
+	    M[kj] = R::horizontalMin(m);
+	    for ( ; ki<K; ki++)
+		{
+		    REAL c = S::add(Di[ki], S::mul(lambda, (REAL) V[ki]));
+		    if (M[kj] > c) M[kj] = c;
+		}
+	}
+}
+
+///////////////////////////////////////////
+//                  L1                   //
+///////////////////////////////////////////
+
+// Message update for V[ki,kj] = lambda*min(|ki - kj|, smoothMax), lambda >= 0:
+//
+// - Set A[k] := gamma*Di_hat[k] - M[k], delta := min_k A[k]
+// - Set M[k] := min(min_j (A[j] + lambda*|j - k|) - delta, lambda*smoothMax)
+// - return delta
+//
+// The lower envelope of the cones is computed by two passes of a running
+// minimum, which are vectorized by substituting A[j] - lambda*j (forward)
+// and F[j] + lambda*j (backward): the running minimum of these values is
+// a prefix (suffix) minimum within a register and a minimum with the value
+// carried over from the previous register.  buf must hold
+// PaddedMessageLength<REAL>(K) values.
+template <typename R>
+inline typename R::Scalar DistanceTransformL1(typename R::Scalar* M, const typename R::Scalar* Di_hat, int K, typename R::Scalar gamma, MRF::CostVal lambda, MRF::CostVal smoothMax, typename R::Scalar* buf)
+{
+    typedef typename R::Scalar REAL;
+    typedef typename R::T T;
+    typedef ScalarRegister<REAL> S;
+    const int W = R::WIDTH;
+    const int padded = (K + W - 1) / W * W;
+    const REAL inf = Infinity<REAL>();
+    const T g = R::set1(gamma), step = R::set1(S::mul((REAL) lambda, (REAL) W));
+    REAL tail[W];
+    int i, k;
+
+    // forward pass: buf[k] := min_{j<=k} (A[j] + lambda*(k-j))
+    T offset = R::mul(R::ramp(), R::set1(lambda));
+    T carry = R::set1(inf), m = R::set1(inf);
+    for (k=0; k<K; k+=W)
+	{
+	    T a;
+	    if (k + W <= K) a = R::sub(R::mul(g, R::load(Di_hat+k)), R::load(M+k));
+	    else
+		{
+		    for (i=0; i<W; i++) tail[i] = (k+i < K) ? S::sub(S::mul(gamma, Di_hat[k+i]), M[k+i]) : inf;
+		    a = R::load(tail);
+		}
+	    m = R::min(m, a);
+	    T s = R::min(R::prefixMin(R::sub(a, offset)), carry);
+	    carry = R::broadcastLast(s);
+	    R::store(buf+k, R::add(s, offset));
+	    offset = R::add(offset, step);
+	}
+    for (k=K; k<padded; k++) buf[k] = inf;
+
+    REAL delta = R::horizontalMin(m);
+    const T d = R::set1(delta), bound = R::set1(ScalarRegister<MRF::CostVal>::mul(lambda, smoothMax));
+
+    // backward pass: M[k] := min(min_{j>=k} (buf[j] + lambda*(j-k)) - delta, lambda*smoothMax)
+    k = padded - W;
+    offset = R::add(R::mul(R::ramp(), R::set1(lambda)), R::set1(S::mul((REAL) lambda, (REAL) k)));
+    carry = R::set1(inf);
+    for ( ; k>=0; k-=W)
+	{
+	    T s = R::min(R::suffixMin(R::add(R::load(buf+k), offset)), carry);
+	    carry = R::broadcastFirst(s);
+	    T r = R::min(R::sub(R::sub(s, offset), d), bound);
+	    if (k + W <= K) R::store(M+k, r);
+	    else
+		{
+		    R::store(tail, r);
+		    for (i=0; k+i<K; i++) M[k+i] = tail[i];
+		}
+	    offset = R::sub(offset, step);
+	}
+
+    return delta;
+}
+
+// the sequential version of the above, faster for messages of few registers
+template <typename REAL>
+inline REAL DistanceTransformL1(REAL* M, const REAL* Di_hat, int K, typename Scalar<REAL>::Type gamma, MRF::CostVal lambda, MRF::CostVal smoothMax)
+{
+    typedef ScalarRegister<REAL> S;
+    const REAL bound = ScalarRegister<MRF::CostVal>::mul(lambda, smoothMax);
+    int k;
+    REAL delta;
+
+    delta = M[0] = S::sub(S::mul(gamma, Di_hat[0]), M[0]);
+    for (k=1; k<K; k++)
+	{
+	    M[k] = S::sub(S::mul(gamma, Di_hat[k]), M[k]);
+	    if (delta > M[k]) delta = M[k];
+	    M[k] = S::min(M[k], S::add(M[k-1], (REAL) lambda));
+	}
+
+    k--;
+    M[k] = S::min(S::sub(M[k], delta), bound);
+    for (k--; k>=0; k--)
+	{
+	    M[k] = S::min(S::sub(M[k], delta), S::add(M[k+1], (REAL) lambda));
+	    M[k] = S::min(M[k], bound);
+	}
+
+    return delta;
+}
+
+template <typename REAL>
+inline REAL UpdateMessageL1(REAL* M, const REAL* Di_hat, int K, typename Scalar<REAL>::Type gamma, MRF::CostVal lambda, MRF::CostVal smoothMax, REAL* buf)
+{
+    typedef typename RegisterOf<REAL>::Type R;
+
+    if (K < 2*R::WIDTH) return DistanceTransformL1(M, Di_hat, K, gamma, lambda, smoothMax);
+    else                return DistanceTransformL1<R>(M, Di_hat, K, gamma, lambda, smoothMax, buf);
+}
+
+#endif /* __MESSAGE_KERNELS_H__ */
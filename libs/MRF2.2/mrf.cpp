@@ -59,6 +59,8 @@ void MRF::commonInitialization(EnergyFunction *e)
     m_initialized = 0;
     m_e = e;
     m_allocateArrayForSmoothnessCostFn = true;
+
+    if (m_nLabels > MAX_LABELS) { fprintf(stderr, "More than %d labels, exiting!\n", (int) MAX_LABELS); exit(1); }
 }
 
 
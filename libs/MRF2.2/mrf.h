@@ -37,19 +37,45 @@ public:
     
 
     // *********** EVALUATING THE ENERGY
+#ifdef MRF_COMPACT_TYPES
+    // Compact types: labels of one byte and costs quantized to 16 bits, which
+    // halve the data costs and the messages of BP-S and HBP and quarter the
+    // labeling. Costs are integers, scale them (and lambda) so that their sums
+    // along a message stay well below MAX_COST; the message updates saturate.
+    typedef unsigned char Label;
+    typedef float EnergyVal;        /* The total energy of a labeling */
+    typedef short CostVal;          /* costs of individual terms of the energy */
+    enum { MAX_LABELS = 256, MAX_COST = 32767 };
+#else
     typedef int Label;
     typedef float EnergyVal;        /* The total energy of a labeling */
     typedef float CostVal;          /* costs of individual terms of the energy */
+    enum { MAX_LABELS = 0x7fffffff };
+#endif
+
+    // Converts a cost to CostVal: rounded to the nearest integer and clamped
+    // to [-MAX_COST, MAX_COST] with compact types, unchanged otherwise
+    static CostVal toCostVal(double cost)
+    {
+#ifdef MRF_COMPACT_TYPES
+	if (cost >= MAX_COST) return MAX_COST;
+	if (cost <= -MAX_COST) return -MAX_COST;
+	return (CostVal) ((cost >= 0) ? cost + 0.5 : cost - 0.5);
+#else
+	return (CostVal) cost;
+#endif
+    }
  
     EnergyVal totalEnergy();      /* returns energy of current labeling */
     virtual EnergyVal dataEnergy() = 0;        /* returns the data part of the energy */
     virtual EnergyVal smoothnessEnergy() = 0;  /* returns the smoothness part of the energy */
 
-    //Functional representation for data costs
-    typedef CostVal (*DataCostFn)(int pix, Label l); 
+    //Functional representation for data costs (labels are passed as int,
+    // whatever the type of Label)
+    typedef CostVal (*DataCostFn)(int pix, int l); 
 
     // Functional representation for the general cost function type 
-    typedef CostVal (*SmoothCostGeneralFn)(int pix1, int pix2,  Label l1, Label l2); 
+    typedef CostVal (*SmoothCostGeneralFn)(int pix1, int pix2,  int l1, int l2); 
 
     // For general smoothness functions, some implementations try to cache all function values in an array
     // for efficiency.  To prevent this, call the following function before calling initialize():
@@ -72,6 +98,8 @@ public:
     // *********** ACCESS TO SOLUTION
     // Returns pointer to array of size nPixels. Client may then read/write solution (but not deallocate array).
     virtual Label* getAnswerPtr()= 0;
+    // Returns nPixels
+    int pixelCount(){return m_nPixels;};
     // returns the label of the input pixel
     virtual Label getLabel(int pixel)= 0;
     // sets label of a pixel
@@ -87,6 +115,14 @@ public:
     // This function returns lower bound computed by the algorithm (if any)
     // By default, it returns 0.
     virtual double lowerBound(){return((double) 0);};
+
+    // Returns true if the algorithm computes lowerBound()
+    virtual bool hasLowerBound(){return false;};
+
+    // Returns the number of labels changed by the last call of optimize(),
+    // counted by the algorithm while it writes the labeling, or -1 if the
+    // algorithm does not count them (by default).
+    virtual int changedLabelCount(){return -1;};
     // Returns 0 if the energy is not suitable for current optimization algorithm 
     // Returns 1 if the energy is suitable for current optimization algorithm
     // Returns 2 if current optimizaiton algorithm does not check the energy 
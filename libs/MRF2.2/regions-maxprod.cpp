@@ -4,7 +4,6 @@
 #include <stdio.h>
 #include "MaxProdBP.h"
 #include "assert.h"
-int numIterRun;
 // Some of the GBP code has been disabled here
 
 #define mexPrintf printf
@@ -15,12 +14,6 @@ int numIterRun;
 #define RIGHT 3
 
 
-OneNodeCluster::OneNodeCluster()
-{
-}
-
-int OneNodeCluster::numStates;
-
 FLOATTYPE vec_min(FLOATTYPE *vec, int length)
 {
 
@@ -43,7 +36,7 @@ FLOATTYPE vec_max(FLOATTYPE *vec, int length)
   return max;
 }
 
-void getPsiMat(OneNodeCluster &/*cluster*/, FLOATTYPE *&destMatrix, 
+void getPsiMat(FLOATTYPE *&destMatrix, 
 	       int r, int c, MaxProdBP *mrf, int direction, FLOATTYPE &var_weight)
 {
   int mrfHeight = mrf->getHeight();
@@ -144,7 +137,7 @@ void getPsiMat(OneNodeCluster &/*cluster*/, FLOATTYPE *&destMatrix,
 }
 
 
-void getVarWeight(OneNodeCluster &/*cluster*/,  int r, int c, MaxProdBP *mrf, int direction, FLOATTYPE &var_weight)
+void getVarWeight(int r, int c, MaxProdBP *mrf, int direction, FLOATTYPE &var_weight)
 {
   MRF::CostVal weight_mod = 1;
   if(mrf->varWeights())
@@ -163,30 +156,6 @@ void getVarWeight(OneNodeCluster &/*cluster*/,  int r, int c, MaxProdBP *mrf, in
   //  printf("%d\n",weight_mod);
 }
 
-void initOneNodeMsgMem(OneNodeCluster *nodeArray, FLOATTYPE *memChunk, 
-		       const int numNodes, const int msgChunkSize)
-{
-  FLOATTYPE *currPtr = memChunk;
-  OneNodeCluster *currNode = nodeArray;
-  FLOATTYPE *nextRoundChunk = new FLOATTYPE[nodeArray[1].numStates];
-  // MEMORY LEAK? where does this ever get deleted??
-  for(int i = 0; i < numNodes; i++)
-  {
-
-    currNode->receivedMsgs[0] = currPtr; currPtr+=msgChunkSize;
-    currNode->receivedMsgs[1] = currPtr; currPtr+=msgChunkSize;
-    currNode->receivedMsgs[2] = currPtr; currPtr+=msgChunkSize;
-    currNode->receivedMsgs[3] = currPtr; currPtr+=msgChunkSize;
-
-    currNode->nextRoundReceivedMsgs[0] = nextRoundChunk;
-    currNode->nextRoundReceivedMsgs[1] = nextRoundChunk;
-    currNode->nextRoundReceivedMsgs[2] = nextRoundChunk;
-    currNode->nextRoundReceivedMsgs[3] = nextRoundChunk;
-
-    currNode++;
-  }
-}
-
 inline void l1_dist_trans_comp(FLOATTYPE smoothMax, FLOATTYPE c, FLOATTYPE* tmpMsgDest, FLOATTYPE * msgProd, int numStates)
 {
   int q;
@@ -292,64 +261,47 @@ inline void l2_dist_trans_comp(FLOATTYPE smoothMax, FLOATTYPE c, FLOATTYPE* tmpM
 
 }
 
-void OneNodeCluster::ComputeMsgRight(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf)
+// Computes the message the node at (r,c) sends in the given direction.
+// msgProd holds the node's data cost minus all messages it received, except
+// the one from the receiver:
+//   msgDest[j] = -min_i(msgProd[i] + V(i,j)),
+// normalized to msgDest[0] = 0.
+void computeMessage(FLOATTYPE *msgDest, FLOATTYPE *msgProd, int r, int c, int direction, MaxProdBP *mrf)
 {
+  const int numStates = mrf->getNLabels();
 
-
-  FLOATTYPE *nodeLeftMsg = receivedMsgs[LEFT],
-    *nodeDownMsg = receivedMsgs[DOWN],
-    *nodeUpMsg =    receivedMsgs[UP];
-
-  FLOATTYPE weight_mod;
-  getVarWeight(*this,r,c,mrf,RIGHT,weight_mod);
-  
-  FLOATTYPE     *tmpMsgDest =msgDest;
-
-  
-  if(mrf->m_type==MaxProdBP::L1 || mrf->m_type==MaxProdBP::L2)
+  if(mrf->getSmoothType()==MRF::THREE_PARAM)
   {
-    FLOATTYPE *msgProd = new FLOATTYPE[numStates];
+    FLOATTYPE weight_mod;
+    getVarWeight(r,c,mrf,direction,weight_mod);
+
     const FLOATTYPE lambda = (FLOATTYPE)mrf->m_lambda;
     const FLOATTYPE smoothMax = (FLOATTYPE)mrf->m_smoothMax;
-    for(int leftNodeInd = 0; leftNodeInd < numStates; leftNodeInd++)
-    {
-      msgProd[leftNodeInd]  = -nodeLeftMsg[leftNodeInd] + 
-	-nodeUpMsg[leftNodeInd] + 
-	-nodeDownMsg[leftNodeInd] + localEv[leftNodeInd];
-    }
-    if(mrf->m_type==MaxProdBP::L1)
-    {
-      l1_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    }
+
+    if(mrf->m_smoothExp==1)
+      l1_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, msgDest, msgProd, numStates);
     else
-    {
-      l2_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    }
-    delete [] msgProd;
+      l2_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, msgDest, msgProd, numStates);
   }
   else if ((mrf->getSmoothType()==MRF::FUNCTION)||(mrf->getSmoothType()==MRF::ARRAY))
   {
     FLOATTYPE *psiMat, var_weight;
-  
-    getPsiMat(*this,psiMat,r,c,mrf,RIGHT, var_weight);
-    FLOATTYPE *cmessage = msgDest;    
-    for(int rightNodeInd = 0; rightNodeInd < numStates; rightNodeInd++)
+    getPsiMat(psiMat,r,c,mrf,direction, var_weight);
+
+    // psiMat is indexed by (sender, receiver) for messages sent right or down
+    // and by (receiver, sender) for messages sent left or up
+    const int senderStride = ((direction==RIGHT)||(direction==DOWN)) ? numStates : 1;
+    const int receiverStride = numStates + 1 - senderStride;
+    for(int j = 0; j < numStates; j++)
     {
-      
-      *cmessage = 0;
-      for(int leftNodeInd = 0; leftNodeInd < numStates; leftNodeInd++)
+      FLOATTYPE best = 0;
+      for(int i = 0; i < numStates; i++)
       {
-	FLOATTYPE tmp = 	nodeLeftMsg[leftNodeInd] + 
-	  nodeUpMsg[leftNodeInd] + 
-	  nodeDownMsg[leftNodeInd]
-	  - localEv[leftNodeInd] 
-	  - psiMat[leftNodeInd * numStates + rightNodeInd];
-
-	if((tmp > *cmessage)||(leftNodeInd==0))
-	  *cmessage = tmp;
-	
+        FLOATTYPE tmp = msgProd[i] + psiMat[i * senderStride + j * receiverStride];
+        if((tmp < best)||(i==0))
+          best = tmp;
       }
-      cmessage++;
+      msgDest[j] = -best;
     }
   }
   else {
@@ -357,270 +309,184 @@ void OneNodeCluster::ComputeMsgRight(FLOATTYPE *msgDest, int r, int c, MaxProdBP
       exit(1);
   }
 
-    
   FLOATTYPE max = msgDest[0];
   for(int i=0; i < numStates; i++)
     msgDest[i] -= max;
 }
 
-
-// This means, "Compute the message to send left."
-
-void OneNodeCluster::ComputeMsgLeft(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf)
+// blends a newly computed message into the old one, both are contiguous and
+// do not overlap, so the loop is vectorized
+inline void dampMessage(FLOATTYPE * __restrict dest, const FLOATTYPE * __restrict msg, const FLOATTYPE alpha, const int numStates)
 {
+  const FLOATTYPE omalpha = 1.0f - alpha;
+  for(int i = 0; i < numStates; i++)
+    dest[i] = omalpha * dest[i] + alpha * msg[i];
+}
 
-  FLOATTYPE *nodeRightMsg = receivedMsgs[RIGHT],
-    *nodeDownMsg = receivedMsgs[DOWN],
-    *nodeUpMsg =    receivedMsgs[UP];
-
-
-  int do_dist=(int)(mrf->getSmoothType()==MRF::THREE_PARAM);
-  FLOATTYPE *tmpMsgDest=msgDest;
-  if(do_dist)
-  {
-    FLOATTYPE weight_mod;
-    getVarWeight(*this,r,c,mrf,LEFT, weight_mod);
-    
-    FLOATTYPE *msgProd = new FLOATTYPE[numStates];
-      
-    const FLOATTYPE lambda = (FLOATTYPE)mrf->m_lambda;
-
-    const FLOATTYPE smoothMax = (FLOATTYPE)mrf->m_smoothMax;
+inline void subtractMessage(FLOATTYPE * __restrict dest, const FLOATTYPE * __restrict base, const FLOATTYPE * __restrict msg, const int numStates)
+{
+  for(int i = 0; i < numStates; i++)
+    dest[i] = base[i] - msg[i];
+}
 
-    for(int rightNodeInd = 0; rightNodeInd < numStates; rightNodeInd++)
-    {
-      msgProd[rightNodeInd]  = -nodeRightMsg[rightNodeInd] + 
-	-nodeUpMsg[rightNodeInd] + 
-	-nodeDownMsg[rightNodeInd] 
-	+localEv[rightNodeInd] ;
-    }
-    if(mrf->m_smoothExp==1)
-    {      l1_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    }
-    else
-      l2_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    
-    delete [] msgProd;
-  }
-  else if ((mrf->getSmoothType()==MRF::FUNCTION)||(mrf->getSmoothType()==MRF::ARRAY))
+// Within a row, only the LEFT and RIGHT messages of the row's nodes are
+// written, so all rows can be processed in parallel (and all columns in
+// computeMessagesUpDown()). The messages received from the other axis do not
+// change during a sweep, so they are subtracted from the data costs once per
+// node (the base sums) before the sweep. Each thread uses its own buffers.
+void computeMessagesLeftRight(MaxProdBP *mrf, const int currRow, const FLOATTYPE alpha)
+{
+  const int numStates = mrf->getNLabels();
+  const int numCols = mrf->getWidth();
+  const int numRows = mrf->getHeight();
+  const FLOATTYPE *localEv = mrf->getExpV() + rowMajorIndex(currRow, 0, numCols) * numStates;
+  const FLOATTYPE *upMsgs = mrf->getMessagePlane(UP);
+  const FLOATTYPE *downMsgs = mrf->getMessagePlane(DOWN);
+  FLOATTYPE *leftMsgs = mrf->getMessagePlane(LEFT) + rowMajorIndex(currRow, 0, numCols) * numStates;
+  FLOATTYPE *rightMsgs = mrf->getMessagePlane(RIGHT) + rowMajorIndex(currRow, 0, numCols) * numStates;
+  FLOATTYPE *msgDest = mrf->getMessageBuffer();
+  FLOATTYPE *msgProd = msgDest + numStates;
+  FLOATTYPE *base = mrf->getBaseBuffer();
+  int col, i;
+
+  for( col = 0; col < numCols; col++)
   {
-    FLOATTYPE *psiMat, var_weight;
-    
-    getPsiMat(*this,psiMat,r,c,mrf,LEFT, var_weight);
-  
-    FLOATTYPE *cmessage = msgDest;
-    
-    for(int leftNodeInd = 0; leftNodeInd < numStates; leftNodeInd++)
-    {
-      
-      *cmessage = 0;
-      for(int rightNodeInd = 0; rightNodeInd < numStates; rightNodeInd++)
-      {
-	FLOATTYPE tmp = 	nodeRightMsg[rightNodeInd] + 
-	  nodeUpMsg[rightNodeInd] + 
-	  nodeDownMsg[rightNodeInd] 
-	  -localEv[rightNodeInd] 
-	  - psiMat[leftNodeInd * numStates + rightNodeInd] ; 
-       
-	if((tmp > *cmessage)||(rightNodeInd==0))
-	  *cmessage = tmp;
-
-      }
-      cmessage++;
-    }
-    
+    const int q = columnMajorIndex(currRow, col, numRows) * numStates;
+    const FLOATTYPE *ev = localEv + col * numStates;
+    FLOATTYPE *b = base + col * numStates;
+    for(i = 0; i < numStates; i++)
+      b[i] = ev[i] - upMsgs[q + i] - downMsgs[q + i];
   }
-  else
-    assert(0);
-
-  
 
-//   FLOATTYPE max = vec_max(msgDest,numStates);
-  FLOATTYPE max = msgDest[0];
-
-  for(int i=0; i < numStates; i++)
-    msgDest[i] -= max;
+  for( col = 0; col < numCols-1; col++)
+  {
+    subtractMessage(msgProd, base + col * numStates, leftMsgs + col * numStates, numStates);
+    computeMessage(msgDest, msgProd, currRow, col, RIGHT, mrf);
+    dampMessage(leftMsgs + (col+1) * numStates, msgDest, alpha, numStates);
+  } 
+  for( col = numCols-1; col > 0; col--)
+  {
+    subtractMessage(msgProd, base + col * numStates, rightMsgs + col * numStates, numStates);
+    computeMessage(msgDest, msgProd, currRow, col, LEFT, mrf);
+    dampMessage(rightMsgs + (col-1) * numStates, msgDest, alpha, numStates);
+  } 
 
 }
 
-void OneNodeCluster::ComputeMsgUp(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf)
+void computeMessagesUpDown(MaxProdBP *mrf, const int currCol, const FLOATTYPE alpha)
 {
-  FLOATTYPE *nodeRightMsg = receivedMsgs[RIGHT],
-    *nodeDownMsg = receivedMsgs[DOWN],
-    *nodeLeftMsg =    receivedMsgs[LEFT];
- 
-
-
-
-  int do_dist=(int)(mrf->getSmoothType()==MRF::THREE_PARAM);
-  if(do_dist)
+  const int numStates = mrf->getNLabels();
+  const int numCols = mrf->getWidth();
+  const int numRows = mrf->getHeight();
+  const FLOATTYPE *localEv = mrf->getExpV();
+  const FLOATTYPE *leftMsgs = mrf->getMessagePlane(LEFT);
+  const FLOATTYPE *rightMsgs = mrf->getMessagePlane(RIGHT);
+  FLOATTYPE *upMsgs = mrf->getMessagePlane(UP) + columnMajorIndex(0, currCol, numRows) * numStates;
+  FLOATTYPE *downMsgs = mrf->getMessagePlane(DOWN) + columnMajorIndex(0, currCol, numRows) * numStates;
+  FLOATTYPE *msgDest = mrf->getMessageBuffer();
+  FLOATTYPE *msgProd = msgDest + numStates;
+  FLOATTYPE *base = mrf->getBaseBuffer();
+  int row, i;
+
+  for(row = 0; row < numRows; row++)
   {
-    FLOATTYPE weight_mod;
-    getVarWeight(*this,r,c,mrf,UP,weight_mod);
-    
-    FLOATTYPE *tmpMsgDest = msgDest;
-    FLOATTYPE *msgProd = new FLOATTYPE[numStates];
-    
-    const FLOATTYPE lambda = (FLOATTYPE)mrf->m_lambda;
-    
-    const FLOATTYPE smoothMax = (FLOATTYPE)mrf->m_smoothMax;
-    
-    for(int downNodeInd = 0; downNodeInd < numStates; downNodeInd++)
-    {
-      msgProd[downNodeInd]  = -nodeRightMsg[downNodeInd] +
-	-nodeLeftMsg[downNodeInd] + 
-	-nodeDownMsg[downNodeInd] + 
-	+localEv[downNodeInd] ;
-    }
-    //       printf("%f %f %f %f\n",nodeLeftMsg[leftNodeInd] ,
-    // 	     nodeUpMsg[leftNodeInd] , 
-    // 	     nodeDownMsg[leftNodeInd] ,localEv[leftNodeInd]);
-    if(mrf->m_smoothExp==1)
-    {      l1_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    }
-    else
-      l2_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    delete [] msgProd;
+    const int p = rowMajorIndex(row, currCol, numCols) * numStates;
+    FLOATTYPE *b = base + row * numStates;
+    for(i = 0; i < numStates; i++)
+      b[i] = localEv[p + i] - leftMsgs[p + i] - rightMsgs[p + i];
   }
-  else if ((mrf->getSmoothType()==MRF::FUNCTION)||(mrf->getSmoothType()==MRF::ARRAY))
+
+  for(row = 0; row < numRows-1; row++)
   {
-    FLOATTYPE *psiMat, var_weight;
-    
-    getPsiMat(*this,psiMat,r,c,mrf,UP, var_weight);
-    
-    FLOATTYPE *cmessage = msgDest;
-    
-    for(int upNodeInd = 0; upNodeInd < numStates; upNodeInd++)
-    {
-      
-      *cmessage = 0;
-      for(int downNodeInd = 0; downNodeInd < numStates; downNodeInd++)
-      {
-	FLOATTYPE tmp = nodeRightMsg[downNodeInd] +
-	  nodeLeftMsg[downNodeInd] + 
-	  nodeDownMsg[downNodeInd] + 
-	  -localEv[downNodeInd] 
-	  -psiMat[upNodeInd * numStates + downNodeInd] ; 
-	
-	if((tmp > *cmessage)||(downNodeInd==0))
-	  *cmessage = tmp;
-	
+    subtractMessage(msgProd, base + row * numStates, upMsgs + row * numStates, numStates);
+    computeMessage(msgDest, msgProd, row, currCol, DOWN, mrf);
+    dampMessage(upMsgs + (row+1) * numStates, msgDest, alpha, numStates);
+  } 
+  for( row = numRows-1; row > 0; row--)
+  {
+    subtractMessage(msgProd, base + row * numStates, downMsgs + row * numStates, numStates);
+    computeMessage(msgDest, msgProd, row, currCol, UP, mrf);
+    dampMessage(downMsgs + (row-1) * numStates, msgDest, alpha, numStates);
+  } 
 
-      }
-      cmessage++;
-    }
-  }
-  else
-    assert(0);
-  FLOATTYPE max = msgDest[0];
-  //  FLOATTYPE max = vec_max(msgDest,numStates);
-  for(int i=0; i < numStates; i++)
-    msgDest[i]  -=max;
 }
 
-void OneNodeCluster::ComputeMsgDown(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf)
+// Red-black schedule: the messages of a node only depend on the messages it
+// received from its four neighbours, which all have the other colour. Every
+// message slot of the other colour is written by exactly one node, so all
+// nodes of one colour can be processed in parallel.
+void computeMessagesCheckerboard(MaxProdBP *mrf, const int currRow, const int parity, const FLOATTYPE alpha)
 {
+  const int numStates = mrf->getNLabels();
+  const int numCols = mrf->getWidth();
+  const int numRows = mrf->getHeight();
+  const FLOATTYPE *localEv = mrf->getExpV();
+  FLOATTYPE *upMsgs = mrf->getMessagePlane(UP);
+  FLOATTYPE *downMsgs = mrf->getMessagePlane(DOWN);
+  FLOATTYPE *leftMsgs = mrf->getMessagePlane(LEFT);
+  FLOATTYPE *rightMsgs = mrf->getMessagePlane(RIGHT);
+  FLOATTYPE *msgDest = mrf->getMessageBuffer();
+  FLOATTYPE *msgProd = msgDest + numStates;
+  FLOATTYPE *base = mrf->getBaseBuffer();
+  int i;
 
-  FLOATTYPE *nodeRightMsg = receivedMsgs[RIGHT],
-    *nodeUpMsg = receivedMsgs[UP],
-    *nodeLeftMsg =    receivedMsgs[LEFT];
- 
-  int do_dist=(int)(mrf->getSmoothType()==MRF::THREE_PARAM);
-  if(do_dist)
+  for(int col = (currRow + parity) % 2; col < numCols; col += 2)
   {
+    const int p = rowMajorIndex(currRow, col, numCols) * numStates;
+    const int q = columnMajorIndex(currRow, col, numRows) * numStates;
 
-    FLOATTYPE weight_mod;
-    getVarWeight(*this,r,c,mrf,DOWN,weight_mod);
-    
-    FLOATTYPE *tmpMsgDest = msgDest;
-    FLOATTYPE *msgProd = new FLOATTYPE[numStates];
-    
-    const FLOATTYPE lambda = (FLOATTYPE)mrf->m_lambda;
-    
-    const FLOATTYPE smoothMax = (FLOATTYPE)mrf->m_smoothMax;
-    
-    for(int upNodeInd = 0; upNodeInd < numStates; upNodeInd++)
+    // data cost minus all received messages
+    for(i = 0; i < numStates; i++)
+      base[i] = localEv[p + i] - leftMsgs[p + i] - rightMsgs[p + i] - upMsgs[q + i] - downMsgs[q + i];
+
+    if(col < numCols-1)
     {
-      msgProd[upNodeInd]  = -nodeRightMsg[upNodeInd] +
-	-nodeLeftMsg[upNodeInd] + 
-      -nodeUpMsg[upNodeInd] +
-      +localEv[upNodeInd] ;
+      for(i = 0; i < numStates; i++)
+        msgProd[i] = base[i] + rightMsgs[p + i];
+      computeMessage(msgDest, msgProd, currRow, col, RIGHT, mrf);
+      dampMessage(leftMsgs + p + numStates, msgDest, alpha, numStates);
     }
-
-    if(mrf->m_smoothExp==1)
-    {      l1_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
+    if(col > 0)
+    {
+      for(i = 0; i < numStates; i++)
+        msgProd[i] = base[i] + leftMsgs[p + i];
+      computeMessage(msgDest, msgProd, currRow, col, LEFT, mrf);
+      dampMessage(rightMsgs + p - numStates, msgDest, alpha, numStates);
     }
-    else
-      l2_dist_trans_comp( weight_mod*smoothMax*lambda, lambda*weight_mod, tmpMsgDest, msgProd, numStates);
-    delete [] msgProd;
-
-  }
-  else if((mrf->getSmoothType()==MRF::FUNCTION)||(mrf->getSmoothType()==MRF::ARRAY))
-  {
-    FLOATTYPE *psiMat, var_weight;
-    
-    getPsiMat(*this,psiMat,r,c,mrf,DOWN, var_weight);
-    
-    FLOATTYPE *cmessage = msgDest;
-    
-    for(int downNodeInd = 0; downNodeInd < numStates; downNodeInd++)
+    if(currRow < numRows-1)
     {
-      
-      *cmessage = 0;
-      for(int upNodeInd = 0; upNodeInd < numStates; upNodeInd++)
-      {
-	FLOATTYPE tmp = 	nodeRightMsg[upNodeInd] +
-	  nodeLeftMsg[upNodeInd] + 
-	  nodeUpMsg[upNodeInd] +
-	  -localEv[upNodeInd] 
-	-psiMat[upNodeInd * numStates + downNodeInd] ; 
-	
-	if((tmp > *cmessage)||(upNodeInd==0))
-	  *cmessage = tmp;
-	
-      }
-      cmessage++;
+      for(i = 0; i < numStates; i++)
+        msgProd[i] = base[i] + downMsgs[q + i];
+      computeMessage(msgDest, msgProd, currRow, col, DOWN, mrf);
+      dampMessage(upMsgs + q + numStates, msgDest, alpha, numStates);
+    }
+    if(currRow > 0)
+    {
+      for(i = 0; i < numStates; i++)
+        msgProd[i] = base[i] + upMsgs[q + i];
+      computeMessage(msgDest, msgProd, currRow, col, UP, mrf);
+      dampMessage(downMsgs + q - numStates, msgDest, alpha, numStates);
     }
-    
   }
-  else
-    assert(0);
-
-  FLOATTYPE max = msgDest[0];
-  //  FLOATTYPE max = vec_max(msgDest,numStates);
-  for(int i=0; i < numStates; i++)
-    msgDest[i] -=max;
-  
-
 }
 
-
-
-
-
-void OneNodeCluster::getBelief(FLOATTYPE *beliefVec)
+int getBeliefMaxInd(MaxProdBP *mrf, const int r, const int c)
 {
-	for(int i = 0; i < numStates; i++)
-	{
-		beliefVec[i] = receivedMsgs[UP][i] + receivedMsgs[DOWN][i] +
-		  receivedMsgs[LEFT][i] + receivedMsgs[RIGHT][i] - localEv[i];
-	}
+  const int numStates = mrf->getNLabels();
+  const int p = rowMajorIndex(r, c, mrf->getWidth()) * numStates;
+  const int q = columnMajorIndex(r, c, mrf->getHeight()) * numStates;
+  const FLOATTYPE *localEv = mrf->getExpV() + p;
+  const FLOATTYPE *upMsg = mrf->getMessagePlane(UP) + q;
+  const FLOATTYPE *downMsg = mrf->getMessagePlane(DOWN) + q;
+  const FLOATTYPE *leftMsg = mrf->getMessagePlane(LEFT) + p;
+  const FLOATTYPE *rightMsg = mrf->getMessagePlane(RIGHT) + p;
 
-}
-
-int OneNodeCluster::getBeliefMaxInd()
-{
   FLOATTYPE currBelief,bestBelief;
   int bestInd = 0;
-  {
-    int i = 0;
-    bestBelief = receivedMsgs[UP][i] + receivedMsgs[DOWN][i] +
-      receivedMsgs[LEFT][i] + receivedMsgs[RIGHT][i] - localEv[i];
-  }
+  bestBelief = upMsg[0] + downMsg[0] + leftMsg[0] + rightMsg[0] - localEv[0];
   for(int i = 1; i < numStates; i++)
   {
-    currBelief = receivedMsgs[UP][i] + receivedMsgs[DOWN][i] +
-      receivedMsgs[LEFT][i] + receivedMsgs[RIGHT][i] - localEv[i];
+    currBelief = upMsg[i] + downMsg[i] + leftMsg[i] + rightMsg[i] - localEv[i];
     if(currBelief > bestBelief)
     {
       bestInd=i;
@@ -631,64 +497,3 @@ int OneNodeCluster::getBeliefMaxInd()
   return bestInd;
 
 }
-
-
-void computeMessagesLeftRight(OneNodeCluster *nodeArray, const int numCols, const int /*numRows*/, const int currRow, const FLOATTYPE alpha, MaxProdBP *mrf)
-{
-  const int numStates = OneNodeCluster::numStates;
-  const FLOATTYPE omalpha = 1.0f - alpha;
-  int i;
-  int col;
-  for( col = 0; col < numCols-1; col++)
-  {
-    nodeArray[currRow * numCols + col].ComputeMsgRight(nodeArray[currRow * numCols + col+1].nextRoundReceivedMsgs[LEFT],currRow, col, mrf);
-    for(i = 0; i < numStates; i++)
-    {
-      nodeArray[currRow * numCols + col+1].receivedMsgs[LEFT][i] = 
-	omalpha * nodeArray[currRow * numCols + col+1].receivedMsgs[LEFT][i] + 
-	alpha * nodeArray[currRow * numCols + col+1].nextRoundReceivedMsgs[LEFT][i];
-    }
-  } 
-  for( col = numCols-1; col > 0; col--)
-  {
-    nodeArray[currRow * numCols + col].ComputeMsgLeft(nodeArray[currRow * numCols + col-1].nextRoundReceivedMsgs[RIGHT],currRow, col, mrf);
-    for(i = 0; i < numStates; i++)
-    {
-      nodeArray[currRow * numCols + col-1].receivedMsgs[RIGHT][i] = 
-	omalpha * nodeArray[currRow * numCols + col-1].receivedMsgs[RIGHT][i] + 
-	alpha * nodeArray[currRow * numCols + col-1].nextRoundReceivedMsgs[RIGHT][i];
-    }
-  } 
-
-}
-
-void computeMessagesUpDown(OneNodeCluster *nodeArray, const int numCols, const int numRows, const int currCol, const FLOATTYPE alpha, MaxProdBP *mrf)
-{
-  const int numStates = OneNodeCluster::numStates;
-  const FLOATTYPE omalpha = 1.0f - alpha;
-  int i;
-  int row;
-  for(row = 0; row < numRows-1; row++)
-  {
-    nodeArray[row * numCols + currCol].ComputeMsgDown(nodeArray[(row+1) * numCols + currCol].nextRoundReceivedMsgs[UP],row, currCol, mrf);
-    for(i = 0; i < numStates; i++)
-    {
-      nodeArray[(row+1) * numCols + currCol].receivedMsgs[UP][i] = 
-	omalpha * nodeArray[(row+1) * numCols + currCol].receivedMsgs[UP][i] + 
-	alpha * nodeArray[(row+1) * numCols + currCol].nextRoundReceivedMsgs[UP][i];
-    }
-  } 
-  for( row = numRows-1; row > 0; row--)
-  {
-    nodeArray[row * numCols + currCol].ComputeMsgUp(nodeArray[(row-1) * numCols + currCol].nextRoundReceivedMsgs[DOWN], row, currCol, mrf);
-    for(i = 0; i < numStates; i++)
-    {
-      nodeArray[(row-1) * numCols + currCol].receivedMsgs[DOWN][i] = 
-	omalpha * nodeArray[(row-1) * numCols + currCol].receivedMsgs[DOWN][i] + 
-	alpha * nodeArray[(row-1) * numCols + currCol].nextRoundReceivedMsgs[DOWN][i];
-    }
-  } 
-
-}
-
-
@@ -11,46 +11,30 @@
 #include "MaxProdBP.h"
 
 class MaxProdBP;
-class OneNodeCluster
-{
-public:
-  OneNodeCluster();
-  
-  //static const int UP = 0, DOWN = 1, LEFT = 2, RIGHT = 3;
-  static int numStates;
-  
-  FLOATTYPE   *receivedMsgs[4],
-              *nextRoundReceivedMsgs[4],
-              *localEv;
-
-
-//   FLOATTYPE *psi[4];
-  void ComputeMsgRight(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf);
-  void ComputeMsgUp(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf);
-
-  void ComputeMsgLeft(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf);
 
-  void ComputeMsgDown(FLOATTYPE *msgDest, int r, int c, MaxProdBP *mrf);
-
-  void getBelief(FLOATTYPE *beliefVec);
-  int getBeliefMaxInd();
-  
-  int msgChange(FLOATTYPE thresh);
-
-  void deliverMsgs();
-    
-};
+// Messages are stored in one plane per direction, the plane of direction d
+// holds the messages every node received from its neighbour in direction d,
+// with the numStates values of a message stored contiguously. The LEFT and
+// RIGHT planes are stored row by row, the UP and DOWN planes transposed
+// (column by column), so both the horizontal and the vertical sweep walk
+// through contiguous memory.
+inline int rowMajorIndex(const int r, const int c, const int numCols)
+{
+  return r * numCols + c;
+}
 
-void initOneNodeMsgMem(OneNodeCluster *nodeArray, FLOATTYPE *memChunk, const int numNodes, 
-                       const int msgChunkSize);
+inline int columnMajorIndex(const int r, const int c, const int numRows)
+{
+  return c * numRows + r;
+}
 
-void computeMessagesUpDown(OneNodeCluster *nodeArray, const int numCols, const int numRows,
-                           const int currCol, const FLOATTYPE alpha, MaxProdBP *mrf);
-void computeMessagesLeftRight(OneNodeCluster *nodeArray, const int numCols, const int numRows,
-                              const int currRow, const FLOATTYPE alpha, MaxProdBP *mrf);
+void computeMessagesUpDown(MaxProdBP *mrf, const int currCol, const FLOATTYPE alpha);
+void computeMessagesLeftRight(MaxProdBP *mrf, const int currRow, const FLOATTYPE alpha);
+// sends all messages of the nodes in currRow with (row + col) % 2 == parity
+void computeMessagesCheckerboard(MaxProdBP *mrf, const int currRow, const int parity,
+                                 const FLOATTYPE alpha);
 
-void computeOneNodeMessagesPeriodic(OneNodeCluster *nodeTopArray, OneNodeCluster *nodeBotArray,
-                                    const int numCols, const FLOATTYPE alpha);
+int getBeliefMaxInd(MaxProdBP *mrf, const int r, const int c);
 
 
 #endif
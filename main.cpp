@@ -17,7 +17,8 @@
 #include "DepthToPointTranslator.h"
 #include "DepthToPointTranslator1.h"
 #include "CameraPoseEstimator.h"
-#include "CameraPoseEstimator1.h"
+#include "CameraPoseEstimator2.h"
+#include "BinaryIndex.h"
 #include "RGBDMerger.h"
 #include "RGBDMerger1.h"
 #include "ReconstructionPipeline.h"
@@ -39,6 +40,11 @@ const string lfpPaths[] = {
 // store compiled ocl kernels in this path
 const char KERNEL_PATH[] = "C:\\Users\\Kai\\Downloads\\opencv_ocl_kernels\\";
 
+// bytes available to the depth estimation, 0 for no limit; with a limit, light
+// fields are loaded without their sub-aperture image atlas, as the depth
+// estimation extracts the sub-aperture images of one tile at a time
+const size_t DEPTH_MEMORY_BUDGET = 0;
+
 // renders a series of images from a LightFieldPicture and displays or saves them
 void showRefocusSeries(const LightFieldPicture& lightfield)
 {
@@ -72,55 +78,45 @@ void renderReconstructionFromImageSeries(const string lfpPaths[])
 	LightFieldPicture* lightfield;
 	CDCDepthEstimator* estimator = new CDCDepthEstimator;
 	RGBDMerger* merger = new RGBDMerger1();
+	estimator->setMemoryBudget(DEPTH_MEMORY_BUDGET);
 
-	Mat calibrationMatrix;
-	vector<Mat> depthMaps = vector<Mat>(lfpCount);
-	vector<Mat> confidenceMaps = vector<Mat>(lfpCount);
-	vector<Mat> aifImages = vector<Mat>(lfpCount);
-
+	// load, estimate and fuse one light field at a time
 	for (int i = 0; i < lfpCount; i++)
 	{
-		lightfield = new LightFieldPicture(lfpPaths[i]);
-		estimator->estimateDepth(*lightfield);
-		depthMaps[i] = estimator->getDepthMap();
-		confidenceMaps[i] = estimator->getConfidenceMap();
-		aifImages[i] = estimator->getExtendedDepthOfFieldImage();
-	}
-
-	calibrationMatrix = lightfield->getCalibrationMatrix();
-	merger->merge(aifImages, depthMaps, confidenceMaps, calibrationMatrix);
+		lightfield = new LightFieldPicture(lfpPaths[i],
+			DEPTH_MEMORY_BUDGET == 0);
+		if (i == 0)
+			merger->beginScene(lightfield->getCalibrationMatrix());
 
-	visualizePointCloud(merger->pointCloud, merger->pointColors);
-}
-
-// loads raw.lfp files using lfpPaths
-vector<LightFieldPicture> loadLightFieldPictures()
-{
-	vector<LightFieldPicture> lfps = vector<LightFieldPicture>(lfpCount);
-	for (int i = 0; i < lfpCount; i++)
-	{
-		lfps.at(i) = LightFieldPicture(lfpPaths[i]);
+		estimator->estimateDepth(*lightfield);
+		merger->addView(estimator->getExtendedDepthOfFieldImage(),
+			estimator->getDepthMap(), estimator->getConfidenceMap());
+		delete lightfield;
 	}
+	merger->finalize();
 
-	cout << lfpCount << " light-field files loaded" << endl;
-	return lfps;
+	visualizePointCloud(merger->pointCloud, merger->pointColors,
+		merger->pixelIndices);
 }
 
 void testCameraPoseEstimation()
 {
-	vector<LightFieldPicture> lightfields = loadLightFieldPictures();
-
-	vector<Mat> images = vector<Mat>(lightfields.size());
+	// only the rendered images are kept, not the light fields
+	vector<Mat> images = vector<Mat>(lfpCount);
+	Mat calibrationMatrix;
 	ImageRenderer* renderer = new ImageRenderer4();
 	renderer->setAlpha(1.1);
 	for (int i = 0; i < images.size(); i++)
 	{
-		renderer->setLightfield(lightfields.at(i));
+		const LightFieldPicture lightfield(lfpPaths[i]);
+		if (i == 0)
+			calibrationMatrix = lightfield.getCalibrationMatrix();
+
+		renderer->setLightfield(lightfield);
 		renderer->renderImage().download(images.at(i));
 	}
 
-	Mat calibrationMatrix = lightfields.at(0).getCalibrationMatrix();
-	CameraPoseEstimator* poseEstimator = new CameraPoseEstimator1();
+	CameraPoseEstimator* poseEstimator = new CameraPoseEstimator2();
 	double t0 = (double)getTickCount();
 	poseEstimator->estimateCameraPoses(images, calibrationMatrix);
 	double t1 = (double)getTickCount();
@@ -133,11 +129,11 @@ void testCameraPoseEstimation()
 
 void testPipeline()
 {
-	vector<LightFieldPicture> lightfields = loadLightFieldPictures();
 	ReconstructionPipeline* pipeline = new ReconstructionPipeline();
-	pipeline->reconstructScene(lightfields);
+	pipeline->reconstructScene(vector<string>(lfpPaths, lfpPaths + lfpCount));
 
-	visualizePointCloud(pipeline->pointCloud, pipeline->pointColors);
+	visualizePointCloud(pipeline->pointCloud, pipeline->pointColors,
+		pipeline->pixelIndices);
 }
 
 void testDepthEstimation(const LightFieldPicture& lightfield)
@@ -145,6 +141,14 @@ void testDepthEstimation(const LightFieldPicture& lightfield)
 	CDCDepthEstimator* estimator = new CDCDepthEstimator();
 	estimator->estimateDepth(lightfield);
 
+	// once the workers' buffers exist, estimating again must not allocate any
+	estimator->resetScratchAllocationCount();
+	estimator->estimateDepth(lightfield);
+	const size_t allocationCount = estimator->getScratchAllocationCount();
+	cout << "Scratch allocations in the second depth estimation: "
+		<< allocationCount << endl;
+	CV_Assert(allocationCount == 0);
+
 	ImageRenderer* renderer = new ImageRenderer4();
 	Mat image;
 	renderer->setLightfield(lightfield);
@@ -174,6 +178,78 @@ void testDepthEstimation(const LightFieldPicture& lightfield)
 	visualizePointCloud(pointCloud, aifImage);
 }
 
+// compares the recall and throughput of BinaryIndex to brute-force matching
+// on random ORB-sized descriptors, each query a copy of one of them with
+// noiseBits distinct bits flipped; the noise is swept past the radius of 31
+// bits within which the index is exact. As the pose estimators match with
+// k = 2 for the ratio test, the second neighbours and the outcome of the
+// ratio test are compared as well.
+void benchmarkDescriptorMatching()
+{
+	const int counts[] = { 500, 2000, 10000 };
+	const int noiseLevels[] = { 16, 24, 32, 40, 48, 56, 64 };
+	const float ratio = 0.75f;
+	RNG rng = RNG(1);
+
+	for (int c = 0; c < 3; c++)
+	for (int n = 0; n < 7; n++)
+	{
+		const int count = counts[c];
+		const int noiseBits = noiseLevels[n];
+		Mat descriptors = Mat(count, 32, CV_8UC1);
+		rng.fill(descriptors, RNG::UNIFORM, 0, 256);
+		Mat queries = descriptors.clone();
+		for (int i = 0; i < count; i++)
+		{
+			bool flipped[256] = { false };
+			for (int b = 0; b < noiseBits; b++)
+			{
+				int bit = rng.uniform(0, 256);
+				while (flipped[bit])
+					bit = (bit + 1) % 256;
+				flipped[bit] = true;
+				queries.at<uchar>(i, bit / 8) ^= 1 << (bit % 8);
+			}
+		}
+
+		vector<vector<DMatch>> exactMatches, approximateMatches;
+		BFMatcher matcher = BFMatcher(NORM_HAMMING);
+		double t0 = (double)getTickCount();
+		matcher.knnMatch(queries, descriptors, exactMatches, 2);
+		double t1 = (double)getTickCount();
+		BinaryIndex index = BinaryIndex();
+		index.build(descriptors);
+		double t2 = (double)getTickCount();
+		index.knnMatch(queries, approximateMatches, 2);
+		double t3 = (double)getTickCount();
+
+		// neighbours are compared by distance, as ties may be ordered
+		// differently
+		int firstHits = 0, secondHits = 0, ratioHits = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const vector<DMatch>& exact = exactMatches.at(i);
+			const vector<DMatch>& approximate = approximateMatches.at(i);
+			if (approximate.at(0).distance == exact.at(0).distance)
+				firstHits++;
+			if (approximate.at(1).distance == exact.at(1).distance)
+				secondHits++;
+			if ((approximate.at(0).distance < ratio * approximate.at(1).distance)
+				== (exact.at(0).distance < ratio * exact.at(1).distance))
+				ratioHits++;
+		}
+
+		const double frequency = getTickFrequency();
+		cout << count << " descriptors, " << noiseBits << " noise bits: recall "
+			<< (double) firstHits / count << " (nearest), "
+			<< (double) secondHits / count << " (second), ratio test agrees for "
+			<< (double) ratioHits / count << ", brute force "
+			<< count * frequency / (t1 - t0) << " queries/s, index "
+			<< count * frequency / (t3 - t2) << " queries/s (built in "
+			<< (t2 - t1) / frequency << " s)" << endl;
+	}
+}
+
 int main( int argc, char** argv )
 {
 	ocl::setBinaryPath(KERNEL_PATH);
@@ -193,6 +269,7 @@ int main( int argc, char** argv )
 		//testDepthEstimation(*lf);
 		
 		//testCameraPoseEstimation();
+		//benchmarkDescriptorMatching();
 		testPipeline();
 
 		/*